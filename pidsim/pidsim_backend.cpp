@@ -1,18 +1,68 @@
 #include "pidsim_backend.h"
-#include "pidsim_backend_physics_sim.h"
-#include "pidsim_backend_pid_controller.h"
+#include "pidsim_backend_autotune.h"
+#include "pidsim_backend_control_loop.h"
+#include "pidsim_backend_cost_map.h"
+#include "pidsim_backend_gain_optimizer.h"
+#include "pidsim_backend_motion_profile.h"
+#include "pidsim_backend_plant_identifier.h"
+#include "pidsim_backend_robustness.h"
+#include "pidsim_backend_session_log.h"
+#include "pidsim_backend_stability_map.h"
+#include "pidsim_backend_step_metrics.h"
+#include "pidsim_backend_telemetry.h"
+#include "pidsim_backend_trace_summary.h"
 #include "pidsim_utils.h"
+#include <random>
 
 namespace PidSim {
 
+namespace {
+  // How long each frame can spend building an opened trace's summary,
+  // which reads this many of the trace's blocks at a time
+  constexpr std::chrono::duration<double> traceSummaryBudget{ 0.004 };
+  constexpr std::size_t traceSummaryChunk = 4;
+
+  // How long each frame can spend on the stability map.  Maps with long
+  // delays take a few frames to fill in.
+  constexpr std::chrono::duration<double> stabilityMapBudget{ 0.003 };
+
+  // Same for the cost map, which simulates this many cells at a time
+  constexpr std::chrono::duration<double> costMapBudget{ 0.004 };
+  constexpr std::size_t costMapChunk = 32;
+
+  // How far ahead the ghost trajectory goes, and how long it stays up
+  // after the gains stop changing
+  constexpr unsigned predictionTicks    = 250;    // 5 seconds
+  constexpr double   predictionHoldTime = 2.0;    // seconds
+
+  // Frame time for the relay auto-tuner, which runs this many ticks at a time
+  constexpr std::chrono::duration<double> autotuneBudget{ 0.003 };
+  constexpr unsigned autotuneChunk = 50;
+
+  // Frame time for the gain optimizer, which runs a generation at a time
+  constexpr std::chrono::duration<double> optimizerBudget{ 0.004 };
+
+  // Frame time for the robustness check, which runs a round at a time
+  constexpr std::chrono::duration<double> robustnessBudget{ 0.004 };
+
+  // How much the robustness check's arms vary around the front end's arm
+  constexpr double robustnessSpread = 0.5;
+}
+
 BackEnd::BackEnd( nanogui::ref<FrontEnd> frontEnd ) : 
   mFrontEnd{ frontEnd },
-  mPhysicsSim{ std::make_unique<PhysicsSim>( Utils::degToRad(mFrontEnd->getStartAngle())) },
-  mPidController{ std::make_unique<PidController>() }
+  mStabilityMaps{ std::make_unique<StabilityMapCache>() },
+  mPredictedGains{ mFrontEnd->getP(), mFrontEnd->getI(), mFrontEnd->getD() }
 {
+  // Each run gets its own noise; the log keeps the seed to replay it
+  std::random_device device;
+  const std::uint64_t seed = ( static_cast<std::uint64_t>( device() ) << 32 ) | device();
+  const Session::Inputs inputs = getInputFromFrontEnd();
+  mSession    = std::make_unique<Session>( inputs, seed );
+  mSessionLog = std::make_unique<SessionLog>( inputs, seed );
 }
 
-// Declared here so PhysicsSim & PidController don't need concrete
+// Declared here so the simulation classes don't need concrete
 // definitions in header file.
 BackEnd::~BackEnd()
 {
@@ -22,6 +72,10 @@ BackEnd::~BackEnd()
 //
 // 1. How many "single updates" are needed to catch the simulation up
 // 2. Run that many single updates
+// 3. Predict where new gains will take the arm
+// 4. Work on the auto-tuner, optimizer, robustness check, stability map & cost map
+// 5. Start, stop or open a trace
+// 6. Save the session log, if asked
 // 
 void BackEnd::update( std::chrono::duration<double> delta )
 {
@@ -38,86 +92,120 @@ void BackEnd::update( std::chrono::duration<double> delta )
   for ( unsigned update = 0; update < updatesSinceLast; ++update ) {
     updateOneTick();
   }
+
+  // 3. Predict where new gains will take the arm
+  //
+  updatePrediction( delta );
+
+  // 4. Work on the auto-tuner, optimizer, robustness check, stability map & cost map
+  //
+  updateAutotuner();
+  updateOptimizer();
+  updateRobustness();
+  updateStabilityMap();
+  updateCostMap();
+
+  // 5. Start, stop or open a trace
+  //
+  updateTrace();
+
+  // 6. Save the session log, if asked
+  //
+  updateSessionLog();
 } 
  
+//
+// Each reset starts the error graph and the plant fit over too
+//
 void BackEnd::reset()
 {
-  // Completely replace the old physics simulation & pid controller
-  const double startAngle = Utils::degToRad( mFrontEnd->getStartAngle() );
-  mPhysicsSim      = std::make_unique< PhysicsSim  >( startAngle ); 
-  mPidController = std::make_unique< PidController >();
-  // Reset the error graph on the front end
+  mIdentifier.reset();
   mFrontEnd->resetErrorRecord();
 }
 
-void BackEnd::getInputFromFrontEnd()
+Session::Inputs BackEnd::getInputFromFrontEnd()
 {
-  if ( mFrontEnd->isReset() ) {
-    reset();
-  }
-
-  mPidController->updatePidSettings(
-      mFrontEnd->getP(),
-      mFrontEnd->getI(),
-      mFrontEnd->getD(),
-      Utils::degToRad(mFrontEnd->getTargetAngle())
-  );
-
-  mRollingFriction = mFrontEnd->getRollingFriction()/50.0;
-  mPhysicsSim->setSensorNoise( mFrontEnd->getSensorNoise() );
-  mPhysicsSim->setSensorDelay( mFrontEnd->getSensorDelay() );
-  mPhysicsSim->setMotorDelay( mFrontEnd->getMotorDelay() );
-  mSlowTime = mFrontEnd->isSlowTime();
-
-  if ( mFrontEnd->isNudgeUp()) {
-    mPhysicsSim->bump( 3 );
-  }
-  if ( mFrontEnd->isNudgeDown()) {
-    mPhysicsSim->bump( -3 );
-  }
-  if ( mFrontEnd->isWackUp()) {
-    mPhysicsSim->bump( 10 );
-  }
-  if ( mFrontEnd->isWackDown()) {
-    mPhysicsSim->bump( -10 );
-  }
+  Session::Inputs inputs;
+  inputs.mP               = mFrontEnd->getP();
+  inputs.mI               = mFrontEnd->getI();
+  inputs.mD               = mFrontEnd->getD();
+  inputs.mStartAngle      = mFrontEnd->getStartAngle();
+  inputs.mTargetAngle     = mFrontEnd->getTargetAngle();
+  inputs.mProfile         = mFrontEnd->getSetpointProfile();
+  inputs.mRollingFriction = mFrontEnd->getRollingFriction();
+  inputs.mSensorNoise     = mFrontEnd->getSensorNoise();
+  inputs.mSensorDelay     = mFrontEnd->getSensorDelay();
+  inputs.mMotorDelay      = mFrontEnd->getMotorDelay();
+  inputs.mStateEstimator  = mFrontEnd->isStateEstimator();
+  inputs.mGainScheduled   = mFrontEnd->isGainScheduled();
+  inputs.mSlowTime        = mFrontEnd->isSlowTime();
+  inputs.mReset           = mFrontEnd->isReset();
+  inputs.mNudgeUp         = mFrontEnd->isNudgeUp();
+  inputs.mNudgeDown       = mFrontEnd->isNudgeDown();
+  inputs.mWackUp          = mFrontEnd->isWackUp();
+  inputs.mWackDown        = mFrontEnd->isWackDown();
+  return inputs;
 }
 
 void BackEnd::updateOneTick()
 {
-  // Check for input
-  getInputFromFrontEnd();
-
-  // Slow time logic
-  ++mCounter0;
-  if ( mSlowTime && ( mCounter0 % slowTimeScale ) != 0 ) { return; }
+  // Check for input, and keep it for replays
+  const Session::Inputs inputs = getInputFromFrontEnd();
+  mSessionLog->record( inputs );
 
-  // Advance the simulation 1/50th of a second
-  const double timeSlice = 1.0/((double) updatesPerSecond);
+  // Advance the PID controller, state estimator & robot arm
+  const Session::Tick tick = mSession->tick( inputs );
+  if ( tick.mReset ) {
+    reset();
+  }
+  if ( !tick.mOut ) {
+    return;
+  }
+  const PidController::Output& pOut = tick.mOut->mPid;
 
-  // Run the PID controller
-  const PidController::Output pOut = mPidController->updatePidController( timeSlice, mPhysicsSim->getSensorAngle() );
+  // Stream the tick out, if tracing
+  if ( mTelemetry ) {
+    mTelemetry->record( mTraceTime, inputs, tick.mSensorAngle,
+                        mSession->getControlLoop().getPhysicsSim().getActualAngle(), *tick.mOut );
+    mTraceTime += Session::timeSlice;
+  }
 
-  // Update the error graph
+  // Update the error graph & the plant fit
   sendErrorToFrontEnd( pOut.mPError, pOut.mIError, pOut.mDError );
-
-  // Advance the robot arm simulation
-  updateRobotArmSimulation( timeSlice, pOut.mMotorPower );
+  // The sensor has nothing to read until the first tick, so start
+  // identifying on the second
+  if ( mIdentifier ) {
+    mIdentifier->update( tick.mSensorAngle, pOut.mMotorPower );
+  }
+  else {
+    mIdentifier = std::make_unique<PlantIdentifier>();
+  }
 
   // Send new positions to the front end.
   updateFrontEnd();
 }
 
-void BackEnd::updateRobotArmSimulation( double timeSlice, double motorPower )
+// See header for interface
+bool BackEnd::startTrace( const std::string& path )
+{
+  stopTrace();
+  mTelemetry = std::make_unique<Telemetry>( path );
+  mTraceTime = 0.0;
+  mTracePath = path;
+  if ( !mTelemetry->isOpen() ) {
+    mTelemetry.reset();
+    return false;
+  }
+  return true;
+}
+
+// See header for interface
+void BackEnd::stopTrace()
 {
-  mPhysicsSim->startSimulationIteration();
-  mPhysicsSim->applyGravity();
-  mPhysicsSim->applyMotor( motorPower, timeSlice );
-  mPhysicsSim->updateAngleVel( timeSlice );
-  mPhysicsSim->applyFriction( mRollingFriction );
-  mPhysicsSim->updateAngle( timeSlice );
-  mPhysicsSim->imposePositionHardLimits();
-  mPhysicsSim->endSimulationIteration();
+  if ( mTelemetry ) {
+    mTelemetry->close();
+    mTelemetry.reset();
+  }
 }
 
 void BackEnd::sendErrorToFrontEnd( double pError, double iError, double dError )
@@ -130,13 +218,307 @@ void BackEnd::sendErrorToFrontEnd( double pError, double iError, double dError )
       Utils::radToDeg( pError ), 
       Utils::radToDeg( iError ), 
       Utils::radToDeg( dError ), 
-      mPhysicsSim->getMotorPower() * 150 );
+      mSession->getControlLoop().getPhysicsSim().getMotorPower() * 150 );
+  }
+}
+
+//
+// 1. Find the map for the current settings
+// 2. Compute cells until we run out of time for this frame
+// 3. Send the map to the front end if there's anything new
+//
+void BackEnd::updateStabilityMap()
+{
+  // 1. Find the map for the current settings
+  StabilityMap::Settings settings;
+  settings.mPlane           = mFrontEnd->getStabilityPlane();
+  settings.mFixedGain       = settings.mPlane == StabilityMap::Plane::KpKd ? mFrontEnd->getI() : mFrontEnd->getD();
+  settings.mRollingFriction = mSession->getRollingFriction();
+  settings.mSensorDelay     = mFrontEnd->getSensorDelay();
+  settings.mMotorDelay      = mFrontEnd->getMotorDelay();
+  settings.mTargetAngle     = Utils::degToRad( mFrontEnd->getTargetAngle() );
+
+  std::shared_ptr<StabilityMap> map = mStabilityMaps->get( settings );
+  if ( map != mStabilityMap ) {
+    mStabilityMap = map;
+    mStabilityMapShown = 0;
+  }
+
+  // 2. Compute cells until we run out of time for this frame
+  const auto start = std::chrono::steady_clock::now();
+  while ( !map->isComplete() && std::chrono::steady_clock::now() - start < stabilityMapBudget ) {
+    map->compute( 4 );
+  }
+
+  // 3. Send the map to the front end if there's anything new
+  if ( map->getComputed() != mStabilityMapShown || mStabilityMapShown == 0 ) {
+    mFrontEnd->setStabilityMap( *map );
+    mStabilityMapShown = map->getComputed();
+  }
+}
+
+//
+// 1. Start over if the settings changed.  The old map is just dropped.
+// 2. Refine until we run out of time for this frame
+// 3. Send the map to the front end if it changed
+//
+void BackEnd::updateCostMap()
+{
+  // 1. Start over if the settings changed
+  CostMap::Settings settings;
+  settings.mPlane                 = mFrontEnd->getStabilityPlane();
+  settings.mMetric                = mFrontEnd->getCostMetric();
+  settings.mFixedGain             = settings.mPlane == StabilityMap::Plane::KpKd ? mFrontEnd->getI() : mFrontEnd->getD();
+  settings.mArm.mStartAngle       = Utils::degToRad( mFrontEnd->getStartAngle() );
+  settings.mArm.mTargetAngle      = Utils::degToRad( mFrontEnd->getTargetAngle() );
+  settings.mArm.mRollingFriction  = mSession->getRollingFriction();
+  settings.mArm.mSensorNoise      = mFrontEnd->getSensorNoise();
+  settings.mArm.mSensorDelay      = mFrontEnd->getSensorDelay();
+  settings.mArm.mMotorDelay       = mFrontEnd->getMotorDelay();
+  settings.mArm.mProfileType      = mFrontEnd->getSetpointProfile();
+  if ( !mCostMap || mCostMap->getSettings() != settings ) {
+    mCostMap = std::make_unique<CostMap>( settings );
+  }
+
+  // 2. Refine until we run out of time for this frame
+  bool changed = false;
+  const auto start = std::chrono::steady_clock::now();
+  while ( !mCostMap->isComplete() && std::chrono::steady_clock::now() - start < costMapBudget ) {
+    changed |= mCostMap->refine( costMapChunk );
+  }
+
+  // 3. Send the map to the front end if it changed
+  if ( changed ) {
+    mFrontEnd->setCostMap( *mCostMap );
+  }
+}
+
+//
+// Slider callbacks just store the newest value, so however many events
+// came in since the last frame only the latest gains get simulated, once.
+//
+// 1. Keep the ghost up while the gains are changing, and for a bit after
+// 2. Fork the live simulation and run it ahead with the new gains
+//
+void BackEnd::updatePrediction( std::chrono::duration<double> delta )
+{
+  // 1. Keep the ghost up while the gains are changing, and for a bit after
+  const std::array<double, 3> gains{ mFrontEnd->getP(), mFrontEnd->getI(), mFrontEnd->getD() };
+  if ( gains != mPredictedGains ) {
+    mPredictedGains = gains;
+    mPredictionTimeLeft = predictionHoldTime;
+  }
+  if ( mPredictionTimeLeft <= 0.0 ) {
+    return;
+  }
+  mPredictionTimeLeft -= delta.count();
+  if ( mPredictionTimeLeft <= 0.0 ) {
+    mFrontEnd->clearPrediction();
+    return;
+  }
+
+  // 2. Fork the live simulation and run it ahead with the new gains
+  const double timeSlice = 1.0/((double) updatesPerSecond);
+  mFrontEnd->setPrediction( mSession->getControlLoop().predict( timeSlice, predictionTicks, gains[ 0 ], gains[ 1 ], gains[ 2 ] ));
+}
+
+//
+// 1. Start a new experiment on a fork of the live loop, if asked
+// 2. Run it until it's done or we run out of time for this frame
+// 3. Send the answer to the front end
+//
+void BackEnd::updateAutotuner()
+{
+  // 1. Start a new experiment on a fork of the live loop, if asked
+  if ( mFrontEnd->isAutotune() ) {
+    mAutotuner = std::make_unique<RelayAutotuner>( mSession->getControlLoop(),
+      Utils::degToRad( mFrontEnd->getTargetAngle() ), mFrontEnd->getSensorNoise() );
+  }
+  if ( !mAutotuner ) {
+    return;
+  }
+
+  // 2. Run it until it's done or we run out of time for this frame
+  const auto start = std::chrono::steady_clock::now();
+  while ( !mAutotuner->isDone() && std::chrono::steady_clock::now() - start < autotuneBudget ) {
+    mAutotuner->run( autotuneChunk );
+  }
+
+  // 3. Send the answer to the front end
+  if ( mAutotuner->isDone() ) {
+    mFrontEnd->setAutotuneResult( mAutotuner->getResult() );
+    mAutotuner.reset();
+  }
+}
+
+//
+// 1. Start a new search from the current gains, if asked
+// 2. Run generations until it's done or we run out of time for this frame
+// 3. Send the progress to the front end
+//
+void BackEnd::updateOptimizer()
+{
+  // 1. Start a new search from the current gains, if asked
+  if ( mFrontEnd->isOptimize() ) {
+    GainOptimizer::Settings settings;
+    settings.mArm.mPidP             = mFrontEnd->getP();
+    settings.mArm.mPidI             = mFrontEnd->getI();
+    settings.mArm.mPidD             = mFrontEnd->getD();
+    settings.mArm.mStartAngle       = Utils::degToRad( mFrontEnd->getStartAngle() );
+    settings.mArm.mTargetAngle      = Utils::degToRad( mFrontEnd->getTargetAngle() );
+    settings.mArm.mRollingFriction  = mSession->getRollingFriction();
+    settings.mArm.mSensorNoise      = mFrontEnd->getSensorNoise();
+    settings.mArm.mSensorDelay      = mFrontEnd->getSensorDelay();
+    settings.mArm.mMotorDelay       = mFrontEnd->getMotorDelay();
+    settings.mArm.mProfileType      = mFrontEnd->getSetpointProfile();
+    mOptimizer = std::make_unique<GainOptimizer>( settings );
+  }
+  if ( !mOptimizer ) {
+    return;
+  }
+
+  // 2. Run generations until it's done or we run out of time for this frame
+  const auto start = std::chrono::steady_clock::now();
+  while ( !mOptimizer->isDone() && std::chrono::steady_clock::now() - start < optimizerBudget ) {
+    mOptimizer->step();
+  }
+
+  // 3. Send the progress to the front end
+  mFrontEnd->setOptimizerReport( mOptimizer->getReport(), mOptimizer->isDone() );
+  if ( mOptimizer->isDone() ) {
+    mOptimizer.reset();
+  }
+}
+
+//
+// 1. Start a new check of the current gains, if asked.  Friction and
+//    delays vary +/- 50% around the front end's settings, and noise goes
+//    from none to double.
+// 2. Run rounds until it's done or we run out of time for this frame
+// 3. Send the progress to the front end
+//
+void BackEnd::updateRobustness()
+{
+  // 1. Start a new check of the current gains, if asked
+  if ( mFrontEnd->isRobustness() ) {
+    using Shape = RobustnessAnalysis::Distribution::Shape;
+    const auto spread = []( double value ) {
+      return RobustnessAnalysis::Distribution{ Shape::Uniform,
+        value * ( 1.0 - robustnessSpread ), value * ( 1.0 + robustnessSpread ) };
+    };
+    RobustnessAnalysis::Settings settings;
+    settings.mArm.mPidP         = mFrontEnd->getP();
+    settings.mArm.mPidI         = mFrontEnd->getI();
+    settings.mArm.mPidD         = mFrontEnd->getD();
+    settings.mArm.mStartAngle   = Utils::degToRad( mFrontEnd->getStartAngle() );
+    settings.mArm.mTargetAngle  = Utils::degToRad( mFrontEnd->getTargetAngle() );
+    settings.mArm.mProfileType  = mFrontEnd->getSetpointProfile();
+    settings.mRollingFriction   = spread( mSession->getRollingFriction() );
+    settings.mSensorDelay       = spread( mFrontEnd->getSensorDelay() );
+    settings.mMotorDelay        = spread( mFrontEnd->getMotorDelay() );
+    settings.mSensorNoise       = { Shape::Uniform, 0.0, 2.0 * mFrontEnd->getSensorNoise() };
+    mRobustness = std::make_unique<RobustnessAnalysis>( settings );
+  }
+  if ( !mRobustness ) {
+    return;
+  }
+
+  // 2. Run rounds until it's done or we run out of time for this frame
+  const auto start = std::chrono::steady_clock::now();
+  while ( !mRobustness->isDone() && std::chrono::steady_clock::now() - start < robustnessBudget ) {
+    mRobustness->step();
+  }
+
+  // 3. Send the progress to the front end
+  mFrontEnd->setRobustnessReport( mRobustness->getReport() );
+  if ( mRobustness->isDone() ) {
+    mRobustness.reset();
+  }
+}
+
+//
+// 1. Start or stop recording when the front end's record button changes
+// 2. Open a trace, if asked
+// 3. Build its summary until we run out of time for this frame.  The
+//    first time a trace is opened that reads the whole trace, so it can
+//    take many frames.  After that the summary is saved.
+//
+void BackEnd::updateTrace()
+{
+  // 1. Start or stop recording
+  const bool recording = mFrontEnd->isTraceRecording();
+  if ( recording != mTraceRecording ) {
+    mTraceRecording = recording;
+    if ( !recording ) {
+      stopTrace();
+      mFrontEnd->setTraceStatus( "Saved " + mTracePath );
+    }
+    else if ( startTrace( mFrontEnd->getTracePath() )) {
+      mFrontEnd->setTraceStatus( "Recording to " + mTracePath );
+    }
+    else {
+      mFrontEnd->setTraceStatus( "Couldn't write " + mFrontEnd->getTracePath() );
+    }
+  }
+
+  // 2. Open a trace
+  if ( mFrontEnd->isOpenTrace() ) {
+    const std::string path = mFrontEnd->getTracePath();
+    mTraceSummary.reset();
+    if ( mTelemetry && path == mTracePath ) {
+      mFrontEnd->setTraceStatus( "Stop recording to open " + path );
+    }
+    else {
+      mTraceSummary = std::make_shared<TraceSummary>( path );
+      if ( !mTraceSummary->isOpen() ) {
+        mFrontEnd->setTraceStatus( "Couldn't open " + path );
+        mTraceSummary.reset();
+      }
+    }
+  }
+
+  // 3. Build its summary until we run out of time for this frame
+  if ( !mTraceSummary ) {
+    return;
+  }
+  const auto start = std::chrono::steady_clock::now();
+  while ( !mTraceSummary->isReady() && std::chrono::steady_clock::now() - start < traceSummaryBudget ) {
+    mTraceSummary->build( traceSummaryChunk );
+  }
+  if ( mTraceSummary->isReady() ) {
+    mFrontEnd->setTrace( std::move( mTraceSummary ));
+  }
+  else {
+    const int percent = static_cast<int>( 100.0 * mTraceSummary->getProgress() );
+    mFrontEnd->setTraceStatus( "Building summary " + std::to_string( percent ) + "%" );
+  }
+}
+
+//
+// Everything the arm has been given so far goes to a file, i.e., to go
+// with a bug report and be replayed headless with pidsim_cli --replay
+//
+void BackEnd::updateSessionLog()
+{
+  if ( !mFrontEnd->isSaveSession() ) {
+    return;
+  }
+  const std::string path = mFrontEnd->getSessionPath();
+  if ( mSessionLog->save( path )) {
+    mFrontEnd->setTraceStatus( "Saved " + std::to_string( mSessionLog->getTicks() ) + " ticks to " + path );
+  }
+  else {
+    mFrontEnd->setTraceStatus( "Couldn't write " + path );
   }
 }
 
 void BackEnd::updateFrontEnd()
 {
-  mFrontEnd->setArmAngle( mPhysicsSim->getActualAngle() );
+  mFrontEnd->setArmAngle( mSession->getControlLoop().getPhysicsSim().getActualAngle() );
+  mFrontEnd->setStepMetrics( mSession->getStepMetrics().getResult() );
+  if ( mIdentifier ) {
+    mFrontEnd->setPlantEstimate( mIdentifier->getEstimate() );
+  }
 }
 
 }
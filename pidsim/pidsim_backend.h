@@ -1,13 +1,23 @@
 #ifndef __PIDSIM_BACKEND_H__
 #define __PIDSIM_BACKEND_H__
 
+#include "pidsim_backend_session.h"
 #include "pidsim_frontend.h"
+#include <array>
 
 namespace PidSim {
 
 // Forward declare the PID Controller & Simulation classess.
-class PhysicsSim;
-class PidController;
+class SessionLog;
+class Telemetry;
+class TraceSummary;
+class RelayAutotuner;
+class GainOptimizer;
+class PlantIdentifier;
+class RobustnessAnalysis;
+class StabilityMap;
+class StabilityMapCache;
+class CostMap;
 
 class BackEnd
 {
@@ -34,28 +44,59 @@ class BackEnd
   ///
   void update( std::chrono::duration<double> delta );
 
+  ///
+  /// @brief Stream every tick from now on into a compressed trace
+  ///
+  /// Replaces any trace already running.
+  ///
+  /// @param[in] path - The file
+  /// @return         - True if the file opened
+  ///
+  bool startTrace( const std::string& path );
+
+  /// @brief Finish the trace, if there is one
+  void stopTrace();
+
   private:
 
   void reset();
   void updateOneTick();
   void updateFrontEnd();
-  void updateRobotArmSimulation( double timeSlice, double motorPower );
-  void getInputFromFrontEnd();
+  Session::Inputs getInputFromFrontEnd();
   void sendErrorToFrontEnd( double pError, double iError, double dError );
+  void updateStabilityMap();
+  void updateCostMap();
+  void updatePrediction( std::chrono::duration<double> delta );
+  void updateAutotuner();
+  void updateOptimizer();
+  void updateRobustness();
+  void updateTrace();
+  void updateSessionLog();
 
   static constexpr int        updatesPerSecond = 50;      // 50 sim updates/ sec
-  static constexpr unsigned   slowTimeScale    = 10;      // "slow time" slows by 10x
-  bool                        mSlowTime         = false;  // slow time starts disabled
 
   double                      time              = 0.0;    // time since sim start, in secs
-  double                      mRollingFriction  = 0.0;    // friction slowing the robot arm
 
-  unsigned int                mCounter0         =0;       // A counter the flow control
-  unsigned int                mCounter1         =0;       // A separate counter :)
+  unsigned int                mCounter1         =0;       // A counter for the error graph
 
   nanogui::ref<FrontEnd>           mFrontEnd;             // The front end GUI
-  std::unique_ptr<PhysicsSim>      mPhysicsSim;             // Robot arm physics simulation
-  std::unique_ptr<PidController>   mPidController;        // PID controller
+  std::unique_ptr<Session>         mSession;              // The arm, as the front end drives it
+  std::unique_ptr<SessionLog>      mSessionLog;           // Every input the session has had, to replay it
+  std::unique_ptr<Telemetry>       mTelemetry;            // Trace of every tick, if one was started
+  double                           mTraceTime = 0.0;      // Seconds into the trace
+  std::string                      mTracePath;            // Where the trace is going
+  bool                             mTraceRecording = false;  // Front end's record button, last seen
+  std::shared_ptr<TraceSummary>    mTraceSummary;         // Summary of the trace being opened, while it's built
+  std::unique_ptr<StabilityMapCache> mStabilityMaps;      // Stability maps we've already built
+  std::shared_ptr<StabilityMap>    mStabilityMap;         // The map the front end is showing
+  std::size_t                      mStabilityMapShown = 0;  // Cells the front end has seen
+  std::unique_ptr<CostMap>         mCostMap;              // Simulated cost over the gains
+  std::array<double, 3>            mPredictedGains;       // The P, I, D gains last seen
+  double                           mPredictionTimeLeft = 0.0;  // Seconds to keep showing the ghost
+  std::unique_ptr<RelayAutotuner>  mAutotuner;            // Relay experiment in progress, if any
+  std::unique_ptr<GainOptimizer>   mOptimizer;            // Gain search in progress, if any
+  std::unique_ptr<RobustnessAnalysis> mRobustness;        // Robustness check in progress, if any
+  std::unique_ptr<PlantIdentifier> mIdentifier;           // Fits the plant from the loop's signals
 };
 
 }
@@ -0,0 +1,128 @@
+
+#include "pidsim_backend_autotune.h"
+#include <algorithm>
+#include <math.h>
+
+namespace PidSim {
+
+namespace {
+  constexpr double timeSlice = 1.0 / 50.0;
+
+  // PidController divides the sum of the gain terms by 5 to get the motor
+  // power, so a slider gain is 5x the motor power per radian.
+  constexpr double sliderScale = 5.0;
+
+  // The most motor power PidController asks for
+  constexpr double maxMotorPower = 0.8;
+
+  // Successive cycles this close (as a fraction) count as steady
+  constexpr double steadyTolerance = 0.05;
+
+  // Cycles to skip while the arm swings in from wherever it was
+  constexpr unsigned warmUpCycles = 2;
+
+  // The least hysteresis, in radians, so the relay doesn't chatter on
+  // rounding
+  constexpr double minHysteresis = 0.1 / 180.0 * M_PI;
+
+  RelayAutotuner::Gains clampGains( double kp, double ki, double kd )
+  {
+    const auto clamp = []( double gain ) { return std::min( std::max( gain, 0.0 ), RelayAutotuner::maxGain ); };
+    return RelayAutotuner::Gains{ clamp( kp ), clamp( ki ), clamp( kd ) };
+  }
+}
+
+RelayAutotuner::RelayAutotuner( const ControlLoop& loop, double targetAngle, double sensorNoise ) :
+  mLoop       { loop },
+  mTarget     { targetAngle },
+  mHysteresis { std::max( minHysteresis, sensorNoise / 180.0 * M_PI ) },
+  mCycleMax   { -INFINITY },
+  mCycleMin   { INFINITY },
+  mResult     {}
+{
+  mLoop.getPhysicsSim().park( targetAngle );
+}
+
+bool RelayAutotuner::run( unsigned maxTicks )
+{
+  for ( unsigned tick = 0; tick < maxTicks && !mDone; ++tick ) {
+    this->tick();
+  }
+  return mDone;
+}
+
+//
+// 1. Switch the relay when the sensor leaves the hysteresis band
+// 2. A switch from pushing down to pushing up ends a cycle
+// 3. Drive the arm.  Gravity pulls at -9.8 cos( angle ), and PhysicsSim
+//    turns motor power p into an acceleration of p / timeSlice, so the
+//    power that holds the arm still is 9.8 cos( angle ) * timeSlice.
+//
+void RelayAutotuner::tick()
+{
+  // 1. Switch the relay when the sensor leaves the hysteresis band
+  const double sensor = mLoop.getPhysicsSim().getSensorAngle();
+  const double error = sensor - mTarget;
+  const double lastRelay = mRelay;
+  mRelay = error > mHysteresis ? -1.0 : ( error < -mHysteresis ? 1.0 : mRelay );
+  mCycleMax = std::max( mCycleMax, sensor );
+  mCycleMin = std::min( mCycleMin, sensor );
+
+  // 2. A switch from pushing down to pushing up ends a cycle
+  if ( lastRelay < 0.0 && mRelay > 0.0 ) {
+    finishCycle();
+  }
+  if ( !mDone && ( mTime >= maxTime || std::abs( error ) > maxAmplitude )) {
+    finish( false );
+  }
+
+  // 3. Drive the arm
+  const double hold = 9.8 * cos( sensor ) * timeSlice;
+  mLoop.tickArm( timeSlice, std::min( std::max( hold + mRelay * relayAmplitude, -maxMotorPower ), maxMotorPower ));
+  mTime += timeSlice;
+}
+
+void RelayAutotuner::finishCycle()
+{
+  if ( mCycleStart >= 0.0 ) {
+    const double period = mTime - mCycleStart;
+    const double amplitude = ( mCycleMax - mCycleMin ) / 2.0;
+    ++mCycles;
+    const bool steady = mCycles > warmUpCycles
+      && std::abs( period    - mLastPeriod    ) < steadyTolerance * period
+      && std::abs( amplitude - mLastAmplitude ) < steadyTolerance * amplitude;
+    mLastPeriod = period;
+    mLastAmplitude = amplitude;
+    if ( steady ) {
+      finish( amplitude > mHysteresis );
+    }
+  }
+  mCycleStart = mTime;
+  mCycleMax   = -INFINITY;
+  mCycleMin   = INFINITY;
+}
+
+void RelayAutotuner::finish( bool success )
+{
+  mDone = true;
+  mResult.mSuccess        = success;
+  mResult.mSimulatedTime  = mTime;
+  if ( !success ) {
+    return;
+  }
+
+  const double a  = mLastAmplitude;
+  const double ku = sliderScale * 4.0 * relayAmplitude / ( M_PI * sqrt( a * a - mHysteresis * mHysteresis ));
+  const double tu = mLastPeriod;
+  mResult.mUltimateGain   = ku;
+  mResult.mUltimatePeriod = tu;
+  mResult.mAmplitude      = a;
+
+  // Ki = Kp / Ti and Kd = Kp * Td, as per PidController
+  const double znP = 0.6 * ku;
+  mResult.mZieglerNichols = clampGains( znP, znP / ( tu / 2.0 ), znP * tu / 8.0 );
+  const double tlP = ku / 2.2;
+  mResult.mTyreusLuyben   = clampGains( tlP, tlP / ( 2.2 * tu ), tlP * tu / 6.3 );
+}
+
+}
@@ -0,0 +1,120 @@
+#ifndef __PIDSIM_BACKEND_AUTOTUNE_H__
+#define __PIDSIM_BACKEND_AUTOTUNE_H__
+
+#include "pidsim_backend_control_loop.h"
+
+namespace PidSim {
+
+///
+/// @brief Relay feedback (Astrom-Hagglund) auto-tuner
+///
+/// Works on a copy of a control loop, so it has the live arm's friction,
+/// noise and delays without disturbing it.  The PID controller is swapped
+/// for a relay: push one way when the sensor is below the target, the
+/// other way when it's above, on top of the motor power that holds the arm
+/// up against gravity at the sensed angle.  The arm settles into an
+/// oscillation whose amplitude a and period Tu give the ultimate gain,
+///
+///     Ku = 4 d / ( pi sqrt( a^2 - e^2 ))
+///
+/// where d is the relay amplitude and e its hysteresis (which keeps noise
+/// from chattering the relay).  Ziegler-Nichols and Tyreus-Luyben turn Ku
+/// and Tu into gains for the front end's sliders.
+///
+/// A relay experiment assumes the process starts at rest at its operating
+/// point.  The arm has almost no damping, so if it starts out swinging
+/// the relay keeps it swinging at whatever amplitude it had.  In a
+/// simulation the fork can just be parked at the target instead.
+///
+/// The experiment runs as fast as the simulation does, a chunk at a time
+/// through run(), so the caller controls how much of a frame it uses.
+///
+class RelayAutotuner
+{
+  public:
+
+  /// @brief Relay amplitude, in PID motor power units
+  static constexpr double relayAmplitude = 0.01;
+
+  /// @brief The biggest gain proposed, as per the front end's PID sliders
+  static constexpr double maxGain = 11.0;
+
+  /// @brief Give up if there's no steady oscillation after this long, in seconds
+  static constexpr double maxTime = 120.0;
+
+  /// @brief Give up if the oscillation gets bigger than this, in radians
+  static constexpr double maxAmplitude = 0.5;
+
+  /// @brief Proposed PID gains, in the front end's slider units, up to maxGain
+  struct Gains
+  {
+    double mPidP;
+    double mPidI;
+    double mPidD;
+  };
+
+  ///
+  /// @brief The outcome of an experiment
+  ///
+  struct Result
+  {
+    bool    mSuccess;             // False if the arm never oscillated steadily & small
+    double  mUltimateGain;        // Ku, in slider units
+    double  mUltimatePeriod;      // Tu, in seconds
+    double  mAmplitude;           // Oscillation amplitude, in radians
+    Gains   mZieglerNichols;      // Kp = 0.6 Ku,  Ti = Tu / 2,    Td = Tu / 8
+    Gains   mTyreusLuyben;        // Kp = Ku / 2.2, Ti = 2.2 Tu,  Td = Tu / 6.3
+    double  mSimulatedTime;       // How long the experiment ran, in seconds
+  };
+
+  ///
+  /// @brief Constructor
+  ///
+  /// @param[in] loop         - The loop to fork.  Copied.
+  /// @param[in] targetAngle  - Where to oscillate around, in radians
+  /// @param[in] sensorNoise  - Max sensor noise in degrees, for the hysteresis
+  ///
+  RelayAutotuner( const ControlLoop& loop, double targetAngle, double sensorNoise );
+
+  // Remove constructors I probably never want (i.e., if used they're a bug)
+  RelayAutotuner() = delete;
+
+  ///
+  /// @brief Run more of the experiment
+  ///
+  /// @param[in] maxTicks - The most simulation ticks to run
+  /// @return             - True once the experiment is finished
+  ///
+  bool run( unsigned maxTicks );
+
+  /// @brief Is the experiment finished (successfully or not)?
+  [[nodiscard]] bool isDone() const { return mDone; }
+
+  /// @brief The outcome.  Only meaningful once isDone().
+  [[nodiscard]] const Result& getResult() const { return mResult; }
+
+  private:
+
+  void tick();
+  void finishCycle();
+  void finish( bool success );
+
+  ControlLoop   mLoop;
+  double        mTarget;
+  double        mHysteresis;            // radians
+  double        mTime         = 0.0;
+  double        mRelay        = 1.0;    // +1 or -1
+  double        mCycleStart   = -1.0;   // When the current cycle started, < 0 before the first
+  double        mCycleMax;              // Sensor extremes this cycle
+  double        mCycleMin;
+  double        mLastPeriod   = 0.0;
+  double        mLastAmplitude = 0.0;
+  unsigned      mCycles       = 0;
+  bool          mDone         = false;
+  Result        mResult;
+};
+
+}
+
+#endif
+
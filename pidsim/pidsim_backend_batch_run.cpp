@@ -0,0 +1,124 @@
+
+#include "pidsim_backend_batch_run.h"
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+namespace PidSim {
+
+const char* const BatchRun::parameterNames[ numParameters ] = {
+  "p", "i", "d", "start_angle", "target_angle", "rolling_friction", "sensor_noise", "sensor_delay", "motor_delay"
+};
+
+double BatchSim::ArmSettings::* const BatchRun::parameterSettings[ numParameters ] = {
+  &BatchSim::ArmSettings::mPidP,            &BatchSim::ArmSettings::mPidI,
+  &BatchSim::ArmSettings::mPidD,            &BatchSim::ArmSettings::mStartAngle,
+  &BatchSim::ArmSettings::mTargetAngle,     &BatchSim::ArmSettings::mRollingFriction,
+  &BatchSim::ArmSettings::mSensorNoise,     &BatchSim::ArmSettings::mSensorDelay,
+  &BatchSim::ArmSettings::mMotorDelay
+};
+
+const char* const BatchRun::metricNames[ numMetrics ] = {
+  "rise_time", "overshoot", "settling_time", "steady_state_error", "iae", "ise", "itae", "control_effort", "settled"
+};
+
+// See header for interface
+bool BatchRun::checkParameter( size_type column, double value, std::string& error )
+{
+  // Keyed on the names, so the bounds follow the columns around
+  const char* name = parameterNames[ column ];
+  const auto is = [name]( const char* other ) { return strcmp( name, other ) == 0; };
+  if ( !std::isfinite( value )) {
+    error = std::string( name ) + " isn't finite";
+    return false;
+  }
+  if ( is( "rolling_friction" ) && ( value < 0.0 || value >= 1.0 )) {
+    error = std::string( name ) + " has to be at least 0 and under 1";
+    return false;
+  }
+  if ( is( "sensor_noise" ) && value < 0.0 ) {
+    error = std::string( name ) + " can't be negative";
+    return false;
+  }
+  if (( is( "sensor_delay" ) || is( "motor_delay" )) && ( value < 0.0 || value >= maxDelay )) {
+    error = std::string( name ) + " has to be at least 0 and under "
+          + std::to_string( static_cast<int>( maxDelay )) + " ms";
+    return false;
+  }
+  return true;
+}
+
+// See header for interface
+bool BatchRun::checkParameters( const double* row, std::string& error )
+{
+  for ( size_type column = 0; column < numParameters; ++column ) {
+    if ( !checkParameter( column, row[ column ], error )) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// See header for interface
+std::vector<BatchSim::ArmSettings> BatchRun::armSettings( const double* parameters, size_type arms,
+                                                          MotionProfile::Type profile )
+{
+  std::vector<BatchSim::ArmSettings> settings( arms );
+  for ( size_type arm = 0; arm < arms; ++arm ) {
+    const double* row = parameters + arm * numParameters;
+    for ( size_type column = 0; column < numParameters; ++column ) {
+      settings[ arm ].*parameterSettings[ column ] = row[ column ];
+    }
+    settings[ arm ].mProfileType = profile;
+  }
+  return settings;
+}
+
+BatchRun::BatchRun( const double* parameters, size_type arms, MotionProfile::Type profile, std::uint64_t seed ) :
+  mSim{ armSettings( parameters, arms, profile ), seed }
+{
+}
+
+//
+// 1. Run a tick at a time, copying each tick's row out, or all at once
+// 2. Fill in the metrics
+//
+void BatchRun::run( unsigned ticks, bool trajectories )
+{
+  // 1. Run the arms
+  const size_type arms = size();
+  if ( trajectories ) {
+    mAngles.resize( static_cast<size_type>( ticks ) * arms );
+    mSetpoints.resize( mAngles.size() );
+    mMotorPowers.resize( mAngles.size() );
+    for ( unsigned tick = 0; tick < ticks; ++tick ) {
+      mSim.run( 1 );
+      const size_type row = static_cast<size_type>( tick ) * arms;
+      std::copy( mSim.getActualAngles().begin(), mSim.getActualAngles().end(), mAngles.begin() + row );
+      std::copy( mSim.getSetpoints().begin(),    mSim.getSetpoints().end(),    mSetpoints.begin() + row );
+      std::copy( mSim.getMotorPowers().begin(),  mSim.getMotorPowers().end(),  mMotorPowers.begin() + row );
+    }
+  }
+  else {
+    mSim.run( ticks );
+  }
+
+  // 2. Fill in the metrics
+  mMetrics.resize( arms * numMetrics );
+  for ( size_type arm = 0; arm < arms; ++arm ) {
+    const StepMetrics::Result metrics = mSim.getMetrics( arm );
+    double* row = &mMetrics[ arm * numMetrics ];
+    row[ 0 ] = metrics.mRiseTime;
+    row[ 1 ] = metrics.mOvershoot;
+    row[ 2 ] = metrics.mSettlingTime;
+    row[ 3 ] = metrics.mSteadyStateError;
+    row[ 4 ] = metrics.mIAE;
+    row[ 5 ] = metrics.mISE;
+    row[ 6 ] = metrics.mITAE;
+    row[ 7 ] = metrics.mControlEffort;
+    row[ 8 ] = metrics.mSettled ? 1.0 : 0.0;
+  }
+}
+
+}
+
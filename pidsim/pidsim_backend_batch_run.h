@@ -0,0 +1,141 @@
+#ifndef __PIDSIM_BACKEND_BATCH_RUN_H__
+#define __PIDSIM_BACKEND_BATCH_RUN_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "pidsim_backend_batch_sim.h"
+
+namespace PidSim {
+
+///
+/// @brief A BatchSim run from a flat table of parameters, with every
+///        result kept in flat arrays
+///
+/// This is BatchSim as other languages see it.  The parameters are a
+/// row per arm, in parameterNames order, and the results are plain
+/// row major arrays of doubles the run owns, so a binding can hand them
+/// out as they are instead of copying them into its own arrays.
+///
+/// - Trajectories: ticks x arms, i.e., getAngles()[ tick * size() + arm ]
+/// - Metrics:      arms x numMetrics, in metricNames order
+///
+class BatchRun
+{
+  public:
+
+  using size_type = BatchSim::size_type;
+
+  /// @brief Columns in a row of parameters
+  static constexpr size_type numParameters = 9;
+  /// @brief Columns in a row of metrics
+  static constexpr size_type numMetrics    = 9;
+
+  ///
+  /// @brief The parameter columns
+  ///
+  /// p, i, d, start_angle & target_angle (radians), rolling_friction (per
+  /// tick, as per PhysicsSim::applyFriction), sensor_noise (degrees),
+  /// sensor_delay & motor_delay (ms, under maxDelay)
+  ///
+  static const char* const parameterNames[ numParameters ];
+
+  /// @brief The ArmSettings member each parameter column sets
+  static double BatchSim::ArmSettings::* const parameterSettings[ numParameters ];
+
+  ///
+  /// @brief The metric columns, as per StepMetrics::Result
+  ///
+  /// rise_time, overshoot, settling_time, steady_state_error, iae, ise,
+  /// itae, control_effort, settled (1 or 0)
+  ///
+  static const char* const metricNames[ numMetrics ];
+
+  /// @brief Delays have to be under this many ms, for BatchSim's rings
+  static constexpr double maxDelay = BatchSim::maxDelayTicks * BatchSim::timeSlice * 1000.0;
+
+  ///
+  /// @brief Check one parameter
+  ///
+  /// Every parameter has to be finite.  rolling_friction has to be at
+  /// least 0 and under 1, sensor_noise at least 0, and the delays at
+  /// least 0 and under maxDelay.
+  ///
+  /// @param[in]  column  - The parameter's column
+  /// @param[in]  value   - Its value
+  /// @param[out] error   - What's wrong with it, if anything
+  /// @return             - True if it's good
+  ///
+  static bool checkParameter( size_type column, double value, std::string& error );
+
+  ///
+  /// @brief Check a row of parameters, as per checkParameter
+  ///
+  /// @param[in]  row   - numParameters values
+  /// @param[out] error - What's wrong with it, if anything
+  /// @return           - True if the row is good
+  ///
+  static bool checkParameters( const double* row, std::string& error );
+
+  ///
+  /// @brief Set up the arms
+  ///
+  /// @param[in] parameters - A good row of parameters per arm, row major
+  /// @param[in] arms       - How many rows
+  /// @param[in] profile    - Every arm's motion profile
+  /// @param[in] seed       - Seed for the sensor noise
+  ///
+  BatchRun( const double* parameters, size_type arms, MotionProfile::Type profile, std::uint64_t seed );
+
+  // Remove operations people shouldn't be using.
+  BatchRun() = delete;
+  BatchRun( const BatchRun& ) = delete;
+  BatchRun& operator=( const BatchRun& ) = delete;
+
+  ///
+  /// @brief Run the arms, then fill in the metrics
+  ///
+  /// Only touches this run, so runs on different threads don't interfere.
+  ///
+  /// @param[in] ticks        - Ticks to run
+  /// @param[in] trajectories - Keep every tick's angles, set points & motor
+  ///                           powers.  Otherwise they stay empty.
+  ///
+  void run( unsigned ticks, bool trajectories );
+
+  /// @brief Number of arms
+  [[nodiscard]] size_type size() const { return mSim.size(); }
+
+  /// @brief Ticks run
+  [[nodiscard]] unsigned getTicks() const { return mSim.getTicks(); }
+
+  /// @brief Actual arm angles, ticks x arms, in radians
+  [[nodiscard]] const std::vector<double>& getAngles() const { return mAngles; }
+
+  /// @brief Set points, ticks x arms, in radians
+  [[nodiscard]] const std::vector<double>& getSetpoints() const { return mSetpoints; }
+
+  /// @brief Motor powers after the motor delay, ticks x arms
+  [[nodiscard]] const std::vector<double>& getMotorPowers() const { return mMotorPowers; }
+
+  /// @brief Step metrics, arms x numMetrics
+  [[nodiscard]] const std::vector<double>& getMetrics() const { return mMetrics; }
+
+  private:
+
+  // BatchSim's settings for each row
+  static std::vector<BatchSim::ArmSettings> armSettings( const double* parameters, size_type arms,
+                                                         MotionProfile::Type profile );
+
+  BatchSim              mSim;
+  std::vector<double>   mAngles;
+  std::vector<double>   mSetpoints;
+  std::vector<double>   mMotorPowers;
+  std::vector<double>   mMetrics;
+};
+
+}
+
+#endif
+
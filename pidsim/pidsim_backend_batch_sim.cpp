@@ -0,0 +1,277 @@
+
+#include "pidsim_backend_batch_sim.h"
+#include "pidsim_utils.h"
+#include <algorithm>
+#include <assert.h>
+#include <utility>
+
+namespace PidSim {
+
+namespace {
+  // Number of simulation ticks for a delay, as per PhysicsSim.  Delays
+  // that don't fit the rings are the caller's bug; BatchRun::checkParameters
+  // turns them down.
+  unsigned delayInTicks( double delayInMs )
+  {
+    assert( delayInMs >= 0.0 );
+    const unsigned ticks = 1 + static_cast<unsigned>( delayInMs / 1000.0 * 50.0 );
+    assert( ticks <= BatchSim::maxDelayTicks );
+    return ticks;
+  }
+}
+
+BatchSim::BatchSim( const std::vector<ArmSettings>& arms, std::uint64_t seed ) :
+  mNumArms      { arms.size() },
+  mSeed         { seed },
+  mPidP         ( mNumArms ),
+  mPidI         ( mNumArms ),
+  mPidD         ( mNumArms ),
+  mFrictionKeep ( mNumArms ),
+  mMaxNoise     ( mNumArms ),
+  mSensorDelay  ( mNumArms ),
+  mMotorDelay   ( mNumArms ),
+  mMotorDelayF  ( mNumArms ),
+  mNoiseStream  ( mNumArms ),
+  mSegStart     ( mNumArms * MotionProfile::numSegments ),
+  mSegPosition  ( mNumArms * MotionProfile::numSegments ),
+  mSegVel       ( mNumArms * MotionProfile::numSegments ),
+  mSegAccel     ( mNumArms * MotionProfile::numSegments ),
+  mSegJerk      ( mNumArms * MotionProfile::numSegments ),
+  mSetpoint     ( mNumArms ),
+  mSensorAngle  ( mNumArms, 0.0 ),
+  mIError       ( mNumArms, 0.0 ),
+  mLastPError   ( mNumArms, 0.0 ),
+  mMotorCommand ( mNumArms, 0.0 ),
+  mAngle        ( mNumArms ),
+  mAngleVel     ( mNumArms, 0.0 ),
+  mMotorSum     ( mNumArms, 0.0 ),
+  mMotorPower   ( mNumArms, 0.0 ),
+  mMotorIndex   ( mNumArms, 0 ),
+  mMotorRing    ( mNumArms * maxDelayTicks, 0.0 ),
+  mSensorRing   ( mNumArms * maxDelayTicks, 0.0 )
+{
+  mMetrics.reserve( mNumArms );
+  for ( size_type arm = 0; arm < mNumArms; ++arm ) {
+    const ArmSettings& settings = arms[ arm ];
+    mPidP[ arm ]          = settings.mPidP;
+    mPidI[ arm ]          = settings.mPidI;
+    mPidD[ arm ]          = settings.mPidD;
+    mFrictionKeep[ arm ]  = 1.0 - settings.mRollingFriction;
+    mMaxNoise[ arm ]      = Utils::degToRad( settings.mSensorNoise ) * ( settings.mAntitheticNoise ? -1.0 : 1.0 );
+    mSensorDelay[ arm ]   = delayInTicks( settings.mSensorDelay );
+    mMotorDelay[ arm ]    = delayInTicks( settings.mMotorDelay );
+    mMotorDelayF[ arm ]   = static_cast<double>( mMotorDelay[ arm ] );
+    mNoiseStream[ arm ]   = settings.mNoiseStream == ownNoiseStream ? arm : settings.mNoiseStream;
+    mAngle[ arm ]         = settings.mStartAngle;
+    mSetpoint[ arm ]      = settings.mTargetAngle;
+    mMetrics.emplace_back( settings.mStartAngle, settings.mTargetAngle );
+
+    // Step arms get a profile too.  It just jumps to the target at t=0.
+    const MotionProfile profile{ settings.mProfileType, settings.mStartAngle,
+                                 settings.mTargetAngle, settings.mProfileLimits };
+    mProfileEnd = std::max( mProfileEnd, profile.getDuration() );
+    for ( size_type seg = 0; seg < MotionProfile::numSegments; ++seg ) {
+      const MotionProfile::Segment& segment = profile.getSegments()[ seg ];
+      const size_type index = seg * mNumArms + arm;
+      mSegStart[ index ]    = segment.mStartTime;
+      mSegPosition[ index ] = segment.mPosition;
+      mSegVel[ index ]      = segment.mVel;
+      mSegAccel[ index ]    = segment.mAccel;
+      mSegJerk[ index ]     = segment.mJerk;
+    }
+  }
+}
+
+// See header for interface
+void BatchSim::setGainSchedule( const GainSchedule& schedule )
+{
+  mGainSchedule = std::make_unique<GainSchedule>( schedule );
+}
+
+// See header for interface
+void BatchSim::setNoise( std::vector<double> noise )
+{
+  mNoise = std::move( noise );
+}
+
+// See header for interface
+void BatchSim::run( unsigned ticks )
+{
+  for ( unsigned i = 0; i < ticks; ++i ) {
+    tick();
+  }
+}
+
+//
+// One tick, in the same order as BackEnd::updateOneTick
+//
+void BatchSim::tick()
+{
+  updateSetpoints();
+  readSensors();
+  updatePidControllers();
+  updateMotors();
+  updateArms();
+  writeSensors();
+  updateMetrics();
+  ++mTicks;
+}
+
+//
+// Evaluate every arm's motion profile in closed form.  Rather than
+// looking up each arm's current segment, evaluate every segment and keep
+// the last one that has started.  That's a few more flops, but it's
+// branch free and vectorizes.
+//
+// Once every profile has reached its target the set points stop moving,
+// so the rest of the run costs the same as a step response.
+//
+void BatchSim::updateSetpoints()
+{
+  // Time is accumulated the same way SetpointGenerator does it.
+  const bool done = mProfileTime >= mProfileEnd;
+  mProfileTime += timeSlice;
+  if ( done ) { return; }
+
+  const double time = mProfileTime;
+  for ( size_type seg = 0; seg < MotionProfile::numSegments; ++seg ) {
+    const double* start = &mSegStart   [ seg * mNumArms ];
+    const double* pos   = &mSegPosition[ seg * mNumArms ];
+    const double* vel   = &mSegVel     [ seg * mNumArms ];
+    const double* accel = &mSegAccel   [ seg * mNumArms ];
+    const double* jerk  = &mSegJerk    [ seg * mNumArms ];
+    for ( size_type arm = 0; arm < mNumArms; ++arm ) {
+      const double tau = time - start[ arm ];
+      const double p   = pos[ arm ] + tau * ( vel[ arm ] + tau * ( accel[ arm ] / 2.0 + tau * jerk[ arm ] / 6.0 ));
+      mSetpoint[ arm ] = tau >= 0.0 ? p : mSetpoint[ arm ];
+    }
+  }
+}
+
+//
+// Same as Utils::Delayer.  After n pushes we see push max( n - delay, 0 ).
+// Before the first push the ring's still 0, which matches the Delayer too.
+//
+void BatchSim::readSensors()
+{
+  for ( size_type arm = 0; arm < mNumArms; ++arm ) {
+    const unsigned delay = mSensorDelay[ arm ];
+    const unsigned push  = mTicks > delay ? mTicks - delay : 0;
+    mSensorAngle[ arm ] = mSensorRing[ ( push % maxDelayTicks ) * mNumArms + arm ];
+  }
+}
+
+//
+// Same as PidController::updatePidController.  The gain schedule check
+// is hoisted out of the loop so the unscheduled loop stays as simple as
+// possible.
+//
+void BatchSim::updatePidControllers()
+{
+  if ( mGainSchedule ) {
+    updatePidControllers( *mGainSchedule );
+    return;
+  }
+
+  for ( size_type arm = 0; arm < mNumArms; ++arm ) {
+    const double pError = mSensorAngle[ arm ] - mSetpoint[ arm ];
+    mIError[ arm ] += pError;
+    const double iError = mIError[ arm ] * timeSlice;
+    const double dError = ( pError - mLastPError[ arm ] ) / timeSlice;
+    mLastPError[ arm ] = pError;
+
+    const double allGains = pError * mPidP[ arm ] + iError * mPidI[ arm ] + dError * mPidD[ arm ];
+    mMotorCommand[ arm ] = std::max( -4.0, std::min( -allGains, 4.0 )) / 5.0;
+  }
+}
+
+// As above, with the gains scaled by the schedule
+void BatchSim::updatePidControllers( const GainSchedule& schedule )
+{
+  for ( size_type arm = 0; arm < mNumArms; ++arm ) {
+    const double pError = mSensorAngle[ arm ] - mSetpoint[ arm ];
+    mIError[ arm ] += pError;
+    const double iError = mIError[ arm ] * timeSlice;
+    const double dError = ( pError - mLastPError[ arm ] ) / timeSlice;
+    mLastPError[ arm ] = pError;
+
+    const GainSchedule::Gains scale = schedule.lookup( mSensorAngle[ arm ] );
+    const double allGains =
+      pError * mPidP[ arm ] * scale.mPidP +
+      iError * mPidI[ arm ] * scale.mPidI +
+      dError * mPidD[ arm ] * scale.mPidD;
+    mMotorCommand[ arm ] = std::max( -4.0, std::min( -allGains, 4.0 )) / 5.0;
+  }
+}
+
+// Same as Utils::MovingAverage
+void BatchSim::updateMotors()
+{
+  for ( size_type arm = 0; arm < mNumArms; ++arm ) {
+    const unsigned index = mMotorIndex[ arm ];
+    double& slot = mMotorRing[ index * mNumArms + arm ];
+    mMotorSum[ arm ] -= slot;
+    slot = mMotorCommand[ arm ];
+    mMotorSum[ arm ] += slot;
+    mMotorIndex[ arm ] = index + 1 == mMotorDelay[ arm ] ? 0 : index + 1;
+    mMotorPower[ arm ] = mMotorSum[ arm ] / mMotorDelayF[ arm ];
+  }
+}
+
+//
+// Same as BackEnd::updateRobotArmSimulation
+//
+void BatchSim::updateArms()
+{
+  const double minAngle = Utils::degToRad( -120 );
+  const double maxAngle = Utils::degToRad( 210 );
+
+  for ( size_type arm = 0; arm < mNumArms; ++arm ) {
+    double accel = 0.0;
+    accel += cos( mAngle[ arm ] ) * -9.8;
+    accel += mMotorPower[ arm ] / timeSlice;
+    double vel = mAngleVel[ arm ] + accel * timeSlice;
+    vel *= mFrictionKeep[ arm ];
+    const double angle = mAngle[ arm ] + vel * timeSlice;
+
+    // A hard stop kills all velocity
+    const bool hitLimit = angle < minAngle || angle > maxAngle;
+    mAngle[ arm ]    = std::max( minAngle, std::min( angle, maxAngle ));
+    mAngleVel[ arm ] = hitLimit ? 0.0 : vel;
+  }
+}
+
+//
+// Record the sensor reading for the end of this tick.  The noise is
+// counter based, so it only depends on the seed, the tick and the arm's
+// noise stream.  Noise from setNoise() is just looked up.
+//
+void BatchSim::writeSensors()
+{
+  double* ring = &mSensorRing[ ( mTicks % maxDelayTicks ) * mNumArms ];
+  if ( !mNoise.empty() ) {
+    assert( mNoise.size() >= ( mTicks + 1 ) * mNumArms );
+    const double* noise = &mNoise[ mTicks * mNumArms ];
+    for ( size_type arm = 0; arm < mNumArms; ++arm ) {
+      ring[ arm ] = mAngle[ arm ] + noise[ arm ] * mMaxNoise[ arm ];
+    }
+    return;
+  }
+
+  const std::uint64_t tickSeed = Utils::splitMix64( mSeed + mTicks );
+  for ( size_type arm = 0; arm < mNumArms; ++arm ) {
+    const double noise = Utils::toSignedUnit( Utils::splitMix64( tickSeed + mNoiseStream[ arm ] )) * mMaxNoise[ arm ];
+    ring[ arm ] = mAngle[ arm ] + noise;
+  }
+}
+
+// Same as BackEnd's metrics, i.e., the actual angle vs the set point
+void BatchSim::updateMetrics()
+{
+  for ( size_type arm = 0; arm < mNumArms; ++arm ) {
+    mMetrics[ arm ].update( timeSlice, mAngle[ arm ], mSetpoint[ arm ], mMotorCommand[ arm ] );
+  }
+}
+
+}
+
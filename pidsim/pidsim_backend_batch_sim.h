@@ -0,0 +1,198 @@
+#ifndef __PIDSIM_BACKEND_BATCH_SIM_H__
+#define __PIDSIM_BACKEND_BATCH_SIM_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "pidsim_backend_gain_schedule.h"
+#include "pidsim_backend_motion_profile.h"
+#include "pidsim_backend_step_metrics.h"
+
+namespace PidSim {
+
+///
+/// @brief Simulates many robot arms + PID controllers in lockstep
+///
+/// This is the "batch mode" for sweeps.  Each arm follows the same rules
+/// as BackEnd's PhysicsSim + PidController loop, but the state is stored
+/// as a structure of arrays (one std::vector per field, indexed by arm)
+/// so every step of a tick is a simple loop over the arms that the
+/// compiler can vectorize.
+///
+/// Delay lines (sensor delay, motor moving average) are rings laid out
+/// slot major, i.e., ring[ slot * numArms + arm ].
+///
+class BatchSim
+{
+  public:
+
+  using size_type = std::size_t;
+
+  /// @brief The length of one simulation tick, in seconds
+  static constexpr double     timeSlice     = 1.0 / 50.0;
+  /// @brief The longest delay, in ticks, the rings can hold
+  static constexpr size_type  maxDelayTicks = 16;
+  /// @brief ArmSettings::mNoiseStream for "the arm's index in the batch"
+  static constexpr std::uint64_t ownNoiseStream = UINT64_MAX;
+  /// @brief Bump whenever a change alters what run() computes (physics,
+  ///        integration, noise or metrics), so cached results go stale
+  static constexpr std::uint32_t resultsVersion = 1;
+
+  ///
+  /// @brief The settings for one arm in the batch
+  ///
+  struct ArmSettings
+  {
+    double                  mPidP             = 0.0;
+    double                  mPidI             = 0.0;
+    double                  mPidD             = 0.0;
+    double                  mStartAngle       = 0.0;  // radians
+    double                  mTargetAngle      = 0.0;  // radians
+    double                  mRollingFriction  = 0.0;  // As per PhysicsSim::applyFriction
+    double                  mSensorNoise      = 0.0;  // Max noise in degrees
+    double                  mSensorDelay      = 0.0;  // ms, at least 0 and under BatchRun::maxDelay
+    double                  mMotorDelay       = 0.0;  // ms, at least 0 and under BatchRun::maxDelay
+    MotionProfile::Type     mProfileType      = MotionProfile::Type::Step;
+    MotionProfile::Limits   mProfileLimits    = defaultProfileLimits;
+    std::uint64_t           mNoiseStream      = ownNoiseStream;  // Arms on the same stream see the same noise
+    bool                    mAntitheticNoise  = false;  // Negate the stream's noise
+  };
+
+  ///
+  /// @brief Constructor
+  ///
+  /// @param[in] arms   - The settings for each arm in the batch
+  /// @param[in] seed   - Seed for the sensor noise
+  ///
+  BatchSim( const std::vector<ArmSettings>& arms, std::uint64_t seed = 0 );
+
+  // Remove operations people shouldn't be using.
+  BatchSim() = delete;
+  BatchSim( const BatchSim& other ) = delete;
+  BatchSim& operator=( const BatchSim& other ) = delete;
+
+  ///
+  /// @brief Scale every arm's gains with a gain schedule
+  ///
+  /// @param[in] schedule - The schedule.  The batch keeps its own copy.
+  ///
+  void setGainSchedule( const GainSchedule& schedule );
+
+  ///
+  /// @brief Use the noise given instead of the seeded noise
+  ///
+  /// For searches that steer the noise, i.e., toward rare failures.
+  ///
+  /// @param[in] noise  - Per tick & arm, from -1 to 1, scaled by each arm's
+  ///                     max noise.  Tick major, i.e., noise[ tick * size()
+  ///                     + arm ], and it has to cover every tick run.
+  ///
+  void setNoise( std::vector<double> noise );
+
+  ///
+  /// @brief Add a sudden velocity to an arm, as per PhysicsSim::bump
+  ///
+  /// @param[in] arm      - The arm
+  /// @param[in] bumpVel  - Velocity to add in radians/s
+  ///
+  void bump( size_type arm, double bumpVel ) { mAngleVel[ arm ] += bumpVel; }
+
+  ///
+  /// @brief Advance every arm
+  ///
+  /// @param[in] ticks  - The number of ticks to run
+  ///
+  void run( unsigned ticks );
+
+  /// @brief Number of arms in the batch
+  [[nodiscard]] size_type size() const { return mNumArms; }
+
+  /// @brief Number of ticks run so far
+  [[nodiscard]] unsigned getTicks() const { return mTicks; }
+
+  /// @brief The actual arm angles, in radians
+  [[nodiscard]] const std::vector<double>& getActualAngles() const { return mAngle; }
+
+  /// @brief The set points the controllers used last tick, in radians
+  [[nodiscard]] const std::vector<double>& getSetpoints() const { return mSetpoint; }
+
+  /// @brief The motor power after the motor delay, as per PhysicsSim::getMotorPower
+  [[nodiscard]] const std::vector<double>& getMotorPowers() const { return mMotorPower; }
+
+  ///
+  /// @brief The step response metrics for an arm, measured from the start
+  ///        angle to the target angle
+  ///
+  /// @param[in] arm  - The arm
+  /// @return         - The metrics after getTicks() ticks
+  ///
+  [[nodiscard]] StepMetrics::Result getMetrics( size_type arm ) const { return mMetrics[ arm ].getResult(); }
+
+  private:
+
+  void tick();
+  void updateSetpoints();
+  void readSensors();
+  void updatePidControllers();
+  void updatePidControllers( const GainSchedule& schedule );
+  void updateMotors();
+  void updateArms();
+  void writeSensors();
+  void updateMetrics();
+
+  size_type             mNumArms;
+  unsigned              mTicks        = 0;
+  double                mProfileTime  = 0.0;  // Seconds since the profiles started
+  double                mProfileEnd   = 0.0;  // When the longest profile finishes
+  std::uint64_t         mSeed;
+  std::unique_ptr<GainSchedule> mGainSchedule;
+
+  // Settings
+  std::vector<double>   mPidP;
+  std::vector<double>   mPidI;
+  std::vector<double>   mPidD;
+  std::vector<double>   mFrictionKeep;      // 1 - rolling friction
+  std::vector<double>   mMaxNoise;          // radians, negative for antithetic noise
+  std::vector<unsigned> mSensorDelay;       // ticks
+  std::vector<unsigned> mMotorDelay;        // ticks (moving average size)
+  std::vector<double>   mMotorDelayF;       // Same, as a double
+  std::vector<std::uint64_t> mNoiseStream;
+
+  // Motion profile segments, segment major (see MotionProfile)
+  std::vector<double>   mSegStart;
+  std::vector<double>   mSegPosition;
+  std::vector<double>   mSegVel;
+  std::vector<double>   mSegAccel;
+  std::vector<double>   mSegJerk;
+
+  // PID controller state
+  std::vector<double>   mSetpoint;
+  std::vector<double>   mSensorAngle;
+  std::vector<double>   mIError;
+  std::vector<double>   mLastPError;
+  std::vector<double>   mMotorCommand;
+
+  // Physics state
+  std::vector<double>   mAngle;
+  std::vector<double>   mAngleVel;
+  std::vector<double>   mMotorSum;
+  std::vector<double>   mMotorPower;
+  std::vector<unsigned> mMotorIndex;
+
+  // Noise from setNoise(), if any
+  std::vector<double>   mNoise;
+
+  // Delay rings
+  std::vector<double>   mMotorRing;
+  std::vector<double>   mSensorRing;
+
+  // Step response metrics.  A few doubles an arm, so a sweep can score
+  // arms without keeping their trajectories.
+  std::vector<StepMetrics> mMetrics;
+};
+
+}
+
+#endif
+
@@ -0,0 +1,117 @@
+
+#include "pidsim_backend_comparison.h"
+#include "pidsim_utils.h"
+#include <algorithm>
+#include <math.h>
+#include <thread>
+
+namespace PidSim {
+
+namespace {
+  // The least number of runs worth giving a core of its own
+  constexpr std::size_t minRunsPerBatch = 32;
+
+  BatchSim::ArmSettings withGains( BatchSim::ArmSettings arm, const GainOptimizer::Gains& gains )
+  {
+    arm.mPidP = gains[ 0 ];
+    arm.mPidI = gains[ 1 ];
+    arm.mPidD = gains[ 2 ];
+    return arm;
+  }
+}
+
+//
+// Runs are laid out A, B, A, B... so a replicate's two runs are next to
+// each other.  Replicate r uses noise streams
+//
+// - Independent:  2r for A, 2r+1 for B
+// - Common:       r for both
+// - Antithetic:   r/2 for both, negated when r is odd
+//
+// 1. Set up the runs
+// 2. Simulate them, spread over the cores
+// 3. Turn the costs into samples of the difference
+// 4. Mean, standard error and a normal interval
+//
+GainComparison::Report GainComparison::compare( const Settings& settings )
+{
+  // 1. Set up the runs
+  const bool antithetic = settings.mMode == Mode::Antithetic;
+  const std::size_t group = antithetic ? 4 : 2;
+  const std::size_t replicates = settings.mSimulations / group * group / 2;
+  const std::size_t count = replicates * 2;
+  std::vector<BatchSim::ArmSettings> arms;
+  arms.reserve( count );
+  for ( std::size_t replicate = 0; replicate < replicates; ++replicate ) {
+    BatchSim::ArmSettings a = withGains( settings.mArm, settings.mGainsA );
+    BatchSim::ArmSettings b = withGains( settings.mArm, settings.mGainsB );
+    switch ( settings.mMode ) {
+      case Mode::Independent:
+        a.mNoiseStream = 2 * replicate;
+        b.mNoiseStream = 2 * replicate + 1;
+        break;
+      case Mode::Common:
+        a.mNoiseStream = b.mNoiseStream = replicate;
+        break;
+      case Mode::Antithetic:
+        a.mNoiseStream = b.mNoiseStream = replicate / 2;
+        a.mAntitheticNoise = b.mAntitheticNoise = replicate % 2 == 1;
+        break;
+    }
+    arms.push_back( a );
+    arms.push_back( b );
+  }
+
+  // 2. Simulate them, spread over the cores
+  std::vector<double> costs( count );
+  const std::size_t batches = std::max<std::size_t>( 1, std::min<std::size_t>(
+    std::thread::hardware_concurrency(), count / minRunsPerBatch ));
+  Utils::parallelFor( batches, [&]( std::size_t batch ) {
+    const std::size_t begin = count * batch / batches;
+    const std::size_t end   = count * ( batch + 1 ) / batches;
+    BatchSim sim( std::vector<BatchSim::ArmSettings>( arms.begin() + begin, arms.begin() + end ), settings.mSeed );
+    sim.run( settings.mTicks );
+    for ( std::size_t arm = 0; arm < sim.size(); ++arm ) {
+      const StepMetrics::Result metrics = sim.getMetrics( arm );
+      costs[ begin + arm ] = settings.mMetric == CostMap::Metric::ITAE ? metrics.mITAE : metrics.mSettlingTime;
+    }
+  });
+
+  // 3. Turn the costs into samples of the difference
+  Report report{ 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0, count };
+  std::vector<double> samples;
+  const std::size_t perSample = antithetic ? 2 : 1;
+  for ( std::size_t first = 0; first < replicates; first += perSample ) {
+    double difference = 0.0;
+    for ( std::size_t replicate = first; replicate < first + perSample; ++replicate ) {
+      report.mMeanA += costs[ 2 * replicate ];
+      report.mMeanB += costs[ 2 * replicate + 1 ];
+      difference    += costs[ 2 * replicate + 1 ] - costs[ 2 * replicate ];
+    }
+    samples.push_back( difference / static_cast<double>( perSample ));
+  }
+
+  // 4. Mean, standard error and a normal interval
+  report.mSamples = samples.size();
+  if ( samples.empty() ) {
+    return report;
+  }
+  const double n = static_cast<double>( samples.size() );
+  report.mMeanA /= static_cast<double>( replicates );
+  report.mMeanB /= static_cast<double>( replicates );
+  for ( double sample : samples ) {
+    report.mMeanDifference += sample / n;
+  }
+  double squares = 0.0;
+  for ( double sample : samples ) {
+    squares += ( sample - report.mMeanDifference ) * ( sample - report.mMeanDifference );
+  }
+  report.mStandardError = n > 1.0 ? sqrt( squares / ( n - 1.0 ) / n ) : INFINITY;
+  const double z = Utils::normalQuantile( 1.0 - ( 1.0 - settings.mConfidence ) / 2.0 );
+  report.mLower = report.mMeanDifference - z * report.mStandardError;
+  report.mUpper = report.mMeanDifference + z * report.mStandardError;
+  return report;
+}
+
+}
+
@@ -0,0 +1,85 @@
+#ifndef __PIDSIM_BACKEND_COMPARISON_H__
+#define __PIDSIM_BACKEND_COMPARISON_H__
+
+#include <cstddef>
+#include <cstdint>
+#include "pidsim_backend_batch_sim.h"
+#include "pidsim_backend_cost_map.h"
+#include "pidsim_backend_gain_optimizer.h"
+
+namespace PidSim {
+
+///
+/// @brief Is gain set B better than gain set A, and by how much?
+///
+/// Runs both gain sets on the same arm many times with sensor noise and
+/// reports the mean difference in cost, B - A, with a confidence
+/// interval.  How the noise is shared makes a big difference:
+///
+/// - Independent:  A and B each get their own noise.  The difference
+///                 has the variance of both costs added together.
+/// - Common:       Each replicate runs A and B on the same noise stream
+///                 (common random numbers).  Noise that hurts A hurts B
+///                 about as much, so most of it cancels in the difference.
+/// - Antithetic:   Common, and each replicate is paired with a second
+///                 one on the same stream with the noise negated.  The
+///                 pair's average difference is the sample, so noise
+///                 that's odd in its effect cancels too.
+///
+/// Every mode runs the same number of simulations, so their intervals
+/// compare directly.
+///
+class GainComparison
+{
+  public:
+
+  /// @brief How the noise is shared between A and B
+  enum class Mode
+  {
+    Independent,
+    Common,
+    Antithetic
+  };
+
+  ///
+  /// @brief What to compare
+  ///
+  struct Settings
+  {
+    BatchSim::ArmSettings   mArm;                     // The arm.  Its gains are ignored.
+    GainOptimizer::Gains    mGainsA;
+    GainOptimizer::Gains    mGainsB;
+    CostMap::Metric         mMetric       = CostMap::Metric::ITAE;
+    Mode                    mMode         = Mode::Antithetic;
+    unsigned                mTicks        = 250;      // How long to simulate each run
+    std::size_t             mSimulations  = 1024;     // Runs, A and B together
+    double                  mConfidence   = 0.95;
+    std::uint64_t           mSeed         = 1;
+  };
+
+  ///
+  /// @brief The comparison
+  ///
+  struct Report
+  {
+    double        mMeanA;             // Average cost of A
+    double        mMeanB;             // Average cost of B
+    double        mMeanDifference;    // B - A.  Negative means B is better.
+    double        mStandardError;     // Of the mean difference
+    double        mLower;             // Confidence interval on the mean difference
+    double        mUpper;
+    std::size_t   mSamples;           // Independent differences the interval is built from
+    std::size_t   mSimulations;       // Runs, A and B together
+  };
+
+  ///
+  /// @brief Run the comparison, spread over the cores
+  ///
+  /// @param[in] settings - What to compare
+  ///
+  [[nodiscard]] static Report compare( const Settings& settings );
+};
+
+}
+
+#endif
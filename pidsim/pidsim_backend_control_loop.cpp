@@ -0,0 +1,71 @@
+
+#include "pidsim_backend_control_loop.h"
+
+namespace PidSim {
+
+ControlLoop::ControlLoop( double startAngle, const MotionProfile::Limits& limits ) :
+  mPhysicsSim         { startAngle },
+  mPidController      {},
+  mStateEstimator     { startAngle },
+  mSetpointGenerator  { startAngle, limits }
+{
+}
+
+//
+// 1. Move the set point along the motion profile
+// 2. Run the state estimator.  Always run it so it's warmed up if the
+//    user turns it on.
+// 3. Run the PID controller
+// 4. Advance the robot arm simulation
+//
+ControlLoop::Output ControlLoop::tick( double timeSlice, double pidP, double pidI, double pidD )
+{
+  // 1. Move the set point along the motion profile
+  const double setpoint = mSetpointGenerator.update( timeSlice );
+  mPidController.updatePidSettings( pidP, pidI, pidD, setpoint );
+
+  // 2. Run the state estimator
+  const double sensorAngle    = mPhysicsSim.getSensorAngle();
+  const double estimatedAngle = mStateEstimator.update( timeSlice, sensorAngle );
+
+  // 3. Run the PID controller
+  const double pidInputAngle = mUseStateEstimator ? estimatedAngle : sensorAngle;
+  const PidController::Output pOut = mPidController.updatePidController( timeSlice, pidInputAngle );
+  mStateEstimator.recordMotorPower( pOut.mMotorPower );
+
+  // 4. Advance the robot arm simulation
+  updateRobotArmSimulation( timeSlice, pOut.mMotorPower );
+
+  return Output{ setpoint, pOut };
+}
+
+ControlLoop::Prediction ControlLoop::predict( double timeSlice, unsigned ticks, double pidP, double pidI, double pidD ) const
+{
+  ControlLoop fork = *this;
+  fork.mPhysicsSim.setSensorNoise( 0.0 );
+
+  Prediction prediction;
+  prediction.mAngles.reserve( ticks );
+  prediction.mSetpoints.reserve( ticks );
+  for ( unsigned tick = 0; tick < ticks; ++tick ) {
+    const Output out = fork.tick( timeSlice, pidP, pidI, pidD );
+    prediction.mAngles.push_back( fork.mPhysicsSim.getActualAngle() );
+    prediction.mSetpoints.push_back( out.mSetpoint );
+  }
+  return prediction;
+}
+
+void ControlLoop::updateRobotArmSimulation( double timeSlice, double motorPower )
+{
+  mPhysicsSim.startSimulationIteration();
+  mPhysicsSim.applyGravity();
+  mPhysicsSim.applyMotor( motorPower, timeSlice );
+  mPhysicsSim.updateAngleVel( timeSlice );
+  mPhysicsSim.applyFriction( mRollingFriction );
+  mPhysicsSim.updateAngle( timeSlice );
+  mPhysicsSim.imposePositionHardLimits();
+  mPhysicsSim.endSimulationIteration();
+}
+
+}
+
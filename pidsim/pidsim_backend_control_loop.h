@@ -0,0 +1,122 @@
+#ifndef __PIDSIM_BACKEND_CONTROL_LOOP_H__
+#define __PIDSIM_BACKEND_CONTROL_LOOP_H__
+
+#include <vector>
+#include "pidsim_backend_motion_profile.h"
+#include "pidsim_backend_physics_sim.h"
+#include "pidsim_backend_pid_controller.h"
+#include "pidsim_backend_state_estimator.h"
+
+namespace PidSim {
+
+///
+/// @brief Everything that runs in one simulation tick, minus the GUI
+///
+/// Holds the robot arm, the PID controller, the state estimator and the
+/// set point generator by value, so the whole loop can be copied.  That
+/// lets the back end fork the live simulation and run the copy ahead to
+/// see what new gains would do, without touching the real one.
+///
+/// tick() is the one place the loop is advanced.  The back end does its
+/// telemetry (graphs, step metrics) around it; predict() just doesn't.
+///
+class ControlLoop
+{
+  public:
+
+  ///
+  /// @brief What a tick produced
+  ///
+  struct Output
+  {
+    double                  mSetpoint;    // Where the motion profile was, in radians
+    PidController::Output   mPid;         // What the PID controller did
+  };
+
+  ///
+  /// @brief A run into the future
+  ///
+  struct Prediction
+  {
+    std::vector<double> mAngles;      // Actual arm angle after each tick, in radians
+    std::vector<double> mSetpoints;   // The set point for each tick, in radians
+  };
+
+  ///
+  /// @brief Constructor
+  ///
+  /// @param[in] startAngle - The angle the Arm starts at, in radians
+  /// @param[in] limits     - The limits for set point motion profiles
+  ///
+  ControlLoop( double startAngle, const MotionProfile::Limits& limits );
+
+  // Remove constructors I probably never want (i.e., if used they're a bug)
+  ControlLoop() = delete;
+
+  ///
+  /// @brief Advance the whole loop by one time slice
+  ///
+  /// @param[in] timeSlice    - The length of the time slice, in seconds
+  /// @param[in] pidP         - PID "P" Gain
+  /// @param[in] pidI         - PID "I" Gain
+  /// @param[in] pidD         - PID "D" Gain
+  ///
+  Output tick( double timeSlice, double pidP, double pidI, double pidD );
+
+  ///
+  /// @brief Run a copy of the loop ahead with (maybe) different gains
+  ///
+  /// The copy has no sensor noise, so the prediction is the trajectory
+  /// the arm follows on average, and the noise's random numbers aren't
+  /// used up.
+  ///
+  /// @param[in] timeSlice    - The length of the time slice, in seconds
+  /// @param[in] ticks        - How many ticks to predict
+  /// @param[in] pidP         - PID "P" Gain
+  /// @param[in] pidI         - PID "I" Gain
+  /// @param[in] pidD         - PID "D" Gain
+  ///
+  [[nodiscard]] Prediction predict( double timeSlice, unsigned ticks, double pidP, double pidI, double pidD ) const;
+
+  ///
+  /// @brief Advance just the arm, with the motor power given
+  ///
+  /// Skips the set point, state estimator and PID controller, i.e., for a
+  /// relay experiment on a fork of the loop.
+  ///
+  /// @param[in] timeSlice    - The length of the time slice, in seconds
+  /// @param[in] motorPower   - The motor power, as the PID controller would give it
+  ///
+  void tickArm( double timeSlice, double motorPower ) { updateRobotArmSimulation( timeSlice, motorPower ); }
+
+  /// @brief Set the rolling friction, as per PhysicsSim::applyFriction
+  void setRollingFriction( double rollingFriction ) { mRollingFriction = rollingFriction; }
+
+  /// @brief Should the PID controller see the state estimate instead of the raw sensor?
+  void setUseStateEstimator( bool useStateEstimator ) { mUseStateEstimator = useStateEstimator; }
+
+  /// @brief Get the rolling friction
+  [[nodiscard]] double getRollingFriction() const { return mRollingFriction; }
+
+  /// @brief The parts of the loop, for settings & input
+  PhysicsSim&         getPhysicsSim()         { return mPhysicsSim; }
+  PidController&      getPidController()      { return mPidController; }
+  StateEstimator&     getStateEstimator()     { return mStateEstimator; }
+  SetpointGenerator&  getSetpointGenerator()  { return mSetpointGenerator; }
+
+  private:
+
+  void updateRobotArmSimulation( double timeSlice, double motorPower );
+
+  PhysicsSim          mPhysicsSim;
+  PidController       mPidController;
+  StateEstimator      mStateEstimator;
+  SetpointGenerator   mSetpointGenerator;
+  double              mRollingFriction    = 0.0;
+  bool                mUseStateEstimator  = false;
+};
+
+}
+
+#endif
+
@@ -0,0 +1,185 @@
+
+#include "pidsim_backend_controller_replay.h"
+#include "pidsim_backend_trace.h"
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
+
+namespace PidSim {
+
+namespace {
+  // The PID controller clamps its output to this, as per PidController
+  constexpr double maxGains = 4.0;
+  constexpr double gainsPerPower = 5.0;
+}
+
+// See header for interface
+bool ControllerReplay::loadRecording( const TraceReader& trace, Recording& out )
+{
+  const std::size_t columns     = trace.getColumns().size();
+  const std::size_t sensorAngle = trace.findColumn( "sensor_angle" );
+  const std::size_t setpoint    = trace.findColumn( "setpoint" );
+  const std::size_t motorPower  = trace.findColumn( "motor_power" );
+  if ( sensorAngle == columns || setpoint == columns ) {
+    return false;
+  }
+
+  out.mTimeSlice = Session::timeSlice;
+  if ( trace.getRows() > 1 ) {
+    std::vector<std::int64_t> times;
+    trace.readBlockTimes( 0, times );
+    if ( times.size() > 1 && times[ 1 ] > times[ 0 ] ) {
+      out.mTimeSlice = static_cast<double>( times[ 1 ] - times[ 0 ] ) * 1e-6;
+    }
+  }
+  out.mSensorAngles = trace.readColumn( sensorAngle );
+  out.mSetpoints    = trace.readColumn( setpoint );
+  out.mMotorPowers  = motorPower == columns ? std::vector<double>{} : trace.readColumn( motorPower );
+  return true;
+}
+
+// See header for interface
+template< typename Scalar >
+std::vector<typename BasicPidController<Scalar>::Output> ControllerReplay::replay(
+    const Recording& recording, const Scalar& pidP, const Scalar& pidI, const Scalar& pidD,
+    const GainSchedule* schedule )
+{
+  assert( recording.mSensorAngles.size() == recording.mSetpoints.size() );
+  BasicPidController<Scalar> controller;
+  controller.setGainSchedule( schedule );
+  std::vector<typename BasicPidController<Scalar>::Output> outputs;
+  outputs.reserve( recording.mSensorAngles.size() );
+  for ( std::size_t tick = 0; tick < recording.mSensorAngles.size(); ++tick ) {
+    controller.updatePidSettings( pidP, pidI, pidD, recording.mSetpoints[ tick ] );
+    outputs.push_back( controller.updatePidController( recording.mTimeSlice, Scalar{ recording.mSensorAngles[ tick ] } ));
+  }
+  return outputs;
+}
+
+ControllerReplay::ControllerReplay( const std::vector<Gains>& variants ) :
+  mNumVariants          { variants.size() },
+  mPidP                 ( mNumVariants ),
+  mPidI                 ( mNumVariants ),
+  mPidD                 ( mNumVariants ),
+  mPower                ( mNumVariants, 0.0 ),
+  mSumSquaredPower      ( mNumVariants, 0.0 ),
+  mSumSquaredDifference ( mNumVariants, 0.0 ),
+  mMaxDifference        ( mNumVariants, 0.0 ),
+  mMaxDifferenceTick    ( mNumVariants, 0.0 ),
+  mSaturatedTicks       ( mNumVariants, 0.0 )
+{
+  for ( size_type variant = 0; variant < mNumVariants; ++variant ) {
+    mPidP[ variant ] = variants[ variant ].mPidP;
+    mPidI[ variant ] = variants[ variant ].mPidI;
+    mPidD[ variant ] = variants[ variant ].mPidD;
+  }
+}
+
+// See header for interface
+void ControllerReplay::setGainSchedule( const GainSchedule& schedule )
+{
+  mGainSchedule = std::make_unique<GainSchedule>( schedule );
+}
+
+//
+// 1. Work out the P, I and D errors, which every variant shares
+// 2. Scale the gains for the sensor angle, if there's a gain schedule
+// 3. Work out every variant's motor power
+// 4. Compare it with the recorded power
+//
+// The arithmetic is in the same order as PidController's, so the powers
+// come out the same to the bit.
+//
+// The clamps and comparisons are selects, not branches.  Even so, GCC's
+// default -ftrapping-math won't vectorize a loop where a select feeds
+// more arithmetic.  Splitting each loop in two so it would was only
+// faster with AVX2, and slower on plain x86-64 builds, so it's one pass.
+//
+void ControllerReplay::run( const Recording& recording, std::vector<double>* motorPowers )
+{
+  assert( recording.mSensorAngles.size() == recording.mSetpoints.size() );
+  assert( recording.mMotorPowers.empty() || recording.mMotorPowers.size() == recording.mSensorAngles.size() );
+  mTicks = recording.mSensorAngles.size();
+  std::fill( mSumSquaredPower.begin(),      mSumSquaredPower.end(),      0.0 );
+  std::fill( mSumSquaredDifference.begin(), mSumSquaredDifference.end(), 0.0 );
+  std::fill( mMaxDifference.begin(),        mMaxDifference.end(),        0.0 );
+  std::fill( mMaxDifferenceTick.begin(),    mMaxDifferenceTick.end(),    0.0 );
+  std::fill( mSaturatedTicks.begin(),       mSaturatedTicks.end(),       0.0 );
+  if ( motorPowers ) {
+    motorPowers->resize( mTicks * mNumVariants );
+  }
+
+  const double timeSlice = recording.mTimeSlice;
+  const bool recorded = !recording.mMotorPowers.empty();
+  double iSum = 0.0, lastPError = 0.0;
+  for ( size_type tick = 0; tick < mTicks; ++tick ) {
+    // 1. Work out the P, I and D errors
+    const double sensorAngle = recording.mSensorAngles[ tick ];
+    const double pError = sensorAngle - recording.mSetpoints[ tick ];
+    iSum += pError;
+    const double iError = iSum * timeSlice;
+    const double dError = ( pError - lastPError ) / timeSlice;
+    lastPError = pError;
+
+    // 2. Scale the gains for the sensor angle
+    const GainSchedule::Gains scale = mGainSchedule ? mGainSchedule->lookup( sensorAngle ) : GainSchedule::Gains{ 1.0, 1.0, 1.0 };
+
+    // 3. Work out every variant's motor power
+    const double* pidP      = mPidP.data();
+    const double* pidI      = mPidI.data();
+    const double* pidD      = mPidD.data();
+    double*       power     = mPower.data();
+    double*       squared   = mSumSquaredPower.data();
+    double*       saturated = mSaturatedTicks.data();
+    for ( size_type variant = 0; variant < mNumVariants; ++variant ) {
+      const double allGains =
+        pError * pidP[ variant ] * scale.mPidP +
+        iError * pidI[ variant ] * scale.mPidI +
+        dError * pidD[ variant ] * scale.mPidD;
+      power[ variant ]      = std::max( -maxGains, std::min( -allGains, maxGains )) / gainsPerPower;
+      squared[ variant ]   += power[ variant ] * power[ variant ];
+      saturated[ variant ] += std::abs( allGains ) >= maxGains ? 1.0 : 0.0;
+    }
+    if ( motorPowers ) {
+      std::copy( mPower.begin(), mPower.end(), motorPowers->begin() + static_cast<std::ptrdiff_t>( tick * mNumVariants ));
+    }
+
+    // 4. Compare it with the recorded power
+    if ( recorded ) {
+      const double recordedPower = recording.mMotorPowers[ tick ];
+      const double tickF = static_cast<double>( tick );
+      double* sumSquared    = mSumSquaredDifference.data();
+      double* maxDifference = mMaxDifference.data();
+      double* maxTick       = mMaxDifferenceTick.data();
+      for ( size_type variant = 0; variant < mNumVariants; ++variant ) {
+        const double difference = std::abs( power[ variant ] - recordedPower );
+        sumSquared[ variant ] += difference * difference;
+        const bool larger = difference > maxDifference[ variant ];
+        maxDifference[ variant ] = larger ? difference : maxDifference[ variant ];
+        maxTick[ variant ]       = larger ? tickF : maxTick[ variant ];
+      }
+    }
+  }
+}
+
+// See header for interface
+ControllerReplay::Result ControllerReplay::getResult( size_type variant ) const
+{
+  const double ticks = std::max( static_cast<double>( mTicks ), 1.0 );
+  return Result{
+    sqrt( mSumSquaredPower[ variant ] / ticks ),
+    sqrt( mSumSquaredDifference[ variant ] / ticks ),
+    mMaxDifference[ variant ],
+    static_cast<size_type>( mMaxDifferenceTick[ variant ] ),
+    static_cast<size_type>( mSaturatedTicks[ variant ] )
+  };
+}
+
+// The scalar types replay() runs with, as per BasicPidController
+template std::vector<PidController::Output> ControllerReplay::replay<double>(
+    const Recording&, const double&, const double&, const double&, const GainSchedule* );
+template std::vector<BasicPidController<Utils::Dual<3>>::Output> ControllerReplay::replay<Utils::Dual<3>>(
+    const Recording&, const Utils::Dual<3>&, const Utils::Dual<3>&, const Utils::Dual<3>&, const GainSchedule* );
+
+}
+
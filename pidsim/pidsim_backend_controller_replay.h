@@ -0,0 +1,167 @@
+#ifndef __PIDSIM_BACKEND_CONTROLLER_REPLAY_H__
+#define __PIDSIM_BACKEND_CONTROLLER_REPLAY_H__
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "pidsim_backend_gain_schedule.h"
+#include "pidsim_backend_pid_controller.h"
+#include "pidsim_backend_session.h"
+
+namespace PidSim {
+
+class TraceReader;
+
+///
+/// @brief Runs controllers open loop over recorded sensor readings
+///
+/// A recording is what a controller read, and where it was told to go,
+/// each tick - i.e., a telemetry trace, or a log off the real robot.
+/// Replaying it through a controller shows what that controller would
+/// have commanded, without simulating the arm.  The arm doesn't react,
+/// so this isn't a prediction of how the run would have gone; it's a
+/// quick way to check a controller change does what it should, or to see
+/// how a gain candidate reacts to real sensor data.
+///
+/// replay() runs one controller.  The class runs many PID gain variants
+/// over the same recording in one pass.  The P, I and D errors only
+/// depend on the recording, so they're worked out once a tick, and each
+/// variant is then a few multiplies.  As in BatchSim, the gains and
+/// results are a structure of arrays, so each tick is one tight loop over
+/// the variants.
+///
+/// Outputs match PidController's bit for bit.
+///
+class ControllerReplay
+{
+  public:
+
+  using size_type = std::size_t;
+
+  ///
+  /// @brief What a controller was given, and what it did, each tick
+  ///
+  struct Recording
+  {
+    double                mTimeSlice = Session::timeSlice;  // Seconds per tick
+    std::vector<double>   mSensorAngles;                    // What the controller read, in radians
+    std::vector<double>   mSetpoints;                       // Where it was told to go, in radians
+    std::vector<double>   mMotorPowers;                     // What it commanded.  Empty if not recorded.
+  };
+
+  ///
+  /// @brief Read a recording from a telemetry trace
+  ///
+  /// The tick length comes from the trace's timestamps.  A reset in the
+  /// trace is just a jump in the angles; the replay doesn't start over.
+  ///
+  /// @param[in] trace  - A trace with Telemetry's sensor_angle & setpoint
+  ///                     columns, and motor_power if it has one
+  /// @param[out] out   - The recording
+  /// @return           - False if the trace doesn't have the columns
+  ///
+  static bool loadRecording( const TraceReader& trace, Recording& out );
+
+  ///
+  /// @brief Replay a recording through one PID controller
+  ///
+  /// @param[in] recording  - The recording
+  /// @param[in] pidP       - P gain
+  /// @param[in] pidI       - I gain
+  /// @param[in] pidD       - D gain
+  /// @param[in] schedule   - Gain schedule, if any
+  /// @return               - The controller's output each tick.  With
+  ///                         Scalar = Dual<3>, that carries the outputs'
+  ///                         derivatives with respect to the gains.
+  ///
+  template< typename Scalar >
+  static std::vector<typename BasicPidController<Scalar>::Output> replay(
+      const Recording& recording, const Scalar& pidP, const Scalar& pidI, const Scalar& pidD,
+      const GainSchedule* schedule = nullptr );
+
+  ///
+  /// @brief One variant's gains
+  ///
+  struct Gains
+  {
+    double    mPidP;
+    double    mPidI;
+    double    mPidD;
+  };
+
+  ///
+  /// @brief How a variant did over the recording
+  ///
+  struct Result
+  {
+    double      mRmsPower;            // RMS motor power
+    double      mRmsDifference;       // RMS difference from the recorded motor power, 0 if none
+    double      mMaxDifference;       // Largest difference from the recorded motor power
+    size_type   mMaxDifferenceTick;   // The tick it was on
+    size_type   mSaturatedTicks;      // Ticks the motor power was clamped
+  };
+
+  ///
+  /// @brief Constructor
+  ///
+  /// @param[in] variants - Gains for each variant
+  ///
+  explicit ControllerReplay( const std::vector<Gains>& variants );
+
+  // Remove operations people shouldn't be using.
+  ControllerReplay() = delete;
+  ControllerReplay( const ControllerReplay& other ) = delete;
+  ControllerReplay& operator=( const ControllerReplay& other ) = delete;
+
+  ///
+  /// @brief Scale every variant's gains with a gain schedule
+  ///
+  /// @param[in] schedule - The schedule.  The replay keeps its own copy.
+  ///
+  void setGainSchedule( const GainSchedule& schedule );
+
+  ///
+  /// @brief Replay a recording through every variant, from a fresh start
+  ///
+  /// @param[in] recording    - The recording
+  /// @param[out] motorPowers - If given, every variant's motor power each
+  ///                           tick.  Tick major, i.e., motorPowers[ tick *
+  ///                           size() + variant ].
+  ///
+  void run( const Recording& recording, std::vector<double>* motorPowers = nullptr );
+
+  /// @brief Number of variants
+  [[nodiscard]] size_type size() const { return mNumVariants; }
+
+  ///
+  /// @brief How a variant did in the last run()
+  ///
+  /// @param[in] variant  - The variant
+  /// @return             - Its result
+  ///
+  [[nodiscard]] Result getResult( size_type variant ) const;
+
+  private:
+
+  size_type             mNumVariants;
+  size_type             mTicks = 0;       // Ticks in the last run
+  std::unique_ptr<GainSchedule> mGainSchedule;
+
+  // Settings
+  std::vector<double>   mPidP;
+  std::vector<double>   mPidI;
+  std::vector<double>   mPidD;
+
+  // What the last run did
+  std::vector<double>   mPower;           // This tick's motor power
+  std::vector<double>   mSumSquaredPower;
+  std::vector<double>   mSumSquaredDifference;
+  std::vector<double>   mMaxDifference;
+  std::vector<double>   mMaxDifferenceTick;   // Doubles, so the loop is all doubles
+  std::vector<double>   mSaturatedTicks;
+};
+
+}
+
+#endif
+
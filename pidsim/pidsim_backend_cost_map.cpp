@@ -0,0 +1,180 @@
+
+#include "pidsim_backend_cost_map.h"
+#include "pidsim_utils.h"
+#include <algorithm>
+#include <math.h>
+
+namespace PidSim {
+
+namespace {
+  // Keeps log( cost ) finite for perfect cells
+  constexpr double minLogCost = 1e-3;
+
+  // Neighbouring cells closer than 1/32 of the cost range look the same
+  // on screen, so there's no point refining between them.
+  constexpr double boundaryFraction = 1.0 / 32.0;
+
+  // The least number of arms worth giving a core of its own
+  constexpr std::size_t minArmsPerBatch = 16;
+
+  bool sameArm( const BatchSim::ArmSettings& a, const BatchSim::ArmSettings& b )
+  {
+    return a.mStartAngle      == b.mStartAngle
+        && a.mTargetAngle     == b.mTargetAngle
+        && a.mRollingFriction == b.mRollingFriction
+        && a.mSensorNoise     == b.mSensorNoise
+        && a.mSensorDelay     == b.mSensorDelay
+        && a.mMotorDelay      == b.mMotorDelay
+        && a.mProfileType     == b.mProfileType;
+  }
+}
+
+// The arm's gains don't count, they're what the map sweeps
+bool CostMap::Settings::operator==( const Settings& other ) const
+{
+  return mPlane     == other.mPlane
+      && mMetric    == other.mMetric
+      && mFixedGain == other.mFixedGain
+      && mTicks     == other.mTicks
+      && sameArm( mArm, other.mArm );
+}
+
+CostMap::CostMap( const Settings& settings ) :
+  mSettings { settings },
+  mCosts    ( maxResolution * maxResolution, -1.0 ),
+  mMinCost  { INFINITY },
+  mMaxCost  { -INFINITY }
+{
+  startLevel();
+}
+
+//
+// 1. Set up the arms for the next chunk of cells
+// 2. Simulate them, spread over the cores
+// 3. Record the costs
+// 4. Move on to the next level if this one's done
+//
+bool CostMap::refine( std::size_t maxCells )
+{
+  if ( mComplete ) {
+    return false;
+  }
+
+  // 1. Set up the arms for the next chunk of cells
+  const std::size_t count = std::min( maxCells, mQueue.size() - mNext );
+  const double gainScale = maxGain / static_cast<double>( mResolution );
+  std::vector<BatchSim::ArmSettings> arms( count, mSettings.mArm );
+  for ( std::size_t i = 0; i < count; ++i ) {
+    const Cell& cell = mQueue[ mNext + i ];
+    const double kp = ( static_cast<double>( cell.mX ) + 0.5 ) * gainScale;
+    const double ky = ( static_cast<double>( cell.mY ) + 0.5 ) * gainScale;
+    const bool kd = mSettings.mPlane == StabilityMap::Plane::KpKd;
+    arms[ i ].mPidP = kp;
+    arms[ i ].mPidI = kd ? mSettings.mFixedGain : ky;
+    arms[ i ].mPidD = kd ? ky : mSettings.mFixedGain;
+    // The noise goes with the cell, not the arm's place in a batch.  A level
+    // of resolution r uses streams r^2 to 2r^2-1, so no two cells share one.
+    arms[ i ].mNoiseStream = mResolution * mResolution + cell.mY * mResolution + cell.mX;
+  }
+
+  // 2. Simulate them, spread over the cores
+  std::vector<double> costs( count );
+  const std::size_t batches = std::max<std::size_t>( 1, std::min<std::size_t>(
+    std::thread::hardware_concurrency(), count / minArmsPerBatch ));
+  Utils::parallelFor( batches, [&]( std::size_t batch ) {
+    const std::size_t begin = count * batch / batches;
+    const std::size_t end   = count * ( batch + 1 ) / batches;
+    BatchSim sim( std::vector<BatchSim::ArmSettings>( arms.begin() + begin, arms.begin() + end ));
+    sim.run( mSettings.mTicks );
+    for ( std::size_t arm = 0; arm < sim.size(); ++arm ) {
+      const StepMetrics::Result metrics = sim.getMetrics( arm );
+      costs[ begin + arm ] = mSettings.mMetric == Metric::ITAE ? metrics.mITAE : metrics.mSettlingTime;
+    }
+  });
+
+  // 3. Record the costs
+  for ( std::size_t i = 0; i < count; ++i ) {
+    paint( mQueue[ mNext + i ], costs[ i ] );
+  }
+  mNext += count;
+  mSimulated += count;
+
+  // 4. Move on to the next level if this one's done
+  if ( mNext == mQueue.size() ) {
+    startLevel();
+  }
+  return count > 0;
+}
+
+//
+// The first level simulates every cell.  Later levels split the cells on
+// a boundary into 4, and leave the rest alone.  A level with no boundary
+// cells is skipped straight over.
+//
+void CostMap::startLevel()
+{
+  mQueue.clear();
+  mNext = 0;
+
+  if ( mResolution == 0 ) {
+    mResolution = startResolution;
+    for ( std::size_t y = 0; y < mResolution; ++y ) {
+      for ( std::size_t x = 0; x < mResolution; ++x ) {
+        mQueue.push_back( { x, y } );
+      }
+    }
+    return;
+  }
+
+  while ( mQueue.empty() ) {
+    if ( mResolution == maxResolution ) {
+      mComplete = true;
+      return;
+    }
+    for ( std::size_t y = 0; y < mResolution; ++y ) {
+      for ( std::size_t x = 0; x < mResolution; ++x ) {
+        if ( isBoundary( x, y )) {
+          mQueue.push_back( { 2*x,   2*y   } );
+          mQueue.push_back( { 2*x+1, 2*y   } );
+          mQueue.push_back( { 2*x,   2*y+1 } );
+          mQueue.push_back( { 2*x+1, 2*y+1 } );
+        }
+      }
+    }
+    mResolution *= 2;
+  }
+}
+
+// Fill in the cell's block at the finest resolution
+void CostMap::paint( const Cell& cell, double cost )
+{
+  const std::size_t block = maxResolution / mResolution;
+  for ( std::size_t y = cell.mY * block; y < ( cell.mY + 1 ) * block; ++y ) {
+    std::fill_n( &mCosts[ y * maxResolution + cell.mX * block ], block, cost );
+  }
+  mMinCost = std::min( mMinCost, cost );
+  mMaxCost = std::max( mMaxCost, cost );
+}
+
+// A cell's cost at the current level.  Its whole block has the same cost.
+double CostMap::levelCost( std::size_t x, std::size_t y ) const
+{
+  const std::size_t block = maxResolution / mResolution;
+  return log( std::max( getCost( x * block, y * block ), minLogCost ));
+}
+
+// Is a cell different enough from any of its neighbours to refine?
+bool CostMap::isBoundary( std::size_t x, std::size_t y ) const
+{
+  const double range = log( std::max( mMaxCost, minLogCost )) - log( std::max( mMinCost, minLogCost ));
+  const double threshold = range * boundaryFraction;
+  const double cost = levelCost( x, y );
+  const bool left   = x > 0                && std::abs( cost - levelCost( x-1, y )) > threshold;
+  const bool right  = x + 1 < mResolution  && std::abs( cost - levelCost( x+1, y )) > threshold;
+  const bool down   = y > 0                && std::abs( cost - levelCost( x, y-1 )) > threshold;
+  const bool up     = y + 1 < mResolution  && std::abs( cost - levelCost( x, y+1 )) > threshold;
+  return left || right || down || up;
+}
+
+}
+
@@ -0,0 +1,138 @@
+#ifndef __PIDSIM_BACKEND_COST_MAP_H__
+#define __PIDSIM_BACKEND_COST_MAP_H__
+
+#include <cstddef>
+#include <vector>
+#include "pidsim_backend_batch_sim.h"
+#include "pidsim_backend_stability_map.h"
+
+namespace PidSim {
+
+///
+/// @brief Step response cost over a plane of PID gains, refined progressively
+///
+/// Unlike StabilityMap, every cell is a full nonlinear simulation (via
+/// BatchSim), so motor limits, hard stops and noise all count.  That's
+/// too much work to do all at once, so the map starts at 8x8 and doubles
+/// its resolution up to 256x256.  Each level only simulates the children
+/// of cells whose cost differs from a neighbour's by more than the colour
+/// map can show.  Everywhere else the children just inherit the parent's
+/// cost, so smooth regions stay cheap and detail goes to the boundaries.
+///
+/// Work is done in small chunks through refine(), so the caller decides
+/// how much time to spend per frame.  There's nothing to cancel - a map
+/// for old settings is just dropped.
+///
+class CostMap
+{
+  public:
+
+  /// @brief The number of cells along each side of the first level
+  static constexpr std::size_t startResolution = 8;
+
+  /// @brief The number of cells along each side of the last level
+  static constexpr std::size_t maxResolution = 256;
+
+  /// @brief The biggest gain on each axis, as per the front end's PID sliders
+  static constexpr double maxGain = StabilityMap::maxGain;
+
+  /// @brief The cost to map
+  enum class Metric
+  {
+    ITAE,
+    SettlingTime
+  };
+
+  ///
+  /// @brief Everything the map depends on
+  ///
+  struct Settings
+  {
+    StabilityMap::Plane     mPlane      = StabilityMap::Plane::KpKd;
+    Metric                  mMetric     = Metric::ITAE;
+    double                  mFixedGain  = 0.0;    // Ki for a Kp/Kd map, Kd for a Kp/Ki map
+    unsigned                mTicks      = 250;    // How long to simulate each cell
+    BatchSim::ArmSettings   mArm;                 // Everything else.  The gains are ignored.
+
+    bool operator==( const Settings& other ) const;
+    bool operator!=( const Settings& other ) const { return !( *this == other ); }
+  };
+
+  ///
+  /// @brief Constructor.  No cells are simulated yet.
+  ///
+  /// @param[in] settings - What to map
+  ///
+  explicit CostMap( const Settings& settings );
+
+  // Remove constructors I probably never want (i.e., if used they're a bug)
+  CostMap() = delete;
+
+  ///
+  /// @brief Simulate some more cells
+  ///
+  /// @param[in] maxCells - The most cells to simulate.  They're simulated
+  ///                       together, in one batch.
+  /// @return             - True if the map changed
+  ///
+  bool refine( std::size_t maxCells );
+
+  /// @brief Is the map as fine as it will get?
+  [[nodiscard]] bool isComplete() const { return mComplete; }
+
+  /// @brief The resolution of the level being worked on (or the last level, when complete)
+  [[nodiscard]] std::size_t getResolution() const { return mResolution; }
+
+  /// @brief The number of cells simulated so far
+  [[nodiscard]] std::size_t getSimulated() const { return mSimulated; }
+
+  ///
+  /// @brief Get a cell's cost, at the finest resolution
+  ///
+  /// @param[in] x    - The Kp index, from 0 to maxResolution-1
+  /// @param[in] y    - The Kd or Ki index, from 0 to maxResolution-1
+  /// @return         - The cost, or a negative number if it's not known yet
+  ///
+  [[nodiscard]] double getCost( std::size_t x, std::size_t y ) const
+  {
+    return mCosts[ y * maxResolution + x ];
+  }
+
+  /// @brief The lowest cost found so far
+  [[nodiscard]] double getMinCost() const { return mMinCost; }
+
+  /// @brief The highest cost found so far
+  [[nodiscard]] double getMaxCost() const { return mMaxCost; }
+
+  /// @brief The settings the map was built with
+  [[nodiscard]] const Settings& getSettings() const { return mSettings; }
+
+  private:
+
+  // A cell at the current level
+  struct Cell
+  {
+    std::size_t mX;
+    std::size_t mY;
+  };
+
+  void startLevel();
+  void paint( const Cell& cell, double cost );
+  double levelCost( std::size_t x, std::size_t y ) const;
+  bool isBoundary( std::size_t x, std::size_t y ) const;
+
+  Settings              mSettings;
+  std::vector<double>   mCosts;               // maxResolution^2, row major
+  std::vector<Cell>     mQueue;               // Cells to simulate at this level
+  std::size_t           mNext         = 0;    // Next cell in mQueue
+  std::size_t           mResolution   = 0;
+  std::size_t           mSimulated    = 0;
+  bool                  mComplete     = false;
+  double                mMinCost;
+  double                mMaxCost;
+};
+
+}
+
+#endif
+
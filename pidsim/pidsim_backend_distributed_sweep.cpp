@@ -0,0 +1,744 @@
+
+#include "pidsim_backend_distributed_sweep.h"
+#include "pidsim_backend_batch_run.h"
+#include <algorithm>
+#include <assert.h>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace PidSim {
+
+namespace {
+  // Every message is [ type, payload words ], then the payload.  Both
+  // ends start with a hello of [ magic, protocol version, BatchSim's
+  // results version ], so mismatched builds don't mix results.
+  constexpr std::uint64_t protocolMagic     = 0x5045455753534450ull;  // "PDSSWEEP"
+  constexpr std::uint64_t protocolVersion   = 2;
+  constexpr std::size_t   headerWords       = 2;
+  constexpr std::size_t   wordSize          = sizeof( std::uint64_t );
+
+  // Anything bigger is garbage, not a message
+  constexpr std::uint64_t maxPayloadWords   = 1ull << 26;
+
+  enum MessageType : std::uint64_t
+  {
+    helloMessage  = 1,    // The hello above
+    sweepMessage  = 2,    // [ ticks, seed, the arm, axes, ( column, min, max ) per axis ]
+    chunkMessage  = 3,    // [ id, first, count ]
+    resultMessage = 4,    // [ id, count, resultWords per run ]
+    leaveMessage  = 5     // [], from a worker that's done enough, before it hangs up
+  };
+
+  // The arm is BatchRun's parameter columns, then the profile type & limits,
+  // noise stream and antithetic flag
+  constexpr std::size_t   armWords          = BatchRun::numParameters + 6;
+  constexpr std::size_t   sweepFixedWords   = 3 + armWords;
+  constexpr std::size_t   axisWords         = 3;
+
+  // StepMetrics::Result's doubles, then settled
+  constexpr std::size_t   resultWords       = 9;
+
+  // How often the coordinator looks at the clock when nothing's happening
+  constexpr int           pollMilliseconds  = 100;
+
+  std::uint64_t toWord( double value )
+  {
+    std::uint64_t word;
+    std::memcpy( &word, &value, sizeof( word ));
+    return word;
+  }
+
+  double toDouble( std::uint64_t word )
+  {
+    double value;
+    std::memcpy( &value, &word, sizeof( value ));
+    return value;
+  }
+
+  std::vector<std::uint64_t> helloPayload()
+  {
+    return { protocolMagic, protocolVersion, BatchSim::resultsVersion };
+  }
+
+  bool checkHello( const std::vector<std::uint64_t>& payload, std::string& error )
+  {
+    if ( payload.size() != 3 || payload[ 0 ] != protocolMagic ) {
+      error = "not a sweep worker or coordinator";
+      return false;
+    }
+    if ( payload[ 1 ] != protocolVersion || payload[ 2 ] != BatchSim::resultsVersion ) {
+      error = "protocol version " + std::to_string( payload[ 1 ] ) + " and results version "
+            + std::to_string( payload[ 2 ] ) + " at the other end, but " + std::to_string( protocolVersion )
+            + " and " + std::to_string( BatchSim::resultsVersion ) + " here";
+      return false;
+    }
+    return true;
+  }
+
+  // The column an axis sets
+  std::size_t axisColumn( double BatchSim::ArmSettings::* setting )
+  {
+    const auto begin = std::begin( BatchRun::parameterSettings );
+    const auto end   = std::end( BatchRun::parameterSettings );
+    return static_cast<std::size_t>( std::find( begin, end, setting ) - begin );
+  }
+
+  std::vector<std::uint64_t> encodeSweep( const ParameterSweep::Settings& settings )
+  {
+    std::vector<std::uint64_t> payload = { settings.mTicks, settings.mSeed };
+    const BatchSim::ArmSettings& arm = settings.mArm;
+    for ( double BatchSim::ArmSettings::* setting : BatchRun::parameterSettings ) {
+      payload.push_back( toWord( arm.*setting ));
+    }
+    payload.push_back( static_cast<std::uint64_t>( arm.mProfileType ));
+    payload.push_back( toWord( arm.mProfileLimits.mMaxVel ));
+    payload.push_back( toWord( arm.mProfileLimits.mMaxAccel ));
+    payload.push_back( toWord( arm.mProfileLimits.mMaxJerk ));
+    payload.push_back( arm.mNoiseStream );
+    payload.push_back( arm.mAntitheticNoise ? 1 : 0 );
+    payload.push_back( settings.mAxes.size() );
+    for ( const ParameterSweep::Axis& axis : settings.mAxes ) {
+      payload.push_back( axisColumn( axis.mSetting ));
+      payload.push_back( toWord( axis.mMin ));
+      payload.push_back( toWord( axis.mMax ));
+    }
+    return payload;
+  }
+
+  bool decodeSweep( const std::vector<std::uint64_t>& payload, ParameterSweep::Settings& settings, std::string& error )
+  {
+    if ( payload.size() < sweepFixedWords
+      || payload[ sweepFixedWords - 1 ] > Utils::Sobol::maxDimensions
+      || payload.size() != sweepFixedWords + payload[ sweepFixedWords - 1 ] * axisWords ) {
+      error = "the coordinator sent a bad sweep";
+      return false;
+    }
+    settings.mTicks = static_cast<unsigned>( payload[ 0 ] );
+    settings.mSeed  = payload[ 1 ];
+    const std::uint64_t* word = &payload[ 2 ];
+    BatchSim::ArmSettings& arm = settings.mArm;
+    for ( double BatchSim::ArmSettings::* setting : BatchRun::parameterSettings ) {
+      arm.*setting = toDouble( *word++ );
+    }
+    if ( *word > static_cast<std::uint64_t>( MotionProfile::Type::SCurve )) {
+      error = "the coordinator sent a profile this build doesn't know";
+      return false;
+    }
+    arm.mProfileType            = static_cast<MotionProfile::Type>( *word++ );
+    arm.mProfileLimits.mMaxVel   = toDouble( *word++ );
+    arm.mProfileLimits.mMaxAccel = toDouble( *word++ );
+    arm.mProfileLimits.mMaxJerk  = toDouble( *word++ );
+    arm.mNoiseStream            = *word++;
+    arm.mAntitheticNoise        = *word++ != 0;
+    settings.mAxes.resize( *word++ );
+    for ( ParameterSweep::Axis& axis : settings.mAxes ) {
+      if ( word[ 0 ] >= BatchRun::numParameters ) {
+        error = "the coordinator sent a bad sweep";
+        return false;
+      }
+      axis.mSetting = BatchRun::parameterSettings[ word[ 0 ]];
+      axis.mMin     = toDouble( word[ 1 ] );
+      axis.mMax     = toDouble( word[ 2 ] );
+      word += axisWords;
+    }
+    return true;
+  }
+
+  void encodeResult( const StepMetrics::Result& result, std::vector<std::uint64_t>& payload )
+  {
+    payload.push_back( toWord( result.mRiseTime ));
+    payload.push_back( toWord( result.mOvershoot ));
+    payload.push_back( toWord( result.mSettlingTime ));
+    payload.push_back( toWord( result.mSteadyStateError ));
+    payload.push_back( toWord( result.mIAE ));
+    payload.push_back( toWord( result.mISE ));
+    payload.push_back( toWord( result.mITAE ));
+    payload.push_back( toWord( result.mControlEffort ));
+    payload.push_back( result.mSettled ? 1 : 0 );
+  }
+
+  StepMetrics::Result decodeResult( const std::uint64_t* word )
+  {
+    return { toDouble( word[ 0 ] ), toDouble( word[ 1 ] ), toDouble( word[ 2 ] ), toDouble( word[ 3 ] ),
+             toDouble( word[ 4 ] ), toDouble( word[ 5 ] ), toDouble( word[ 6 ] ), toDouble( word[ 7 ] ),
+             word[ 8 ] != 0 };
+  }
+
+  bool sendMessage( int socket, std::uint64_t type, const std::vector<std::uint64_t>& payload )
+  {
+    std::vector<std::uint64_t> message = { type, payload.size() };
+    message.insert( message.end(), payload.begin(), payload.end() );
+    const char* bytes = reinterpret_cast<const char*>( message.data() );
+    std::size_t left = message.size() * wordSize;
+    while ( left > 0 ) {
+      const ssize_t sent = send( socket, bytes, left, MSG_NOSIGNAL );
+      if ( sent < 0 && errno == EINTR ) {
+        continue;
+      }
+      if ( sent <= 0 ) {
+        return false;
+      }
+      bytes += sent;
+      left  -= static_cast<std::size_t>( sent );
+    }
+    return true;
+  }
+
+  // Read exactly size bytes
+  bool receiveAll( int socket, void* data, std::size_t size )
+  {
+    char* bytes = static_cast<char*>( data );
+    std::size_t got = 0;
+    while ( got < size ) {
+      const ssize_t read = recv( socket, bytes + got, size - got, 0 );
+      if ( read < 0 && errno == EINTR ) {
+        continue;
+      }
+      if ( read <= 0 ) {
+        return false;
+      }
+      got += static_cast<std::size_t>( read );
+    }
+    return true;
+  }
+
+  bool receiveMessage( int socket, std::uint64_t& type, std::vector<std::uint64_t>& payload )
+  {
+    std::uint64_t header[ headerWords ];
+    if ( !receiveAll( socket, header, sizeof( header )) || header[ 1 ] > maxPayloadWords ) {
+      return false;
+    }
+    type = header[ 0 ];
+    payload.resize( header[ 1 ] );
+    return payload.empty() || receiveAll( socket, payload.data(), payload.size() * wordSize );
+  }
+
+  //
+  // 1. Split the address into a Unix path, or a host and port
+  // 2. Bind & listen, or connect, to the first address that works
+  // 3. Work out the real address, if a port was picked for us
+  //
+  int openSocket( const std::string& address, bool listening, std::string& error, std::string* bound )
+  {
+    // 1. Split the address
+    const std::string unixPrefix = "unix:";
+    if ( address.compare( 0, unixPrefix.size(), unixPrefix ) == 0 ) {
+      const std::string path = address.substr( unixPrefix.size() );
+      sockaddr_un name{};
+      if ( path.empty() || path.size() >= sizeof( name.sun_path )) {
+        error = "bad socket path " + path;
+        return -1;
+      }
+      name.sun_family = AF_UNIX;
+      std::memcpy( name.sun_path, path.c_str(), path.size() );
+      const int socket = ::socket( AF_UNIX, SOCK_STREAM, 0 );
+      if ( socket < 0 ) {
+        error = std::string( "couldn't make a socket: " ) + strerror( errno );
+        return -1;
+      }
+      // A crashed coordinator leaves its socket file behind
+      if ( listening ) {
+        unlink( path.c_str() );
+      }
+      const sockaddr* generic = reinterpret_cast<const sockaddr*>( &name );
+      if ( listening ? bind( socket, generic, sizeof( name )) != 0 || ::listen( socket, SOMAXCONN ) != 0
+                     : connect( socket, generic, sizeof( name )) != 0 ) {
+        error = "couldn't " + std::string( listening ? "listen on " : "connect to " ) + address + ": "
+              + strerror( errno );
+        close( socket );
+        return -1;
+      }
+      if ( bound ) {
+        *bound = address;
+      }
+      return socket;
+    }
+    const std::size_t colon = address.rfind( ':' );
+    if ( colon == std::string::npos ) {
+      error = "bad address " + address + ", expected unix:<path> or <host>:<port>";
+      return -1;
+    }
+    std::string host = address.substr( 0, colon );
+    const std::string port = address.substr( colon + 1 );
+    const bool anyHost = host.empty() || host == "*";
+
+    // 2. Bind & listen, or connect
+    addrinfo hints{};
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags    = listening ? AI_PASSIVE : 0;
+    addrinfo* found = nullptr;
+    if ( const int status = getaddrinfo( anyHost ? nullptr : host.c_str(), port.c_str(), &hints, &found )) {
+      error = "couldn't look up " + address + ": " + gai_strerror( status );
+      return -1;
+    }
+    int socket = -1;
+    error = "couldn't " + std::string( listening ? "listen on " : "connect to " ) + address;
+    for ( addrinfo* candidate = found; candidate && socket < 0; candidate = candidate->ai_next ) {
+      socket = ::socket( candidate->ai_family, candidate->ai_socktype, candidate->ai_protocol );
+      if ( socket < 0 ) {
+        continue;
+      }
+      const int on = 1;
+      if ( listening ) {
+        setsockopt( socket, SOL_SOCKET, SO_REUSEADDR, &on, sizeof( on ));
+      }
+      else {
+        setsockopt( socket, IPPROTO_TCP, TCP_NODELAY, &on, sizeof( on ));
+      }
+      if ( listening ? bind( socket, candidate->ai_addr, candidate->ai_addrlen ) != 0
+                    || ::listen( socket, SOMAXCONN ) != 0
+                     : connect( socket, candidate->ai_addr, candidate->ai_addrlen ) != 0 ) {
+        error += std::string( ": " ) + strerror( errno );
+        close( socket );
+        socket = -1;
+      }
+    }
+    freeaddrinfo( found );
+    if ( socket < 0 ) {
+      return -1;
+    }
+
+    // 3. Work out the real address
+    if ( bound ) {
+      sockaddr_storage name{};
+      socklen_t length = sizeof( name );
+      getsockname( socket, reinterpret_cast<sockaddr*>( &name ), &length );
+      const int realPort = name.ss_family == AF_INET6 ? ntohs( reinterpret_cast<sockaddr_in6*>( &name )->sin6_port )
+                                                      : ntohs( reinterpret_cast<sockaddr_in*>( &name )->sin_port );
+      if ( anyHost ) {
+        char hostName[ 256 ] = {};
+        gethostname( hostName, sizeof( hostName ) - 1 );
+        host = hostName;
+      }
+      *bound = host + ":" + std::to_string( realPort );
+    }
+    return socket;
+  }
+}
+
+SweepCoordinator::SweepCoordinator( const ParameterSweep::Settings& settings, const Options& options ) :
+  mOptions      { options },
+  mSweepMessage { encodeSweep( settings ) }
+{
+  assert( options.mChunkSize > 0 && options.mChunksPerWorker > 0 && options.mMaxAttempts > 0 );
+  for ( const ParameterSweep::Axis& axis : settings.mAxes ) {
+    assert( axisColumn( axis.mSetting ) < BatchRun::numParameters );
+    (void) axis;
+  }
+}
+
+SweepCoordinator::~SweepCoordinator()
+{
+  for ( Worker& worker : mWorkers ) {
+    close( worker.mSocket );
+  }
+  if ( mListener >= 0 ) {
+    close( mListener );
+  }
+  if ( !mUnixPath.empty() ) {
+    unlink( mUnixPath.c_str() );
+  }
+}
+
+// See header for interface
+bool SweepCoordinator::listen( const std::string& address, std::string& error )
+{
+  assert( mListener < 0 );
+  mListener = openSocket( address, true, error, &mAddress );
+  if ( mListener >= 0 && address.compare( 0, 5, "unix:" ) == 0 ) {
+    mUnixPath = address.substr( 5 );
+  }
+  return mListener >= 0;
+}
+
+// See header for interface
+void SweepCoordinator::accept()
+{
+  const int socket = ::accept( mListener, nullptr, nullptr );
+  if ( socket < 0 ) {
+    return;
+  }
+  // Notice workers on machines that went away without a word
+  const int on = 1;
+  setsockopt( socket, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof( on ));
+  setsockopt( socket, IPPROTO_TCP, TCP_NODELAY, &on, sizeof( on ));
+  if ( !sendMessage( socket, helloMessage, helloPayload() ) || !sendMessage( socket, sweepMessage, mSweepMessage )) {
+    close( socket );
+    return;
+  }
+  Worker worker;
+  worker.mSocket = socket;
+  mWorkers.push_back( std::move( worker ));
+}
+
+//
+// 1. Read whatever's waiting
+// 2. Act on each whole message
+//
+bool SweepCoordinator::receive( Worker& worker, std::vector<std::vector<StepMetrics::Result>>& finished,
+                                std::string& error )
+{
+  // 1. Read whatever's waiting.  A worker that hangs up may have sent
+  //    results first.
+  unsigned char buffer[ 1 << 16 ];
+  bool hungUp = false;
+  while ( !hungUp ) {
+    const ssize_t read = recv( worker.mSocket, buffer, sizeof( buffer ), MSG_DONTWAIT );
+    if ( read > 0 ) {
+      worker.mInput.insert( worker.mInput.end(), buffer, buffer + read );
+    }
+    else if ( read < 0 && errno == EINTR ) {
+      continue;
+    }
+    else if ( read < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK )) {
+      break;
+    }
+    else {
+      hungUp = true;
+    }
+  }
+
+  // 2. Act on each whole message
+  std::size_t used = 0;
+  std::vector<std::uint64_t> payload;
+  while ( worker.mInput.size() - used >= headerWords * wordSize ) {
+    std::uint64_t header[ headerWords ];
+    std::memcpy( header, &worker.mInput[ used ], sizeof( header ));
+    if ( header[ 1 ] > maxPayloadWords ) {
+      return false;
+    }
+    const std::size_t size = sizeof( header ) + header[ 1 ] * wordSize;
+    if ( worker.mInput.size() - used < size ) {
+      break;
+    }
+    payload.resize( header[ 1 ] );
+    std::memcpy( payload.data(), &worker.mInput[ used + sizeof( header ) ], payload.size() * wordSize );
+    used += size;
+
+    if ( !worker.mReady ) {
+      std::string ignored;
+      if ( header[ 0 ] != helloMessage || !checkHello( payload, ignored )) {
+        return false;
+      }
+      worker.mReady = true;
+      continue;
+    }
+    if ( header[ 0 ] == leaveMessage ) {
+      worker.mLeaving = true;
+      continue;
+    }
+    if ( header[ 0 ] != resultMessage || payload.size() < 2 ) {
+      return false;
+    }
+    const std::uint64_t id = payload[ 0 ];
+    const auto held = std::find( worker.mHeld.begin(), worker.mHeld.end(), id );
+    if ( held == worker.mHeld.end() ) {
+      return false;
+    }
+    worker.mHeld.erase( held );
+    worker.mProgress = Clock::now();
+
+    // A copy from an earlier run
+    if ( id < mChunkBase || id - mChunkBase >= mChunks.size() ) {
+      continue;
+    }
+    const std::size_t index = static_cast<std::size_t>( id - mChunkBase );
+    Chunk& chunk = mChunks[ index ];
+    --chunk.mHolders;
+    if ( payload[ 1 ] != chunk.mCount || payload.size() != 2 + chunk.mCount * resultWords ) {
+      error = "a worker sent a bad result";
+      return false;
+    }
+    if ( chunk.mDone ) {
+      ++mReport.mDiscarded;
+      continue;
+    }
+    chunk.mDone = true;
+    finished[ index ].resize( chunk.mCount );
+    for ( std::size_t run = 0; run < chunk.mCount; ++run ) {
+      finished[ index ][ run ] = decodeResult( &payload[ 2 + run * resultWords ] );
+    }
+  }
+  worker.mInput.erase( worker.mInput.begin(), worker.mInput.begin() + static_cast<std::ptrdiff_t>( used ));
+  return !hungUp;
+}
+
+//
+// Queued chunks first.  With the queue empty, an idle worker takes a
+// copy of the earliest chunk only one worker holds, since that's the one
+// holding up the results.
+//
+bool SweepCoordinator::deal( Worker& worker )
+{
+  while ( worker.mReady && !worker.mLeaving && worker.mHeld.size() < mOptions.mChunksPerWorker ) {
+    std::size_t index = mChunks.size();
+    if ( !mQueue.empty() ) {
+      index = mQueue.front();
+      mQueue.pop_front();
+    }
+    else if ( worker.mHeld.empty() ) {
+      for ( std::size_t candidate = 0; candidate < mChunks.size(); ++candidate ) {
+        if ( !mChunks[ candidate ].mDone && mChunks[ candidate ].mHolders == 1 ) {
+          index = candidate;
+          ++mReport.mStolen;
+          break;
+        }
+      }
+    }
+    if ( index == mChunks.size() ) {
+      break;
+    }
+    Chunk& chunk = mChunks[ index ];
+    ++chunk.mHolders;
+    if ( worker.mHeld.empty() ) {
+      worker.mProgress = Clock::now();
+    }
+    worker.mHeld.push_back( mChunkBase + index );
+    worker.mTookPart = true;
+    if ( !sendMessage( worker.mSocket, chunkMessage, { mChunkBase + index, chunk.mFirst, chunk.mCount } )) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// See header for interface
+bool SweepCoordinator::drop( Worker& worker, std::string& error )
+{
+  close( worker.mSocket );
+  worker.mSocket = -1;
+  bool ok = true;
+  // Latest first, so the earliest ends up at the front of the queue, and
+  // in the error
+  for ( auto held = worker.mHeld.rbegin(); held != worker.mHeld.rend(); ++held ) {
+    const std::uint64_t id = *held;
+    if ( id < mChunkBase || id - mChunkBase >= mChunks.size() ) {
+      continue;
+    }
+    const std::size_t index = static_cast<std::size_t>( id - mChunkBase );
+    Chunk& chunk = mChunks[ index ];
+    if ( --chunk.mHolders > 0 || chunk.mDone ) {
+      continue;
+    }
+    if ( !worker.mLeaving && ++chunk.mLost >= mOptions.mMaxAttempts ) {
+      error = "runs " + std::to_string( chunk.mFirst ) + " to " + std::to_string( chunk.mFirst + chunk.mCount - 1 )
+            + " were lost " + std::to_string( chunk.mLost ) + " times";
+      ok = false;
+    }
+    mQueue.push_front( index );
+    ++mReport.mRetried;
+  }
+  worker.mHeld.clear();
+  return ok;
+}
+
+//
+// 1. Split the range into chunks, all queued
+// 2. Until every result has gone to the sink:
+//    a. Deal chunks to workers with room
+//    b. Wait for workers to say something, or for new ones
+//    c. Drop workers that hung up, misbehaved or stalled
+//    d. Hand the sink every finished chunk that's next in line
+//    e. Give up if there have been no workers for too long.  A connection
+//       that never said hello isn't a worker.
+//
+bool SweepCoordinator::run( std::uint64_t first, std::uint64_t count, const Sink& sink, std::string& error )
+{
+  assert( mListener >= 0 );
+
+  // 1. Split the range into chunks
+  mChunks.clear();
+  mQueue.clear();
+  mReport = Report();
+  for ( std::uint64_t start = first; start < first + count; start += mOptions.mChunkSize ) {
+    mQueue.push_back( mChunks.size() );
+    mChunks.push_back( { start, static_cast<std::size_t>( std::min<std::uint64_t>( mOptions.mChunkSize,
+                                                                                   first + count - start )) } );
+  }
+  mChunkBase = mNextId;
+  mNextId += mChunks.size();
+  mReport.mChunks = mChunks.size();
+  for ( Worker& worker : mWorkers ) {
+    worker.mTookPart = false;
+  }
+
+  // 2. Until every result has gone to the sink
+  std::vector<std::vector<StepMetrics::Result>> finished( mChunks.size() );
+  std::size_t next = 0;
+  Clock::time_point lastWorker = Clock::now();
+  bool ok = true;
+  // Only the first failure is reported
+  auto fail = [&]( const std::string& failure ) {
+    if ( ok ) {
+      error = failure;
+      ok = false;
+    }
+  };
+  std::string failure;
+  while ( ok && next < mChunks.size() ) {
+    // a. Deal chunks to workers with room
+    for ( Worker& worker : mWorkers ) {
+      if ( worker.mSocket >= 0 && !deal( worker ) && !drop( worker, failure )) {
+        fail( failure );
+      }
+    }
+
+    // b. Wait for workers to say something, or for new ones
+    std::vector<pollfd> polls = { { mListener, POLLIN, 0 } };
+    for ( const Worker& worker : mWorkers ) {
+      polls.push_back( { worker.mSocket, static_cast<short>( worker.mSocket >= 0 ? POLLIN : 0 ), 0 } );
+    }
+    if ( poll( polls.data(), polls.size(), pollMilliseconds ) < 0 && errno != EINTR ) {
+      error = std::string( "poll failed: " ) + strerror( errno );
+      return false;
+    }
+
+    // c. Drop workers that hung up, misbehaved or stalled
+    const Clock::time_point now = Clock::now();
+    for ( std::size_t index = 0; index < mWorkers.size(); ++index ) {
+      Worker& worker = mWorkers[ index ];
+      if ( worker.mSocket < 0 ) {
+        continue;
+      }
+      failure.clear();
+      bool keep = !( polls[ index + 1 ].revents & ( POLLIN | POLLHUP | POLLERR ))
+               || receive( worker, finished, failure );
+      if ( !failure.empty() ) {
+        fail( failure );
+      }
+      const std::chrono::duration<double> quiet = now - worker.mProgress;
+      if ( mOptions.mChunkTimeout > 0.0 && !worker.mHeld.empty() && quiet.count() > mOptions.mChunkTimeout ) {
+        keep = false;
+      }
+      if ( !keep && !drop( worker, failure )) {
+        fail( failure );
+      }
+    }
+    mReport.mWorkers += static_cast<std::size_t>( std::count_if( mWorkers.begin(), mWorkers.end(),
+      []( const Worker& worker ) { return worker.mSocket < 0 && worker.mTookPart; } ));
+    mWorkers.erase( std::remove_if( mWorkers.begin(), mWorkers.end(),
+                                    []( const Worker& worker ) { return worker.mSocket < 0; } ), mWorkers.end() );
+    if ( polls[ 0 ].revents & POLLIN ) {
+      accept();
+    }
+
+    // d. Hand the sink every finished chunk that's next in line
+    for ( ; next < mChunks.size() && mChunks[ next ].mDone; ++next ) {
+      sink( mChunks[ next ].mFirst, finished[ next ] );
+      finished[ next ] = std::vector<StepMetrics::Result>();
+    }
+
+    // e. Give up if there have been no workers for too long
+    if ( std::any_of( mWorkers.begin(), mWorkers.end(), []( const Worker& worker ) { return worker.mReady; } )) {
+      lastWorker = now;
+    }
+    else if ( std::chrono::duration<double>( now - lastWorker ).count() > mOptions.mIdleTimeout ) {
+      fail( "gave up waiting for workers" );
+    }
+  }
+  mReport.mWorkers += static_cast<std::size_t>( std::count_if( mWorkers.begin(), mWorkers.end(),
+    []( const Worker& worker ) { return worker.mTookPart; } ));
+  return ok;
+}
+
+// See header for interface
+bool SweepCoordinator::run( std::uint64_t first, std::size_t count, std::vector<StepMetrics::Result>& results,
+                            std::string& error )
+{
+  results.clear();
+  results.reserve( count );
+  return run( first, static_cast<std::uint64_t>( count ), [&]( std::uint64_t, const std::vector<StepMetrics::Result>& chunk ) {
+    results.insert( results.end(), chunk.begin(), chunk.end() );
+  }, error );
+}
+
+//
+// 1. Connect and say hello
+// 2. Check the coordinator's hello, and take its sweep
+// 3. Run each chunk and send its results back, until the coordinator
+//    hangs up or we've done enough
+// 4. If we've done enough, tell the coordinator we're leaving
+//
+bool SweepWorker::serve( const std::string& address, std::string& error, ResultCache* cache, std::size_t maxChunks )
+{
+  // 1. Connect and say hello
+  const int socket = openSocket( address, false, error, nullptr );
+  if ( socket < 0 ) {
+    return false;
+  }
+  if ( !sendMessage( socket, helloMessage, helloPayload() )) {
+    error = "couldn't talk to the coordinator";
+    close( socket );
+    return false;
+  }
+
+  bool greeted = false;
+  std::unique_ptr<ParameterSweep> sweep;
+  std::size_t chunks = 0;
+  std::uint64_t type;
+  std::vector<std::uint64_t> payload;
+  bool ok = true;
+  while ( ok && ( maxChunks == 0 || chunks < maxChunks )) {
+    // Once there's a sweep, the connection going away is the coordinator
+    // being done with us
+    if ( !receiveMessage( socket, type, payload )) {
+      ok = static_cast<bool>( sweep );
+      if ( !ok ) {
+        error = "lost the coordinator";
+      }
+      break;
+    }
+    // 2. Check the coordinator's hello, and take its sweep
+    if ( type == helloMessage ) {
+      ok = checkHello( payload, error );
+      greeted = ok;
+    }
+    else if ( type == sweepMessage && greeted ) {
+      ParameterSweep::Settings settings;
+      ok = decodeSweep( payload, settings, error );
+      if ( ok ) {
+        sweep = std::make_unique<ParameterSweep>( settings );
+      }
+    }
+    // 3. Run each chunk and send its results back
+    else if ( type == chunkMessage && sweep && payload.size() == 3 && payload[ 2 ] <= maxPayloadWords / resultWords ) {
+      const std::vector<StepMetrics::Result> results = sweep->run( payload[ 1 ], payload[ 2 ], cache );
+      std::vector<std::uint64_t> reply = { payload[ 0 ], results.size() };
+      reply.reserve( 2 + results.size() * resultWords );
+      for ( const StepMetrics::Result& result : results ) {
+        encodeResult( result, reply );
+      }
+      if ( !sendMessage( socket, resultMessage, reply )) {
+        break;
+      }
+      ++chunks;
+    }
+    else {
+      error = "the coordinator sent something unexpected";
+      ok = false;
+    }
+  }
+
+  // 4. If we've done enough, say so, so the chunks still held aren't
+  //    taken as lost
+  if ( ok && maxChunks > 0 && chunks == maxChunks ) {
+    sendMessage( socket, leaveMessage, {} );
+  }
+  close( socket );
+  return ok;
+}
+
+}
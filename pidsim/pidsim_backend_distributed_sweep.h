@@ -0,0 +1,216 @@
+#ifndef __PIDSIM_BACKEND_DISTRIBUTED_SWEEP_H__
+#define __PIDSIM_BACKEND_DISTRIBUTED_SWEEP_H__
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+#include "pidsim_backend_result_cache.h"
+#include "pidsim_backend_step_metrics.h"
+#include "pidsim_backend_sweep.h"
+
+namespace PidSim {
+
+///
+/// @brief Hand a ParameterSweep out to worker processes, a chunk at a time
+///
+/// ParameterSweep::run spreads a range of runs over one machine's cores.
+/// The coordinator splits a larger range into chunks and deals them out
+/// to SweepWorkers, which connect over a Unix domain socket (on the same
+/// box) or TCP (from anywhere), and each run a chunk on all their cores.
+///
+/// - Workers pull: each holds a couple of chunks, so it never waits on
+///   the network, and fast workers simply come back for more
+/// - Once every chunk is dealt out, an idle worker steals a copy of a
+///   chunk a slower worker is sitting on.  Whichever finishes first wins.
+/// - A worker that hangs up (or crashes, or stalls past mChunkTimeout)
+///   loses its chunks back to the front of the queue.  A chunk lost too
+///   many times fails the sweep.  A worker that says it's leaving gives
+///   its chunks back the same way, but they don't count as lost.
+/// - Results go to the caller in index order, as soon as each chunk and
+///   all the chunks before it are in
+///
+/// Since run i depends on the sweep's settings and i alone, the results
+/// are bit for bit what ParameterSweep::run gives, wherever each chunk
+/// ran.  Workers can join or leave at any time.
+///
+/// Addresses are "unix:<path>" or "<host>:<port>".  Everything on the wire
+/// is 64 bit words in the host's byte order, so the coordinator and its
+/// workers need the same byte order (i.e., any mix of x86 and ARM).
+///
+class SweepCoordinator
+{
+  public:
+
+  ///
+  /// @brief How the sweep is split up and dealt out
+  ///
+  struct Options
+  {
+    std::size_t   mChunkSize        = 4096;   // Runs per chunk
+    std::size_t   mChunksPerWorker  = 2;      // Chunks a worker holds at once
+    unsigned      mMaxAttempts      = 3;      // Workers a chunk can be lost by
+    double        mChunkTimeout     = 0.0;    // Seconds a worker can go without finishing a chunk.  0 is forever.
+    double        mIdleTimeout      = 60.0;   // Seconds to wait with work left and no workers
+  };
+
+  ///
+  /// @brief How the last run went
+  ///
+  struct Report
+  {
+    std::size_t   mChunks     = 0;    // Chunks in the sweep
+    std::size_t   mWorkers    = 0;    // Workers that took part
+    std::size_t   mRetried    = 0;    // Chunks a worker lost or gave back, dealt out again
+    std::size_t   mStolen     = 0;    // Copies dealt out to idle workers
+    std::size_t   mDiscarded  = 0;    // Copies that finished second
+  };
+
+  ///
+  /// @brief Where results go, in index order
+  ///
+  /// @param[in] first    - The first result's index
+  /// @param[in] results  - The runs from first on
+  ///
+  using Sink = std::function<void( std::uint64_t first, const std::vector<StepMetrics::Result>& results )>;
+
+  ///
+  /// @brief Constructor.  Nothing listens yet.
+  ///
+  /// @param[in] settings - The sweep
+  /// @param[in] options  - How it's dealt out
+  ///
+  explicit SweepCoordinator( const ParameterSweep::Settings& settings, const Options& options );
+
+  /// @brief Hangs up on the workers, which then return
+  ~SweepCoordinator();
+
+  // Remove operations people shouldn't be using.
+  SweepCoordinator() = delete;
+  SweepCoordinator( const SweepCoordinator& ) = delete;
+  SweepCoordinator& operator=( const SweepCoordinator& ) = delete;
+
+  ///
+  /// @brief Start taking workers
+  ///
+  /// @param[in]  address - "unix:<path>", or "<host>:<port>", where host
+  ///                       can be * for any interface and port 0 picks
+  ///                       a free one
+  /// @param[out] error   - What went wrong, if anything
+  /// @return             - True if listening
+  ///
+  bool listen( const std::string& address, std::string& error );
+
+  /// @brief The address workers should connect to, with the real port
+  [[nodiscard]] const std::string& getAddress() const { return mAddress; }
+
+  ///
+  /// @brief Run a range of the sweep on the workers
+  ///
+  /// Workers stay connected between runs.
+  ///
+  /// @param[in]  first   - The first run's index
+  /// @param[in]  count   - How many runs
+  /// @param[in]  sink    - Takes the results, in index order
+  /// @param[out] error   - What went wrong, if anything
+  /// @return             - True if every run's result went to the sink
+  ///
+  bool run( std::uint64_t first, std::uint64_t count, const Sink& sink, std::string& error );
+
+  ///
+  /// @brief Run a range of the sweep on the workers, keeping the results
+  ///
+  /// @param[in]  first   - The first run's index
+  /// @param[in]  count   - How many runs
+  /// @param[out] results - Each run's step response metrics, in index order
+  /// @param[out] error   - What went wrong, if anything
+  /// @return             - True if results has every run
+  ///
+  bool run( std::uint64_t first, std::size_t count, std::vector<StepMetrics::Result>& results, std::string& error );
+
+  /// @brief How the last run went
+  [[nodiscard]] const Report& getReport() const { return mReport; }
+
+  private:
+
+  using Clock = std::chrono::steady_clock;
+
+  struct Chunk
+  {
+    std::uint64_t   mFirst;
+    std::size_t     mCount;
+    std::size_t     mHolders  = 0;      // Workers with a copy
+    unsigned        mLost     = 0;      // Times every copy was lost
+    bool            mDone     = false;
+  };
+
+  struct Worker
+  {
+    int                         mSocket;
+    std::vector<unsigned char>  mInput;             // Bytes read, not yet a whole message
+    bool                        mReady    = false;  // Said hello
+    bool                        mLeaving  = false;  // Said it's leaving
+    std::vector<std::uint64_t>  mHeld;              // Ids of the chunks it's working on, oldest first
+    Clock::time_point           mProgress;          // Last finished a chunk, or was dealt one when idle
+    bool                        mTookPart = false;  // Was dealt a chunk this run
+  };
+
+  // Take a waiting connection
+  void accept();
+  // Read what a worker sent, and act on each whole message.  False if it
+  // should be dropped.
+  bool receive( Worker& worker, std::vector<std::vector<StepMetrics::Result>>& finished, std::string& error );
+  // Deal chunks to a worker until it's full, stealing if need be.  False
+  // if it couldn't be sent to.
+  bool deal( Worker& worker );
+  // Hang up on a worker, putting back its chunks.  Unless it said it was
+  // leaving they count as lost.  False if a chunk ran out of attempts.
+  bool drop( Worker& worker, std::string& error );
+
+  Options                           mOptions;
+  int                               mListener = -1;
+  std::string                       mAddress;
+  std::string                       mUnixPath;          // To remove, if listening on one
+  std::vector<Worker>               mWorkers;
+  std::vector<std::uint64_t>        mSweepMessage;      // Sent to each worker as it connects
+
+  // The run in progress.  Chunk ids go up across runs, so a late copy
+  // from the last run is known to be stale.
+  std::vector<Chunk>                mChunks;
+  std::uint64_t                     mChunkBase  = 0;    // Id of mChunks[ 0 ]
+  std::uint64_t                     mNextId     = 0;    // Id of the next run's first chunk
+  std::deque<std::size_t>           mQueue;             // Chunks nobody holds
+  Report                            mReport;
+};
+
+///
+/// @brief The other end of a SweepCoordinator
+///
+class SweepWorker
+{
+  public:
+
+  ///
+  /// @brief Connect to a coordinator and run chunks until it hangs up
+  ///
+  /// @param[in]  address   - The coordinator's address
+  /// @param[out] error     - What went wrong, if anything
+  /// @param[in]  cache     - If not null, runs found here aren't simulated
+  /// @param[in]  maxChunks - Leave after this many chunks, i.e., to give
+  ///                         the machine back.  0 is no limit.  The
+  ///                         coordinator is told, so the chunks still
+  ///                         held aren't counted as lost.
+  /// @return               - True once the coordinator hangs up (or
+  ///                         goes away) after sending its sweep, or the
+  ///                         limit is reached
+  ///
+  static bool serve( const std::string& address, std::string& error, ResultCache* cache = nullptr,
+                     std::size_t maxChunks = 0 );
+};
+
+}
+
+#endif
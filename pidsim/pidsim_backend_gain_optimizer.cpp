@@ -0,0 +1,254 @@
+
+#include "pidsim_backend_gain_optimizer.h"
+#include "pidsim_utils.h"
+#include <Eigen/Eigenvalues>
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <numeric>
+
+namespace PidSim {
+
+namespace {
+  // The number of gains searched
+  constexpr double dimensions = 3.0;
+
+  // Cost per gain unit^2 outside of 0..maxGain.  Candidates out there are
+  // simulated with their gains clamped, and this pushes the search back.
+  constexpr double boundaryPenalty = 10.0;
+
+  // Salt so the sample deviates don't line up with BatchSim's noise
+  constexpr std::uint64_t sampleSalt = 0x5ca1ab1e0ddba11ull;
+}
+
+//
+// Strategy parameters are the tutorial's defaults for 3 dimensions.
+//
+GainOptimizer::GainOptimizer( const Settings& settings ) :
+  mSettings   { settings },
+  mReport     { { settings.mArm.mPidP, settings.mArm.mPidI, settings.mArm.mPidD }, INFINITY, 0, 0, 0, 0, 0.0 },
+  mStopCost   { INFINITY },
+  mMu         { std::max<std::size_t>( 1, settings.mPopulation / 2 ) },
+  mMean       { settings.mArm.mPidP, settings.mArm.mPidI, settings.mArm.mPidD },
+  mSigma      { settings.mStartSigma },
+  mC          { Matrix::Identity() },
+  mB          { Matrix::Identity() },
+  mD          { Vector::Ones() },
+  mPathSigma  { Vector::Zero() },
+  mPathC      { Vector::Zero() }
+{
+  // Log weights for the best mu candidates
+  for ( std::size_t i = 0; i < mMu; ++i ) {
+    mWeights.push_back( log( static_cast<double>( mMu ) + 0.5 ) - log( static_cast<double>( i + 1 )));
+  }
+  const double sum = std::accumulate( mWeights.begin(), mWeights.end(), 0.0 );
+  double sumSquares = 0.0;
+  for ( double& weight : mWeights ) {
+    weight /= sum;
+    sumSquares += weight * weight;
+  }
+  mMuEff = 1.0 / sumSquares;
+
+  const double n = dimensions;
+  mCSigma = ( mMuEff + 2.0 ) / ( n + mMuEff + 5.0 );
+  mDSigma = 1.0 + 2.0 * std::max( 0.0, sqrt(( mMuEff - 1.0 ) / ( n + 1.0 )) - 1.0 ) + mCSigma;
+  mCC     = ( 4.0 + mMuEff / n ) / ( n + 4.0 + 2.0 * mMuEff / n );
+  mC1     = 2.0 / (( n + 1.3 ) * ( n + 1.3 ) + mMuEff );
+  mCMu    = std::min( 1.0 - mC1, 2.0 * ( mMuEff - 2.0 + 1.0 / mMuEff ) / (( n + 2.0 ) * ( n + 2.0 ) + mMuEff ));
+  mChiN   = sqrt( n ) * ( 1.0 - 1.0 / ( 4.0 * n ) + 1.0 / ( 21.0 * n * n ));
+}
+
+//
+// 1. Sample the population, x = mean + sigma * B * D * z
+// 2. Simulate it
+// 3. Move the distribution toward the best candidates
+// 4. Stop once the steps get tiny or we run out of generations
+//
+bool GainOptimizer::step()
+{
+  if ( mDone ) {
+    return true;
+  }
+  const auto start = std::chrono::steady_clock::now();
+
+  // 1. Sample the population
+  std::vector<Vector> candidates( std::max<std::size_t>( 2, mSettings.mPopulation ));
+  for ( Vector& candidate : candidates ) {
+    const Vector z{ normal(), normal(), normal() };
+    candidate = mMean + mSigma * ( mB * mD.cwiseProduct( z ));
+  }
+
+  // 2. Simulate it
+  const std::vector<double> costs = evaluate( candidates );
+
+  // 3. Move the distribution toward the best candidates
+  update( candidates, costs );
+
+  // 4. Stop once the steps get tiny or we run out of generations
+  ++mReport.mGenerations;
+  mDone = mReport.mGenerations >= mSettings.mMaxGenerations
+       || mSigma * mD.maxCoeff() < mSettings.mTolerance;
+
+  const std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+  mReport.mSeconds += time.count();
+  return mDone;
+}
+
+// See header for interface
+const GainOptimizer::Report& GainOptimizer::run()
+{
+  while ( !step() ) {
+  }
+  return mReport;
+}
+
+// See header for interface
+double GainOptimizer::cost( const Settings& settings, const StepMetrics::Result& metrics )
+{
+  return metrics.mITAE
+       + settings.mOvershootWeight * metrics.mOvershoot
+       + settings.mEffortWeight * metrics.mControlEffort;
+}
+
+// Counter based, so every deviate can be recreated from the seed and its index
+double GainOptimizer::normal()
+{
+  const std::uint64_t base = mSettings.mSeed ^ sampleSalt;
+  const double deviate = Utils::toGaussian( Utils::splitMix64( base + 2 * mDraws ),
+                                            Utils::splitMix64( base + 2 * mDraws + 1 ));
+  ++mDraws;
+  return deviate;
+}
+
+//
+// 1. Clamp the gains into range, and charge for the clamping.  Every
+//    candidate gets the same sensor noise, so the costs compare gains
+//    and not luck.
+// 2. Simulate the batches, spread over the cores.  Check the running
+//    costs every so often and stop the ones that can't be selected.
+//    Once every arm in a batch has stopped, so does the batch.
+// 3. Stopped candidates' costs are only partial, so they cost infinity.
+//    They rank last, and are never the best or set the stop cost.
+// 4. Add up the report
+//
+std::vector<double> GainOptimizer::evaluate( const std::vector<Vector>& candidates )
+{
+  // 1. Clamp the gains into range, and charge for the clamping
+  const std::size_t count = candidates.size();
+  std::vector<BatchSim::ArmSettings> arms( count, mSettings.mArm );
+  std::vector<double> penalties( count );
+  for ( std::size_t i = 0; i < count; ++i ) {
+    const Vector clamped = candidates[ i ].cwiseMax( 0.0 ).cwiseMin( maxGain );
+    arms[ i ].mPidP = clamped[ 0 ];
+    arms[ i ].mPidI = clamped[ 1 ];
+    arms[ i ].mPidD = clamped[ 2 ];
+    arms[ i ].mNoiseStream = 0;
+    penalties[ i ] = boundaryPenalty * ( candidates[ i ] - clamped ).squaredNorm();
+  }
+
+  // 2. Simulate the batches, spread over the cores
+  std::vector<double> costs( count );
+  std::vector<char> stopped( count, 0 );
+  std::vector<std::uint64_t> armTicks(( count + armsPerBatch - 1 ) / armsPerBatch, 0 );
+  Utils::parallelFor( armTicks.size(), [&]( std::size_t batch ) {
+    const std::size_t begin = batch * armsPerBatch;
+    const std::size_t end   = std::min( begin + armsPerBatch, count );
+    BatchSim sim( std::vector<BatchSim::ArmSettings>( arms.begin() + begin, arms.begin() + end ), mSettings.mSeed );
+    std::size_t running = sim.size();
+    while ( running > 0 && sim.getTicks() < mSettings.mTicks ) {
+      const unsigned ticks = std::min( checkTicks, mSettings.mTicks - sim.getTicks() );
+      sim.run( ticks );
+      armTicks[ batch ] += ticks * sim.size();
+      for ( std::size_t arm = 0; arm < sim.size(); ++arm ) {
+        const std::size_t i = begin + arm;
+        if ( stopped[ i ] ) {
+          continue;
+        }
+        costs[ i ] = penalties[ i ] + cost( mSettings, sim.getMetrics( arm ));
+        if ( costs[ i ] > mStopCost && sim.getTicks() < mSettings.mTicks ) {
+          stopped[ i ] = 1;
+          --running;
+        }
+      }
+    }
+  });
+
+  // 3. Stopped candidates' costs are only partial, so they cost infinity
+  for ( std::size_t i = 0; i < count; ++i ) {
+    if ( stopped[ i ] ) {
+      costs[ i ] = INFINITY;
+    }
+  }
+
+  // 4. Add up the report
+  mReport.mEvaluations += count;
+  mReport.mStoppedEarly += static_cast<std::size_t>( std::count( stopped.begin(), stopped.end(), 1 ));
+  mReport.mArmTicks += std::accumulate( armTicks.begin(), armTicks.end(), std::uint64_t{ 0 } );
+  return costs;
+}
+
+//
+// Stopped candidates cost infinity, so every finished candidate ranks
+// ahead of them.  If fewer than mu finished, the stop cost stays as it
+// was; a stopped candidate never sets it.
+//
+// 1. Rank the candidates and keep the best one seen
+// 2. Move the mean to the weighted average of the best mu
+// 3. Update the evolution paths, covariance and step size
+// 4. Decompose the new covariance for the next generation's samples
+//
+void GainOptimizer::update( const std::vector<Vector>& candidates, const std::vector<double>& costs )
+{
+  // 1. Rank the candidates and keep the best one seen
+  std::vector<std::size_t> order( candidates.size() );
+  std::iota( order.begin(), order.end(), 0 );
+  std::stable_sort( order.begin(), order.end(), [&]( std::size_t a, std::size_t b ) {
+    return costs[ a ] < costs[ b ];
+  });
+  if ( costs[ order[ 0 ]] < mReport.mBestCost ) {
+    const Vector best = candidates[ order[ 0 ]].cwiseMax( 0.0 ).cwiseMin( maxGain );
+    mReport.mBest     = { best[ 0 ], best[ 1 ], best[ 2 ] };
+    mReport.mBestCost = costs[ order[ 0 ]];
+  }
+  if ( std::isfinite( costs[ order[ mMu - 1 ]] )) {
+    mStopCost = mSettings.mEarlyStopFactor * costs[ order[ mMu - 1 ]];
+  }
+
+  // 2. Move the mean to the weighted average of the best mu
+  const Vector oldMean = mMean;
+  mMean = Vector::Zero();
+  for ( std::size_t i = 0; i < mMu; ++i ) {
+    mMean += mWeights[ i ] * candidates[ order[ i ]];
+  }
+  const Vector meanStep = ( mMean - oldMean ) / mSigma;
+
+  // 3. Update the evolution paths, covariance and step size
+  const Matrix invSqrtC = mB * mD.cwiseInverse().asDiagonal() * mB.transpose();
+  mPathSigma = ( 1.0 - mCSigma ) * mPathSigma
+             + sqrt( mCSigma * ( 2.0 - mCSigma ) * mMuEff ) * ( invSqrtC * meanStep );
+  const double generations = static_cast<double>( mReport.mGenerations + 1 );
+  const double pathNorm = mPathSigma.norm() / sqrt( 1.0 - pow( 1.0 - mCSigma, 2.0 * generations ));
+  const bool stalled = pathNorm >= ( 1.4 + 2.0 / ( dimensions + 1.0 )) * mChiN;
+  mPathC = ( 1.0 - mCC ) * mPathC
+         + ( stalled ? 0.0 : sqrt( mCC * ( 2.0 - mCC ) * mMuEff )) * meanStep;
+
+  Matrix rankMu = Matrix::Zero();
+  for ( std::size_t i = 0; i < mMu; ++i ) {
+    const Vector y = ( candidates[ order[ i ]] - oldMean ) / mSigma;
+    rankMu += mWeights[ i ] * y * y.transpose();
+  }
+  const double stallFix = stalled ? mCC * ( 2.0 - mCC ) : 0.0;
+  mC = ( 1.0 - mC1 - mCMu ) * mC
+     + mC1 * ( mPathC * mPathC.transpose() + stallFix * mC )
+     + mCMu * rankMu;
+  mSigma *= exp(( mCSigma / mDSigma ) * ( mPathSigma.norm() / mChiN - 1.0 ));
+
+  // 4. Decompose the new covariance for the next generation's samples
+  mC = ( mC + mC.transpose() ) / 2.0;
+  const Eigen::SelfAdjointEigenSolver<Matrix> solver( mC );
+  mB = solver.eigenvectors();
+  mD = solver.eigenvalues().cwiseMax( 1e-20 ).cwiseSqrt();
+}
+
+}
+
@@ -0,0 +1,172 @@
+#ifndef __PIDSIM_BACKEND_GAIN_OPTIMIZER_H__
+#define __PIDSIM_BACKEND_GAIN_OPTIMIZER_H__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <Eigen/Core>
+#include "pidsim_backend_batch_sim.h"
+#include "pidsim_backend_stability_map.h"
+
+namespace PidSim {
+
+///
+/// @brief Searches for the PID gains with the lowest step response cost
+///
+/// Uses CMA-ES (the covariance matrix adaptation evolution strategy) on
+/// the nonlinear arm.  Each generation samples a population of gains
+/// from a multivariate normal, simulates them all as one batch (spread
+/// over the cores), and moves the normal's mean, shape and size toward
+/// the best of them.  It only uses the ranking of the costs, so motor
+/// limits, hard stops and noise don't trip it up the way they would a
+/// gradient method.
+///
+/// The cost is ITAE + overshoot weight * overshoot + effort weight *
+/// control effort, as per StepMetrics.  Every term only grows as the
+/// simulation goes on, so a candidate whose cost so far is already well
+/// past last generation's selected candidates is stopped early; it can't
+/// be selected anyway.
+///
+/// Every candidate sees the same sensor noise, from the seed, so a run
+/// gives the same answer on any number of cores.
+///
+class GainOptimizer
+{
+  public:
+
+  /// @brief Kp, Ki and Kd, in the front end's slider units
+  using Gains = std::array<double, 3>;
+
+  /// @brief The biggest gain searched, as per the front end's PID sliders
+  static constexpr double maxGain = StabilityMap::maxGain;
+
+  /// @brief The number of candidates simulated together on one core
+  static constexpr std::size_t armsPerBatch = 4;
+
+  /// @brief How often, in ticks, running candidates are checked for an early stop
+  static constexpr unsigned checkTicks = 25;
+
+  ///
+  /// @brief What to optimize, and how hard to try
+  ///
+  struct Settings
+  {
+    BatchSim::ArmSettings   mArm;                       // The arm.  Its gains are where the search starts.
+    unsigned                mTicks            = 250;    // How long to simulate each candidate
+    double                  mOvershootWeight  = 1.0;    // Cost per unit of overshoot (1 = 100%)
+    double                  mEffortWeight     = 0.1;    // Cost per unit of control effort
+    std::size_t             mPopulation       = 16;     // Candidates per generation
+    double                  mStartSigma       = 2.0;    // Starting step size, in gain units
+    std::uint64_t           mSeed             = 1;      // For the samples and the sensor noise
+    unsigned                mMaxGenerations   = 100;
+    double                  mTolerance        = 1e-3;   // Stop once steps are smaller than this, in gain units
+    double                  mEarlyStopFactor  = 2.0;    // Stop candidates past this times the last selected cost
+  };
+
+  ///
+  /// @brief How the search went
+  ///
+  struct Report
+  {
+    Gains         mBest;              // The best gains simulated so far
+    double        mBestCost;          // Their cost
+    unsigned      mGenerations;       // Generations run
+    std::size_t   mEvaluations;       // Candidates simulated, stopped early or not
+    std::size_t   mStoppedEarly;      // Candidates stopped early
+    std::uint64_t mArmTicks;          // Arm-ticks actually simulated
+    double        mSeconds;           // Wall clock time spent in step()
+
+    /// @brief Candidates evaluated per second of wall clock time
+    [[nodiscard]] double getEvaluationsPerSecond() const
+    {
+      return mSeconds > 0.0 ? static_cast<double>( mEvaluations ) / mSeconds : 0.0;
+    }
+  };
+
+  ///
+  /// @brief Constructor.  Nothing is simulated yet.
+  ///
+  /// @param[in] settings - What to optimize
+  ///
+  explicit GainOptimizer( const Settings& settings );
+
+  // Remove constructors I probably never want (i.e., if used they're a bug)
+  GainOptimizer() = delete;
+
+  ///
+  /// @brief Run one generation
+  ///
+  /// @return - True once the search is finished
+  ///
+  bool step();
+
+  ///
+  /// @brief Run generations until the search is finished
+  ///
+  /// @return - The final report
+  ///
+  const Report& run();
+
+  /// @brief Is the search finished?
+  [[nodiscard]] bool isDone() const { return mDone; }
+
+  /// @brief The results so far
+  [[nodiscard]] const Report& getReport() const { return mReport; }
+
+  /// @brief The centre of the search distribution
+  [[nodiscard]] Gains getMean() const { return { mMean[ 0 ], mMean[ 1 ], mMean[ 2 ] }; }
+
+  /// @brief The current step size
+  [[nodiscard]] double getSigma() const { return mSigma; }
+
+  /// @brief The settings the search was started with
+  [[nodiscard]] const Settings& getSettings() const { return mSettings; }
+
+  ///
+  /// @brief The cost of a step response, as the search sees it
+  ///
+  /// @param[in] settings - The weights
+  /// @param[in] metrics  - The step response, complete or not
+  ///
+  [[nodiscard]] static double cost( const Settings& settings, const StepMetrics::Result& metrics );
+
+  private:
+
+  using Vector = Eigen::Vector3d;
+  using Matrix = Eigen::Matrix3d;
+
+  double normal();
+  std::vector<double> evaluate( const std::vector<Vector>& candidates );
+  void update( const std::vector<Vector>& candidates, const std::vector<double>& costs );
+
+  Settings              mSettings;
+  Report                mReport;
+  bool                  mDone         = false;
+  std::uint64_t         mDraws        = 0;      // Normal deviates drawn so far
+  double                mStopCost;              // Candidates past this are stopped early
+
+  // Strategy parameters (see Hansen's "The CMA Evolution Strategy: A Tutorial")
+  std::size_t           mMu;
+  std::vector<double>   mWeights;
+  double                mMuEff;
+  double                mCSigma;
+  double                mDSigma;
+  double                mCC;
+  double                mC1;
+  double                mCMu;
+  double                mChiN;
+
+  // Search state
+  Vector                mMean;
+  double                mSigma;
+  Matrix                mC;                     // Covariance
+  Matrix                mB;                     // Its eigenvectors...
+  Vector                mD;                     // ...and the square roots of its eigenvalues
+  Vector                mPathSigma;
+  Vector                mPathC;
+};
+
+}
+
+#endif
@@ -0,0 +1,62 @@
+
+#include "pidsim_backend_gain_schedule.h"
+#include <assert.h>
+
+namespace PidSim {
+
+//
+// 1. Sort the breakpoints by angle
+// 2. Sample the piecewise linear breakpoint curve at each grid point
+// 3. Record the slope to the next grid point
+//
+GainSchedule::GainSchedule( std::vector<Breakpoint> breakpoints, double minAngle, double maxAngle ) :
+  mMinAngle   { minAngle },
+  mGridScale  { lastIndex / ( maxAngle - minAngle ) }
+{
+  assert( !breakpoints.empty() );
+  assert( maxAngle > minAngle );
+
+  // 1. Sort the breakpoints by angle
+  std::sort( breakpoints.begin(), breakpoints.end(),
+    []( const Breakpoint& a, const Breakpoint& b ) { return a.mAngle < b.mAngle; } );
+
+  // 2. Sample the piecewise linear breakpoint curve at each grid point.
+  //    Grid points are in order, so the breakpoint search only moves
+  //    forward.
+  std::size_t next = 0;
+  for ( std::size_t i = 0; i < tableSize; ++i ) {
+    const double angle = minAngle + static_cast<double>( i ) / mGridScale;
+    while ( next < breakpoints.size() && breakpoints[ next ].mAngle <= angle ) { ++next; }
+
+    Gains& gains = mTable[ i ].mGains;
+    if ( next == 0 ) {
+      gains = breakpoints.front().mGains;
+    }
+    else if ( next == breakpoints.size() ) {
+      gains = breakpoints.back().mGains;
+    }
+    else {
+      const Breakpoint& lo = breakpoints[ next-1 ];
+      const Breakpoint& hi = breakpoints[ next ];
+      const double t = ( angle - lo.mAngle ) / ( hi.mAngle - lo.mAngle );
+      gains.mPidP = lo.mGains.mPidP + t * ( hi.mGains.mPidP - lo.mGains.mPidP );
+      gains.mPidI = lo.mGains.mPidI + t * ( hi.mGains.mPidI - lo.mGains.mPidI );
+      gains.mPidD = lo.mGains.mPidD + t * ( hi.mGains.mPidD - lo.mGains.mPidD );
+    }
+  }
+
+  // 3. Record the slope to the next grid point.  The last grid point is
+  //    only ever looked up with a fraction of 0.
+  for ( std::size_t i = 0; i < tableSize; ++i ) {
+    const Gains& cur  = mTable[ i ].mGains;
+    const Gains& following = mTable[ std::min( i+1, tableSize-1 ) ].mGains;
+    mTable[ i ].mSlope = Gains{
+      following.mPidP - cur.mPidP,
+      following.mPidI - cur.mPidI,
+      following.mPidD - cur.mPidD
+    };
+  }
+}
+
+}
+
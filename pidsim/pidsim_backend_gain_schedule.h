@@ -0,0 +1,103 @@
+#ifndef __PIDSIM_BACKEND_GAIN_SCHEDULE_H__
+#define __PIDSIM_BACKEND_GAIN_SCHEDULE_H__
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <vector>
+#include "pidsim_utils.h"
+
+namespace PidSim {
+
+///
+/// @brief Angle dependent multipliers for the PID gains
+///
+/// Gravity's pull on the arm goes with cos( angle ), so the gains that work
+/// well with the arm level don't work as well with the arm pointed up.  A
+/// gain schedule scales the P, I and D gains depending on the angle.
+///
+/// The user gives a list of breakpoints.  Those get resampled, once, onto
+/// a uniform grid that covers the arm's range of motion.  Looking up the
+/// multipliers is then just a scale, a truncate and a linear interpolation
+/// - no searching and no branches - so it costs about the same as the PID
+/// controller itself.
+///
+class GainSchedule
+{
+  public:
+
+  // Number of grid points in the lookup table
+  static constexpr std::size_t tableSize = 256;
+
+  /// @brief Gain multipliers
+  struct Gains
+  {
+    double mPidP;
+    double mPidI;
+    double mPidD;
+  };
+
+  /// @brief The gain multipliers at a given angle
+  struct Breakpoint
+  {
+    double  mAngle;   // radians
+    Gains   mGains;
+  };
+
+  ///
+  /// @brief Constructor
+  ///
+  /// @param[in] breakpoints  - The multipliers at each breakpoint.  They're
+  ///     linearly interpolated between breakpoints and held constant past
+  ///     the first & last breakpoint.  Order doesn't matter.
+  /// @param[in] minAngle     - Start of the lookup table, in radians
+  /// @param[in] maxAngle     - End of the lookup table, in radians
+  ///
+  GainSchedule( std::vector<Breakpoint> breakpoints,
+                double minAngle = Utils::degToRad( -120 ),
+                double maxAngle = Utils::degToRad( 210 ));
+
+  // Remove constructors I probably never want (i.e., if used they're a bug)
+  GainSchedule() = delete;
+
+  ///
+  /// @brief Look up the gain multipliers for an angle
+  ///
+  /// @param[in] angle  - The angle, in radians.  Angles outside the table
+  ///                     get the multipliers at the nearest end.
+  /// @return           - The gain multipliers
+  ///
+  [[nodiscard]] Gains lookup( double angle ) const
+  {
+    const double position = std::min( std::max(( angle - mMinAngle ) * mGridScale, 0.0 ), lastIndex );
+    const std::size_t index = static_cast<std::size_t>( position );
+    const double fraction = position - static_cast<double>( index );
+    const Entry& entry = mTable[ index ];
+    return Gains{
+      entry.mGains.mPidP + fraction * entry.mSlope.mPidP,
+      entry.mGains.mPidI + fraction * entry.mSlope.mPidI,
+      entry.mGains.mPidD + fraction * entry.mSlope.mPidD
+    };
+  }
+
+  private:
+
+  static constexpr double lastIndex = static_cast<double>( tableSize - 1 );
+
+  // A grid point, and the change to the next grid point.  Keeping them
+  // together means a lookup touches a single cache line or two.
+  struct Entry
+  {
+    Gains mGains;
+    Gains mSlope;
+  };
+
+  double                          mMinAngle;
+  double                          mGridScale;   // Grid points per radian
+  std::array<Entry, tableSize>    mTable;
+};
+
+}
+
+#endif
+
@@ -0,0 +1,277 @@
+
+#include "pidsim_backend_linear_model.h"
+#include "pidsim_backend_physics_sim.h"
+#include "pidsim_backend_pid_controller.h"
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
+
+namespace PidSim {
+
+namespace {
+  // Number of simulation ticks for a delay, as per PhysicsSim
+  std::size_t delayInTicks( double delayInMs )
+  {
+    return 1 + static_cast<std::size_t>( delayInMs / 1000.0 * 50.0 );
+  }
+}
+
+LinearModel::Layout::Layout( const BatchSim::ArmSettings& settings ) :
+  mMotorTicks   { delayInTicks( settings.mMotorDelay ) },
+  mSensorTicks  { delayInTicks( settings.mSensorDelay ) },
+  mSensorIndex  { motorIndex + mMotorTicks },
+  mSize         { mSensorIndex + mSensorTicks }
+{
+}
+
+//
+// 1. Work out the state layout
+// 2. Build A, and the powers of A
+// 3. Do the first tick
+// 4. Work out the gains.  An acceleration error in a tick moves the state
+//    by b, and A carries that on, so the angle's response is c A^k b.  Its
+//    sum of squares over N ticks is c W c^T with
+//
+//      W = sum ( A^k b )( A^k b )^T,  k < N
+//
+//    which doubles up through the powers of A: W2n = Wn + A^n Wn A^n^T.
+//    The motor command's is the same with its own c.
+//
+LinearModel::LinearModel( const BatchSim::ArmSettings& settings, unsigned horizon ) :
+  mSettings { settings },
+  mLayout   { settings }
+{
+  assert( horizon < ( 1u << maxPowers ));
+
+  // 2. Build A, and the powers of A
+  mPowers[ 0 ] = buildTransition( settings, mLayout, false );
+  for ( unsigned i = 1; i < maxPowers; ++i ) {
+    mPowers[ i ].noalias() = mPowers[ i-1 ] * mPowers[ i-1 ];
+  }
+
+  // 3. Do the first tick.  The sensor ring starts at 0, like Utils::Delayer.
+  Vector start = Vector::Zero( mLayout.mSize );
+  start[ angleIndex ] = settings.mStartAngle;
+  start[ oneIndex ]   = 1.0;
+  mFirstTickState = buildTransition( settings, mLayout, true ) * start;
+
+  // 4. Work out the gains.  The new angle is pushed onto the sensor ring too.
+  const double dt   = BatchSim::timeSlice;
+  const double keep = 1.0 - settings.mRollingFriction;
+  Vector b = Vector::Zero( mLayout.mSize );
+  b[ angleIndex ]           = keep * dt * dt;
+  b[ velIndex ]             = keep * dt;
+  b[ mLayout.mSensorIndex ] = keep * dt * dt;
+  Matrix gram = b * b.transpose();
+  for ( unsigned i = 0; ( 1u << i ) < horizon; ++i ) {
+    gram += mPowers[ i ] * gram * mPowers[ i ].transpose();
+  }
+  mAngleGain    = std::sqrt( gram( angleIndex, angleIndex ));
+  mCommandGain  = std::sqrt( gram( motorIndex, motorIndex ));
+}
+
+//
+// The constant 1 (and the PID integral, if it's not used) only ever map
+// to themselves, so removing their rows & columns leaves the rest of the
+// loop untouched.
+//
+LinearModel::Matrix LinearModel::buildDynamics( const BatchSim::ArmSettings& settings )
+{
+  const Layout layout{ settings };
+  const Matrix transition = buildTransition( settings, layout, false );
+
+  std::vector<Eigen::Index> keep;
+  for ( std::size_t i = 0; i < layout.mSize; ++i ) {
+    const bool unused = i == oneIndex || ( i == iSumIndex && settings.mPidI == 0.0 );
+    if ( !unused ) {
+      keep.push_back( static_cast<Eigen::Index>( i ));
+    }
+  }
+
+  const Eigen::Index size = static_cast<Eigen::Index>( keep.size() );
+  Matrix dynamics( size, size );
+  for ( Eigen::Index row = 0; row < size; ++row ) {
+    for ( Eigen::Index col = 0; col < size; ++col ) {
+      dynamics( row, col ) = transition( keep[ row ], keep[ col ] );
+    }
+  }
+  return dynamics;
+}
+
+//
+// Each row of A says how one entry of the new state is built from the old
+// state.  Build the rows up the same way PidController & PhysicsSim do the
+// math, so each step can be checked against the original code.
+//
+LinearModel::Matrix LinearModel::buildTransition(
+  const BatchSim::ArmSettings& settings,
+  const Layout& layout,
+  bool firstTick )
+{
+  using Row = Eigen::RowVectorXd;
+  const double dt = BatchSim::timeSlice;
+  const std::size_t motorTicks  = layout.mMotorTicks;
+  const std::size_t sensorTicks = layout.mSensorTicks;
+  const std::size_t sensorIndex = layout.mSensorIndex;
+  auto entry = [&]( std::size_t index ) {
+    Row row = Row::Zero( layout.mSize );
+    row[ index ] = 1.0;
+    return row;
+  };
+
+  // PidController::updatePidController, with the set point held constant
+  const Row sensor  = entry( sensorIndex + sensorTicks - 1 );
+  const Row pError  = sensor - settings.mTargetAngle * entry( oneIndex );
+  const Row iSum    = entry( iSumIndex ) + pError;
+  const Row dError  = ( pError - entry( lastPIndex )) / dt;
+  const Row allGains = settings.mPidP * pError + settings.mPidI * dt * iSum + settings.mPidD * dError;
+  const Row command = -allGains / 5.0;
+
+  // Utils::MovingAverage
+  Row motorPower = command;
+  for ( std::size_t i = 0; i + 1 < motorTicks; ++i ) {
+    motorPower += entry( motorIndex + i );
+  }
+  motorPower /= static_cast<double>( motorTicks );
+
+  // PhysicsSim, with cos( angle ) replaced by its tangent line at the target
+  const double target   = settings.mTargetAngle;
+  const double gravity1 = 9.8 * sin( target );
+  const double gravity0 = -9.8 * cos( target ) - gravity1 * target;
+  const Row accel   = gravity0 * entry( oneIndex ) + gravity1 * entry( angleIndex ) + motorPower / dt;
+  const Row vel     = ( 1.0 - settings.mRollingFriction ) * ( entry( velIndex ) + accel * dt );
+  const Row angle   = entry( angleIndex ) + vel * dt;
+
+  Matrix transition = Matrix::Zero( layout.mSize, layout.mSize );
+  transition.row( angleIndex )  = angle;
+  transition.row( velIndex )    = vel;
+  transition.row( iSumIndex )   = iSum;
+  transition.row( lastPIndex )  = pError;
+  transition.row( oneIndex )    = entry( oneIndex );
+  transition.row( motorIndex )  = command;
+  for ( std::size_t i = 1; i < motorTicks; ++i ) {
+    transition.row( motorIndex + i ) = entry( motorIndex + i - 1 );
+  }
+  // Utils::Delayer returns the first push until the delay line fills up,
+  // so the first tick fills the whole line.
+  transition.row( sensorIndex ) = angle;
+  for ( std::size_t i = 1; i < sensorTicks; ++i ) {
+    transition.row( sensorIndex + i ) = firstTick ? angle : entry( sensorIndex + i - 1 );
+  }
+  return transition;
+}
+
+// See header for interface
+LinearModel::Vector LinearModel::advance( Vector state, unsigned ticks ) const
+{
+  assert( ticks < ( 1u << maxPowers ));
+  for ( unsigned i = 0; ticks != 0; ++i, ticks >>= 1 ) {
+    if ( ticks & 1 ) {
+      state = mPowers[ i ] * state;
+    }
+  }
+  return state;
+}
+
+//
+// 1. Use the linear model if it applies.  It jumps a stride at a time.
+//    Each sample accounts for the gravity error until the next, allowing
+//    for the arm moving at its velocity that long and for the simulation
+//    having strayed up to the tolerance.  The simulation has to stay
+//    within the tolerance, the motor command unclamped and the arm off
+//    the hard limits (which are well outside any sensible step, but check
+//    them anyway).  The command & angle are linear in the state, so rows
+//    of c A^k give them for every tick up to the next sample without
+//    stepping there, and the command can't clamp between samples unseen.
+// 2. Otherwise run PhysicsSim + PidController, the way BackEnd does
+//
+LinearModel::StepResponse LinearModel::runStepResponse(
+  const BatchSim::ArmSettings& settings,
+  unsigned ticks,
+  unsigned stride,
+  double tolerance )
+{
+  assert( stride > 0 && tolerance > 0.0 );
+  StepResponse response{ {}, true };
+  response.mAngles.reserve( ticks / stride );
+
+  // 1. Use the linear model if it applies
+  if ( settings.mProfileType == MotionProfile::Type::Step && settings.mSensorNoise == 0.0 && ticks >= stride ) {
+    const LinearModel model( settings, ticks );
+    const Eigen::Index size = static_cast<Eigen::Index>( model.size() );
+    const Eigen::Index span = static_cast<Eigen::Index>( stride ) + 1;
+    Matrix ahead( 2 * span, size );
+    Eigen::RowVectorXd command = Eigen::RowVectorXd::Unit( size, motorIndex );
+    Eigen::RowVectorXd angle   = Eigen::RowVectorXd::Unit( size, angleIndex );
+    for ( Eigen::Index k = 0; k < span; ++k ) {
+      ahead.row( k )        = command;
+      ahead.row( span + k ) = angle;
+      command = command * model.mPowers[ 0 ];
+      angle   = angle * model.mPowers[ 0 ];
+    }
+
+    double errorSquares = 0.0;
+    double maxCommand   = 0.0;
+    const auto linear = [&]( const Vector& state, unsigned ticksToNext ) {
+      const double excursion  = std::abs( state[ angleIndex ] - settings.mTargetAngle ) + tolerance
+                              + std::abs( state[ velIndex ] ) * ticksToNext * BatchSim::timeSlice;
+      const double error      = 4.9 * excursion * excursion;
+      errorSquares += ticksToNext * error * error;
+      const Vector along = ahead * state;
+      const Eigen::Index last = static_cast<Eigen::Index>( ticksToNext );
+      maxCommand = std::max( maxCommand, along.head( last + 1 ).cwiseAbs().maxCoeff() );
+      const double minAngle = along.segment( span, last + 1 ).minCoeff();
+      const double maxAngle = along.segment( span, last + 1 ).maxCoeff();
+      const double stray = std::sqrt( errorSquares );
+      return model.mAngleGain * stray <= tolerance
+          && maxCommand + model.mCommandGain * stray <= 4.0 / 5.0
+          && minAngle >= Utils::degToRad( -120 )
+          && maxAngle <= Utils::degToRad( 210 );
+    };
+
+    Vector state = model.getFirstTickState();
+    bool isLinear = linear( state, stride - 1 );
+    state = model.advance( state, stride - 1 );
+    for ( unsigned tick = stride; isLinear && tick <= ticks; tick += stride ) {
+      isLinear = linear( state, stride );
+      response.mAngles.push_back( model.getAngle( state ));
+      if ( tick + stride <= ticks ) {
+        state = model.advance( state, stride );
+      }
+    }
+    if ( isLinear ) {
+      return response;
+    }
+  }
+
+  // 2. Otherwise run PhysicsSim + PidController, the way BackEnd does
+  response.mAngles.clear();
+  response.mLinear = false;
+  PhysicsSim          sim( settings.mStartAngle );
+  PidController       pid;
+  SetpointGenerator   setpoint( settings.mStartAngle, settings.mProfileLimits );
+  sim.setSensorNoise( settings.mSensorNoise );
+  sim.setSensorDelay( settings.mSensorDelay );
+  sim.setMotorDelay( settings.mMotorDelay );
+  setpoint.updateTarget( settings.mTargetAngle, settings.mProfileType );
+
+  for ( unsigned tick = 1; tick <= ticks; ++tick ) {
+    pid.updatePidSettings( settings.mPidP, settings.mPidI, settings.mPidD,
+                           setpoint.update( BatchSim::timeSlice ));
+    const PidController::Output out = pid.updatePidController( BatchSim::timeSlice, sim.getSensorAngle() );
+    sim.startSimulationIteration();
+    sim.applyGravity();
+    sim.applyMotor( out.mMotorPower, BatchSim::timeSlice );
+    sim.updateAngleVel( BatchSim::timeSlice );
+    sim.applyFriction( settings.mRollingFriction );
+    sim.updateAngle( BatchSim::timeSlice );
+    sim.imposePositionHardLimits();
+    sim.endSimulationIteration();
+    if ( tick % stride == 0 ) {
+      response.mAngles.push_back( sim.getActualAngle() );
+    }
+  }
+  return response;
+}
+
+}
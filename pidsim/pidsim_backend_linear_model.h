@@ -0,0 +1,198 @@
+#ifndef __PIDSIM_BACKEND_LINEAR_MODEL_H__
+#define __PIDSIM_BACKEND_LINEAR_MODEL_H__
+
+#include <array>
+#include <cstddef>
+#include <vector>
+#include <Eigen/Core>
+#include "pidsim_backend_batch_sim.h"
+#include "pidsim_utils.h"
+
+namespace PidSim {
+
+///
+/// @brief The arm + PID controller, linearized around the target angle
+///
+/// Close to the target, cos( angle ) is nearly a straight line and, as
+/// long as the motor isn't maxed out, everything else the simulation does
+/// is linear already.  The whole closed loop then becomes
+///
+///   x[ k+1 ] = A x[ k ]
+///
+/// where x holds the arm angle & velocity, the PID controller's integral
+/// and last error, the motor's moving average window, the sensor's delay
+/// line, and a constant 1 (for gravity & the set point).
+///
+/// The simulation is already discrete - one tick is one step of its
+/// integrator - so A is built straight from the tick's update rules.
+/// There's no continuous time model to discretize, and A matches what
+/// PhysicsSim does exactly (up to the linearization).
+///
+/// A is built once per set of settings, along with A^1, A^2, A^4, ... so
+/// jumping k ticks ahead takes log2( k ) matrix-vector products.
+///
+/// How far the simulation can stray from the model comes from the model
+/// too.  Within e of the target, cos() is off its tangent line by at most
+/// e^2 / 2, so gravity is off by at most 4.9 e^2.  If those acceleration
+/// errors are d[ j ], the angle strays by at most
+///
+///   sum |h[ k-j ]| d[ j ] <= | h | * | d |
+///
+/// where h is the angle's response to a one tick acceleration and | | is
+/// the root sum of squares.  | h | comes from the powers of A (see the
+/// constructor), and | d | from the excursions along the model's own
+/// trajectory, so a step response knows when it's been close enough.
+///
+/// Only step responses without sensor noise are modelled.
+///
+class LinearModel
+{
+  public:
+
+  using Vector = Eigen::VectorXd;
+  using Matrix = Eigen::MatrixXd;
+
+  /// @brief The number of powers of A we keep.  Jumps must be shorter than 2^maxPowers ticks
+  static constexpr unsigned maxPowers = 16;
+
+  /// @brief How far, in radians, a step response may be from PhysicsSim's by default
+  static constexpr double   defaultTolerance  = 1e-3;
+  /// @brief How many ticks the gains cover by default, i.e., 10 seconds
+  static constexpr unsigned defaultHorizon    = 500;
+
+  ///
+  /// @brief Constructor
+  ///
+  /// @param[in] settings   - The arm settings.  The profile type and
+  ///                         sensor noise are ignored.
+  /// @param[in] horizon    - How many ticks getAngleGain() and
+  ///                         getCommandGain() cover.  Must be less than
+  ///                         2^maxPowers.
+  ///
+  LinearModel( const BatchSim::ArmSettings& settings, unsigned horizon = defaultHorizon );
+
+  // Remove constructors I probably never want (i.e., if used they're a bug)
+  LinearModel() = delete;
+
+  ///
+  /// @brief The state after the first tick
+  ///
+  /// The sensor reads 0 until the first tick is done, then reads the
+  /// angle after the first tick until the delay line fills (see
+  /// Utils::Delayer).  The first tick is the odd one out, so it's done
+  /// here and every tick after it is a multiply by A.
+  ///
+  [[nodiscard]] const Vector& getFirstTickState() const { return mFirstTickState; }
+
+  /// @brief Advance a state one tick
+  [[nodiscard]] Vector tick( const Vector& state ) const { return mPowers[ 0 ] * state; }
+
+  ///
+  /// @brief Advance a state many ticks at once
+  ///
+  /// @param[in] state  - The state
+  /// @param[in] ticks  - The number of ticks.  Must be less than 2^maxPowers
+  /// @return           - The state ticks later
+  ///
+  [[nodiscard]] Vector advance( Vector state, unsigned ticks ) const;
+
+  /// @brief The arm angle in a state, in radians
+  [[nodiscard]] double getAngle( const Vector& state ) const { return state[ angleIndex ]; }
+
+  /// @brief The motor command (before the moving average) that got us to a state
+  [[nodiscard]] double getMotorCommand( const Vector& state ) const { return state[ motorIndex ]; }
+
+  ///
+  /// @brief How far acceleration errors can move the angle
+  ///
+  /// Acceleration errors d[ j ] in ticks j (radians/s^2) move the angle,
+  /// within the horizon, by at most getAngleGain() * | d |, where | d |
+  /// is their root sum of squares.
+  ///
+  [[nodiscard]] double getAngleGain() const { return mAngleGain; }
+
+  /// @brief The same for the motor command
+  [[nodiscard]] double getCommandGain() const { return mCommandGain; }
+
+  /// @brief The number of entries in the state
+  [[nodiscard]] std::size_t size() const { return mLayout.mSize; }
+
+  ///
+  /// @brief The closed loop dynamics, without the constant 1
+  ///
+  /// @param[in] settings - The arm settings.  The start angle, profile
+  ///                       type and sensor noise are ignored.
+  /// @return             - A, less the constant 1's row & column.  The
+  ///     PID integral is dropped too if the I gain is 0, since it doesn't
+  ///     feed back into anything.  The eigenvalues of what's left are the
+  ///     closed loop poles.
+  ///
+  /// Doesn't build the powers of A, so it's cheap enough to call for
+  /// every cell of a gain sweep.
+  ///
+  static Matrix buildDynamics( const BatchSim::ArmSettings& settings );
+
+  ///
+  /// @brief A step response
+  ///
+  struct StepResponse
+  {
+    std::vector<double> mAngles;    // The angle after every stride ticks, in radians
+    bool                mLinear;    // Did the linear model do the work?
+  };
+
+  ///
+  /// @brief Run a step response, using the linear model if it stays valid
+  ///
+  /// @param[in] settings   - The arm settings
+  /// @param[in] ticks      - The number of ticks to run
+  /// @param[in] stride     - Sample the angle every this many ticks.  The
+  ///                         model jumps from sample to sample.
+  /// @param[in] tolerance  - How far, in radians, the angles may be from
+  ///                         PhysicsSim's
+  /// @return               - The angles after ticks stride, 2 * stride, ...
+  ///     If the model can't promise the tolerance, the motor command may
+  ///     have been clamped, or the settings have noise or a motion profile,
+  ///     it's rerun with PhysicsSim + PidController.
+  ///
+  static StepResponse runStepResponse(
+    const BatchSim::ArmSettings& settings,
+    unsigned ticks,
+    unsigned stride = 1,
+    double tolerance = defaultTolerance );
+
+  private:
+
+  // State layout.  Rings are newest first, and follow the fixed entries.
+  static constexpr std::size_t angleIndex     = 0;
+  static constexpr std::size_t velIndex       = 1;
+  static constexpr std::size_t iSumIndex      = 2;
+  static constexpr std::size_t lastPIndex     = 3;
+  static constexpr std::size_t oneIndex       = 4;
+  static constexpr std::size_t motorIndex     = 5;
+
+  // Where the rings are, which depends on the delays
+  struct Layout
+  {
+    explicit Layout( const BatchSim::ArmSettings& settings );
+
+    std::size_t mMotorTicks;    // Motor moving average size
+    std::size_t mSensorTicks;   // Sensor delay
+    std::size_t mSensorIndex;   // Start of the sensor ring
+    std::size_t mSize;
+  };
+
+  static Matrix buildTransition( const BatchSim::ArmSettings& settings, const Layout& layout, bool firstTick );
+
+  BatchSim::ArmSettings         mSettings;
+  Layout                        mLayout;
+  std::array<Matrix, maxPowers> mPowers;        // A^(2^i)
+  Vector                        mFirstTickState;
+  double                        mAngleGain;
+  double                        mCommandGain;
+};
+
+}
+
+#endif
+
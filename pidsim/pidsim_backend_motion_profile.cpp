@@ -0,0 +1,318 @@
+
+#include "pidsim_backend_motion_profile.h"
+#include <algorithm>
+#include <assert.h>
+#include <cmath>
+
+namespace PidSim {
+
+namespace {
+
+  //
+  // Work out the S-Curve timing.  See Biagiotti & Melchiorri, "Trajectory
+  // Planning for Automatic Machines and Robots", section 3.4.  A trapezoid
+  // is the special case jerkTime = 0.
+  //
+  // distance     - How far to go.  Must be >= 0
+  // jerkTime     - Out: Length of each constant jerk segment
+  // accelTime    - Out: Length of the whole acceleration phase
+  // cruiseTime   - Out: Length of the constant velocity phase
+  //
+  void sCurveTiming( double distance, const MotionProfile::Limits& limits, bool limitJerk,
+                     double& jerkTime, double& accelTime, double& cruiseTime )
+  {
+    const double vel   = limits.mMaxVel;
+    const double accel = limits.mMaxAccel;
+    const double jerk  = limits.mMaxJerk;
+
+    // 1. Assume we reach max velocity.
+    if ( !limitJerk ) {
+      jerkTime  = 0.0;
+      accelTime = vel / accel;
+    }
+    else if ( vel * jerk >= accel * accel ) {
+      jerkTime  = accel / jerk;
+      accelTime = jerkTime + vel / accel;
+    }
+    else {
+      jerkTime  = std::sqrt( vel / jerk );
+      accelTime = 2.0 * jerkTime;
+    }
+    cruiseTime = distance / vel - accelTime;
+
+    // 2. If we didn't, shorten the acceleration phase.
+    if ( cruiseTime < 0.0 ) {
+      cruiseTime = 0.0;
+      if ( !limitJerk ) {
+        accelTime = std::sqrt( distance / accel );
+      }
+      else if ( distance >= 2.0 * accel * accel * accel / ( jerk * jerk )) {
+        jerkTime  = accel / jerk;
+        accelTime = jerkTime / 2.0 + std::sqrt( jerkTime * jerkTime / 4.0 + distance / accel );
+      }
+      else {
+        jerkTime  = std::cbrt( distance / ( 2.0 * jerk ));
+        accelTime = 2.0 * jerkTime;
+      }
+    }
+  }
+
+  // Position & velocity of a segment, tau seconds after it starts
+  double segmentPosition( const MotionProfile::Segment& seg, double tau )
+  {
+    return seg.mPosition + tau * ( seg.mVel + tau * ( seg.mAccel / 2.0 + tau * seg.mJerk / 6.0 ));
+  }
+
+  double segmentVel( const MotionProfile::Segment& seg, double tau )
+  {
+    return seg.mVel + tau * ( seg.mAccel + tau * seg.mJerk / 2.0 );
+  }
+
+  double segmentAccel( const MotionProfile::Segment& seg, double tau )
+  {
+    return seg.mAccel + tau * seg.mJerk;
+  }
+
+  // A change of velocity, ending with no acceleration, as 3 segments:
+  // jerk to the peak acceleration, hold it, and jerk back to 0.
+  struct VelocityChange
+  {
+    std::array<double, 3> mDurations;
+    std::array<double, 3> mAccels;    // At the start of each segment
+    std::array<double, 3> mJerks;
+  };
+
+  //
+  // Work out the fastest change from vel & accel to target, within the
+  // limits.  A trapezoid just accelerates flat out.  An S-Curve first
+  // works out which way to go from where the velocity would end up if the
+  // acceleration went straight to 0, then finds the peak acceleration.
+  //
+  VelocityChange velocityChange( double vel, double accel, double target, const MotionProfile::Limits& limits,
+                                 bool limitJerk )
+  {
+    VelocityChange change{};
+    if ( !limitJerk ) {
+      change.mDurations[ 1 ] = std::abs( target - vel ) / limits.mMaxAccel;
+      change.mAccels[ 1 ]    = ( target >= vel ? 1.0 : -1.0 ) * limits.mMaxAccel;
+      return change;
+    }
+
+    // In the direction we're going, starting at a0 and changing by dv
+    const double jerk       = limits.mMaxJerk;
+    const double coast      = vel + accel * std::abs( accel ) / ( 2.0 * jerk );
+    const double direction  = target >= coast ? 1.0 : -1.0;
+    const double a0         = direction * accel;
+    const double dv         = direction * ( target - vel );
+
+    // Try reaching max acceleration.  If that goes too far the peak
+    // acceleration's lower, with no time at it.
+    double peak = limits.mMaxAccel;
+    double flat = ( dv - ( peak + a0 ) / 2.0 * std::abs( peak - a0 ) / jerk - peak * peak / ( 2.0 * jerk )) / peak;
+    if ( flat < 0.0 && a0 <= peak ) {
+      peak = std::sqrt( std::max( 0.0, jerk * dv + a0 * a0 / 2.0 ));
+      flat = 0.0;
+    }
+    change.mDurations = { std::abs( peak - a0 ) / jerk, std::max( 0.0, flat ), peak / jerk };
+    change.mAccels    = { accel, direction * peak, direction * peak };
+    change.mJerks     = { peak >= a0 ? direction * jerk : -direction * jerk, 0.0, -direction * jerk };
+    return change;
+  }
+
+  //
+  // Lay a change to the cruise velocity, the cruise and the stop end to
+  // end, into the first 7 segments.  Returns where they end up.
+  //
+  double layOut( std::array<MotionProfile::Segment, MotionProfile::numSegments>& segments,
+                 double pos, double vel, const VelocityChange& change, double cruiseTime,
+                 const VelocityChange& stop )
+  {
+    const std::array<const VelocityChange*, 2> changes{ &change, &stop };
+    double time = 0.0;
+    std::size_t index = 0;
+    for ( std::size_t phase = 0; phase < 2; ++phase ) {
+      for ( std::size_t i = 0; i < 3; ++i, ++index ) {
+        segments[ index ] = MotionProfile::Segment{ time, pos, vel, changes[ phase ]->mAccels[ i ],
+                                                    changes[ phase ]->mJerks[ i ] };
+        pos  = segmentPosition( segments[ index ], changes[ phase ]->mDurations[ i ] );
+        vel  = segmentVel( segments[ index ], changes[ phase ]->mDurations[ i ] );
+        time += changes[ phase ]->mDurations[ i ];
+      }
+      if ( phase == 0 ) {
+        segments[ index ] = MotionProfile::Segment{ time, pos, vel, 0.0, 0.0 };
+        pos  += vel * cruiseTime;
+        time += cruiseTime;
+        ++index;
+      }
+    }
+    segments[ index ] = MotionProfile::Segment{ time, pos, 0.0, 0.0, 0.0 };
+    return pos;
+  }
+}
+
+//
+// From rest,
+//
+// 1. Work out the phase timings for the distance we're going
+// 2. Build the segments by integrating through each of them
+// 3. Finish with a segment that holds the target exactly
+//
+// On the move,
+//
+// 1. Work out where we'd stop if we stopped right now.  The target's
+//    past that, in the direction we cruise.
+// 2. Find the cruise velocity.  If going flat out doesn't overshoot, we
+//    cruise at max velocity for as long as it takes.  Otherwise how far
+//    we go only grows with the cruise velocity, so bisect for it.
+// 3. Finish with a segment that holds the target exactly
+//
+MotionProfile::MotionProfile( Type type, double start, double target, const Limits& limits,
+                              double startVel, double startAccel )
+{
+  assert( limits.mMaxVel > 0 && limits.mMaxAccel > 0 && limits.mMaxJerk > 0 );
+
+  const bool limitJerk = type == Type::SCurve;
+  if ( type != Type::Step && ( startVel != 0.0 || ( limitJerk && startAccel != 0.0 ))) {
+    // 1. Work out where we'd stop if we stopped right now
+    const VelocityChange none{};
+    const double stopAt = layOut( mSegments, start, startVel,
+                                  velocityChange( startVel, startAccel, 0.0, limits, limitJerk ), 0.0, none );
+    const double direction = target >= stopAt ? 1.0 : -1.0;
+    const double distance  = direction * ( target - start );
+    const auto reach = [&]( double cruiseVel, double cruiseTime ) {
+      return direction * ( layOut( mSegments, start, startVel,
+        velocityChange( startVel, startAccel, direction * cruiseVel, limits, limitJerk ), cruiseTime,
+        velocityChange( direction * cruiseVel, 0.0, 0.0, limits, limitJerk )) - start );
+    };
+
+    // 2. Find the cruise velocity
+    const double flatOut = reach( limits.mMaxVel, 0.0 );
+    if ( flatOut <= distance ) {
+      reach( limits.mMaxVel, ( distance - flatOut ) / limits.mMaxVel );
+    }
+    else {
+      double low  = 0.0;
+      double high = limits.mMaxVel;
+      for ( int i = 0; i < 64; ++i ) {
+        const double mid = ( low + high ) / 2.0;
+        ( reach( mid, 0.0 ) < distance ? low : high ) = mid;
+      }
+      reach( low, 0.0 );
+    }
+
+    // 3. Finish with a segment that holds the target exactly
+    mSegments[ numSegments-1 ].mPosition = target;
+    return;
+  }
+
+  // 1. Work out the phase timings for the distance we're going
+  const double direction = target >= start ? 1.0 : -1.0;
+  const double distance  = std::abs( target - start );
+  double jerkTime   = 0.0;
+  double accelTime  = 0.0;
+  double cruiseTime = 0.0;
+  if ( type != Type::Step ) {
+    sCurveTiming( distance, limits, type == Type::SCurve, jerkTime, accelTime, cruiseTime );
+  }
+  const double jerk      = direction * ( jerkTime > 0.0 ? limits.mMaxJerk : 0.0 );
+  const double peakAccel = direction * ( jerkTime > 0.0 ? limits.mMaxJerk * jerkTime : limits.mMaxAccel );
+  const double flatTime  = accelTime - 2.0 * jerkTime;
+
+  // 2. Build the segments by integrating through each of them
+  const std::array<double, numSegments-1> durations{
+    jerkTime, flatTime, jerkTime, cruiseTime, jerkTime, flatTime, jerkTime };
+  const std::array<double, numSegments-1> accels{
+    0.0, peakAccel, peakAccel, 0.0, 0.0, -peakAccel, -peakAccel };
+  const std::array<double, numSegments-1> jerks{
+    jerk, 0.0, -jerk, 0.0, -jerk, 0.0, jerk };
+
+  double time = 0.0;
+  double pos  = start;
+  double vel  = 0.0;
+  for ( std::size_t i = 0; i < numSegments-1; ++i ) {
+    // A trapezoid has no jerk, so the acceleration comes from the table.
+    mSegments[ i ] = Segment{ time, pos, vel, accels[ i ], jerks[ i ] };
+    pos  = segmentPosition( mSegments[ i ], durations[ i ] );
+    vel  = segmentVel( mSegments[ i ], durations[ i ] );
+    time += durations[ i ];
+  }
+
+  // 3. Finish with a segment that holds the target exactly
+  mSegments[ numSegments-1 ] = Segment{ time, target, 0.0, 0.0, 0.0 };
+}
+
+//
+// Segments are in time order, so the last one that has started is the
+// one we want.  No early exit so the cost doesn't depend on the time.
+//
+double MotionProfile::getPosition( double time ) const
+{
+  double pos = mSegments[ 0 ].mPosition;
+  for ( const Segment& seg : mSegments ) {
+    const double tau = time - seg.mStartTime;
+    pos = tau >= 0.0 ? segmentPosition( seg, tau ) : pos;
+  }
+  return pos;
+}
+
+// See getPosition
+double MotionProfile::getVel( double time ) const
+{
+  double vel = 0.0;
+  for ( const Segment& seg : mSegments ) {
+    const double tau = time - seg.mStartTime;
+    vel = tau >= 0.0 ? segmentVel( seg, tau ) : vel;
+  }
+  return vel;
+}
+
+// See getPosition
+double MotionProfile::getAccel( double time ) const
+{
+  double accel = 0.0;
+  for ( const Segment& seg : mSegments ) {
+    const double tau = time - seg.mStartTime;
+    accel = tau >= 0.0 ? segmentAccel( seg, tau ) : accel;
+  }
+  return accel;
+}
+
+double MotionProfile::getDuration() const
+{
+  return mSegments[ numSegments-1 ].mStartTime;
+}
+
+SetpointGenerator::SetpointGenerator( double start, const MotionProfile::Limits& limits ) :
+  mLimits{ limits },
+  mTarget{ start },
+  mProfile{ MotionProfile::Type::Step, start, start, limits }
+{
+}
+
+// See header for interface
+void SetpointGenerator::updateTarget( double target, MotionProfile::Type type )
+{
+  if ( target == mTarget && type == mType ) { return; }
+
+  mProfile = MotionProfile{ type, getSetpoint(), target, mLimits, mProfile.getVel( mTime ), mProfile.getAccel( mTime ) };
+  mTarget  = target;
+  mType    = type;
+  mTime    = 0.0;
+}
+
+// See header for interface
+double SetpointGenerator::update( double timeSlice )
+{
+  // Stop counting once the profile's done so the time never gets huge.
+  mTime = std::min( mTime + timeSlice, mProfile.getDuration() );
+  return getSetpoint();
+}
+
+// See header for interface
+double SetpointGenerator::getSetpoint() const
+{
+  return mProfile.getPosition( mTime );
+}
+
+}
+
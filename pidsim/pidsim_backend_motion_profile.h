@@ -0,0 +1,180 @@
+#ifndef __PIDSIM_BACKEND_MOTION_PROFILE_H__
+#define __PIDSIM_BACKEND_MOTION_PROFILE_H__
+
+#include <array>
+#include <cstddef>
+#include <math.h>
+
+namespace PidSim {
+
+///
+/// @brief A motion profile to rest at a target, evaluated in closed form
+///
+/// A profile is a fixed list of segments.  Each segment starts at a time
+/// and has a constant jerk, so within a segment the position is a cubic:
+///
+/// pos( t ) = p + v * tau + a * tau^2 / 2 + j * tau^3 / 6,  tau = t - start
+///
+/// An S-Curve uses all 7 segments (jerk up, constant accel, jerk down,
+/// cruise, and the mirror image to stop).  A trapezoid is the same thing
+/// with zero length jerk segments.  The last segment holds the target.
+/// Unused segments have zero length, so getPosition is always the same
+/// handful of operations, no matter the profile or time.
+///
+/// A profile can also start on the move, i.e., when the target changes
+/// part way through another profile.  The first 3 segments then take the
+/// velocity (and, for an S-Curve, the acceleration) from where it is to
+/// the cruise velocity, turning around first if need be, so the limits
+/// hold across the change of target too.
+///
+class MotionProfile
+{
+  public:
+
+  static constexpr std::size_t numSegments = 8;
+
+  /// @brief The kinds of profile we can generate
+  enum class Type
+  {
+    Step,           // Jump straight to the target, i.e., no profile
+    Trapezoidal,    // Velocity & acceleration limited
+    SCurve          // Velocity, acceleration & jerk limited
+  };
+
+  /// @brief Limits for the profile.  All must be > 0.
+  struct Limits
+  {
+    double mMaxVel;     // radians/s
+    double mMaxAccel;   // radians/s^2
+    double mMaxJerk;    // radians/s^3.  Ignored by trapezoidal profiles
+  };
+
+  /// @brief One constant jerk piece of the profile
+  struct Segment
+  {
+    double mStartTime;
+    double mPosition;
+    double mVel;
+    double mAccel;
+    double mJerk;
+  };
+
+  ///
+  /// @brief Create a profile
+  ///
+  /// @param[in] type       - What kind of profile
+  /// @param[in] start      - The position to start at, in radians
+  /// @param[in] target     - The position to end at, in radians
+  /// @param[in] limits     - The velocity/ acceleration/ jerk limits
+  /// @param[in] startVel   - The velocity to start at, in radians/s
+  /// @param[in] startAccel - The acceleration to start at, in radians/s^2.
+  ///                         Trapezoids ignore it.
+  ///
+  MotionProfile( Type type, double start, double target, const Limits& limits,
+                 double startVel = 0.0, double startAccel = 0.0 );
+
+  // Remove constructors I probably never want (i.e., if used they're a bug)
+  MotionProfile() = delete;
+
+  ///
+  /// @brief Get the profile's position
+  ///
+  /// @param[in] time   - Seconds since the profile started
+  /// @return           - The position, in radians
+  ///
+  [[nodiscard]] double getPosition( double time ) const;
+
+  ///
+  /// @brief Get the profile's velocity
+  ///
+  /// @param[in] time   - Seconds since the profile started
+  /// @return           - The velocity, in radians/s
+  ///
+  [[nodiscard]] double getVel( double time ) const;
+
+  ///
+  /// @brief Get the profile's acceleration
+  ///
+  /// @param[in] time   - Seconds since the profile started
+  /// @return           - The acceleration, in radians/s^2
+  ///
+  [[nodiscard]] double getAccel( double time ) const;
+
+  ///
+  /// @brief How long until the profile reaches the target, in seconds
+  ///
+  [[nodiscard]] double getDuration() const;
+
+  ///
+  /// @brief The raw segments, i.e., for BatchSim to vectorize with
+  ///
+  [[nodiscard]] const std::array<Segment, numSegments>& getSegments() const
+  {
+    return mSegments;
+  }
+
+  private:
+
+  std::array<Segment, numSegments> mSegments;
+};
+
+///
+/// @brief The limits the GUI & batch runs use unless told otherwise
+///
+/// 90 degrees/s, 180 degrees/s^2, 720 degrees/s^3
+///
+inline constexpr MotionProfile::Limits defaultProfileLimits{ M_PI / 2.0, M_PI, 4.0 * M_PI };
+
+///
+/// @brief Turns target angle changes into motion profiled set points
+///
+/// Whenever the target changes a new profile starts from wherever the
+/// set point is right now, moving as it is right now.
+///
+class SetpointGenerator
+{
+  public:
+
+  /// @brief Constructor
+  ///
+  /// @param[in] start  - The initial set point, in radians
+  /// @param[in] limits - The limits for new profiles
+  ///
+  SetpointGenerator( double start, const MotionProfile::Limits& limits );
+
+  // Remove constructors I probably never want (i.e., if used they're a bug)
+  SetpointGenerator() = delete;
+
+  ///
+  /// @brief Update the target & profile type
+  ///
+  /// Starts a new profile if either changed.
+  ///
+  void updateTarget( double target, MotionProfile::Type type );
+
+  ///
+  /// @brief Advance the profile by one time slice
+  ///
+  /// @param[in] timeSlice  - The length of the time slice, in seconds
+  /// @return               - The new set point, in radians
+  ///
+  double update( double timeSlice );
+
+  ///
+  /// @brief Get the current set point, in radians
+  ///
+  [[nodiscard]] double getSetpoint() const;
+
+  private:
+
+  MotionProfile::Limits mLimits;
+  MotionProfile::Type   mType   = MotionProfile::Type::Step;
+  double                mTarget;
+  double                mTime   = 0.0;
+  MotionProfile         mProfile;
+};
+
+}
+
+#endif
+
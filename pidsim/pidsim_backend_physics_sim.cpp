@@ -5,44 +5,65 @@
 
 namespace  PidSim {
 
-PhysicsSim::PhysicsSim( double startAngle )
+template< typename Scalar >
+BasicPhysicsSim<Scalar>::BasicPhysicsSim( double startAngle )
   : mAngle{ startAngle },
     mMotorDelay{ 1, 0.0 },
     mSensorDelay{ 1 }
 {
 }
 
-void PhysicsSim::bump( double bumpVel ) {
+template< typename Scalar >
+void BasicPhysicsSim<Scalar>::bump( double bumpVel ) {
   mAngleVel += bumpVel;
 }
 
-void PhysicsSim::startSimulationIteration() {
+template< typename Scalar >
+void BasicPhysicsSim<Scalar>::park( double angle ) {
+  mAngle    = angle;
+  mAngleVel = 0.0;
+}
+
+template< typename Scalar >
+void BasicPhysicsSim<Scalar>::startSimulationIteration() {
   mAngleAccel = 0.0;
 }
 
-void PhysicsSim::endSimulationIteration() {
-  double noise = static_cast<double>((rand() % 2000)-1000) / 1000.0 * mMaxNoiseInRadians;
+template< typename Scalar >
+void BasicPhysicsSim<Scalar>::endSimulationIteration() {
+  // No noise, no draw, so noise free stretches don't move the sequence along
+  const double noise = mMaxNoiseInRadians == 0.0 ? 0.0 :
+    Utils::toSignedUnit( Utils::splitMix64( mNoiseKey + mNoiseDraws++ )) * mMaxNoiseInRadians;
   mSensorDelay.push( mAngle + noise );
 }
 
-void PhysicsSim::setSensorDelay( double sensorDelayInMs )
+template< typename Scalar >
+void BasicPhysicsSim<Scalar>::setSensorDelay( double sensorDelayInMs )
 {
-  using size_type = decltype( mSensorDelay )::size_type; 
+  using size_type = typename decltype( mSensorDelay )::size_type; 
 
   const double sensorDelayInSeconds = sensorDelayInMs / 1000.0;
   const size_type delayInUpdates = 1+static_cast<size_type>(sensorDelayInSeconds * 50.0);
   if ( delayInUpdates != mSensorDelay.size() ) {
-    mSensorDelay = Utils::Delayer<double>{ delayInUpdates };
+    mSensorDelay = Utils::Delayer<Scalar>{ delayInUpdates };
   }
 }
 
-void PhysicsSim::setSensorNoise( double maxNoiseInDegrees ) {
+template< typename Scalar >
+void BasicPhysicsSim<Scalar>::setSensorNoise( double maxNoiseInDegrees ) {
   mMaxNoiseInRadians = Utils::degToRad(maxNoiseInDegrees);
 }
 
-void PhysicsSim::applyGravity()
+template< typename Scalar >
+void BasicPhysicsSim<Scalar>::setNoiseSeed( std::uint64_t seed ) {
+  mNoiseKey   = Utils::splitMix64( seed );
+  mNoiseDraws = 0;
+}
+
+template< typename Scalar >
+void BasicPhysicsSim<Scalar>::applyGravity()
 {
-  const double armX = cos( mAngle );
+  const Scalar armX = cos( mAngle );
   // const double armY = sin( mAngle );
   // Gravity = < 0   , -9.8 >
   // Arm     = < armX, armY >
@@ -50,44 +71,51 @@ void PhysicsSim::applyGravity()
   mAngleAccel += armX * -9.8;
 }
 
-void PhysicsSim::setMotorDelay( double MotorDelayMS )
+template< typename Scalar >
+void BasicPhysicsSim<Scalar>::setMotorDelay( double MotorDelayMS )
 {
-  using size_type = decltype(mMotorDelay)::size_type;
+  using size_type = typename decltype(mMotorDelay)::size_type;
   size_type newNumDelays = 1+static_cast<size_type>(MotorDelayMS / 1000.0 * 50.0);
   if ( newNumDelays != mMotorDelay.size() ) {
-    const double currentAverage = mMotorDelay.getAverage();
-    mMotorDelay = Utils::MovingAverage<double>( newNumDelays, currentAverage );
+    const Scalar currentAverage = mMotorDelay.getAverage();
+    mMotorDelay = Utils::MovingAverage<Scalar>( newNumDelays, currentAverage );
   }
 }
 
-double PhysicsSim::getMotorPower()
+template< typename Scalar >
+Scalar BasicPhysicsSim<Scalar>::getMotorPower()
 {
   return mMotorDelay.getAverage();
 }
 
-void PhysicsSim::applyMotor( double motorPower, double timeSlice )
+template< typename Scalar >
+void BasicPhysicsSim<Scalar>::applyMotor( const Scalar& motorPower, double timeSlice )
 {
   mMotorDelay.newValue( motorPower );
   mAngleAccel += getMotorPower() / timeSlice;
 }
 
-void PhysicsSim::applyFriction( double rollingFriction )
+template< typename Scalar >
+void BasicPhysicsSim<Scalar>::applyFriction( double rollingFriction )
 {
   mAngleVel *= 1.0 - rollingFriction;
 }
 
-void PhysicsSim::updateAngleVel( double timeSlice )
+template< typename Scalar >
+void BasicPhysicsSim<Scalar>::updateAngleVel( double timeSlice )
 {
   mAngleVel += mAngleAccel * timeSlice;
   mAngleAccel = 0.0;
 }
 
-void PhysicsSim::updateAngle( double timeSlice )
+template< typename Scalar >
+void BasicPhysicsSim<Scalar>::updateAngle( double timeSlice )
 {
   mAngle += mAngleVel * timeSlice;
 }
 
-void PhysicsSim::imposePositionHardLimits()
+template< typename Scalar >
+void BasicPhysicsSim<Scalar>::imposePositionHardLimits()
 {
   //
   // Impose some hard limits.  -120 degrees is about the angle where
@@ -109,16 +137,21 @@ void PhysicsSim::imposePositionHardLimits()
   }
 }
 
-double PhysicsSim::getSensorAngle() 
+template< typename Scalar >
+Scalar BasicPhysicsSim<Scalar>::getSensorAngle() 
 {
   return mSensorDelay.pop();
 }
 
-double PhysicsSim::getActualAngle() 
+template< typename Scalar >
+Scalar BasicPhysicsSim<Scalar>::getActualAngle() 
 {
   return mAngle;
 }
 
-}
-
+// The scalar types the simulation runs with.  Dual<3> carries derivatives
+// with respect to Kp, Ki & Kd, see Sensitivity.
+template class BasicPhysicsSim<double>;
+template class BasicPhysicsSim<Utils::Dual<3>>;
 
+}
@@ -1,15 +1,26 @@
 #ifndef __PIDSIM_BACKEND_STATE_H__
 #define __PIDSIM_BACKEND_STATE_H__
 
+#include <cstdint>
 #include <queue>
 #include <vector>
 #include <assert.h>
 #include <iostream>
 #include "pidsim_utils.h"
+#include "pidsim_utils_dual.h"
 
 namespace PidSim {
 
-class PhysicsSim
+///
+/// @brief The robot arm simulation
+///
+/// @param[in] Scalar = the type for the arm's state.  double, or a
+///                     Utils::Dual to get derivatives of the motion with
+///                     respect to whatever the motor power depended on.
+///                     Both are instantiated in the .cpp.
+///
+template< typename Scalar >
+class BasicPhysicsSim
 {
   public:
 
@@ -17,12 +28,13 @@ class PhysicsSim
   ///
   /// startAngle - The angle the Arm starts at
   ///
-  PhysicsSim(double startAngle); 
+  BasicPhysicsSim(double startAngle); 
 
-  // Delete default operators that don't want to expose.
-  PhysicsSim() = delete;
-  PhysicsSim( const PhysicsSim& other ) = delete;
-  PhysicsSim& operator=( const PhysicsSim& other ) = delete;
+  // Delete default operators that don't want to expose.  Copies are
+  // fine, they're how ControlLoop forks the simulation.
+  BasicPhysicsSim() = delete;
+  BasicPhysicsSim( const BasicPhysicsSim& other ) = default;
+  BasicPhysicsSim& operator=( const BasicPhysicsSim& other ) = default;
 
   ///
   /// Setters
@@ -34,6 +46,13 @@ class PhysicsSim
   /// 
   void bump( double bumpVel );
 
+  /// @brief Stop the arm dead at an angle
+  /// 
+  /// @param[in] angle - The angle, in radians.  The sensor catches up
+  ///     after the sensor delay.
+  /// 
+  void park( double angle );
+
   /// @brief Set a new Sensor Delay time window
   ///
   /// @param[in] sensorDelayInMs - The time the simulation waits
@@ -50,6 +69,14 @@ class PhysicsSim
   ///
   void setSensorNoise( double maxNoiseInDegrees );
 
+  /// @brief Restart the sensor noise from a seed
+  ///
+  /// @param[in] seed - Picks the noise.  Sims with the same seed and
+  ///     settings read exactly the same noise, whatever else is
+  ///     drawing random numbers.
+  ///
+  void setNoiseSeed( std::uint64_t seed );
+
   ///
   /// @brief Set the moving average time for motor output
   ///
@@ -64,18 +91,18 @@ class PhysicsSim
   /// 
   /// @return The sensor angle in Radians.
   /// 
-  double getSensorAngle();
+  Scalar getSensorAngle();
   /// 
   /// @brief Get the actual angle the arm is pointed at
   ///
   /// @return The angle the arm is pointed at, in Radians.
   /// 
-  double getActualAngle();
+  Scalar getActualAngle();
 
   ///
   /// @brief The the simulated Motor Output
   ///
-  double getMotorPower();
+  Scalar getMotorPower();
   
   // @brief Start a simulation iteration
   void startSimulationIteration();
@@ -84,7 +111,7 @@ class PhysicsSim
   void applyGravity();
 
   // @brief Add motor power to the arm slice for timeSlice seconds
-  void applyMotor( double motorPower, double timeSlice );
+  void applyMotor( const Scalar& motorPower, double timeSlice );
 
   // @brief Apply rolling friction to the arm for timeSlice seconds
   void applyFriction( double rollingFriction );
@@ -103,15 +130,20 @@ class PhysicsSim
 
   private:
 
-  double mAngle = 0.0;
-  double mAngleVel = 0.0;
-  double mAngleAccel = 0.0;
+  Scalar mAngle = 0.0;
+  Scalar mAngleVel = 0.0;
+  Scalar mAngleAccel = 0.0;
   double mMaxNoiseInRadians = 0.0;
+  std::uint64_t mNoiseKey = 0;      // From the seed
+  std::uint64_t mNoiseDraws = 0;    // Noise values read so far
 
-  Utils::MovingAverage<double> mMotorDelay;
-  Utils::Delayer<double> mSensorDelay;
+  Utils::MovingAverage<Scalar> mMotorDelay;
+  Utils::Delayer<Scalar> mSensorDelay;
 };
 
+/// @brief The simulation everything but sensitivity analysis uses
+using PhysicsSim = BasicPhysicsSim<double>;
+
 }
 
 #endif
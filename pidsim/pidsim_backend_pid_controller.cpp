@@ -1,10 +1,12 @@
 #include "pidsim_backend_pid_controller.h"
+#include "pidsim_backend_gain_schedule.h"
 #include <algorithm>
 
 namespace PidSim {
 
 // See header for interface
-void PidController::updatePidSettings( double pidP, double pidI, double pidD, double targetAngle )
+template< typename Scalar >
+void BasicPidController<Scalar>::updatePidSettings( const Scalar& pidP, const Scalar& pidI, const Scalar& pidD, double targetAngle )
 {
   // If the new I setting is different than the old one, reset the accumulated error.
   if ( pidI != mPidI ) { mIError = 0; }
@@ -15,32 +17,47 @@ void PidController::updatePidSettings( double pidP, double pidI, double pidD, do
   mTargetAngle = targetAngle;
 }
 
+// See header for interface
+template< typename Scalar >
+void BasicPidController<Scalar>::setGainSchedule( const GainSchedule* schedule )
+{
+  mGainSchedule = schedule;
+}
+
 // See header for interface.
-PidController::Output
-PidController::updatePidController( double timeSlice, double sensorInputAngle )
+template< typename Scalar >
+typename BasicPidController<Scalar>::Output
+BasicPidController<Scalar>::updatePidController( double timeSlice, const Scalar& sensorInputAngle )
 {
   // Compute new values for the P, I, and D errors
-  const double pError = sensorInputAngle - mTargetAngle;
+  const Scalar pError = sensorInputAngle - mTargetAngle;
   mIError += pError;
-  const double iError = mIError * timeSlice; 
-  const double dError = (pError - mLastPError) / timeSlice;
+  const Scalar iError = mIError * timeSlice; 
+  const Scalar dError = (pError - mLastPError) / timeSlice;
 
   // Record the current proportional error so we can compute derivative error next iteration
   mLastPError = pError;
 
+  // If there's a gain schedule, scale the gains for the current angle.
+  const GainSchedule::Gains scale = mGainSchedule ?
+    mGainSchedule->lookup( Utils::valueOf( sensorInputAngle )) : GainSchedule::Gains{ 1.0, 1.0, 1.0 };
+
   // Compute the P, I, and D gains, them add them together.
-  const double pGain = pError * mPidP;
-  const double iGain = iError * mPidI;
-  const double dGain = dError * mPidD;
-  const double allGains = pGain + iGain + dGain;
+  const Scalar pGain = pError * mPidP * scale.mPidP;
+  const Scalar iGain = iError * mPidI * scale.mPidI;
+  const Scalar dGain = dError * mPidD * scale.mPidD;
+  const Scalar allGains = pGain + iGain + dGain;
   
   // Compute the new motorPower.  Make sure the output power is within some reasonable
   // range.  Motors are not infinitely powerful.  TODO - clean up constants here.
-  const double motorPower = std::max(-4.0, std::min( -allGains, 4.0 )) / 5.0;
+  const Scalar motorPower = std::max<Scalar>(-4.0, std::min<Scalar>( -allGains, 4.0 )) / 5.0;
 
   return Output{ pError, iError, dError, motorPower };
 }
 
-}
-
+// The scalar types the controller runs with.  Dual<3> carries derivatives
+// with respect to Kp, Ki & Kd, see Sensitivity.
+template class BasicPidController<double>;
+template class BasicPidController<Utils::Dual<3>>;
 
+}
@@ -1,12 +1,21 @@
 #ifndef __PIDSIM_BACKEND_PID_CONTROLLER_H__
 #define __PIDSIM_BACKEND_PID_CONTROLLER_H__
 
+#include "pidsim_utils_dual.h"
+
 namespace PidSim {
 
+class GainSchedule;
+
 ///
 /// @brief A class that implements a PID controller
 /// 
-class PidController
+/// @param[in] Scalar = the type for the gains & errors.  double, or a
+///                     Utils::Dual to get derivatives with respect to the
+///                     gains.  Both are instantiated in the .cpp.
+///
+template< typename Scalar >
+class BasicPidController
 {
   public:
 
@@ -16,7 +25,7 @@ class PidController
   struct Output
   {
     Output() = delete;
-    Output( double pError, double iError, double dError, double motorPower ) :
+    Output( Scalar pError, Scalar iError, Scalar dError, Scalar motorPower ) :
       mPError{pError}, 
       mIError{iError}, 
       mDError{dError}, 
@@ -24,13 +33,13 @@ class PidController
     {}
 
     /// @brief The proportional error from the PID controller.  For reporting.
-    double mPError;
+    Scalar mPError;
     /// @brief The integral error from the PID controller. For reporting
-    double mIError;
+    Scalar mIError;
     /// @brief The derivative error from the PID controller. For reporting
-    double mDError;
+    Scalar mDError;
     /// @brief The motor power setting from the PID controller
-    double mMotorPower;
+    Scalar mMotorPower;
   };
 
   ///
@@ -41,7 +50,16 @@ class PidController
   /// @param[in] pidD         - New PID "D" Gain
   /// @param[in] targetAngle  - New Set Point
   ///
-  void updatePidSettings(double pidP, double pidI, double pidD, double targetAngle );
+  void updatePidSettings( const Scalar& pidP, const Scalar& pidI, const Scalar& pidD, double targetAngle );
+
+  ///
+  /// @brief Scale the gains depending on the sensor angle
+  ///
+  /// @param[in] schedule     - The gain schedule, or nullptr to turn
+  ///                           scheduling off.  Not owned; it must outlive
+  ///                           the controller or be replaced.
+  ///
+  void setGainSchedule( const GainSchedule* schedule );
 
   ///
   /// @brief Apply the PID controller to sensorInputAngle for one time slice 
@@ -50,17 +68,21 @@ class PidController
   /// @param[in] sensorAngle  - The current angle from the sensor, in radians
   /// @return    The PID Controller error terms @ the motor power 
   ///
-  Output updatePidController( double timeSlice, double sensorAngle );
+  Output updatePidController( double timeSlice, const Scalar& sensorAngle );
 
   private:
-  double mPidP = 0;
-  double mPidI = 0;
-  double mPidD = 0;
-  double mIError = 0;
-  double mLastPError = 0;
+  Scalar mPidP = 0;
+  Scalar mPidI = 0;
+  Scalar mPidD = 0;
+  Scalar mIError = 0;
+  Scalar mLastPError = 0;
   double mTargetAngle = 0;
+  const GainSchedule* mGainSchedule = nullptr;
 };
 
+/// @brief The controller everything but sensitivity analysis uses
+using PidController = BasicPidController<double>;
+
 }
 
 #endif
@@ -0,0 +1,150 @@
+
+#include "pidsim_backend_plant_identifier.h"
+#include "pidsim_utils.h"
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
+
+namespace PidSim {
+
+namespace {
+  // Samples this close to a hard stop (see PhysicsSim::imposePositionHardLimits) are skipped
+  const double minAngle = Utils::degToRad( -120 + 1 );
+  const double maxAngle = Utils::degToRad( 210 - 1 );
+
+  // Starting covariance.  Big, so the first samples set the fit.
+  constexpr double initialP = 1e6;
+
+  // Forgetting stops while trace( P ) is above this
+  constexpr double maxTrace = 1e5;
+
+  // The residual leaves out this many samples while the fit gets going
+  constexpr std::size_t warmUp = 4 * PlantIdentifier::parameters;
+}
+
+PlantIdentifier::PlantIdentifier( double forgetting, double timeSlice ) :
+  mRls        { forgetting, initialP, maxTrace },
+  mTimeSlice  { timeSlice },
+  mLastPhi    { Rls::Vector::Zero() }
+{
+}
+
+//
+// 1. Remember the command
+// 2. Turn the angle into a velocity
+// 3. Fit last tick's regressors to this tick's velocity
+// 4. Set up this tick's regressors
+//
+void PlantIdentifier::update( double sensorAngle, double motorCommand )
+{
+  // 1. Remember the command
+  mNewest = mNewest == 0 ? taps - 1 : mNewest - 1;
+  mCommands[ mNewest ] = motorCommand;
+
+  // 2. Turn the angle into a velocity
+  const bool nearStop = sensorAngle < minAngle || sensorAngle > maxAngle;
+  if ( !mHaveAngle ) {
+    mLastAngle = sensorAngle;
+    mHaveAngle = true;
+    return;
+  }
+  const double velocity = ( sensorAngle - mLastAngle ) / mTimeSlice;
+  mLastAngle = sensorAngle;
+
+  // 3. Fit last tick's regressors to this tick's velocity
+  if ( mHavePhi && !nearStop ) {
+    const double error = mRls.update( mLastPhi, velocity );
+    if ( ++mSamples > warmUp ) {
+      mSquaredError = mSquaredError * 0.999 + error * error;
+      mErrorWeight  = mErrorWeight  * 0.999 + 1.0;
+    }
+  }
+
+  // 4. Set up this tick's regressors
+  mHavePhi = !nearStop;
+  mLastPhi[ 0 ] = velocity;
+  mLastPhi[ 1 ] = -cos( sensorAngle ) * mTimeSlice;
+  for ( int tap = 0; tap < taps; ++tap ) {
+    mLastPhi[ 2 + tap ] = mCommands[ ( mNewest + tap ) % taps ];
+  }
+}
+
+// See header for interface
+void PlantIdentifier::fit( const std::vector<double>& sensorAngles, const std::vector<double>& motorCommands )
+{
+  assert( sensorAngles.size() == motorCommands.size() );
+  for ( std::size_t tick = 0; tick < sensorAngles.size(); ++tick ) {
+    update( sensorAngles[ tick ], motorCommands[ tick ] );
+  }
+}
+
+//
+// 1. Undo the keep factor
+// 2. The taps' sum is 1 / J, their mean is the average delay
+// 3. Find the window of equal taps that's closest to the fitted ones.
+//    For a window of m taps, the best height is their mean, and the
+//    squared error is sum( h^2 ) - sum( window )^2 / m, so the best
+//    window has the biggest sum / sqrt( m ).  A delay of n ticks in
+//    PhysicsSim is 1 + ms / 20 ticks, and the first tap for a one tick
+//    sensor delay is tap 0, so the window's start lines up with ms.
+//
+PlantIdentifier::Estimate PlantIdentifier::getEstimate() const
+{
+  const Rls::Vector& theta = mRls.getParameters();
+  Estimate estimate{ 0.0, INFINITY, 0.0, 0.0, 0.0, 0.0, 0.0, mSamples };
+  estimate.mResidual = mErrorWeight > 0.0 ? sqrt( mSquaredError / mErrorWeight ) : 0.0;
+  const double keep = theta[ 0 ];
+  if ( keep == 0.0 ) {
+    return estimate;
+  }
+
+  // 1. Undo the keep factor
+  estimate.mFriction = 1.0 - keep;
+  estimate.mGravity  = theta[ 1 ] / keep;
+
+  // 2. The taps' sum is 1 / J, their mean is the average delay
+  std::array<double, taps + 1> sums{};
+  double mean = 0.0;
+  for ( int tap = 0; tap < taps; ++tap ) {
+    sums[ tap + 1 ] = sums[ tap ] + theta[ 2 + tap ];
+    mean += theta[ 2 + tap ] * tap;
+  }
+  const double sum = sums[ taps ];
+  if ( sum == 0.0 ) {
+    return estimate;
+  }
+  estimate.mInertia = keep / sum;
+  estimate.mDelay   = mean / sum * mTimeSlice * 1000.0;
+
+  // 3. Find the closest window of equal taps
+  double best = -INFINITY;
+  for ( int start = 0; start < taps; ++start ) {
+    for ( int end = start + 1; end <= taps; ++end ) {
+      const double score = ( sums[ end ] - sums[ start ] ) / sqrt( end - start );
+      if ( score > best ) {
+        best = score;
+        estimate.mSensorDelay = start * mTimeSlice * 1000.0;
+        estimate.mMotorDelay  = ( end - start - 1 ) * mTimeSlice * 1000.0;
+      }
+    }
+  }
+  return estimate;
+}
+
+//
+// BatchSim rounds delays down to whole ticks, so add half a tick to the
+// whole tick estimates
+//
+BatchSim::ArmSettings PlantIdentifier::toArmSettings( BatchSim::ArmSettings arm ) const
+{
+  const Estimate estimate = getEstimate();
+  const double halfTick = mTimeSlice * 1000.0 / 2.0;
+  const double maxDelay = ( BatchSim::maxDelayTicks - 1 ) * mTimeSlice * 1000.0;
+  arm.mRollingFriction  = std::max( 0.0, std::min( estimate.mFriction, 1.0 ));
+  arm.mSensorDelay      = std::min( estimate.mSensorDelay + halfTick, maxDelay );
+  arm.mMotorDelay       = std::min( estimate.mMotorDelay + halfTick, maxDelay );
+  return arm;
+}
+
+}
+
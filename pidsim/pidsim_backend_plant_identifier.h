@@ -0,0 +1,209 @@
+#ifndef __PIDSIM_BACKEND_PLANT_IDENTIFIER_H__
+#define __PIDSIM_BACKEND_PLANT_IDENTIFIER_H__
+
+#include <array>
+#include <cstddef>
+#include <vector>
+#include <Eigen/Core>
+#include "pidsim_backend_batch_sim.h"
+
+namespace PidSim {
+
+///
+/// @brief Recursive least squares with exponential forgetting
+///
+/// @param[in] N  - The number of parameters
+///
+/// Fits y = phi' theta one sample at a time.  Samples k ticks old are
+/// weighted by lambda^k, so the fit tracks a plant that changes.  Each
+/// update is O( N^2 ) with no heap allocations.
+///
+/// A loop that's sitting still doesn't excite every direction, and
+/// forgetting would blow P up in the directions it isn't seeing (estimator
+/// windup).  So forgetting stops while trace( P ) is above a limit.
+///
+template< int N >
+class RecursiveLeastSquares
+{
+  public:
+
+  // Expose some standard types
+  using Vector = Eigen::Matrix<double, N, 1>;
+  using Matrix = Eigen::Matrix<double, N, N>;
+
+  ///
+  /// @brief Constructor
+  ///
+  /// @param[in] forgetting - lambda, i.e., .999 remembers about 1000 samples
+  /// @param[in] initialP   - The starting covariance, times the identity.
+  ///                         Big means "no idea yet".
+  /// @param[in] maxTrace   - Stop forgetting while trace( P ) is above this
+  ///
+  RecursiveLeastSquares( double forgetting, double initialP, double maxTrace ) :
+    mTheta      { Vector::Zero() },
+    mP          { Matrix::Identity() * initialP },
+    mForgetting { forgetting },
+    mMaxTrace   { maxTrace }
+  {
+  }
+
+  // Remove constructors I probably never want (i.e., if used they're a bug)
+  RecursiveLeastSquares() = delete;
+
+  ///
+  /// @brief Add a sample
+  ///
+  /// 1. Predict y with the current fit
+  /// 2. Work out the gain, k = P phi / ( lambda + phi' P phi )
+  /// 3. Move theta by the gain times the error, and update P
+  ///
+  /// @param[in] phi  - The regressors
+  /// @param[in] y    - The value to fit
+  /// @return         - The error before the update, y - phi' theta
+  ///
+  double update( const Vector& phi, double y )
+  {
+    // 1. Predict y with the current fit
+    const double error = y - phi.dot( mTheta );
+
+    // 2. Work out the gain
+    const double lambda = mP.trace() > mMaxTrace ? 1.0 : mForgetting;
+    const Vector pPhi = mP * phi;
+    const Vector gain = pPhi / ( lambda + phi.dot( pPhi ));
+
+    // 3. Move theta, and update P
+    mTheta += gain * error;
+    mP.noalias() -= gain * pPhi.transpose();
+    mP /= lambda;
+    return error;
+  }
+
+  /// @brief The fit so far
+  [[nodiscard]] const Vector& getParameters() const { return mTheta; }
+
+  /// @brief The covariance, up to the noise variance
+  [[nodiscard]] const Matrix& getCovariance() const { return mP; }
+
+  private:
+
+  Vector  mTheta;
+  Matrix  mP;
+  double  mForgetting;
+  double  mMaxTrace;
+};
+
+///
+/// @brief Fits the arm's plant from its sensor and motor streams
+///
+/// Per tick, the simulation does
+///
+///   vel'    = keep * ( vel - g cos( angle ) dt + motor power / J )
+///   angle'  = angle + vel' dt
+///
+/// where keep = 1 - rolling friction and the motor power is the average
+/// of the last few motor commands.  The sensor sees the angle a few ticks
+/// late.  Both delays together just make the velocity change depend on a
+/// window of past motor commands, so with the velocity taken from the
+/// sensor (w = change in sensor angle / dt), that's linear in
+///
+///   phi   = [ w, -cos( sensor angle ) dt, u[ k ], u[ k-1 ], ... ]
+///   theta = [ keep, keep g, keep h0, keep h1, ... ]
+///
+/// with w one tick later as the value to fit.  RLS tracks theta; the
+/// plant comes out as friction = 1 - keep, gravity g, inertia 1 / sum( h )
+/// and the delays from where the taps h are.  A moving average of m
+/// commands, d ticks late, is m equal taps starting at d, so the closest
+/// run of equal taps gives both.
+///
+/// Samples next to the hard stops, which kill the velocity, are skipped.
+/// Gravity really pulls on where the arm is, not where the sensor says it
+/// was, so a slow sensor pulls g a little low (2% at 20 ms).
+///
+/// Sensor noise ends up on both sides of the fit (and the PID controller
+/// feeds it back into u), which biases least squares towards more
+/// friction and gravity.  Differencing makes it worse: 0.1 degrees of
+/// noise is already noticeable.  Identify with the noise turned down.
+///
+class PlantIdentifier
+{
+  public:
+
+  /// @brief Motor commands in the fit.  Covers 200 ms of each delay.
+  static constexpr int taps = 24;
+  /// @brief Parameters in the fit
+  static constexpr int parameters = 2 + taps;
+
+  using Rls = RecursiveLeastSquares<parameters>;
+
+  ///
+  /// @brief The plant, as fitted
+  ///
+  struct Estimate
+  {
+    double        mGravity;         // g, in radians/s^2 at horizontal.  9.8 in the simulation.
+    double        mInertia;         // J, relative to the simulation's arm
+    double        mFriction;        // As per PhysicsSim::applyFriction, per tick
+    double        mDelay;           // Motor command to sensor, on average, in ms
+    double        mSensorDelay;     // As BatchSim::ArmSettings would have it, in whole ticks of ms
+    double        mMotorDelay;      // As BatchSim::ArmSettings would have it, in whole ticks of ms
+    double        mResidual;        // RMS one tick velocity prediction error, in radians/s
+    std::size_t   mSamples;         // Samples fitted
+  };
+
+  ///
+  /// @brief Constructor
+  ///
+  /// @param[in] forgetting - lambda.  The default remembers about 20 s.
+  /// @param[in] timeSlice  - The tick length, in seconds
+  ///
+  explicit PlantIdentifier( double forgetting = 0.999, double timeSlice = BatchSim::timeSlice );
+
+  ///
+  /// @brief Add one tick
+  ///
+  /// @param[in] sensorAngle  - What the sensor read at the start of the
+  ///                           tick, in radians
+  /// @param[in] motorCommand - The motor command that tick produced
+  ///
+  void update( double sensorAngle, double motorCommand );
+
+  ///
+  /// @brief Add a whole recorded trace, as if update() were called on each tick
+  ///
+  /// @param[in] sensorAngles   - One per tick, in radians
+  /// @param[in] motorCommands  - One per tick
+  ///
+  void fit( const std::vector<double>& sensorAngles, const std::vector<double>& motorCommands );
+
+  /// @brief The plant, from the fit so far
+  [[nodiscard]] Estimate getEstimate() const;
+
+  ///
+  /// @brief Put the fitted plant into arm settings for simulating
+  ///
+  /// @param[in] arm  - Gains, angles etc. to keep
+  /// @return         - arm, with the friction and delays from the fit
+  ///
+  [[nodiscard]] BatchSim::ArmSettings toArmSettings( BatchSim::ArmSettings arm ) const;
+
+  /// @brief The raw fit
+  [[nodiscard]] const Rls& getRls() const { return mRls; }
+
+  private:
+
+  Rls                             mRls;
+  double                          mTimeSlice;
+  std::array<double, taps>        mCommands{};        // Ring of recent motor commands
+  unsigned                        mNewest       = 0;  // Where the latest command is in the ring
+  Rls::Vector                     mLastPhi;           // Regressors from the last tick
+  double                          mLastAngle    = 0.0;
+  bool                            mHaveAngle    = false;
+  bool                            mHavePhi      = false;
+  double                          mSquaredError = 0.0;  // Forgetting weighted, for the residual
+  double                          mErrorWeight  = 0.0;
+  std::size_t                     mSamples      = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,246 @@
+
+#include "pidsim_backend_rare_failure.h"
+#include "pidsim_utils.h"
+#include <algorithm>
+#include <math.h>
+#include <numeric>
+#include <thread>
+
+namespace PidSim {
+
+namespace {
+  // The hard stops, as per PhysicsSim::imposePositionHardLimits
+  const double minAngle = Utils::degToRad( -120 );
+  const double maxAngle = Utils::degToRad( 210 );
+
+  // The least number of runs worth giving a core of its own
+  constexpr std::size_t minRunsPerBatch = 16;
+
+  // Plain Monte Carlo simulates this many runs at a time
+  constexpr std::size_t monteCarloChunk = 4096;
+
+  // Chain acceptance outside this range changes rho for the next level
+  constexpr double minAcceptance = 0.2;
+  constexpr double maxAcceptance = 0.5;
+
+  //
+  // Counter based standard normals, so every run's inputs can be
+  // recreated from the seed
+  //
+  class Normals
+  {
+    public:
+
+    explicit Normals( std::uint64_t seed ) : mSeed{ seed } {}
+
+    double operator()()
+    {
+      const double deviate = Utils::toGaussian( Utils::splitMix64( mSeed + 2 * mDraws ),
+                                                Utils::splitMix64( mSeed + 2 * mDraws + 1 ));
+      ++mDraws;
+      return deviate;
+    }
+
+    std::vector<double> vector( std::size_t size )
+    {
+      std::vector<double> result( size );
+      for ( double& value : result ) {
+        value = ( *this )();
+      }
+      return result;
+    }
+
+    private:
+
+    std::uint64_t mSeed;
+    std::uint64_t mDraws = 0;
+  };
+
+  std::size_t countFailures( const std::vector<double>& scores )
+  {
+    return static_cast<std::size_t>( std::count_if( scores.begin(), scores.end(),
+      []( double score ) { return score >= 0.0; } ));
+  }
+}
+
+// See header for interface
+std::size_t RareFailureAnalysis::inputSize( const Settings& settings )
+{
+  const unsigned interval = std::max( 1u, settings.mPushInterval );
+  return settings.mTicks + ( settings.mTicks + interval - 1 ) / interval;
+}
+
+//
+// 1. Turn the normals into noise (tick major, for BatchSim) and pushes
+// 2. Simulate a tick at a time, pushing every push interval and keeping
+//    track of how close each arm gets to a stop
+//
+std::vector<double> RareFailureAnalysis::score( const Settings& settings,
+                                                const std::vector<std::vector<double>>& inputs )
+{
+  const std::size_t count = inputs.size();
+  const unsigned interval = std::max( 1u, settings.mPushInterval );
+  std::vector<double> scores( count, -INFINITY );
+  const std::size_t batches = std::max<std::size_t>( 1, std::min<std::size_t>(
+    std::thread::hardware_concurrency(), count / minRunsPerBatch ));
+
+  Utils::parallelFor( batches, [&]( std::size_t batch ) {
+    const std::size_t begin = count * batch / batches;
+    const std::size_t end   = count * ( batch + 1 ) / batches;
+    const std::size_t arms  = end - begin;
+
+    // 1. Turn the normals into noise and pushes
+    std::vector<double> noise( settings.mTicks * arms );
+    for ( std::size_t arm = 0; arm < arms; ++arm ) {
+      const std::vector<double>& input = inputs[ begin + arm ];
+      for ( unsigned tick = 0; tick < settings.mTicks; ++tick ) {
+        noise[ tick * arms + arm ] = erf( input[ tick ] / M_SQRT2 );
+      }
+    }
+    BatchSim sim( std::vector<BatchSim::ArmSettings>( arms, settings.mArm ));
+    sim.setNoise( std::move( noise ));
+
+    // 2. Simulate a tick at a time
+    for ( unsigned tick = 0; tick < settings.mTicks; ++tick ) {
+      if ( tick % interval == 0 ) {
+        for ( std::size_t arm = 0; arm < arms; ++arm ) {
+          sim.bump( arm, settings.mPushSigma * inputs[ begin + arm ][ settings.mTicks + tick / interval ] );
+        }
+      }
+      sim.run( 1 );
+      const std::vector<double>& angles = sim.getActualAngles();
+      for ( std::size_t arm = 0; arm < arms; ++arm ) {
+        const double closeness = std::max( angles[ arm ] - maxAngle, minAngle - angles[ arm ] );
+        scores[ begin + arm ] = std::max( scores[ begin + arm ], closeness );
+      }
+    }
+  });
+  return scores;
+}
+
+//
+// 1. Simulate N runs from scratch
+// 2. Stop if enough of them fail (or we're out of levels)
+// 3. Set the next level, and seed a chain with each run above it
+// 4. Step every chain at once.  A move that falls below the level is
+//    rejected, and the chain stays put.
+// 5. Tune rho for the next level
+//
+RareFailureAnalysis::Report RareFailureAnalysis::run( const Settings& settings )
+{
+  Report report{ 1.0, 0.0, 0, 0, {}, 0.0 };
+  Normals normals( settings.mSeed );
+  const std::size_t size  = inputSize( settings );
+  const std::size_t runs  = std::max<std::size_t>( 2, settings.mRunsPerLevel );
+  const std::size_t seeds = std::max<std::size_t>( 1, static_cast<std::size_t>(
+    std::lround( settings.mLevelProbability * static_cast<double>( runs ))));
+  const std::size_t chainLength = std::max<std::size_t>( 1, runs / seeds );
+  double rho = settings.mCorrelation;
+  double squaredCV = 0.0;
+  std::size_t moves = 0, accepted = 0;
+
+  // 1. Simulate N runs from scratch
+  std::vector<std::vector<double>> inputs;
+  for ( std::size_t run = 0; run < runs; ++run ) {
+    inputs.push_back( normals.vector( size ));
+  }
+  std::vector<double> scores = score( settings, inputs );
+  report.mSimulations += runs;
+
+  for ( unsigned level = 0; ; ++level ) {
+    // 2. Stop if enough of them fail (or we're out of levels)
+    std::vector<std::size_t> order( inputs.size() );
+    std::iota( order.begin(), order.end(), 0 );
+    std::stable_sort( order.begin(), order.end(), [&]( std::size_t a, std::size_t b ) {
+      return scores[ a ] > scores[ b ];
+    });
+    const double n = static_cast<double>( inputs.size() );
+    const double threshold = seeds < order.size()
+      ? ( scores[ order[ seeds - 1 ]] + scores[ order[ seeds ]] ) / 2.0
+      : scores[ order.back() ];
+    if ( threshold >= 0.0 || level + 1 >= settings.mMaxLevels ) {
+      report.mFailures = countFailures( scores );
+      const double fraction = static_cast<double>( report.mFailures ) / n;
+      report.mProbability *= fraction;
+      squaredCV += fraction > 0.0 ? ( 1.0 - fraction ) / ( fraction * n ) : INFINITY;
+      break;
+    }
+
+    // 3. Set the next level, and seed a chain with each run above it
+    const double levelProbability = static_cast<double>( seeds ) / n;
+    report.mProbability *= levelProbability;
+    squaredCV += ( 1.0 - levelProbability ) / ( levelProbability * n );
+    report.mLevels.push_back( threshold );
+    std::vector<std::vector<double>> chains;
+    std::vector<double> chainScores;
+    for ( std::size_t seed = 0; seed < seeds; ++seed ) {
+      chains.push_back( inputs[ order[ seed ]] );
+      chainScores.push_back( scores[ order[ seed ]] );
+    }
+    inputs = chains;
+    scores = chainScores;
+
+    // 4. Step every chain at once
+    const double spread = sqrt( 1.0 - rho * rho );
+    std::size_t levelAccepted = 0;
+    for ( std::size_t step = 1; step < chainLength; ++step ) {
+      std::vector<std::vector<double>> proposals( seeds );
+      for ( std::size_t chain = 0; chain < seeds; ++chain ) {
+        proposals[ chain ] = normals.vector( size );
+        for ( std::size_t i = 0; i < size; ++i ) {
+          proposals[ chain ][ i ] = rho * chains[ chain ][ i ] + spread * proposals[ chain ][ i ];
+        }
+      }
+      const std::vector<double> proposalScores = score( settings, proposals );
+      report.mSimulations += seeds;
+      for ( std::size_t chain = 0; chain < seeds; ++chain ) {
+        if ( proposalScores[ chain ] > threshold ) {
+          chains[ chain ]       = std::move( proposals[ chain ] );
+          chainScores[ chain ]  = proposalScores[ chain ];
+          ++levelAccepted;
+        }
+        inputs.push_back( chains[ chain ] );
+        scores.push_back( chainScores[ chain ] );
+      }
+    }
+
+    // 5. Tune rho for the next level
+    const std::size_t levelMoves = seeds * ( chainLength - 1 );
+    moves += levelMoves;
+    accepted += levelAccepted;
+    const double acceptance = levelMoves > 0 ? static_cast<double>( levelAccepted ) / static_cast<double>( levelMoves ) : 1.0;
+    const double newSpread =
+      acceptance < minAcceptance ? spread * 0.7 :
+      acceptance > maxAcceptance ? std::min( 1.0, spread * 1.3 ) : spread;
+    rho = sqrt( 1.0 - newSpread * newSpread );
+  }
+
+  report.mCoefficientOfVariation = sqrt( squaredCV );
+  report.mAcceptance = moves > 0 ? static_cast<double>( accepted ) / static_cast<double>( moves ) : 0.0;
+  return report;
+}
+
+// See header for interface
+RareFailureAnalysis::Report RareFailureAnalysis::monteCarlo( const Settings& settings, std::size_t runs )
+{
+  Report report{ 0.0, 0.0, 0, 0, {}, 0.0 };
+  Normals normals( settings.mSeed );
+  const std::size_t size = inputSize( settings );
+  while ( report.mSimulations < runs ) {
+    const std::size_t count = std::min( monteCarloChunk, runs - report.mSimulations );
+    std::vector<std::vector<double>> inputs;
+    for ( std::size_t run = 0; run < count; ++run ) {
+      inputs.push_back( normals.vector( size ));
+    }
+    report.mFailures += countFailures( score( settings, inputs ));
+    report.mSimulations += count;
+  }
+  const double n = static_cast<double>( report.mSimulations );
+  report.mProbability = static_cast<double>( report.mFailures ) / n;
+  report.mCoefficientOfVariation = report.mFailures > 0
+    ? sqrt(( 1.0 - report.mProbability ) / ( report.mProbability * n )) : INFINITY;
+  return report;
+}
+
+}
+
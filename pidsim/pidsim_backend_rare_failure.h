@@ -0,0 +1,108 @@
+#ifndef __PIDSIM_BACKEND_RARE_FAILURE_H__
+#define __PIDSIM_BACKEND_RARE_FAILURE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "pidsim_backend_batch_sim.h"
+
+namespace PidSim {
+
+///
+/// @brief How likely is the arm to hit a hard stop?
+///
+/// The arm holds or moves as usual while sensor noise and random pushes
+/// act on it.  A run fails if the arm reaches -120 or 210 degrees (see
+/// PhysicsSim::imposePositionHardLimits).  With good gains that's rare,
+/// and plain Monte Carlo needs about 100 / p runs to see enough failures
+/// to estimate p.
+///
+/// Subset simulation (a form of multilevel splitting) gets there in
+/// steps instead.  Every run is driven by a vector of standard normals:
+/// one per tick for the noise (mapped to -1..1 through the normal CDF)
+/// and one per push.  Each run is scored by how close it got to a stop,
+/// with 0 meaning it hit one.
+///
+/// 1. Simulate N runs from scratch
+/// 2. Set the next level to the score that the best p0 N runs beat.  The
+///    probability of beating it is p0.
+/// 3. Grow new runs from those, with Markov chains that only accept
+///    moves that stay above the level.  The preconditioned Crank-Nicolson
+///    move, x' = rho x + sqrt( 1 - rho^2 ) z, keeps the normals' own
+///    distribution, so there's nothing to reweight.
+/// 4. Repeat until p0 N runs fail.  P( fail ) is p0 to the number of
+///    levels, times the fraction that fail at the last level.
+///
+/// So 1e-6 takes 6 levels of N runs, not 1e8 runs.  Each chain step
+/// simulates all the chains together as one batch, spread over the cores.
+///
+class RareFailureAnalysis
+{
+  public:
+
+  ///
+  /// @brief The runs, and how hard to look
+  ///
+  struct Settings
+  {
+    BatchSim::ArmSettings   mArm;                         // The arm, gains & noise.  mNoiseStream is ignored.
+    unsigned                mTicks              = 250;    // How long to simulate each run
+    unsigned                mPushInterval       = 25;     // Ticks between pushes
+    double                  mPushSigma          = 3.0;    // Standard deviation of a push, in radians/s
+    std::size_t             mRunsPerLevel       = 1000;   // N
+    double                  mLevelProbability   = 0.1;    // p0
+    unsigned                mMaxLevels          = 12;     // So p0 ^ 12 at the least
+    double                  mCorrelation        = 0.8;    // rho, to start with.  Adapted per level.
+    std::uint64_t           mSeed               = 1;
+  };
+
+  ///
+  /// @brief The estimate
+  ///
+  struct Report
+  {
+    double                mProbability;             // P( the arm hits a stop )
+    double                mCoefficientOfVariation;  // Of mProbability, if the runs were independent.
+                                                    // Chained runs aren't, so it's a lower bound.
+    std::size_t           mSimulations;             // Runs simulated
+    std::size_t           mFailures;                // Runs that hit a stop, at the last level
+    std::vector<double>   mLevels;                  // The score for each level, in radians
+    double                mAcceptance;              // Fraction of chain moves accepted
+  };
+
+  ///
+  /// @brief Estimate the failure probability with subset simulation
+  ///
+  /// @param[in] settings - The runs
+  ///
+  [[nodiscard]] static Report run( const Settings& settings );
+
+  ///
+  /// @brief Estimate the failure probability with plain Monte Carlo
+  ///
+  /// For checking subset simulation, where p isn't too small.
+  ///
+  /// @param[in] settings - The runs.  Only the arm, pushes and seed count.
+  /// @param[in] runs     - How many runs to simulate
+  ///
+  [[nodiscard]] static Report monteCarlo( const Settings& settings, std::size_t runs );
+
+  ///
+  /// @brief Simulate runs, given the normals that drive them
+  ///
+  /// @param[in] settings - The runs
+  /// @param[in] inputs   - One vector of inputSize() normals per run
+  /// @return             - How close each run got to a stop.  The largest
+  ///                       of angle - 210 degrees and -120 degrees - angle
+  ///                       over the run, so 0 if it hit one.
+  ///
+  [[nodiscard]] static std::vector<double> score( const Settings& settings,
+                                                  const std::vector<std::vector<double>>& inputs );
+
+  /// @brief The number of normals that drive one run
+  [[nodiscard]] static std::size_t inputSize( const Settings& settings );
+};
+
+}
+
+#endif
@@ -0,0 +1,381 @@
+
+#include "pidsim_backend_result_cache.h"
+#include "pidsim_utils.h"
+#include <assert.h>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace PidSim {
+
+namespace {
+  // The file starts with these two words
+  constexpr std::uint64_t fileMagic     = 0x4352534d49534450ull;  // "PDSIMSRC"
+  constexpr std::uint64_t formatVersion = 1;
+  constexpr std::size_t   headerWords   = 2;
+
+  // Each record is [ magic, words, key high, key low, 8 metrics, settled,
+  // trajectory length, trajectory..., checksum ], all 64 bit words
+  constexpr std::uint64_t recordMagic   = 0x5245434f52445053ull;
+  constexpr std::size_t   fixedWords    = 15;
+  constexpr std::size_t   wordSize      = sizeof( std::uint64_t );
+
+  // The map grows by at least this much, so appends don't remap every time
+  constexpr std::size_t   mapChunk      = 1 << 20;
+
+  //
+  // Two lanes of SplitMix64, fed one 64 bit word at a time
+  //
+  class Hasher
+  {
+    public:
+
+    void add( std::uint64_t word )
+    {
+      mHigh = Utils::splitMix64( mHigh ^ word );
+      mLow  = Utils::splitMix64( mLow + word );
+      ++mWords;
+    }
+
+    void add( double value )
+    {
+      // -0 and 0 simulate the same
+      value = value == 0.0 ? 0.0 : value;
+      std::uint64_t word;
+      std::memcpy( &word, &value, sizeof( word ));
+      add( word );
+    }
+
+    ResultCache::Key finish()
+    {
+      add( mWords );
+      return { mHigh, mLow };
+    }
+
+    private:
+
+    std::uint64_t mHigh   = 0x243f6a8885a308d3ull;
+    std::uint64_t mLow    = 0x13198a2e03707344ull;
+    std::uint64_t mWords  = 0;
+  };
+
+  // Must match the one scan() works out in place
+  std::uint64_t checksum( const std::uint64_t* words, std::size_t count )
+  {
+    std::uint64_t sum = 0;
+    for ( std::size_t i = 0; i < count; ++i ) {
+      sum = Utils::splitMix64( sum ^ words[ i ] );
+    }
+    return sum;
+  }
+
+  std::uint64_t toWord( double value )
+  {
+    std::uint64_t word;
+    std::memcpy( &word, &value, sizeof( word ));
+    return word;
+  }
+
+  double toDouble( std::uint64_t word )
+  {
+    double value;
+    std::memcpy( &value, &word, sizeof( value ));
+    return value;
+  }
+
+  // Read word i of a record (the map is only byte aligned as far as the
+  // compiler knows)
+  std::uint64_t wordAt( const unsigned char* record, std::size_t i )
+  {
+    std::uint64_t word;
+    std::memcpy( &word, record + i * wordSize, sizeof( word ));
+    return word;
+  }
+
+  // Hold a flock for the life of the scope
+  class FileLock
+  {
+    public:
+
+    FileLock( int file, int operation ) : mFile{ file } { flock( mFile, operation ); }
+    ~FileLock() { flock( mFile, LOCK_UN ); }
+
+    private:
+
+    int mFile;
+  };
+}
+
+//
+// Everything BatchSim reads from the arm, then the run itself, then the
+// simulation's own constants
+//
+ResultCache::Key ResultCache::key( const BatchSim::ArmSettings& arm, unsigned ticks, std::uint64_t seed )
+{
+  assert( arm.mNoiseStream != BatchSim::ownNoiseStream );
+  Hasher hasher;
+  hasher.add( arm.mPidP );
+  hasher.add( arm.mPidI );
+  hasher.add( arm.mPidD );
+  hasher.add( arm.mStartAngle );
+  hasher.add( arm.mTargetAngle );
+  hasher.add( arm.mRollingFriction );
+  hasher.add( arm.mSensorNoise );
+  hasher.add( arm.mSensorDelay );
+  hasher.add( arm.mMotorDelay );
+  hasher.add( static_cast<std::uint64_t>( arm.mProfileType ));
+  hasher.add( arm.mProfileLimits.mMaxVel );
+  hasher.add( arm.mProfileLimits.mMaxAccel );
+  hasher.add( arm.mProfileLimits.mMaxJerk );
+  hasher.add( arm.mNoiseStream );
+  hasher.add( static_cast<std::uint64_t>( arm.mAntitheticNoise ));
+  hasher.add( static_cast<std::uint64_t>( ticks ));
+  hasher.add( seed );
+  hasher.add( BatchSim::timeSlice );
+  hasher.add( static_cast<std::uint64_t>( BatchSim::resultsVersion ));
+  return hasher.finish();
+}
+
+//
+// 1. Open (or create) the file
+// 2. Under an exclusive lock, write the header if the file's new, or
+//    check it if it isn't
+// 3. Index what's there
+//
+ResultCache::ResultCache( const std::string& path )
+{
+  // 1. Open (or create) the file
+  const int file = open( path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644 );
+  if ( file < 0 ) {
+    return;
+  }
+
+  // 2. Write or check the header
+  bool good = false;
+  {
+    FileLock lock( file, LOCK_EX );
+    struct stat status;
+    const std::uint64_t header[ headerWords ] = { fileMagic, formatVersion };
+    std::uint64_t existing[ headerWords ] = {};
+    if ( fstat( file, &status ) == 0 && status.st_size == 0 ) {
+      good = pwrite( file, header, sizeof( header ), 0 ) == static_cast<ssize_t>( sizeof( header ));
+    }
+    else {
+      good = pread( file, existing, sizeof( existing ), 0 ) == static_cast<ssize_t>( sizeof( existing ))
+          && std::memcmp( header, existing, sizeof( header )) == 0;
+    }
+    if ( good ) {
+      // 3. Index what's there
+      std::lock_guard<std::mutex> guard( mMutex );
+      mFile     = file;
+      mScanned  = headerWords * wordSize;
+      scan( true );
+    }
+  }
+  if ( !good ) {
+    close( file );
+  }
+}
+
+ResultCache::~ResultCache()
+{
+  if ( mMap ) {
+    munmap( const_cast<unsigned char*>( mMap ), mMapped );
+  }
+  if ( mFile >= 0 ) {
+    close( mFile );
+  }
+}
+
+//
+// 1. Look in the index
+// 2. If it isn't there, another writer might have added it since the
+//    last scan
+// 3. Copy the record out of the map
+//
+bool ResultCache::find( const Key& key, StepMetrics::Result& metrics, std::vector<double>* trajectory )
+{
+  std::lock_guard<std::mutex> guard( mMutex );
+  if ( mFile < 0 ) {
+    return false;
+  }
+
+  // 1. Look in the index
+  auto found = mIndex.find( key );
+
+  // 2. If it isn't there, look for new records
+  if ( found == mIndex.end() ) {
+    FileLock lock( mFile, LOCK_SH );
+    scan( false );
+    found = mIndex.find( key );
+    if ( found == mIndex.end() ) {
+      return false;
+    }
+  }
+
+  // 3. Copy the record out of the map
+  const unsigned char* record = mMap + found->second;
+  metrics.mRiseTime         = toDouble( wordAt( record, 4 ));
+  metrics.mOvershoot        = toDouble( wordAt( record, 5 ));
+  metrics.mSettlingTime     = toDouble( wordAt( record, 6 ));
+  metrics.mSteadyStateError = toDouble( wordAt( record, 7 ));
+  metrics.mIAE              = toDouble( wordAt( record, 8 ));
+  metrics.mISE              = toDouble( wordAt( record, 9 ));
+  metrics.mITAE             = toDouble( wordAt( record, 10 ));
+  metrics.mControlEffort    = toDouble( wordAt( record, 11 ));
+  metrics.mSettled          = wordAt( record, 12 ) != 0;
+  if ( trajectory ) {
+    trajectory->resize( wordAt( record, 13 ));
+    for ( std::size_t i = 0; i < trajectory->size(); ++i ) {
+      ( *trajectory )[ i ] = toDouble( wordAt( record, fixedWords - 1 + i ));
+    }
+  }
+  return true;
+}
+
+//
+// 1. Under the exclusive lock, catch up with other writers, cutting off
+//    any half written record
+// 2. Don't store a key twice
+// 3. Map far enough for the record, then append it in one write.  If
+//    the map can't grow nothing is written, so whatever is written gets
+//    indexed, and the next append never lands on top of it.
+// 4. Index it, so find() can read it back right away
+//
+bool ResultCache::insert( const Key& key, const StepMetrics::Result& metrics, const std::vector<double>& trajectory )
+{
+  std::lock_guard<std::mutex> guard( mMutex );
+  if ( mFile < 0 ) {
+    return false;
+  }
+
+  // 1. Catch up with other writers
+  FileLock lock( mFile, LOCK_EX );
+  scan( true );
+
+  // 2. Don't store a key twice
+  if ( mIndex.count( key )) {
+    return false;
+  }
+
+  // 3. Map far enough for the record, then append it in one write
+  std::vector<std::uint64_t> words = {
+    recordMagic, fixedWords + trajectory.size(), key.mHigh, key.mLow,
+    toWord( metrics.mRiseTime ),  toWord( metrics.mOvershoot ),  toWord( metrics.mSettlingTime ),
+    toWord( metrics.mSteadyStateError ), toWord( metrics.mIAE ), toWord( metrics.mISE ),
+    toWord( metrics.mITAE ), toWord( metrics.mControlEffort ),
+    metrics.mSettled ? 1u : 0u, trajectory.size()
+  };
+  for ( double value : trajectory ) {
+    words.push_back( toWord( value ));
+  }
+  words.push_back( checksum( words.data(), words.size() ));
+
+  const std::size_t bytes = words.size() * wordSize;
+  if ( !mapTo( mScanned + bytes )) {
+    return false;
+  }
+  if ( pwrite( mFile, words.data(), bytes, static_cast<off_t>( mScanned )) != static_cast<ssize_t>( bytes )) {
+    if ( ftruncate( mFile, static_cast<off_t>( mScanned )) != 0 ) {
+      // The next writer's scan cuts it off
+    }
+    return false;
+  }
+
+  // 4. Index it
+  mIndex.emplace( key, mScanned );
+  mScanned += bytes;
+  return true;
+}
+
+// See header for interface
+void ResultCache::refresh()
+{
+  std::lock_guard<std::mutex> guard( mMutex );
+  if ( mFile >= 0 ) {
+    FileLock lock( mFile, LOCK_SH );
+    scan( false );
+  }
+}
+
+// See header for interface
+std::size_t ResultCache::size()
+{
+  std::lock_guard<std::mutex> guard( mMutex );
+  return mIndex.size();
+}
+
+//
+// 1. Map the whole file
+// 2. Index each record that's complete and passes its checksum
+// 3. Stop at the first that doesn't.  Under the exclusive lock no one
+//    else is writing, so it's left over from a crash; cut it off.
+//
+void ResultCache::scan( bool truncateTornTail )
+{
+  // 1. Map the whole file
+  struct stat status;
+  if ( fstat( mFile, &status ) != 0 ) {
+    return;
+  }
+  const std::size_t size = static_cast<std::size_t>( status.st_size );
+  if ( size <= mScanned || !mapTo( size )) {
+    return;
+  }
+
+  // 2. Index each record that's complete and passes its checksum
+  while ( size - mScanned >= fixedWords * wordSize ) {
+    const unsigned char* record = mMap + mScanned;
+    const std::uint64_t words = wordAt( record, 1 );
+    if ( wordAt( record, 0 ) != recordMagic || words < fixedWords
+      || words > ( size - mScanned ) / wordSize
+      || wordAt( record, 13 ) != words - fixedWords ) {
+      break;
+    }
+    std::uint64_t sum = 0;
+    for ( std::size_t i = 0; i + 1 < words; ++i ) {
+      sum = Utils::splitMix64( sum ^ wordAt( record, i ));
+    }
+    if ( sum != wordAt( record, words - 1 )) {
+      break;
+    }
+    mIndex.emplace( Key{ wordAt( record, 2 ), wordAt( record, 3 ) }, mScanned );
+    mScanned += words * wordSize;
+  }
+
+  // 3. Cut off what's left over from a crash
+  if ( truncateTornTail && mScanned < size ) {
+    if ( ftruncate( mFile, static_cast<off_t>( mScanned )) != 0 ) {
+      // Appends go at mScanned either way
+    }
+  }
+}
+
+//
+// The map is rounded up past the end of the file, so the file can grow
+// into it.  Shared mappings see other writers' appends; only bytes below
+// the file's size are ever read.
+//
+bool ResultCache::mapTo( std::size_t size )
+{
+  if ( size <= mMapped ) {
+    return true;
+  }
+  const std::size_t length = std::max( 2 * mMapped, ( size + mapChunk - 1 ) / mapChunk * mapChunk );
+  void* map = mmap( nullptr, length, PROT_READ, MAP_SHARED, mFile, 0 );
+  if ( map == MAP_FAILED ) {
+    return false;
+  }
+  if ( mMap ) {
+    munmap( const_cast<unsigned char*>( mMap ), mMapped );
+  }
+  mMap    = static_cast<const unsigned char*>( map );
+  mMapped = length;
+  return true;
+}
+
+}
+
@@ -0,0 +1,132 @@
+#ifndef __PIDSIM_BACKEND_RESULT_CACHE_H__
+#define __PIDSIM_BACKEND_RESULT_CACHE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "pidsim_backend_batch_sim.h"
+#include "pidsim_backend_step_metrics.h"
+
+namespace PidSim {
+
+///
+/// @brief An on-disk cache of simulation results, keyed by the scenario
+///
+/// Each result is filed under a 128 bit hash of everything that decides
+/// it: the arm's gains, plant, profile and noise stream, the seed, the
+/// tick count, the tick length and BatchSim::resultsVersion.  Change any
+/// of them (or the simulation code, and bump the version) and the old
+/// entry is simply never asked for again.
+///
+/// The file is append only: a header, then records of the key, the step
+/// metrics, an optional trajectory and a checksum.  It's memory mapped
+/// for reading, and an in-memory hash table maps keys to records.
+///
+/// Several processes (or several caches in one process) can share a
+/// file.  Appends hold an exclusive flock and scans a shared one.  Each
+/// append first picks up the records other writers added, so a key is
+/// only stored once.  A record a crashed writer left half written fails
+/// its checksum; readers stop short of it, and the next writer cuts it
+/// off before appending.
+///
+/// A cache that can't open its file stays empty and stores nothing, so
+/// callers just simulate everything.
+///
+class ResultCache
+{
+  public:
+
+  /// @brief A scenario's hash
+  struct Key
+  {
+    std::uint64_t   mHigh;
+    std::uint64_t   mLow;
+
+    bool operator==( const Key& other ) const { return mHigh == other.mHigh && mLow == other.mLow; }
+  };
+
+  ///
+  /// @brief The key for one arm's run
+  ///
+  /// @param[in] arm    - The arm.  mNoiseStream can't be ownNoiseStream,
+  ///                     since then the noise depends on the arm's slot.
+  /// @param[in] ticks  - How long it's simulated
+  /// @param[in] seed   - BatchSim's noise seed
+  ///
+  /// Gain schedules and setNoise() aren't covered, so runs that use them
+  /// shouldn't be cached.
+  ///
+  [[nodiscard]] static Key key( const BatchSim::ArmSettings& arm, unsigned ticks, std::uint64_t seed );
+
+  ///
+  /// @brief Open a cache file, creating it if it isn't there
+  ///
+  /// @param[in] path   - The file
+  ///
+  explicit ResultCache( const std::string& path );
+
+  ~ResultCache();
+
+  // Remove operations people shouldn't be using.
+  ResultCache() = delete;
+  ResultCache( const ResultCache& ) = delete;
+  ResultCache& operator=( const ResultCache& ) = delete;
+
+  /// @brief Did the file open?
+  [[nodiscard]] bool isOpen() const { return mFile >= 0; }
+
+  ///
+  /// @brief Look up a result
+  ///
+  /// @param[in] key          - The scenario
+  /// @param[out] metrics     - Its step metrics, if found
+  /// @param[out] trajectory  - Its trajectory (empty if none was stored),
+  ///                           if found and not null
+  /// @return                 - True if found
+  ///
+  bool find( const Key& key, StepMetrics::Result& metrics, std::vector<double>* trajectory = nullptr );
+
+  ///
+  /// @brief Store a result
+  ///
+  /// @param[in] key        - The scenario
+  /// @param[in] metrics    - Its step metrics
+  /// @param[in] trajectory - Optionally, i.e., the angle at every tick
+  /// @return               - True if it was added, false if the key was
+  ///                         already there or the write failed
+  ///
+  bool insert( const Key& key, const StepMetrics::Result& metrics, const std::vector<double>& trajectory = {} );
+
+  /// @brief Pick up records other writers have added
+  void refresh();
+
+  /// @brief Results in the cache, as of the last refresh
+  [[nodiscard]] std::size_t size();
+
+  private:
+
+  struct KeyHash
+  {
+    std::size_t operator()( const Key& key ) const { return static_cast<std::size_t>( key.mLow ); }
+  };
+
+  // Index records from mScanned up to the end of the file.  Call with
+  // mMutex and at least a shared flock held.
+  void scan( bool truncateTornTail );
+  // Make sure the map covers [0, size).  Call with mMutex held.
+  bool mapTo( std::size_t size );
+
+  std::mutex                                      mMutex;
+  int                                             mFile     = -1;
+  const unsigned char*                            mMap      = nullptr;
+  std::size_t                                     mMapped   = 0;    // Bytes mapped
+  std::size_t                                     mScanned  = 0;    // Offset of the first record not yet indexed
+  std::unordered_map<Key, std::size_t, KeyHash>   mIndex;           // Key to record offset
+};
+
+}
+
+#endif
@@ -0,0 +1,195 @@
+
+#include "pidsim_backend_robustness.h"
+#include "pidsim_utils.h"
+#include <algorithm>
+#include <array>
+#include <math.h>
+#include <thread>
+
+namespace PidSim {
+
+namespace {
+  // The least number of draws worth giving a core of its own
+  constexpr std::size_t minDrawsPerBatch = 16;
+
+  // Random numbers used per draw: 2 per distribution, for Box-Muller
+  constexpr std::uint64_t randomsPerDraw = 8;
+
+  // Salt so the plant draws don't line up with BatchSim's noise
+  constexpr std::uint64_t drawSalt = 0x0b0e0fda7a5e7ull;
+
+  // Plant parameters drawn per draw
+  constexpr std::size_t parametersPerDraw = 4;
+
+  //
+  // Draw one parameter, given a uniform value in (0, 1) and a standard
+  // normal that the shape can use
+  //
+  double sample( const RobustnessAnalysis::Distribution& distribution, double uniform, double normal )
+  {
+    using Shape = RobustnessAnalysis::Distribution::Shape;
+    double value = distribution.mA;
+    switch ( distribution.mShape ) {
+      case Shape::Fixed:
+        break;
+      case Shape::Uniform:
+        value = distribution.mA + ( distribution.mB - distribution.mA ) * uniform;
+        break;
+      case Shape::Normal:
+        value = distribution.mA + distribution.mB * normal;
+        break;
+    }
+    return std::max( 0.0, value );
+  }
+}
+
+RobustnessAnalysis::RobustnessAnalysis( const Settings& settings ) :
+  mSettings { settings },
+  mSobol    { makeSobol( settings ) },
+  mReport   { 0, 0, 0, 0, 0.0, 0.0, 1.0, 0, Verdict::Undecided }
+{
+}
+
+//
+// 1. Draw the round's arms
+// 2. Simulate them, spread over the cores
+// 3. Count the passes
+// 4. Work out the interval, at this round's share of the confidence
+// 5. Stop if it's narrow enough, decides the verdict, or we're out of draws
+//
+bool RobustnessAnalysis::step()
+{
+  if ( mDone ) {
+    return true;
+  }
+
+  // 1. Draw the round's arms
+  const std::size_t first = mReport.mDraws;
+  const std::size_t count = std::min( mSettings.mRoundSize, mSettings.mMaxDraws - first );
+  std::vector<BatchSim::ArmSettings> arms;
+  arms.reserve( count );
+  for ( std::size_t i = 0; i < count; ++i ) {
+    arms.push_back( drawArm( mSettings, mSobol, first + i ));
+  }
+
+  // 2. Simulate them, spread over the cores
+  std::vector<StepMetrics::Result> results( count );
+  const std::size_t batches = std::max<std::size_t>( 1, std::min<std::size_t>(
+    std::thread::hardware_concurrency(), count / minDrawsPerBatch ));
+  Utils::parallelFor( batches, [&]( std::size_t batch ) {
+    const std::size_t begin = count * batch / batches;
+    const std::size_t end   = count * ( batch + 1 ) / batches;
+    BatchSim sim( std::vector<BatchSim::ArmSettings>( arms.begin() + begin, arms.begin() + end ), mSettings.mSeed );
+    sim.run( mSettings.mTicks );
+    for ( std::size_t arm = 0; arm < sim.size(); ++arm ) {
+      results[ begin + arm ] = sim.getMetrics( arm );
+    }
+  });
+
+  // 3. Count the passes.  An arm that isn't in the band at the end
+  //    hasn't settled, whatever its last time outside the band says.
+  for ( const StepMetrics::Result& result : results ) {
+    const bool settled    = result.mSettled && result.mSettlingTime <= mSettings.mMaxSettlingTime;
+    const bool overshoot  = result.mOvershoot <= mSettings.mMaxOvershoot;
+    mReport.mSettleFailures     += !settled;
+    mReport.mOvershootFailures  += !overshoot;
+    mReport.mPasses             += settled && overshoot;
+  }
+  mReport.mDraws += count;
+  ++mReport.mRounds;
+  mReport.mPassRate = static_cast<double>( mReport.mPasses ) / static_cast<double>( mReport.mDraws );
+
+  // 4. Work out the interval, at this round's share of the confidence
+  const double rounds = static_cast<double>( mReport.mRounds );
+  const double alpha  = ( 1.0 - mSettings.mConfidence ) / ( rounds * ( rounds + 1.0 ));
+  wilsonInterval( mReport.mPasses, mReport.mDraws, 1.0 - alpha, mReport.mLower, mReport.mUpper );
+
+  // 5. Stop if it's narrow enough, decides the verdict, or we're out of draws
+  const bool checkRate = mSettings.mRequiredRate >= 0.0;
+  mReport.mVerdict =
+    checkRate && mReport.mLower >= mSettings.mRequiredRate ? Verdict::Meets :
+    checkRate && mReport.mUpper <  mSettings.mRequiredRate ? Verdict::Fails :
+                                                             Verdict::Undecided;
+  mDone = mReport.mVerdict != Verdict::Undecided
+       || ( mReport.mUpper - mReport.mLower ) / 2.0 <= mSettings.mHalfWidth
+       || mReport.mDraws >= mSettings.mMaxDraws;
+  return mDone;
+}
+
+// See header for interface
+const RobustnessAnalysis::Report& RobustnessAnalysis::run()
+{
+  while ( !step() ) {
+  }
+  return mReport;
+}
+
+// See header for interface
+BatchSim::ArmSettings RobustnessAnalysis::drawArm( const Settings& settings, std::size_t draw )
+{
+  return drawArm( settings, makeSobol( settings ), draw );
+}
+
+// See header for interface
+Utils::Sobol RobustnessAnalysis::makeSobol( const Settings& settings )
+{
+  return Utils::Sobol( parametersPerDraw, settings.mSeed ^ drawSalt );
+}
+
+//
+// Each draw has its own block of counters (or its own Sobol point), and
+// its own noise stream, so it comes out the same whatever round or batch
+// it's simulated in.
+//
+BatchSim::ArmSettings RobustnessAnalysis::drawArm( const Settings& settings, const Utils::Sobol& sobol,
+                                                   std::size_t draw )
+{
+  std::array<double, parametersPerDraw> uniforms;
+  std::array<double, parametersPerDraw> normals;
+  if ( settings.mQuasiRandom ) {
+    // Nudge each point to the middle of its 2^-32 cell, so it's never 0
+    for ( std::size_t parameter = 0; parameter < parametersPerDraw; ++parameter ) {
+      uniforms[ parameter ] = sobol.coordinate( draw, parameter ) + 0.5 / 4294967296.0;
+      normals[ parameter ]  = Utils::normalQuantile( uniforms[ parameter ] );
+    }
+  }
+  else {
+    const std::uint64_t base = ( settings.mSeed ^ drawSalt ) + randomsPerDraw * draw;
+    for ( std::size_t parameter = 0; parameter < parametersPerDraw; ++parameter ) {
+      const std::uint64_t random0 = Utils::splitMix64( base + 2 * parameter );
+      const std::uint64_t random1 = Utils::splitMix64( base + 2 * parameter + 1 );
+      uniforms[ parameter ] = Utils::toUnit( random0 );
+      normals[ parameter ]  = Utils::toGaussian( random0, random1 );
+    }
+  }
+
+  BatchSim::ArmSettings arm = settings.mArm;
+  arm.mRollingFriction  = std::min( 1.0,      sample( settings.mRollingFriction,  uniforms[ 0 ], normals[ 0 ] ));
+  arm.mSensorDelay      = std::min( maxDelay, sample( settings.mSensorDelay,      uniforms[ 1 ], normals[ 1 ] ));
+  arm.mMotorDelay       = std::min( maxDelay, sample( settings.mMotorDelay,       uniforms[ 2 ], normals[ 2 ] ));
+  arm.mSensorNoise      =                     sample( settings.mSensorNoise,      uniforms[ 3 ], normals[ 3 ] );
+  arm.mNoiseStream      = draw;
+  return arm;
+}
+
+// See header for interface
+void RobustnessAnalysis::wilsonInterval( std::size_t passes, std::size_t draws, double confidence,
+                                         double& lower, double& upper )
+{
+  if ( draws == 0 ) {
+    lower = 0.0;
+    upper = 1.0;
+    return;
+  }
+  const double n      = static_cast<double>( draws );
+  const double p      = static_cast<double>( passes ) / n;
+  const double z      = Utils::normalQuantile( 1.0 - ( 1.0 - confidence ) / 2.0 );
+  const double z2n    = z * z / n;
+  const double centre = ( p + z2n / 2.0 ) / ( 1.0 + z2n );
+  const double spread = z * sqrt( p * ( 1.0 - p ) / n + z2n / ( 4.0 * n )) / ( 1.0 + z2n );
+  lower = std::max( 0.0, centre - spread );
+  upper = std::min( 1.0, centre + spread );
+}
+
+}
+
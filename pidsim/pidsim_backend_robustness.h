@@ -0,0 +1,175 @@
+#ifndef __PIDSIM_BACKEND_ROBUSTNESS_H__
+#define __PIDSIM_BACKEND_ROBUSTNESS_H__
+
+#include <cstddef>
+#include <cstdint>
+#include "pidsim_backend_batch_sim.h"
+#include "pidsim_utils_sobol.h"
+
+namespace PidSim {
+
+///
+/// @brief How likely a gain set is to meet its specs on arms that vary
+///
+/// Real arms don't all have the same friction, delays and noise.  This
+/// draws plant parameters from distributions, simulates each draw's step
+/// response (via BatchSim, spread over the cores), and counts how many
+/// settle in time without overshooting too much.  The pass rate comes
+/// with a Wilson score confidence interval.
+///
+/// Draws are simulated a round at a time, and the analysis stops as soon
+/// as the interval is narrow enough, or is clear of the required pass
+/// rate either way.  Looking at the interval after every round would
+/// normally spoil its coverage, so round k uses confidence
+/// 1 - alpha / ( k ( k + 1 )).  Those add up to alpha, so the interval
+/// holds whenever the analysis stops.
+///
+/// Each draw's parameters and noise come from the seed and the draw's
+/// index, so the report doesn't depend on how many cores there are.
+///
+/// With mQuasiRandom the plant parameters come from a scrambled Sobol
+/// sequence instead (see Utils::Sobol), which covers the parameter space
+/// more evenly, so the pass rate settles down in fewer draws.  The
+/// interval still treats the draws as independent, which for scrambled
+/// points errs on the wide side in practice.
+///
+class RobustnessAnalysis
+{
+  public:
+
+  /// @brief The largest delay a draw can have, in ms (see BatchSim::maxDelayTicks)
+  static constexpr double maxDelay = 299.0;
+
+  ///
+  /// @brief How one plant parameter varies.  Draws below 0 are clamped to 0.
+  ///
+  struct Distribution
+  {
+    enum class Shape
+    {
+      Fixed,      // Always mA
+      Uniform,    // Between mA and mB
+      Normal      // Mean mA, standard deviation mB
+    };
+
+    Shape   mShape  = Shape::Fixed;
+    double  mA      = 0.0;
+    double  mB      = 0.0;
+  };
+
+  ///
+  /// @brief What to check, and how sure to be
+  ///
+  struct Settings
+  {
+    BatchSim::ArmSettings   mArm;                     // Gains, angles & profile.  The plant is drawn.
+    Distribution            mRollingFriction;
+    Distribution            mSensorDelay;             // ms
+    Distribution            mMotorDelay;              // ms
+    Distribution            mSensorNoise;             // degrees
+    double                  mMaxSettlingTime  = 3.0;  // Spec, in seconds
+    double                  mMaxOvershoot     = 0.1;  // Spec, as a fraction of the step
+    double                  mRequiredRate     = 0.9;  // Stop once the interval is clear of this.  < 0 to never.
+    unsigned                mTicks            = 250;  // How long to simulate each draw
+    double                  mConfidence       = 0.95;
+    double                  mHalfWidth        = 0.02; // Stop once the interval is this narrow
+    std::size_t             mRoundSize        = 256;  // Draws simulated between looks
+    std::size_t             mMaxDraws         = 16384;
+    std::uint64_t           mSeed             = 1;
+    bool                    mQuasiRandom      = false;  // Draw the plant from a Sobol sequence
+  };
+
+  /// @brief Where the pass rate is compared to the required rate
+  enum class Verdict
+  {
+    Undecided,
+    Meets,          // The whole interval is at or above the required rate
+    Fails           // The whole interval is below it
+  };
+
+  ///
+  /// @brief The analysis so far
+  ///
+  struct Report
+  {
+    std::size_t   mDraws;             // Draws simulated
+    std::size_t   mPasses;            // Draws that met both specs
+    std::size_t   mSettleFailures;    // Draws that didn't settle in time
+    std::size_t   mOvershootFailures; // Draws that overshot too much
+    double        mPassRate;          // mPasses / mDraws
+    double        mLower;             // Confidence interval on the pass rate
+    double        mUpper;
+    unsigned      mRounds;            // Rounds simulated
+    Verdict       mVerdict;
+  };
+
+  ///
+  /// @brief Constructor.  Nothing is simulated yet.
+  ///
+  /// @param[in] settings - What to check
+  ///
+  explicit RobustnessAnalysis( const Settings& settings );
+
+  // Remove constructors I probably never want (i.e., if used they're a bug)
+  RobustnessAnalysis() = delete;
+
+  ///
+  /// @brief Simulate one more round of draws, then look at the interval
+  ///
+  /// @return - True once the analysis is finished
+  ///
+  bool step();
+
+  ///
+  /// @brief Simulate rounds until the analysis is finished
+  ///
+  /// @return - The final report
+  ///
+  const Report& run();
+
+  /// @brief Is the analysis finished?
+  [[nodiscard]] bool isDone() const { return mDone; }
+
+  /// @brief The results so far
+  [[nodiscard]] const Report& getReport() const { return mReport; }
+
+  ///
+  /// @brief The arm for one draw
+  ///
+  /// Sets up its own Sobol sequence, so step() keeps one instead of
+  /// calling this for every draw.
+  ///
+  /// @param[in] settings - The analysis
+  /// @param[in] draw     - The draw's index
+  ///
+  [[nodiscard]] static BatchSim::ArmSettings drawArm( const Settings& settings, std::size_t draw );
+
+  ///
+  /// @brief A Wilson score interval for a binomial proportion
+  ///
+  /// @param[in] passes     - Successes
+  /// @param[in] draws      - Trials
+  /// @param[in] confidence - i.e., .95 for a 95% interval
+  /// @param[out] lower     - The interval
+  /// @param[out] upper
+  ///
+  static void wilsonInterval( std::size_t passes, std::size_t draws, double confidence,
+                              double& lower, double& upper );
+
+  private:
+
+  // The analysis' Sobol sequence, for mQuasiRandom
+  static Utils::Sobol makeSobol( const Settings& settings );
+
+  // drawArm, given the analysis' Sobol sequence
+  static BatchSim::ArmSettings drawArm( const Settings& settings, const Utils::Sobol& sobol, std::size_t draw );
+
+  Settings      mSettings;
+  Utils::Sobol  mSobol;
+  Report        mReport;
+  bool          mDone = false;
+};
+
+}
+
+#endif
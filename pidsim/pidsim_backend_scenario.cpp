@@ -0,0 +1,321 @@
+
+#include "pidsim_backend_scenario.h"
+#include "pidsim_backend_batch_run.h"
+#include "pidsim_backend_telemetry.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <math.h>
+#include <sstream>
+
+namespace PidSim {
+
+namespace {
+  // Where the GUI's sliders start
+  constexpr double defaultStartAngle      = -90.0;
+  constexpr double defaultRollingFriction = 2.0;
+
+  // A number, and nothing but
+  bool parseNumber( const std::string& text, double& value )
+  {
+    char* end = nullptr;
+    value = strtod( text.c_str(), &end );
+    return !text.empty() && *end == '\0' && std::isfinite( value );
+  }
+
+  bool parseSeed( const std::string& text, std::uint64_t& seed )
+  {
+    char* end = nullptr;
+    seed = strtoull( text.c_str(), &end, 0 );
+    return !text.empty() && text[ 0 ] != '-' && *end == '\0';
+  }
+
+  std::string lineError( std::size_t line, const std::string& message )
+  {
+    return "line " + std::to_string( line ) + ": " + message;
+  }
+}
+
+// See header for interface
+bool Scenario::load( const std::string& path, std::vector<Scenario>& scenarios, std::string& error )
+{
+  std::ifstream in( path );
+  if ( !in ) {
+    error = path + ": can't open";
+    return false;
+  }
+
+  // Unnamed scenarios are named for the file, without its directory or extension
+  std::string name = path.substr( path.find_last_of( '/' ) + 1 );
+  name = name.substr( 0, name.find_last_of( '.' ));
+  if ( !parse( in, name, scenarios, error )) {
+    error = path + ": " + error;
+    return false;
+  }
+  return true;
+}
+
+//
+// 1. Strip the comment, and split the line into words
+// 2. "scenario <name>" starts a new scenario from the defaults
+// 3. "at <seconds> ..." is an event, anything else a setting.  Before the
+//    first scenario line, they go in the defaults.
+// 4. Put each scenario's events in order
+//
+bool Scenario::parse( std::istream& in, const std::string& defaultName, std::vector<Scenario>& scenarios,
+                      std::string& error )
+{
+  Scenario defaults;
+  defaults.mName                    = defaultName;
+  defaults.mInputs.mStartAngle      = defaultStartAngle;
+  defaults.mInputs.mRollingFriction = defaultRollingFriction;
+  std::vector<Scenario> parsed;
+  std::string text;
+  for ( std::size_t line = 1; std::getline( in, text ); ++line ) {
+
+    // 1. Strip the comment, and split the line into words
+    std::istringstream stream( text.substr( 0, text.find( '#' )));
+    std::vector<std::string> words;
+    for ( std::string word; stream >> word; ) {
+      words.push_back( word );
+    }
+    if ( words.empty() ) {
+      continue;
+    }
+
+    // 2. "scenario <name>" starts a new scenario from the defaults
+    if ( words[ 0 ] == "scenario" ) {
+      if ( words.size() != 2 ) {
+        error = lineError( line, "expected scenario <name>" );
+        return false;
+      }
+      parsed.push_back( defaults );
+      parsed.back().mName = words[ 1 ];
+      continue;
+    }
+    Scenario& scenario = parsed.empty() ? defaults : parsed.back();
+
+    // 3. "at <seconds> ..." is an event
+    if ( words[ 0 ] == "at" ) {
+      double time = 0.0;
+      if ( words.size() < 3 || words.size() > 4 || !parseNumber( words[ 1 ], time ) || time < 0.0 ) {
+        error = lineError( line, "expected at <seconds> <setting> [value]" );
+        return false;
+      }
+      Event event{ static_cast<std::uint64_t>( llround( time / Session::timeSlice )), Field::P, 0.0 };
+      if ( !parseField( words[ 2 ], words.size() == 4 ? words[ 3 ] : "", event.mField, event.mValue, error )) {
+        error = lineError( line, error );
+        return false;
+      }
+      if ( event.mField >= Field::NudgeUp && words.size() == 4 ) {
+        error = lineError( line, words[ 2 ] + " doesn't take a value" );
+        return false;
+      }
+      scenario.mEvents.push_back( event );
+      continue;
+    }
+
+    // Anything else is a setting
+    if ( words.size() != 2 ) {
+      error = lineError( line, "expected <setting> <value>" );
+      return false;
+    }
+    if ( words[ 0 ] == "seed" ) {
+      if ( !parseSeed( words[ 1 ], scenario.mSeed )) {
+        error = lineError( line, "bad seed " + words[ 1 ] );
+        return false;
+      }
+      continue;
+    }
+    if ( words[ 0 ] == "duration" ) {
+      if ( !parseNumber( words[ 1 ], scenario.mDuration ) || scenario.mDuration <= 0.0 ) {
+        error = lineError( line, "bad duration " + words[ 1 ] );
+        return false;
+      }
+      continue;
+    }
+    if ( words[ 0 ] == "start" ) {
+      if ( !parseNumber( words[ 1 ], scenario.mInputs.mStartAngle )) {
+        error = lineError( line, "bad start angle " + words[ 1 ] );
+        return false;
+      }
+      continue;
+    }
+    Field field = Field::P;
+    double value = 0.0;
+    if ( !parseField( words[ 0 ], words[ 1 ], field, value, error )) {
+      error = lineError( line, error );
+      return false;
+    }
+    if ( field >= Field::NudgeUp ) {
+      error = lineError( line, words[ 0 ] + " only makes sense with at <seconds>" );
+      return false;
+    }
+    apply( scenario.mInputs, field, value );
+  }
+  if ( parsed.empty() ) {
+    parsed.push_back( defaults );
+  }
+
+  // 4. Put each scenario's events in order.  Events at the same time
+  //    happen in the order they were written.
+  for ( Scenario& scenario : parsed ) {
+    std::stable_sort( scenario.mEvents.begin(), scenario.mEvents.end(),
+      []( const Event& a, const Event& b ) { return a.mTick < b.mTick; } );
+  }
+  scenarios.insert( scenarios.end(), parsed.begin(), parsed.end() );
+  return true;
+}
+
+// See header for interface
+bool Scenario::parseField( const std::string& name, const std::string& value, Field& field, double& parsed,
+                           std::string& error )
+{
+  struct Named { const char* mName; Field mField; };
+  static const Named numbers[] = {
+    { "p", Field::P }, { "i", Field::I }, { "d", Field::D }, { "target", Field::Target },
+    { "rolling_friction", Field::RollingFriction }, { "sensor_noise", Field::SensorNoise },
+    { "sensor_delay", Field::SensorDelay }, { "motor_delay", Field::MotorDelay },
+  };
+  static const Named switches[] = {
+    { "state_estimator", Field::StateEstimator }, { "gain_scheduled", Field::GainScheduled },
+  };
+  static const Named bumps[] = {
+    { "nudge_up", Field::NudgeUp }, { "nudge_down", Field::NudgeDown },
+    { "wack_up", Field::WackUp }, { "wack_down", Field::WackDown },
+  };
+
+  for ( const Named& named : numbers ) {
+    if ( name == named.mName ) {
+      field = named.mField;
+      if ( !parseNumber( value, parsed )) {
+        error = "bad " + name + " " + value;
+        return false;
+      }
+      // The arm settings BatchRun has are held to its bounds.  Friction is
+      // per second here, as per Session, and per tick there.
+      for ( BatchRun::size_type column = 0; column < BatchRun::numParameters; ++column ) {
+        if ( name != BatchRun::parameterNames[ column ] ) {
+          continue;
+        }
+        const bool friction = field == Field::RollingFriction;
+        if ( !BatchRun::checkParameter( column, friction ? parsed * Session::timeSlice : parsed, error )) {
+          if ( friction ) {
+            error = name + " has to be at least 0 and under " + std::to_string( static_cast<int>( 1.0 / Session::timeSlice ));
+          }
+          return false;
+        }
+      }
+      return true;
+    }
+  }
+  for ( const Named& named : switches ) {
+    if ( name == named.mName ) {
+      field = named.mField;
+      if ( value != "on" && value != "off" ) {
+        error = name + " should be on or off";
+        return false;
+      }
+      parsed = value == "on" ? 1.0 : 0.0;
+      return true;
+    }
+  }
+  for ( const Named& named : bumps ) {
+    if ( name == named.mName ) {
+      field = named.mField;
+      parsed = 1.0;
+      return true;
+    }
+  }
+  if ( name == "profile" ) {
+    field = Field::Profile;
+    if ( value == "step" ) {
+      parsed = static_cast<double>( MotionProfile::Type::Step );
+    }
+    else if ( value == "trapezoidal" ) {
+      parsed = static_cast<double>( MotionProfile::Type::Trapezoidal );
+    }
+    else if ( value == "scurve" ) {
+      parsed = static_cast<double>( MotionProfile::Type::SCurve );
+    }
+    else {
+      error = "profile should be step, trapezoidal or scurve";
+      return false;
+    }
+    return true;
+  }
+  error = "unknown setting " + name;
+  return false;
+}
+
+// See header for interface
+void Scenario::apply( Session::Inputs& inputs, Field field, double value )
+{
+  switch ( field ) {
+    case Field::P:                inputs.mP               = value; break;
+    case Field::I:                inputs.mI               = value; break;
+    case Field::D:                inputs.mD               = value; break;
+    case Field::Target:           inputs.mTargetAngle     = value; break;
+    case Field::Profile:          inputs.mProfile         = static_cast<MotionProfile::Type>( value ); break;
+    case Field::RollingFriction:  inputs.mRollingFriction = value; break;
+    case Field::SensorNoise:      inputs.mSensorNoise     = value; break;
+    case Field::SensorDelay:      inputs.mSensorDelay     = value; break;
+    case Field::MotorDelay:       inputs.mMotorDelay      = value; break;
+    case Field::StateEstimator:   inputs.mStateEstimator  = value != 0.0; break;
+    case Field::GainScheduled:    inputs.mGainScheduled   = value != 0.0; break;
+    case Field::NudgeUp:          inputs.mNudgeUp         = true; break;
+    case Field::NudgeDown:        inputs.mNudgeDown       = true; break;
+    case Field::WackUp:           inputs.mWackUp          = true; break;
+    case Field::WackDown:         inputs.mWackDown        = true; break;
+  }
+}
+
+//
+// 1. Bumps only last a tick, so clear them
+// 2. Apply this tick's events
+// 3. A new target ends the step, so keep its metrics
+// 4. Advance the arm, and stream the tick out
+//
+Scenario::Result Scenario::run( Telemetry* telemetry, const Publisher& publish ) const
+{
+  Result result{ {}, static_cast<std::uint64_t>( llround( mDuration / Session::timeSlice )) };
+  Session::Inputs inputs = mInputs;
+  Session session( inputs, mSeed );
+  double stepStart = 0.0;
+  double target = inputs.mTargetAngle;
+  auto event = mEvents.begin();
+  for ( std::uint64_t tick = 0; tick < result.mTicks; ++tick ) {
+    const double time = static_cast<double>( tick ) * Session::timeSlice;
+
+    // 1. Bumps only last a tick
+    inputs.mNudgeUp = inputs.mNudgeDown = inputs.mWackUp = inputs.mWackDown = false;
+
+    // 2. Apply this tick's events
+    for ( ; event != mEvents.end() && event->mTick == tick; ++event ) {
+      apply( inputs, event->mField, event->mValue );
+    }
+
+    // 3. A new target ends the step
+    if ( inputs.mTargetAngle != target ) {
+      result.mSteps.push_back( { stepStart, target, session.getStepMetrics().getResult() } );
+      stepStart = time;
+      target = inputs.mTargetAngle;
+    }
+
+    // 4. Advance the arm, and stream the tick out
+    const Session::Tick out = session.tick( inputs );
+    if ( telemetry && out.mOut ) {
+      telemetry->record( time, inputs, out.mSensorAngle,
+                         session.getControlLoop().getPhysicsSim().getActualAngle(), *out.mOut );
+    }
+    if ( publish && out.mOut ) {
+      publish( time, inputs, out.mSensorAngle,
+               session.getControlLoop().getPhysicsSim().getActualAngle(), *out.mOut );
+    }
+  }
+  result.mSteps.push_back( { stepStart, target, session.getStepMetrics().getResult() } );
+  return result;
+}
+
+}
+
@@ -0,0 +1,152 @@
+#ifndef __PIDSIM_BACKEND_SCENARIO_H__
+#define __PIDSIM_BACKEND_SCENARIO_H__
+
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <string>
+#include <vector>
+#include "pidsim_backend_session.h"
+#include "pidsim_backend_step_metrics.h"
+
+namespace PidSim {
+
+class Telemetry;
+
+///
+/// @brief A headless run of the arm, as a scenario file describes it
+///
+/// A scenario file is lines of "setting value", with # comments.  The
+/// settings are the GUI's: p, i, d, start, target (degrees), profile
+/// (step, trapezoidal or scurve), rolling_friction, sensor_noise,
+/// sensor_delay, motor_delay, state_estimator and gain_scheduled (on or
+/// off), plus seed and duration (seconds).
+///
+/// "at <seconds> <setting> <value>" changes a setting part way through,
+/// i.e., "at 5 target 45" is a setpoint schedule.  "at <seconds> <bump>"
+/// bumps the arm, where bump is nudge_up, nudge_down, wack_up or
+/// wack_down, as the GUI's buttons do.
+///
+/// "scenario <name>" starts a new scenario.  Everything before the first
+/// one is the default for every scenario in the file, so a file can be a
+/// small family of variations on one setup.  A file with no scenario
+/// lines is one scenario, named by the caller.
+///
+class Scenario
+{
+  public:
+
+  ///
+  /// @brief The metrics for each target the arm was given
+  ///
+  struct Step
+  {
+    double              mStartTime;   // Seconds into the run
+    double              mTarget;      // Degrees
+    StepMetrics::Result mMetrics;
+  };
+
+  ///
+  /// @brief What a run did
+  ///
+  struct Result
+  {
+    std::vector<Step>   mSteps;
+    std::uint64_t       mTicks;
+  };
+
+  ///
+  /// @brief Read the scenarios in a file
+  ///
+  /// @param[in]  path      - The file
+  /// @param[out] scenarios - Its scenarios are appended
+  /// @param[out] error     - Why it didn't load, with the line
+  /// @return               - True if it loaded.  If not, scenarios is unchanged.
+  ///
+  static bool load( const std::string& path, std::vector<Scenario>& scenarios, std::string& error );
+
+  ///
+  /// @brief Read scenarios from a stream
+  ///
+  /// @param[in]  in          - The scenario text
+  /// @param[in]  defaultName - The name if there are no scenario lines
+  /// @param[out] scenarios   - Its scenarios are appended
+  /// @param[out] error       - Why it didn't parse, with the line
+  /// @return                 - True if it parsed.  If not, scenarios is unchanged.
+  ///
+  static bool parse( std::istream& in, const std::string& defaultName, std::vector<Scenario>& scenarios,
+                     std::string& error );
+
+  /// @brief The scenario's name
+  [[nodiscard]] const std::string& getName() const { return mName; }
+
+  /// @brief The inputs the arm starts with
+  [[nodiscard]] const Session::Inputs& getInputs() const { return mInputs; }
+
+  /// @brief Seconds to run for
+  [[nodiscard]] double getDuration() const { return mDuration; }
+
+  /// @brief Seed for the sensor noise
+  [[nodiscard]] std::uint64_t getSeed() const { return mSeed; }
+
+  ///
+  /// @brief Where each tick goes as it runs, i.e., a TelemetryStream
+  ///
+  /// @param[in] time         - Seconds into the run
+  /// @param[in] inputs       - The settings the tick ran with
+  /// @param[in] sensorAngle  - What the controller read
+  /// @param[in] actualAngle  - Where the arm was after the tick
+  /// @param[in] out          - What the loop did
+  ///
+  using Publisher = std::function<void( double time, const Session::Inputs& inputs, double sensorAngle,
+                                        double actualAngle, const ControlLoop::Output& out )>;
+
+  ///
+  /// @brief Run the scenario
+  ///
+  /// Runs are independent, so scenarios can run on as many threads as
+  /// there are scenarios.
+  ///
+  /// @param[in] telemetry - Where to trace every tick, if anywhere
+  /// @param[in] publish   - Where to publish every tick, if anywhere
+  /// @return              - Metrics for each target
+  ///
+  Result run( Telemetry* telemetry = nullptr, const Publisher& publish = {} ) const;
+
+  private:
+
+  // Settings that can change part way through a run.  The bumps are last,
+  // since they're only events.
+  enum class Field
+  {
+    P, I, D, Target, Profile, RollingFriction, SensorNoise, SensorDelay, MotorDelay,
+    StateEstimator, GainScheduled, NudgeUp, NudgeDown, WackUp, WackDown
+  };
+
+  struct Event
+  {
+    std::uint64_t   mTick;      // When, in ticks from the start
+    Field           mField;
+    double          mValue;
+  };
+
+  // Set up by parse()
+  Scenario() = default;
+
+  // Read a setting's value, or say why not.  Bumps don't have one.
+  static bool parseField( const std::string& name, const std::string& value, Field& field, double& parsed,
+                          std::string& error );
+  // Change a setting
+  static void apply( Session::Inputs& inputs, Field field, double value );
+
+  std::string         mName;
+  Session::Inputs     mInputs;
+  double              mDuration   = 10.0;
+  std::uint64_t       mSeed       = 0;
+  std::vector<Event>  mEvents;                // In tick order
+};
+
+}
+
+#endif
+
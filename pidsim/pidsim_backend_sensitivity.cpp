@@ -0,0 +1,87 @@
+
+#include "pidsim_backend_sensitivity.h"
+#include "pidsim_backend_motion_profile.h"
+#include "pidsim_backend_physics_sim.h"
+#include "pidsim_backend_pid_controller.h"
+#include <cmath>
+
+namespace PidSim {
+
+namespace {
+  //
+  // The loop LinearModel falls back on, with the gains & state in Scalar
+  //
+  // 1. Move the set point along the motion profile
+  // 2. Run the PID controller & the arm
+  // 3. Add up the ITAE, as per StepMetrics
+  //
+  template< typename Scalar, typename Record >
+  Scalar runLoop( const BatchSim::ArmSettings& settings, unsigned ticks,
+                  const Scalar& pidP, const Scalar& pidI, const Scalar& pidD,
+                  Record&& record )
+  {
+    using std::abs;
+    constexpr double timeSlice = BatchSim::timeSlice;
+
+    BasicPhysicsSim<Scalar>     sim( settings.mStartAngle );
+    BasicPidController<Scalar>  pid;
+    SetpointGenerator           setpoint( settings.mStartAngle, settings.mProfileLimits );
+    sim.setSensorNoise( settings.mSensorNoise );
+    sim.setSensorDelay( settings.mSensorDelay );
+    sim.setMotorDelay( settings.mMotorDelay );
+    setpoint.updateTarget( settings.mTargetAngle, settings.mProfileType );
+
+    Scalar itae = 0.0;
+    double time = 0.0;
+    for ( unsigned tick = 0; tick < ticks; ++tick ) {
+      // 1. Move the set point along the motion profile
+      const double target = setpoint.update( timeSlice );
+      pid.updatePidSettings( pidP, pidI, pidD, target );
+
+      // 2. Run the PID controller & the arm
+      const auto out = pid.updatePidController( timeSlice, sim.getSensorAngle() );
+      sim.startSimulationIteration();
+      sim.applyGravity();
+      sim.applyMotor( out.mMotorPower, timeSlice );
+      sim.updateAngleVel( timeSlice );
+      sim.applyFriction( settings.mRollingFriction );
+      sim.updateAngle( timeSlice );
+      sim.imposePositionHardLimits();
+      sim.endSimulationIteration();
+
+      // 3. Add up the ITAE
+      const Scalar angle = sim.getActualAngle();
+      time += timeSlice;
+      itae += time * abs( angle - target ) * timeSlice;
+      record( angle );
+    }
+    return itae;
+  }
+}
+
+Sensitivity::Result Sensitivity::runStepResponse( const BatchSim::ArmSettings& settings, unsigned ticks )
+{
+  Result result;
+  result.mAngles.reserve( ticks );
+  result.mAngleGradients.reserve( ticks );
+  const Dual cost = runLoop<Dual>( settings, ticks,
+    Dual::variable( settings.mPidP, 0 ),
+    Dual::variable( settings.mPidI, 1 ),
+    Dual::variable( settings.mPidD, 2 ),
+    [&]( const Dual& angle ) {
+      result.mAngles.push_back( angle.mValue );
+      result.mAngleGradients.push_back( angle.mGradient );
+    });
+  result.mCost      = cost.mValue;
+  result.mGradient  = cost.mGradient;
+  return result;
+}
+
+double Sensitivity::runCost( const BatchSim::ArmSettings& settings, unsigned ticks )
+{
+  return runLoop<double>( settings, ticks, settings.mPidP, settings.mPidI, settings.mPidD,
+    []( double ) {} );
+}
+
+}
+
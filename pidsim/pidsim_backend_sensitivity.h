@@ -0,0 +1,61 @@
+#ifndef __PIDSIM_BACKEND_SENSITIVITY_H__
+#define __PIDSIM_BACKEND_SENSITIVITY_H__
+
+#include <array>
+#include <vector>
+#include "pidsim_backend_batch_sim.h"
+#include "pidsim_utils_dual.h"
+
+namespace PidSim {
+
+///
+/// @brief How a step response's cost changes with the PID gains
+///
+/// Runs PhysicsSim + PidController once with dual numbers for Kp, Ki and
+/// Kd, so the trajectory comes out with its exact derivatives.  A central
+/// finite difference gradient needs 7 runs (1 + 2 per gain) and has to
+/// guess a step size; this is one run and no guessing.
+///
+/// The cost is the ITAE, as per StepMetrics.  Motor limits and hard stops
+/// are kinks, so right on one the gradient is one sided.
+///
+class Sensitivity
+{
+  public:
+
+  /// @brief A scalar that tracks derivatives with respect to Kp, Ki & Kd
+  using Dual = Utils::Dual<3>;
+
+  ///
+  /// @brief A step response and its gradient
+  ///
+  struct Result
+  {
+    double                  mCost;        // ITAE, radian-seconds^2
+    std::array<double, 3>   mGradient;    // d cost / d Kp, Ki, Kd
+    std::vector<double>     mAngles;      // Actual arm angle after each tick, in radians
+    std::vector<Dual::Gradient> mAngleGradients;  // d angle / d Kp, Ki, Kd after each tick
+  };
+
+  ///
+  /// @brief Run a step response and get its gradient
+  ///
+  /// @param[in] settings - The arm.  Sensor noise is PhysicsSim's default
+  ///                       sequence.
+  /// @param[in] ticks    - How many ticks to simulate
+  ///
+  [[nodiscard]] static Result runStepResponse( const BatchSim::ArmSettings& settings, unsigned ticks );
+
+  ///
+  /// @brief Just the cost, with plain doubles.  For finite differences.
+  ///
+  /// @param[in] settings - The arm
+  /// @param[in] ticks    - How many ticks to simulate
+  ///
+  [[nodiscard]] static double runCost( const BatchSim::ArmSettings& settings, unsigned ticks );
+};
+
+}
+
+#endif
+
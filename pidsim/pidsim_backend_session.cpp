@@ -0,0 +1,111 @@
+
+#include "pidsim_backend_session.h"
+#include "pidsim_utils.h"
+#include <math.h>
+
+namespace PidSim {
+
+namespace {
+  //
+  // Gravity pulls hardest on the arm when it's level, and not at all when
+  // it's straight up or down.  Use more P & D where gravity is strong, and
+  // less where it's weak.
+  //
+  std::vector<GainSchedule::Breakpoint> gravityBreakpoints()
+  {
+    std::vector<GainSchedule::Breakpoint> breakpoints;
+    for ( int degrees = -120; degrees <= 210; degrees += 30 ) {
+      const double angle = Utils::degToRad( degrees );
+      const double scale = 0.5 + std::abs( cos( angle ));
+      breakpoints.push_back( { angle, { scale, 1.0, scale }} );
+    }
+    return breakpoints;
+  }
+}
+
+Session::Session( const Inputs& inputs, std::uint64_t seed ) :
+  mSeed         { seed },
+  mGainSchedule { std::make_unique<GainSchedule>( gravityBreakpoints() ) }
+{
+  reset( inputs );
+}
+
+// See header for interface
+Session::Tick Session::tick( const Inputs& inputs )
+{
+  Tick result{ false, 0.0, std::nullopt };
+
+  // 1. Start over, if asked
+  if ( inputs.mReset ) {
+    reset( inputs );
+    result.mReset = true;
+  }
+
+  // 2. Update the target.  The PID controller settings are updated every
+  //    tick, after the set point moves along the motion profile.
+  const double targetAngle = Utils::degToRad( inputs.mTargetAngle );
+  mControlLoop->getSetpointGenerator().updateTarget( targetAngle, inputs.mProfile );
+
+  // A new target is a new step, so start measuring from where the arm is.
+  if ( targetAngle != mStepMetrics->getTarget() ) {
+    mStepMetrics = std::make_unique< StepMetrics >( mControlLoop->getPhysicsSim().getActualAngle(), targetAngle );
+  }
+
+  // 3. Update the plant, controller & estimator settings
+  mRollingFriction = inputs.mRollingFriction / 50.0;
+  mControlLoop->setRollingFriction( mRollingFriction );
+  mControlLoop->setUseStateEstimator( inputs.mStateEstimator );
+  PhysicsSim& physicsSim = mControlLoop->getPhysicsSim();
+  physicsSim.setSensorNoise( inputs.mSensorNoise );
+  physicsSim.setSensorDelay( inputs.mSensorDelay );
+  physicsSim.setMotorDelay( inputs.mMotorDelay );
+  mControlLoop->getPidController().setGainSchedule( inputs.mGainScheduled ? mGainSchedule.get() : nullptr );
+  mControlLoop->getStateEstimator().updateSettings(
+      mRollingFriction,
+      inputs.mSensorNoise,
+      inputs.mSensorDelay,
+      inputs.mMotorDelay
+  );
+
+  // 4. Bump the arm, if asked
+  if ( inputs.mNudgeUp ) {
+    physicsSim.bump( 3 );
+  }
+  if ( inputs.mNudgeDown ) {
+    physicsSim.bump( -3 );
+  }
+  if ( inputs.mWackUp ) {
+    physicsSim.bump( 10 );
+  }
+  if ( inputs.mWackDown ) {
+    physicsSim.bump( -10 );
+  }
+
+  // 5. In slow time, skip all but every slowTimeScale'th tick
+  ++mCounter;
+  if ( inputs.mSlowTime && ( mCounter % slowTimeScale ) != 0 ) {
+    return result;
+  }
+
+  // 6. Advance the PID controller, state estimator & robot arm
+  result.mSensorAngle = physicsSim.getSensorAngle();
+  result.mOut         = mControlLoop->tick( timeSlice, inputs.mP, inputs.mI, inputs.mD );
+  mStepMetrics->update( timeSlice, physicsSim.getActualAngle(), result.mOut->mSetpoint,
+                        result.mOut->mPid.mMotorPower );
+  return result;
+}
+
+//
+// Completely replace the old physics simulation & pid controller.  Each
+// reset reads fresh noise, so restarting doesn't replay the last run.
+//
+void Session::reset( const Inputs& inputs )
+{
+  const double startAngle = Utils::degToRad( inputs.mStartAngle );
+  mControlLoop = std::make_unique< ControlLoop >( startAngle, defaultProfileLimits );
+  mControlLoop->getPhysicsSim().setNoiseSeed( mSeed + mResets++ );
+  mStepMetrics = std::make_unique< StepMetrics >( startAngle, Utils::degToRad( inputs.mTargetAngle ));
+}
+
+}
+
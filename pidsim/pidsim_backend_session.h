@@ -0,0 +1,124 @@
+#ifndef __PIDSIM_BACKEND_SESSION_H__
+#define __PIDSIM_BACKEND_SESSION_H__
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include "pidsim_backend_control_loop.h"
+#include "pidsim_backend_gain_schedule.h"
+#include "pidsim_backend_motion_profile.h"
+#include "pidsim_backend_step_metrics.h"
+
+namespace PidSim {
+
+///
+/// @brief The live arm, as the GUI drives it, without the GUI
+///
+/// The back end reads its inputs from the front end once a tick and
+/// hands them to tick().  Everything that decides the arm's motion is in
+/// those inputs and the noise seed, so a session fed the same inputs
+/// from the same seed moves exactly the same way, GUI or not.  That's
+/// what lets SessionLog record a session and replay it headless.
+///
+class Session
+{
+  public:
+
+  /// @brief Seconds per tick
+  static constexpr double   timeSlice     = 1.0 / 50.0;
+  /// @brief "Slow time" only advances every this many ticks
+  static constexpr unsigned slowTimeScale = 10;
+
+  ///
+  /// @brief Everything the back end reads from the front end for a tick
+  ///
+  /// Angles, noise, delays and friction are as the sliders have them.
+  ///
+  struct Inputs
+  {
+    double              mP              = 0.0;
+    double              mI              = 0.0;
+    double              mD              = 0.0;
+    double              mStartAngle     = 0.0;                        // Degrees
+    double              mTargetAngle    = 0.0;                        // Degrees
+    MotionProfile::Type mProfile        = MotionProfile::Type::Step;
+    double              mRollingFriction = 0.0;                       // Per second
+    double              mSensorNoise    = 0.0;                        // Degrees
+    double              mSensorDelay    = 0.0;                        // ms
+    double              mMotorDelay     = 0.0;                        // ms
+    bool                mStateEstimator = false;
+    bool                mGainScheduled  = false;
+    bool                mSlowTime       = false;
+    // Things that happen on one tick
+    bool                mReset          = false;
+    bool                mNudgeUp        = false;
+    bool                mNudgeDown      = false;
+    bool                mWackUp         = false;
+    bool                mWackDown       = false;
+  };
+
+  ///
+  /// @brief What a tick did
+  ///
+  struct Tick
+  {
+    bool                                mReset;         // The arm started over
+    double                              mSensorAngle;   // What the controller read, if it advanced
+    std::optional<ControlLoop::Output>  mOut;           // The loop's output, unless slow time skipped the tick
+  };
+
+  ///
+  /// @brief Constructor
+  ///
+  /// @param[in] inputs - Only the start & target angles are used
+  /// @param[in] seed   - Seed for the sensor noise
+  ///
+  Session( const Inputs& inputs, std::uint64_t seed );
+
+  // Remove constructors I probably never want (i.e., if used they're a bug)
+  Session() = delete;
+
+  ///
+  /// @brief Apply a tick's inputs and advance the arm
+  ///
+  /// 1. Start over, if asked
+  /// 2. Update the target, starting new step metrics if it moved
+  /// 3. Update the plant, controller & estimator settings
+  /// 4. Bump the arm, if asked
+  /// 5. In slow time, skip all but every slowTimeScale'th tick
+  /// 6. Advance the PID controller, state estimator & robot arm
+  ///
+  /// @param[in] inputs - This tick's inputs
+  /// @return           - What happened
+  ///
+  Tick tick( const Inputs& inputs );
+
+  /// @brief Arm, PID controller, estimator & set point
+  [[nodiscard]] ControlLoop& getControlLoop() { return *mControlLoop; }
+
+  /// @brief Metrics for the latest target change
+  [[nodiscard]] const StepMetrics& getStepMetrics() const { return *mStepMetrics; }
+
+  /// @brief Friction slowing the arm, per tick
+  [[nodiscard]] double getRollingFriction() const { return mRollingFriction; }
+
+  /// @brief The noise seed
+  [[nodiscard]] std::uint64_t getSeed() const { return mSeed; }
+
+  private:
+
+  // Start the arm over at the start angle
+  void reset( const Inputs& inputs );
+
+  std::uint64_t                    mSeed;                   // Seed for the sensor noise
+  std::uint64_t                    mResets          = 0;    // Each reset gets its own noise
+  unsigned                         mCounter         = 0;    // Ticks, for slow time
+  double                           mRollingFriction = 0.0;  // Friction slowing the robot arm
+  std::unique_ptr<ControlLoop>     mControlLoop;            // Arm, PID controller, estimator & set point
+  std::unique_ptr<GainSchedule>    mGainSchedule;           // Angle dependent gain multipliers
+  std::unique_ptr<StepMetrics>     mStepMetrics;            // Metrics for the latest target change
+};
+
+}
+
+#endif
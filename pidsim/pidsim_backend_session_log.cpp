@@ -0,0 +1,330 @@
+
+#include "pidsim_backend_session_log.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace PidSim {
+
+namespace {
+  // The file is six words, then the initial inputs, then the changes
+  constexpr std::uint64_t fileMagic     = 0x474f4c534d495350ull;  // "PSIMSLOG"
+  constexpr std::uint64_t formatVersion = 1;
+  constexpr std::size_t   headerWords   = 6;
+
+  using Inputs = Session::Inputs;
+
+  // Each field's number is its place in these tables, one after the other
+  constexpr double Inputs::* doubleFields[] = {
+    &Inputs::mP, &Inputs::mI, &Inputs::mD, &Inputs::mStartAngle, &Inputs::mTargetAngle,
+    &Inputs::mRollingFriction, &Inputs::mSensorNoise, &Inputs::mSensorDelay, &Inputs::mMotorDelay
+  };
+  constexpr bool Inputs::* settingFields[] = {
+    &Inputs::mStateEstimator, &Inputs::mGainScheduled, &Inputs::mSlowTime
+  };
+  constexpr bool Inputs::* eventFields[] = {
+    &Inputs::mReset, &Inputs::mNudgeUp, &Inputs::mNudgeDown, &Inputs::mWackUp, &Inputs::mWackDown
+  };
+  constexpr std::uint8_t doubleCount    = std::size( doubleFields );
+  constexpr std::uint8_t profileField   = doubleCount;
+  constexpr std::uint8_t firstSetting   = profileField + 1;
+  constexpr std::uint8_t firstEvent     = firstSetting + std::size( settingFields );
+  constexpr std::uint8_t fieldCount     = firstEvent + std::size( eventFields );
+
+  void appendVarint( std::vector<std::uint8_t>& out, std::uint64_t value )
+  {
+    while ( value >= 0x80 ) {
+      out.push_back( static_cast<std::uint8_t>( value | 0x80 ));
+      value >>= 7;
+    }
+    out.push_back( static_cast<std::uint8_t>( value ));
+  }
+
+  // False if it runs off the end or is too long
+  bool readVarint( const std::vector<std::uint8_t>& in, std::size_t& position, std::uint64_t& value )
+  {
+    value = 0;
+    for ( unsigned shift = 0; shift < 64 && position < in.size(); shift += 7 ) {
+      const std::uint8_t byte = in[ position++ ];
+      value |= static_cast<std::uint64_t>( byte & 0x7f ) << shift;
+      if (( byte & 0x80 ) == 0 ) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Doubles are compared and stored bit for bit, so the replay sees
+  // exactly what the session did
+  std::uint64_t bits( double value )
+  {
+    std::uint64_t word;
+    std::memcpy( &word, &value, sizeof( word ));
+    return word;
+  }
+
+  //
+  // Append a change to the field, as it is in inputs
+  //
+  void appendChange( std::vector<std::uint8_t>& out, std::uint64_t ticks, std::uint8_t field, const Inputs& inputs )
+  {
+    appendVarint( out, ticks );
+    out.push_back( field );
+    if ( field < doubleCount ) {
+      const std::uint64_t word = bits( inputs.*doubleFields[ field ] );
+      for ( unsigned byte = 0; byte < 8; ++byte ) {
+        out.push_back( static_cast<std::uint8_t>( word >> ( 8 * byte )));
+      }
+    }
+    else if ( field == profileField ) {
+      out.push_back( static_cast<std::uint8_t>( inputs.mProfile ));
+    }
+    else if ( field < firstEvent ) {
+      out.push_back( inputs.*settingFields[ field - firstSetting ] ? 1 : 0 );
+    }
+  }
+
+  //
+  // Append a change for every field that differs, and every one tick
+  // thing that's happening.  The first is stamped ticks, the rest 0.
+  //
+  void appendChanges( std::vector<std::uint8_t>& out, std::uint64_t ticks, const Inputs& from, const Inputs& to )
+  {
+    for ( std::uint8_t field = 0; field < fieldCount; ++field ) {
+      bool changed;
+      if ( field < doubleCount ) {
+        changed = bits( from.*doubleFields[ field ] ) != bits( to.*doubleFields[ field ] );
+      }
+      else if ( field == profileField ) {
+        changed = from.mProfile != to.mProfile;
+      }
+      else if ( field < firstEvent ) {
+        changed = from.*settingFields[ field - firstSetting ] != to.*settingFields[ field - firstSetting ];
+      }
+      else {
+        changed = to.*eventFields[ field - firstEvent ];
+      }
+      if ( changed ) {
+        appendChange( out, ticks, field, to );
+        ticks = 0;
+      }
+    }
+  }
+
+  //
+  // Apply the change at position (after its tick stamp), and move past it.
+  // False if it's not a valid change.
+  //
+  bool applyChange( const std::vector<std::uint8_t>& in, std::size_t& position, Inputs& inputs )
+  {
+    if ( position >= in.size() ) {
+      return false;
+    }
+    const std::uint8_t field = in[ position++ ];
+    if ( field < doubleCount ) {
+      if ( in.size() - position < 8 ) {
+        return false;
+      }
+      std::uint64_t word = 0;
+      for ( unsigned byte = 0; byte < 8; ++byte ) {
+        word |= static_cast<std::uint64_t>( in[ position++ ] ) << ( 8 * byte );
+      }
+      std::memcpy( &( inputs.*doubleFields[ field ] ), &word, sizeof( word ));
+    }
+    else if ( field == profileField ) {
+      if ( position >= in.size() ) {
+        return false;
+      }
+      if ( in[ position ] > static_cast<std::uint8_t>( MotionProfile::Type::SCurve )) {
+        return false;
+      }
+      inputs.mProfile = static_cast<MotionProfile::Type>( in[ position++ ] );
+    }
+    else if ( field < firstEvent ) {
+      if ( position >= in.size() ) {
+        return false;
+      }
+      inputs.*settingFields[ field - firstSetting ] = in[ position++ ] != 0;
+    }
+    else if ( field < fieldCount ) {
+      inputs.*eventFields[ field - firstEvent ] = true;
+    }
+    else {
+      return false;
+    }
+    return true;
+  }
+
+  Inputs withoutEvents( Inputs inputs )
+  {
+    for ( bool Inputs::* field : eventFields ) {
+      inputs.*field = false;
+    }
+    return inputs;
+  }
+}
+
+SessionLog::SessionLog( const Session::Inputs& initial, std::uint64_t seed ) :
+  mInitial  { withoutEvents( initial ) },
+  mSeed     { seed },
+  mLast     { mInitial }
+{
+}
+
+//
+// Stamp the first change with the ticks since the last one
+//
+void SessionLog::record( const Session::Inputs& inputs )
+{
+  const std::size_t before = mChanges.size();
+  appendChanges( mChanges, mTicks - mChangeTick, mLast, inputs );
+  if ( mChanges.size() != before ) {
+    mChangeTick = mTicks;
+  }
+  mLast = withoutEvents( inputs );
+  ++mTicks;
+}
+
+// See header for interface
+std::vector<double> SessionLog::replay() const
+{
+  Session session = makeSession();
+  Reader reader( *this );
+  std::vector<double> angles;
+  angles.reserve( mTicks );
+  Session::Inputs inputs;
+  while ( reader.next( inputs )) {
+    session.tick( inputs );
+    angles.push_back( session.getControlLoop().getPhysicsSim().getActualAngle() );
+  }
+  return angles;
+}
+
+//
+// 1. Write the header
+// 2. Write the initial inputs, as changes from the defaults
+// 3. Write the changes
+//
+bool SessionLog::save( const std::string& path ) const
+{
+  std::vector<std::uint8_t> initial;
+  appendChanges( initial, 0, Session::Inputs{}, mInitial );
+
+  // 1. Write the header
+  std::ofstream file( path, std::ios::binary | std::ios::trunc );
+  const std::uint64_t header[ headerWords ] = {
+    fileMagic, formatVersion, mSeed, mTicks, initial.size(), mChanges.size()
+  };
+  file.write( reinterpret_cast<const char*>( header ), sizeof( header ));
+
+  // 2. Write the initial inputs
+  file.write( reinterpret_cast<const char*>( initial.data() ), static_cast<std::streamsize>( initial.size() ));
+
+  // 3. Write the changes
+  file.write( reinterpret_cast<const char*>( mChanges.data() ), static_cast<std::streamsize>( mChanges.size() ));
+  return static_cast<bool>( file.flush() );
+}
+
+//
+// 1. Read and check the header, including that the sizes it gives fit in
+//    the file (so a corrupt one can't make us allocate the earth)
+// 2. Read the initial inputs
+// 3. Read the changes, and check they all decode and stay within the ticks
+//
+bool SessionLog::load( const std::string& path )
+{
+  // 1. Read and check the header
+  std::ifstream file( path, std::ios::binary );
+  std::uint64_t header[ headerWords ] = {};
+  if ( !file.read( reinterpret_cast<char*>( header ), sizeof( header ))
+    || header[ 0 ] != fileMagic || header[ 1 ] != formatVersion ) {
+    return false;
+  }
+  const std::streamoff start = file.tellg();
+  file.seekg( 0, std::ios::end );
+  const std::uint64_t remaining = static_cast<std::uint64_t>( file.tellg() - start );
+  file.seekg( start );
+  if ( !file || header[ 4 ] > remaining || header[ 5 ] > remaining - header[ 4 ] ) {
+    return false;
+  }
+  const std::uint64_t seed = header[ 2 ], ticks = header[ 3 ];
+
+  // 2. Read the initial inputs
+  std::vector<std::uint8_t> initial( header[ 4 ] );
+  if ( !file.read( reinterpret_cast<char*>( initial.data() ), static_cast<std::streamsize>( initial.size() ))) {
+    return false;
+  }
+  Session::Inputs inputs;
+  for ( std::size_t position = 0; position < initial.size(); ) {
+    std::uint64_t stamp;
+    if ( !readVarint( initial, position, stamp ) || !applyChange( initial, position, inputs )) {
+      return false;
+    }
+  }
+
+  // 3. Read the changes, and check them
+  std::vector<std::uint8_t> changes( header[ 5 ] );
+  if ( !file.read( reinterpret_cast<char*>( changes.data() ), static_cast<std::streamsize>( changes.size() ))) {
+    return false;
+  }
+  std::uint64_t changeTick = 0;
+  Session::Inputs scratch;
+  for ( std::size_t position = 0; position < changes.size(); ) {
+    std::uint64_t stamp;
+    if ( !readVarint( changes, position, stamp ) || stamp >= ticks - changeTick
+      || !applyChange( changes, position, scratch )) {
+      return false;
+    }
+    changeTick += stamp;
+  }
+
+  mInitial    = withoutEvents( inputs );
+  mSeed       = seed;
+  mTicks      = ticks;
+  mChangeTick = changeTick;
+  mChanges    = std::move( changes );
+  mLast       = mInitial;
+  for ( Reader reader( *this ); reader.next( inputs ); ) {
+    mLast = withoutEvents( inputs );
+  }
+  return true;
+}
+
+SessionLog::Reader::Reader( const SessionLog& log ) :
+  mLog    { log },
+  mInputs { log.mInitial }
+{
+}
+
+//
+// 1. Clear last tick's one tick things
+// 2. Apply every change stamped with this tick
+//
+bool SessionLog::Reader::next( Session::Inputs& inputs )
+{
+  if ( mTick == mLog.mTicks ) {
+    return false;
+  }
+
+  // 1. Clear last tick's one tick things
+  mInputs = withoutEvents( mInputs );
+
+  // 2. Apply every change stamped with this tick
+  while ( mPosition < mLog.mChanges.size() ) {
+    std::size_t position = mPosition;
+    std::uint64_t stamp = 0;
+    readVarint( mLog.mChanges, position, stamp );
+    if ( mChangeTick + stamp != mTick ) {
+      break;
+    }
+    applyChange( mLog.mChanges, position, mInputs );
+    mChangeTick = mTick;
+    mPosition   = position;
+  }
+  ++mTick;
+  inputs = mInputs;
+  return true;
+}
+
+}
+
@@ -0,0 +1,120 @@
+#ifndef __PIDSIM_BACKEND_SESSION_LOG_H__
+#define __PIDSIM_BACKEND_SESSION_LOG_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "pidsim_backend_session.h"
+
+namespace PidSim {
+
+///
+/// @brief A recording of every input a Session saw, to replay it exactly
+///
+/// The log is the noise seed, the inputs the session started with, and
+/// then only what changed: each change is a tick stamp (ticks since the
+/// last change, as a varint), a field number and the new value.  Bumps
+/// and resets are changes that only last a tick.  A session where the
+/// sliders sit still is a few bytes however long it runs.
+///
+/// replay() feeds the log through a fresh, headless Session.  Since the
+/// inputs and the seed are everything that decides the arm's motion, the
+/// replay is bit for bit the run that was recorded.
+///
+class SessionLog
+{
+  public:
+
+  ///
+  /// @brief Start an empty log
+  ///
+  /// @param[in] initial  - The inputs the session was constructed with
+  /// @param[in] seed     - The session's noise seed
+  ///
+  SessionLog( const Session::Inputs& initial, std::uint64_t seed );
+
+  // Remove constructors I probably never want (i.e., if used they're a bug)
+  SessionLog() = delete;
+
+  ///
+  /// @brief Load a log save() wrote
+  ///
+  /// @param[in] path - The file
+  /// @return         - True if it loaded.  If not, the log is unchanged.
+  ///
+  bool load( const std::string& path );
+
+  ///
+  /// @brief Write the log to a file
+  ///
+  /// @param[in] path - The file
+  /// @return         - True if it was all written
+  ///
+  bool save( const std::string& path ) const;
+
+  ///
+  /// @brief Add a tick
+  ///
+  /// @param[in] inputs - What the session was given that tick
+  ///
+  void record( const Session::Inputs& inputs );
+
+  /// @brief A session set up as the recorded one was, before its first tick
+  [[nodiscard]] Session makeSession() const { return Session( mInitial, mSeed ); }
+
+  ///
+  /// @brief Run the log through a headless session, as fast as it goes
+  ///
+  /// @return - The arm's actual angle after every tick, in radians
+  ///
+  [[nodiscard]] std::vector<double> replay() const;
+
+  ///
+  /// @brief Walks a log's ticks in order
+  ///
+  class Reader
+  {
+    public:
+
+    explicit Reader( const SessionLog& log );
+
+    ///
+    /// @brief The next tick's inputs
+    ///
+    /// @param[out] inputs  - The inputs, if there's a tick left
+    /// @return             - False once all the ticks have been read
+    ///
+    bool next( Session::Inputs& inputs );
+
+    private:
+
+    const SessionLog&   mLog;
+    Session::Inputs     mInputs;            // The inputs as of the last tick read
+    std::size_t         mTick       = 0;    // The next tick to read
+    std::size_t         mPosition   = 0;    // The next change in mLog.mChanges
+    std::size_t         mChangeTick = 0;    // The tick of the last change read
+  };
+
+  [[nodiscard]] std::uint64_t getSeed() const { return mSeed; }
+  [[nodiscard]] const Session::Inputs& getInitialInputs() const { return mInitial; }
+
+  /// @brief Ticks recorded
+  [[nodiscard]] std::size_t getTicks() const { return mTicks; }
+
+  /// @brief Size of the change stream, in bytes
+  [[nodiscard]] std::size_t getBytes() const { return mChanges.size(); }
+
+  private:
+
+  Session::Inputs               mInitial;
+  std::uint64_t                 mSeed;
+  std::size_t                   mTicks        = 0;  // Ticks recorded
+  std::size_t                   mChangeTick   = 0;  // The tick of the last change recorded
+  Session::Inputs               mLast;              // The inputs last recorded, one tick things cleared
+  std::vector<std::uint8_t>     mChanges;           // The encoded changes
+};
+
+}
+
+#endif
@@ -0,0 +1,106 @@
+
+#include "pidsim_backend_stability_map.h"
+#include "pidsim_backend_linear_model.h"
+#include "pidsim_utils.h"
+#include <algorithm>
+#include <complex>
+#include <Eigen/Eigenvalues>
+
+namespace PidSim {
+
+namespace {
+  // Number of simulation ticks for a delay, as per PhysicsSim
+  unsigned delayInTicks( double delayInMs )
+  {
+    return 1 + static_cast<unsigned>( delayInMs / 1000.0 * 50.0 );
+  }
+
+  // Poles this close to 0 die out within a tick.  Treat them as fully damped.
+  constexpr double deadbeatRadius = 1e-9;
+}
+
+StabilityMap::StabilityMap( const Settings& settings ) :
+  mSettings { settings },
+  mCells    ( resolution * resolution, Cell{ 0.0, 0.0 } )
+{
+}
+
+// Every cell is independent, so hand them out to all the cores
+std::size_t StabilityMap::compute( std::size_t maxCells )
+{
+  const std::size_t start = mComputed;
+  const std::size_t count = std::min( maxCells, mCells.size() - start );
+  Utils::parallelFor( count, [&]( std::size_t i ) {
+    const std::size_t cell = start + i;
+    mCells[ cell ] = analyze( mSettings, getGain( cell % resolution ), getGain( cell / resolution ));
+  });
+  mComputed += count;
+  return mCells.size() - mComputed;
+}
+
+//
+// 1. Build the linearized closed loop
+// 2. Get its poles
+// 3. Turn each pole into a damping ratio
+//
+StabilityMap::Cell StabilityMap::analyze( const Settings& settings, double kp, double ky )
+{
+  // 1. Build the linearized closed loop
+  BatchSim::ArmSettings arm;
+  arm.mPidP             = kp;
+  arm.mPidI             = settings.mPlane == Plane::KpKi ? ky : settings.mFixedGain;
+  arm.mPidD             = settings.mPlane == Plane::KpKd ? ky : settings.mFixedGain;
+  arm.mTargetAngle      = settings.mTargetAngle;
+  arm.mRollingFriction  = settings.mRollingFriction;
+  arm.mSensorDelay      = settings.mSensorDelay;
+  arm.mMotorDelay       = settings.mMotorDelay;
+
+  // 2. Get its poles
+  const Eigen::EigenSolver<LinearModel::Matrix> solver( LinearModel::buildDynamics( arm ), false );
+
+  // 3. Turn each pole into a damping ratio.  A pole z of the discrete
+  //    system matches a pole s = ln( z ) / dt of a continuous one.
+  Cell cell{ 0.0, 1.0 };
+  for ( const std::complex<double>& pole : solver.eigenvalues() ) {
+    const double radius = std::abs( pole );
+    cell.mSpectralRadius = std::max( cell.mSpectralRadius, radius );
+    if ( radius < deadbeatRadius ) {
+      continue;
+    }
+    const std::complex<double> s = std::log( pole ) / BatchSim::timeSlice;
+    const double damping = std::abs( s ) > 0.0 ? -s.real() / std::abs( s ) : 0.0;
+    cell.mDampingRatio = std::min( cell.mDampingRatio, damping );
+  }
+  return cell;
+}
+
+//
+// Maps are only a few tens of KB, so rather than track which map is the
+// oldest just start over when the cache fills up.
+//
+std::shared_ptr<StabilityMap> StabilityMapCache::get( const StabilityMap::Settings& settings )
+{
+  const Key key{
+    settings.mPlane,
+    settings.mFixedGain,
+    settings.mRollingFriction,
+    delayInTicks( settings.mSensorDelay ),
+    delayInTicks( settings.mMotorDelay ),
+    settings.mTargetAngle
+  };
+
+  auto found = mMaps.find( key );
+  if ( found != mMaps.end() ) {
+    return found->second;
+  }
+
+  if ( mMaps.size() >= capacity ) {
+    mMaps.clear();
+  }
+  auto map = std::make_shared<StabilityMap>( settings );
+  mMaps.emplace( key, map );
+  return map;
+}
+
+}
+
@@ -0,0 +1,159 @@
+#ifndef __PIDSIM_BACKEND_STABILITY_MAP_H__
+#define __PIDSIM_BACKEND_STABILITY_MAP_H__
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+namespace PidSim {
+
+///
+/// @brief Closed loop stability over a plane of PID gains
+///
+/// For each cell of the grid the arm, PID controller, motor delay and
+/// sensor delay are linearized around the target angle (see LinearModel)
+/// and the closed loop poles come out of an eigen solver.  No time domain
+/// simulation is run, so a whole map costs about as much as a few step
+/// responses.
+///
+/// Each cell records
+///
+/// - The spectral radius, i.e., the biggest |pole|.  Over 1 is unstable.
+/// - The damping ratio of the least damped pole.  Near 0 rings for a long
+///   time, 0.7 or so is a well behaved step response.
+///
+/// Long delays make for big models, so a map can be filled in a bit at a
+/// time to keep the GUI responsive.
+///
+class StabilityMap
+{
+  public:
+
+  /// @brief The number of cells along each side of the map
+  static constexpr std::size_t resolution = 32;
+
+  /// @brief The biggest gain on each axis, as per the front end's PID sliders
+  static constexpr double maxGain = 11.0;
+
+  /// @brief Which gains the map sweeps.  Kp is always the x axis.
+  enum class Plane
+  {
+    KpKd,
+    KpKi
+  };
+
+  ///
+  /// @brief Everything the map depends on
+  ///
+  struct Settings
+  {
+    Plane   mPlane            = Plane::KpKd;
+    double  mFixedGain        = 0.0;    // Ki for a Kp/Kd map, Kd for a Kp/Ki map
+    double  mRollingFriction  = 0.0;    // As per PhysicsSim::applyFriction
+    double  mSensorDelay      = 0.0;    // ms
+    double  mMotorDelay       = 0.0;    // ms
+    double  mTargetAngle      = 0.0;    // radians
+  };
+
+  /// @brief One cell of the map
+  struct Cell
+  {
+    double mSpectralRadius;
+    double mDampingRatio;
+  };
+
+  ///
+  /// @brief Constructor.  No cells are computed yet.
+  ///
+  /// @param[in] settings - What to map
+  ///
+  explicit StabilityMap( const Settings& settings );
+
+  // Remove constructors I probably never want (i.e., if used they're a bug)
+  StabilityMap() = delete;
+
+  ///
+  /// @brief Compute more cells, in parallel
+  ///
+  /// @param[in] maxCells - The most cells to compute
+  /// @return             - The number of cells still to go
+  ///
+  std::size_t compute( std::size_t maxCells = resolution * resolution );
+
+  /// @brief Have all the cells been computed?
+  [[nodiscard]] bool isComplete() const { return mComputed == mCells.size(); }
+
+  /// @brief The number of cells computed so far.  Cells are computed in order.
+  [[nodiscard]] std::size_t getComputed() const { return mComputed; }
+
+  ///
+  /// @brief Get a cell
+  ///
+  /// @param[in] x    - The Kp index, from 0 to resolution-1
+  /// @param[in] y    - The Kd or Ki index, from 0 to resolution-1
+  ///
+  [[nodiscard]] const Cell& getCell( std::size_t x, std::size_t y ) const
+  {
+    return mCells[ y * resolution + x ];
+  }
+
+  /// @brief The gain at a cell index.  Index 0 is 0, index resolution-1 is maxGain
+  [[nodiscard]] static double getGain( std::size_t index )
+  {
+    return maxGain * static_cast<double>( index ) / static_cast<double>( resolution - 1 );
+  }
+
+  /// @brief The settings the map was built with
+  [[nodiscard]] const Settings& getSettings() const { return mSettings; }
+
+  ///
+  /// @brief The closed loop poles for one set of gains
+  ///
+  /// @param[in] settings - Everything but the swept gains
+  /// @param[in] kp       - Kp
+  /// @param[in] ky       - Kd or Ki, depending on the plane
+  ///
+  [[nodiscard]] static Cell analyze( const Settings& settings, double kp, double ky );
+
+  private:
+
+  Settings            mSettings;
+  std::vector<Cell>   mCells;       // Row major, y = Kd or Ki
+  std::size_t         mComputed = 0;
+};
+
+///
+/// @brief Remembers recently built stability maps
+///
+/// Delays only matter to the nearest simulation tick, so the cache is
+/// keyed on ticks.  Flipping back to settings seen before is free, and a
+/// half computed map picks up where it left off.
+///
+class StabilityMapCache
+{
+  public:
+
+  /// @brief The number of maps to keep
+  static constexpr std::size_t capacity = 32;
+
+  ///
+  /// @brief Get a map, building it if we don't have it
+  ///
+  /// @param[in] settings - What to map
+  /// @return             - The map.  New maps have no cells computed.
+  ///
+  std::shared_ptr<StabilityMap> get( const StabilityMap::Settings& settings );
+
+  private:
+
+  using Key = std::tuple<StabilityMap::Plane, double, double, unsigned, unsigned, double>;
+
+  std::map<Key, std::shared_ptr<StabilityMap>> mMaps;
+};
+
+}
+
+#endif
+
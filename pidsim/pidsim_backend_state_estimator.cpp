@@ -0,0 +1,134 @@
+
+#include "pidsim_backend_state_estimator.h"
+#include <algorithm>
+
+namespace PidSim {
+
+namespace {
+  // Process noise.  Mostly there to soak up the model's mistakes, like
+  // gravity being computed from the estimated angle or the arm hitting
+  // the hard limits.  Velocity takes the brunt since pushes change it.
+  constexpr double angleProcessNoise    = 1e-8;
+  constexpr double velProcessNoise      = 1e-3;
+  // Keep the innovation variance away from 0 when there's no sensor noise
+  constexpr double minMeasurementNoise  = 1e-10;
+  // How well we know the start state.  The arm starts at rest.
+  constexpr double startVariance        = 1e-8;
+  constexpr double gravity              = -9.8;
+
+  // Number of 1/50 second simulation ticks for a delay, as per PhysicsSim
+  std::size_t delayInTicks( double delayInMs )
+  {
+    return 1 + static_cast<std::size_t>( delayInMs / 1000.0 * 50.0 );
+  }
+}
+
+StateEstimator::StateEstimator( double startAngle ) :
+  mFilter{
+    Filter::Matrix::Identity(),
+    Filter::Vector::Zero(),
+    Filter::RowVector{ 1.0, 0.0 },
+    Filter::Vector{ angleProcessNoise, velProcessNoise }.asDiagonal(),
+    minMeasurementNoise
+  },
+  mMotorDelay{ 1, 0.0 },
+  mAngle{ startAngle }
+{
+  mFilter.reset( Filter::Vector{ startAngle, 0.0 },
+                 Filter::Matrix::Identity() * startVariance );
+  // Before the first sensor reading the sensor reports nonsense (0)
+  mWarmUpTicks = mSensorDelay;
+}
+
+// See header for interface
+void StateEstimator::updateSettings( double rollingFriction, double sensorNoise,
+                                     double sensorDelayInMs, double motorDelayInMs )
+{
+  if ( rollingFriction != mRollingFriction ) {
+    updateModel( mTimeSlice, rollingFriction );
+  }
+
+  // Uniform noise between -max and max has a variance of max^2/3
+  const double maxNoise = Utils::degToRad( sensorNoise );
+  mFilter.setMeasurementNoise( std::max( maxNoise * maxNoise / 3.0, minMeasurementNoise ));
+
+  // PhysicsSim starts a new, empty, delay queue when the delay changes, so
+  // the sensor is garbage until the queue refills.
+  const Filter::size_type sensorDelay = delayInTicks( sensorDelayInMs );
+  if ( sensorDelay != mSensorDelay ) {
+    mSensorDelay = sensorDelay;
+    mWarmUpTicks = sensorDelay;
+    // The estimator's "now" is the end of the last tick, which the
+    // sensor sees one tick early.  Delays past what the filter can
+    // compensate for are compensated for as far as it can.
+    mFilter.setDelay( std::min( sensorDelay - 1, Filter::maxDelay ));
+  }
+
+  const auto motorDelay = delayInTicks( motorDelayInMs );
+  if ( motorDelay != mMotorDelay.size() ) {
+    mMotorDelay = Utils::MovingAverage<double>( motorDelay, mMotorDelay.getAverage() );
+  }
+}
+
+// See header for interface
+double StateEstimator::update( double timeSlice, double sensorAngle )
+{
+  if ( timeSlice != mTimeSlice ) {
+    updateModel( timeSlice, mRollingFriction );
+  }
+
+  // The acceleration PhysicsSim applied last tick.  Gravity has to use
+  // the estimated angle since the actual angle is what we're after.
+  const double accel = cos( mAngle ) * gravity + mMotorDelay.getAverage() / timeSlice;
+
+  // Nothing has moved the arm before the first tick
+  if ( mFirstUpdate ) {
+    mFirstUpdate = false;
+    return mAngle;
+  }
+
+  if ( mWarmUpTicks > 0 ) {
+    --mWarmUpTicks;
+    mFilter.predict( accel );
+  }
+  else {
+    mFilter.update( accel, sensorAngle );
+  }
+
+  mAngle = mFilter.getState()( 0 );
+  return mAngle;
+}
+
+// See header for interface
+void StateEstimator::recordMotorPower( double motorPower )
+{
+  mMotorDelay.newValue( motorPower );
+}
+
+// See header for interface
+double StateEstimator::getAngleVel() const
+{
+  return mFilter.getState()( 1 );
+}
+
+//
+// The model matches PhysicsSim's update order:
+//
+// vel'   = ( vel + accel * t ) * ( 1 - friction )
+// angle' = angle + vel' * t
+//
+void StateEstimator::updateModel( double timeSlice, double rollingFriction )
+{
+  mTimeSlice = timeSlice;
+  mRollingFriction = rollingFriction;
+
+  const double keep = 1.0 - rollingFriction;
+  Filter::Matrix a;
+  a << 1.0, timeSlice * keep,
+       0.0, keep;
+  const Filter::Vector b{ timeSlice * timeSlice * keep, timeSlice * keep };
+  mFilter.setModel( a, b );
+}
+
+}
+
@@ -0,0 +1,292 @@
+#ifndef __PIDSIM_BACKEND_STATE_ESTIMATOR_H__
+#define __PIDSIM_BACKEND_STATE_ESTIMATOR_H__
+
+#include <array>
+#include <cstddef>
+#include <Eigen/Core>
+#include "pidsim_utils.h"
+
+namespace PidSim {
+
+///
+/// @brief A fixed size linear Kalman filter for delayed scalar measurements
+///
+/// @param[in] N         - The number of states (i.e., 2 for angle + velocity)
+/// @param[in] MaxDelay  - The largest measurement delay, in ticks, we support
+///
+/// The filter tracks x[k] = A * x[k-1] + B * u[k] and expects a
+/// measurement z[k] = H * x[k-delay] + noise.  Delay compensation works
+/// like this:
+///
+/// 1. The Kalman filter proper runs at the "delayed horizon", i.e., it
+///    estimates x[k-delay] using the input from delay ticks ago.  That's
+///    the time the measurement is actually valid for, so no approximation
+///    is needed.
+/// 2. An open loop predictor runs at the current time, using the current
+///    inputs.  Its history is kept in a ring.
+/// 3. The current estimate is the predictor plus the delayed horizon
+///    correction carried forward, i.e.,
+///    x[k] = xPred[k] + A^delay * ( xKalman[k-delay] - xPred[k-delay] )
+///
+/// Everything is fixed size, so the per tick cost is constant and there
+/// are no heap allocations after construction.
+///
+template< int N, std::size_t MaxDelay = 16 >
+class KalmanFilter
+{
+  public:
+
+  /// @brief The largest delay setDelay() takes
+  static constexpr std::size_t maxDelay = MaxDelay - 1;
+
+  // Expose some standard types
+  using Vector    = Eigen::Matrix<double, N, 1>;
+  using RowVector = Eigen::Matrix<double, 1, N>;
+  using Matrix    = Eigen::Matrix<double, N, N>;
+  using size_type = std::size_t;
+
+  /// @brief Constructor
+  ///
+  /// @param[in] a  - The state transition matrix
+  /// @param[in] b  - How the scalar input changes the state
+  /// @param[in] h  - How the state maps to the scalar measurement
+  /// @param[in] q  - The process noise covariance
+  /// @param[in] r  - The measurement noise variance
+  ///
+  KalmanFilter( const Matrix& a, const Vector& b, const RowVector& h, const Matrix& q, double r ) :
+    mA{ a }, mB{ b }, mH{ h }, mQ{ q }, mR{ r },
+    mX{ Vector::Zero() }, mP{ Matrix::Identity() }, mAd{ Matrix::Identity() }
+  {
+    mInputs.fill( 0.0 );
+    mPredicted.fill( Vector::Zero() );
+  }
+
+  // Remove constructors I probably never want (i.e., if used they're a bug)
+  KalmanFilter() = delete;
+
+  ///
+  /// @brief Restart the filter from a known state
+  ///
+  /// @param[in] x  - The initial state
+  /// @param[in] p  - The initial state covariance
+  ///
+  void reset( const Vector& x, const Matrix& p )
+  {
+    mX = x;
+    mP = p;
+    mInputs.fill( 0.0 );
+    mPredicted.fill( x );
+  }
+
+  ///
+  /// @brief Change the plant model (i.e., if the friction changes)
+  ///
+  void setModel( const Matrix& a, const Vector& b )
+  {
+    mA = a;
+    mB = b;
+    updateDelayedTransition();
+  }
+
+  ///
+  /// @brief Change the measurement noise variance
+  ///
+  void setMeasurementNoise( double r )
+  {
+    mR = r;
+  }
+
+  ///
+  /// @brief Set how many ticks old the measurements are
+  ///
+  /// @param[in] delay  - The delay, in ticks
+  /// @return           - False, with the delay left as it was, if the
+  ///                     delay won't fit in the history rings
+  ///
+  bool setDelay( size_type delay )
+  {
+    if ( delay >= MaxDelay ) {
+      return false;
+    }
+    if ( delay != mDelay ) {
+      mDelay = delay;
+      updateDelayedTransition();
+    }
+    return true;
+  }
+
+  ///
+  /// @brief Advance the filter by one tick, without a measurement
+  ///
+  /// @param[in] u  - The input applied during this tick
+  ///
+  /// 1. Advance the current time predictor & record it in the ring
+  /// 2. Advance the delayed horizon filter with the delayed input
+  ///
+  void predict( double u )
+  {
+    // 1. Advance the current time predictor & record it in the ring
+    const Vector predicted = mA * mPredicted[ mHead ] + mB * u;
+    mHead = ( mHead + 1 ) % MaxDelay;
+    mPredicted[ mHead ] = predicted;
+    mInputs[ mHead ] = u;
+
+    // 2. Advance the delayed horizon filter with the delayed input
+    mX = mA * mX + mB * mInputs[ delayedIndex() ];
+    mP = mA * mP * mA.transpose() + mQ;
+  }
+
+  ///
+  /// @brief Fold a measurement into the filter
+  ///
+  /// @param[in] z  - The measurement, which is mDelay ticks old
+  ///
+  void correct( double z )
+  {
+    const Vector    pht = mP * mH.transpose();
+    const double    s   = mH.dot( pht ) + mR;
+    const Vector    k   = pht / s;
+    mX += k * ( z - mH.dot( mX ));
+    mP -= k * pht.transpose();
+  }
+
+  ///
+  /// @brief Advance the filter by one tick & fold in a measurement
+  ///
+  /// @param[in] u  - The input applied during this tick
+  /// @param[in] z  - The measurement, which is mDelay ticks old
+  ///
+  void update( double u, double z )
+  {
+    predict( u );
+    correct( z );
+  }
+
+  ///
+  /// @brief Get the estimate of the current (not delayed) state
+  ///
+  [[nodiscard]] Vector getState() const
+  {
+    return mPredicted[ mHead ] + mAd * ( mX - mPredicted[ delayedIndex() ] );
+  }
+
+  ///
+  /// @brief Get the estimate of the state when the last measurement was taken
+  ///
+  [[nodiscard]] const Vector& getDelayedState() const
+  {
+    return mX;
+  }
+
+  ///
+  /// @brief Get the covariance of the delayed state estimate
+  ///
+  [[nodiscard]] const Matrix& getCovariance() const
+  {
+    return mP;
+  }
+
+  private:
+
+  // Ring index of the entry recorded mDelay ticks ago
+  [[nodiscard]] size_type delayedIndex() const
+  {
+    return ( mHead + MaxDelay - mDelay ) % MaxDelay;
+  }
+
+  // A^delay carries the delayed correction to the current time
+  void updateDelayedTransition()
+  {
+    mAd.setIdentity();
+    for ( size_type i = 0; i < mDelay; ++i ) { mAd = mA * mAd; }
+  }
+
+  Matrix      mA;
+  Vector      mB;
+  RowVector   mH;
+  Matrix      mQ;
+  double      mR;
+
+  Vector      mX;             // Estimate at the delayed horizon
+  Matrix      mP;             // Covariance at the delayed horizon
+  Matrix      mAd;            // A^mDelay
+  size_type   mDelay = 0;     // Measurement delay in ticks
+  size_type   mHead  = 0;     // Newest ring entry
+
+  std::array<double, MaxDelay>  mInputs;      // Input history ring
+  std::array<Vector, MaxDelay>  mPredicted;   // Predictor history ring
+};
+
+///
+/// @brief Estimates the arm angle & velocity from noisy, delayed sensor data
+///
+/// Sits between PhysicsSim::getSensorAngle() and the PID controller.  The
+/// model mirrors PhysicsSim - gravity, the motor moving average, and rolling
+/// friction - so with no noise the estimate tracks the actual arm angle,
+/// delay included.
+///
+class StateEstimator
+{
+  public:
+
+  /// @brief Constructor
+  ///
+  /// @param[in] startAngle - The angle the Arm starts at, in radians
+  ///
+  StateEstimator( double startAngle );
+
+  // Remove constructors I probably never want (i.e., if used they're a bug)
+  StateEstimator() = delete;
+
+  ///
+  /// @brief Update the plant settings the estimator models
+  ///
+  /// @param[in] rollingFriction  - Friction, as given to PhysicsSim::applyFriction
+  /// @param[in] sensorNoise      - Max sensor noise in degrees
+  /// @param[in] sensorDelayInMs  - Sensor delay in ms
+  /// @param[in] motorDelayInMs   - Motor moving average window in ms
+  ///
+  void updateSettings( double rollingFriction, double sensorNoise,
+                       double sensorDelayInMs, double motorDelayInMs );
+
+  ///
+  /// @brief Fold in a new sensor reading
+  ///
+  /// @param[in] timeSlice    - The length of the time slice, in seconds
+  /// @param[in] sensorAngle  - The (delayed, noisy) sensor angle, in radians
+  /// @return    The estimate of the current arm angle, in radians
+  ///
+  double update( double timeSlice, double sensorAngle );
+
+  ///
+  /// @brief Tell the estimator what motor power the controller asked for
+  ///
+  /// @param[in] motorPower   - The PID controller's motor power output
+  ///
+  void recordMotorPower( double motorPower );
+
+  ///
+  /// @brief Get the estimated angular velocity, in radians/s
+  ///
+  [[nodiscard]] double getAngleVel() const;
+
+  private:
+
+  using Filter = KalmanFilter<2>;
+
+  void updateModel( double timeSlice, double rollingFriction );
+
+  Filter                        mFilter;
+  Utils::MovingAverage<double>  mMotorDelay;
+  double                        mRollingFriction  = 0.0;
+  double                        mTimeSlice        = 0.0;
+  double                        mAngle;                   // Current angle estimate
+  Filter::size_type             mSensorDelay      = 1;    // In ticks, as per PhysicsSim
+  Filter::size_type             mWarmUpTicks      = 0;    // Ticks left before sensor is valid
+  bool                          mFirstUpdate      = true;
+};
+
+}
+
+#endif
+
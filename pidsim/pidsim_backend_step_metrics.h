@@ -0,0 +1,151 @@
+#ifndef __PIDSIM_BACKEND_STEP_METRICS_H__
+#define __PIDSIM_BACKEND_STEP_METRICS_H__
+
+#include <algorithm>
+#include <math.h>
+#include "pidsim_utils.h"
+
+namespace PidSim {
+
+///
+/// @brief Step response metrics, computed as the simulation runs
+///
+/// Every metric is a running sum, max, or "last time something happened",
+/// so each tick is O(1) work and the class is a few doubles no matter how
+/// long the run is.  Nothing about the trajectory is stored.
+///
+/// - Rise time:            10% to 90% of the step
+/// - Overshoot:            How far past the target the arm went, as a
+///                         fraction of the step
+/// - Settling time:        The last time the arm was outside the settle
+///                         band around the target
+/// - Steady state error:   The average error since the arm last entered
+///                         the settle band, or the latest error if it's
+///                         outside the band
+/// - IAE/ ISE/ ITAE:       Integrals of |e|, e^2, and t*|e|, where e is the
+///                         difference between the arm and the set point
+/// - Control effort:       Integral of motor power^2
+///
+class StepMetrics
+{
+  public:
+
+  ///
+  /// @brief The metrics so far
+  ///
+  struct Result
+  {
+    double  mRiseTime;          // seconds.  Infinite if we never got to 90%
+    double  mOvershoot;         // fraction of the step, i.e., .1 = 10%
+    double  mSettlingTime;      // seconds
+    double  mSteadyStateError;  // radians
+    double  mIAE;               // radian-seconds
+    double  mISE;               // radian^2-seconds
+    double  mITAE;              // radian-seconds^2
+    double  mControlEffort;     // motor power^2-seconds
+    bool    mSettled;           // Is the arm inside the settle band now?
+  };
+
+  ///
+  /// @brief Constructor
+  ///
+  /// @param[in] start      - Where the arm started the step, in radians
+  /// @param[in] target     - The target angle for the step, in radians
+  /// @param[in] settleBand - How close to the target counts as settled, in radians
+  ///
+  StepMetrics( double start, double target, double settleBand = Utils::degToRad( 2.0 )) :
+    mStart      { start },
+    mTarget     { target },
+    mSettleBand { settleBand },
+    mInvStep    { target != start ? 1.0 / ( target - start ) : 0.0 }
+  {
+  }
+
+  // Remove constructors I probably never want (i.e., if used they're a bug)
+  StepMetrics() = delete;
+
+  ///
+  /// @brief Fold in the results of one simulation tick
+  ///
+  /// @param[in] timeSlice  - The length of the tick, in seconds
+  /// @param[in] angle      - The arm angle at the end of the tick, in radians
+  /// @param[in] setpoint   - The PID controller's set point, in radians
+  /// @param[in] motorPower - The PID controller's motor power output
+  ///
+  /// Defined here so BatchSim's per arm loop can inline it.
+  ///
+  void update( double timeSlice, double angle, double setpoint, double motorPower )
+  {
+    mTime += timeSlice;
+
+    // Integral metrics use the error from the set point, so a motion
+    // profiled target isn't penalized for moving slowly on purpose.
+    const double trackingError = std::abs( angle - setpoint );
+    mIAE    += trackingError * timeSlice;
+    mISE    += trackingError * trackingError * timeSlice;
+    mITAE   += mTime * trackingError * timeSlice;
+    mEffort += motorPower * motorPower * timeSlice;
+
+    // Rise time & overshoot use the fraction of the step we've done
+    const double progress = ( angle - mStart ) * mInvStep;
+    mMaxProgress = std::max( mMaxProgress, progress );
+    mRiseStart   = ( mRiseStart < 0.0 && progress >= 0.1 ) ? mTime : mRiseStart;
+    mRiseEnd     = ( mRiseEnd   < 0.0 && progress >= 0.9 ) ? mTime : mRiseEnd;
+
+    // Settling time & steady state error use the error from the target
+    const double error = angle - mTarget;
+    const bool outside = std::abs( error ) > mSettleBand;
+    mError        = error;
+    mLastOutside  = outside ? mTime : mLastOutside;
+    mSettledSum   = outside ? 0.0   : mSettledSum + error;
+    mSettledTicks = outside ? 0.0   : mSettledTicks + 1.0;
+  }
+
+  ///
+  /// @brief Get the metrics so far
+  ///
+  [[nodiscard]] Result getResult() const
+  {
+    const bool stepped = mInvStep != 0.0;
+    const bool rose    = mRiseEnd >= 0.0;
+    return Result{
+      !stepped ? 0.0 : rose ? mRiseEnd - mRiseStart : INFINITY,
+      std::max( 0.0, mMaxProgress - 1.0 ),
+      mLastOutside,
+      mSettledTicks > 0.0 ? mSettledSum / mSettledTicks : mError,
+      mIAE,
+      mISE,
+      mITAE,
+      mEffort,
+      mSettledTicks > 0.0
+    };
+  }
+
+  /// @brief The target angle the metrics are measured against, in radians
+  [[nodiscard]] double getTarget() const { return mTarget; }
+
+  private:
+
+  double mStart;
+  double mTarget;
+  double mSettleBand;
+  double mInvStep;                  // 1 / step size, or 0 for no step
+
+  double mTime          = 0.0;
+  double mIAE           = 0.0;
+  double mISE           = 0.0;
+  double mITAE          = 0.0;
+  double mEffort        = 0.0;
+  double mMaxProgress   = 0.0;
+  double mRiseStart     = -1.0;     // Negative until it happens
+  double mRiseEnd       = -1.0;     // Negative until it happens
+  double mLastOutside   = 0.0;
+  double mSettledSum    = 0.0;
+  double mSettledTicks  = 0.0;
+  double mError         = 0.0;      // Latest error from the target
+};
+
+}
+
+#endif
+
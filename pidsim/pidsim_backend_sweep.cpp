@@ -0,0 +1,102 @@
+
+#include "pidsim_backend_sweep.h"
+#include "pidsim_utils.h"
+#include <algorithm>
+#include <assert.h>
+#include <thread>
+
+namespace PidSim {
+
+namespace {
+  // The least number of runs worth giving a core of its own
+  constexpr std::size_t minRunsPerBatch = 32;
+}
+
+ParameterSweep::ParameterSweep( const Settings& settings ) :
+  mSettings { settings },
+  mSobol    { std::max<std::size_t>( 1, settings.mAxes.size() ), settings.mSeed }
+{
+  assert( settings.mAxes.size() <= Utils::Sobol::maxDimensions );
+}
+
+// See header for interface
+BatchSim::ArmSettings ParameterSweep::arm( std::uint64_t index ) const
+{
+  return arms( index, 1 ).front();
+}
+
+//
+// 1. Generate the range's points in one pass
+// 2. Scale each coordinate onto its axis
+//
+std::vector<BatchSim::ArmSettings> ParameterSweep::arms( std::uint64_t first, std::size_t count ) const
+{
+  // 1. Generate the range's points in one pass
+  std::vector<double> points;
+  mSobol.generate( first, count, points );
+
+  // 2. Scale each coordinate onto its axis
+  const std::size_t dimensions = mSobol.dimensions();
+  std::vector<BatchSim::ArmSettings> result( count, mSettings.mArm );
+  for ( std::size_t i = 0; i < count; ++i ) {
+    for ( std::size_t axis = 0; axis < mSettings.mAxes.size(); ++axis ) {
+      const Axis& a = mSettings.mAxes[ axis ];
+      result[ i ].*a.mSetting = a.mMin + ( a.mMax - a.mMin ) * points[ i * dimensions + axis ];
+    }
+    result[ i ].mNoiseStream = first + i;
+  }
+  return result;
+}
+
+//
+// 1. Look each run up in the cache
+// 2. Simulate the rest, spread over the cores
+// 3. Add what was simulated to the cache
+//
+std::vector<StepMetrics::Result> ParameterSweep::run( std::uint64_t first, std::size_t count,
+                                                      ResultCache* cache ) const
+{
+  // 1. Look each run up in the cache
+  const std::vector<BatchSim::ArmSettings> all = arms( first, count );
+  std::vector<StepMetrics::Result> results( count );
+  std::vector<ResultCache::Key> keys;
+  std::vector<std::size_t> misses;
+  for ( std::size_t i = 0; i < count; ++i ) {
+    if ( cache ) {
+      keys.push_back( ResultCache::key( all[ i ], mSettings.mTicks, mSettings.mSeed ));
+      if ( cache->find( keys.back(), results[ i ] )) {
+        continue;
+      }
+    }
+    misses.push_back( i );
+  }
+
+  // 2. Simulate the rest, spread over the cores
+  const std::size_t simulated = misses.size();
+  const std::size_t batches = std::min( simulated, std::max<std::size_t>( 1, std::min<std::size_t>(
+    std::thread::hardware_concurrency(), simulated / minRunsPerBatch )));
+  Utils::parallelFor( batches, [&]( std::size_t batch ) {
+    const std::size_t begin = simulated * batch / batches;
+    const std::size_t end   = simulated * ( batch + 1 ) / batches;
+    std::vector<BatchSim::ArmSettings> batchArms;
+    for ( std::size_t miss = begin; miss < end; ++miss ) {
+      batchArms.push_back( all[ misses[ miss ]] );
+    }
+    BatchSim sim( batchArms, mSettings.mSeed );
+    sim.run( mSettings.mTicks );
+    for ( std::size_t arm = 0; arm < sim.size(); ++arm ) {
+      results[ misses[ begin + arm ]] = sim.getMetrics( arm );
+    }
+  });
+
+  // 3. Add what was simulated to the cache
+  if ( cache ) {
+    for ( std::size_t miss : misses ) {
+      cache->insert( keys[ miss ], results[ miss ] );
+    }
+  }
+  return results;
+}
+
+}
+
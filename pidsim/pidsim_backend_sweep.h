@@ -0,0 +1,96 @@
+#ifndef __PIDSIM_BACKEND_SWEEP_H__
+#define __PIDSIM_BACKEND_SWEEP_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "pidsim_backend_batch_sim.h"
+#include "pidsim_backend_result_cache.h"
+#include "pidsim_backend_step_metrics.h"
+#include "pidsim_utils_sobol.h"
+
+namespace PidSim {
+
+///
+/// @brief Sweep any number of arm settings at once
+///
+/// CostMap and StabilityMap sweep two gains on a grid.  A grid over six
+/// settings at 20 steps each is 64 million runs; this spreads N runs over
+/// all of them with a scrambled Sobol sequence instead, so every setting
+/// (and every pair of the first few) is covered evenly at any N.
+///
+/// Run i's settings and noise come from the seed and i alone.  Shards on
+/// different cores or machines can each take a range of indices, and the
+/// results line up as if one machine had run them all.
+///
+class ParameterSweep
+{
+  public:
+
+  ///
+  /// @brief One setting to sweep, between mMin and mMax
+  ///
+  struct Axis
+  {
+    double BatchSim::ArmSettings::*   mSetting;   // i.e., &BatchSim::ArmSettings::mPidP
+    double                            mMin;
+    double                            mMax;
+  };
+
+  ///
+  /// @brief The sweep
+  ///
+  struct Settings
+  {
+    BatchSim::ArmSettings   mArm;               // Everything that isn't swept
+    std::vector<Axis>       mAxes;              // Up to Utils::Sobol::maxDimensions
+    unsigned                mTicks    = 250;    // How long to simulate each run
+    std::uint64_t           mSeed     = 1;      // Picks the scramble and the noise
+  };
+
+  ///
+  /// @brief Constructor.  Nothing is simulated yet.
+  ///
+  /// @param[in] settings - The sweep
+  ///
+  explicit ParameterSweep( const Settings& settings );
+
+  // Remove constructors I probably never want (i.e., if used they're a bug)
+  ParameterSweep() = delete;
+
+  ///
+  /// @brief The arm for one run
+  ///
+  /// @param[in] index  - The run's index
+  ///
+  [[nodiscard]] BatchSim::ArmSettings arm( std::uint64_t index ) const;
+
+  ///
+  /// @brief The arms for a range of runs
+  ///
+  /// @param[in] first  - The first run's index
+  /// @param[in] count  - How many runs
+  ///
+  [[nodiscard]] std::vector<BatchSim::ArmSettings> arms( std::uint64_t first, std::size_t count ) const;
+
+  ///
+  /// @brief Simulate a range of runs, spread over the cores
+  ///
+  /// @param[in] first  - The first run's index
+  /// @param[in] count  - How many runs
+  /// @param[in] cache  - If not null, runs found here aren't simulated,
+  ///                     and the ones that are get added
+  /// @return           - Each run's step response metrics, in index order
+  ///
+  [[nodiscard]] std::vector<StepMetrics::Result> run( std::uint64_t first, std::size_t count,
+                                                      ResultCache* cache = nullptr ) const;
+
+  private:
+
+  Settings      mSettings;
+  Utils::Sobol  mSobol;
+};
+
+}
+
+#endif
@@ -0,0 +1,76 @@
+
+#include "pidsim_backend_telemetry.h"
+#include "pidsim_utils.h"
+#include <algorithm>
+#include <math.h>
+
+namespace PidSim {
+
+namespace {
+  // Motor power is -1 to 1 and the errors are in radians, so they're kept
+  // as finely as the angles.  The settings are as the sliders have them,
+  // and only change when someone drags one, so they're kept exactly.
+  constexpr double powerResolution = Telemetry::angleResolution;
+}
+
+// See header for interface
+std::vector<TraceWriter::Column> Telemetry::columns()
+{
+  return {
+    { "sensor_angle",     angleResolution },
+    { "actual_angle",     angleResolution },
+    { "setpoint",         angleResolution },
+    { "p_error",          angleResolution },
+    { "i_error",          angleResolution },
+    { "d_error",          angleResolution },
+    { "motor_power",      powerResolution },
+    { "p",                0.0 },
+    { "i",                0.0 },
+    { "d",                0.0 },
+    { "target_angle",     0.0 },
+    { "rolling_friction", 0.0 },
+    { "sensor_noise",     0.0 },
+    { "sensor_delay",     0.0 },
+    { "motor_delay",      0.0 },
+  };
+}
+
+Telemetry::Telemetry( const std::string& path ) :
+  mWriter{ path, columns() }
+{
+}
+
+// See header for interface
+void Telemetry::row( const Session::Inputs& inputs, double sensorAngle, double actualAngle,
+                     const ControlLoop::Output& out, double* row )
+{
+  const double values[ numColumns ] = {
+    sensorAngle,
+    actualAngle,
+    out.mSetpoint,
+    out.mPid.mPError,
+    out.mPid.mIError,
+    out.mPid.mDError,
+    out.mPid.mMotorPower,
+    inputs.mP,
+    inputs.mI,
+    inputs.mD,
+    Utils::degToRad( inputs.mTargetAngle ),
+    inputs.mRollingFriction,
+    inputs.mSensorNoise,
+    inputs.mSensorDelay,
+    inputs.mMotorDelay,
+  };
+  std::copy( values, values + numColumns, row );
+}
+
+// See header for interface
+void Telemetry::record( double time, const Session::Inputs& inputs, double sensorAngle, double actualAngle,
+                        const ControlLoop::Output& out )
+{
+  double values[ numColumns ];
+  row( inputs, sensorAngle, actualAngle, out, values );
+  mWriter.append( llround( time * 1e6 ), values );
+}
+
+}
@@ -0,0 +1,99 @@
+#ifndef __PIDSIM_BACKEND_TELEMETRY_H__
+#define __PIDSIM_BACKEND_TELEMETRY_H__
+
+#include <string>
+#include <vector>
+#include "pidsim_backend_control_loop.h"
+#include "pidsim_backend_session.h"
+#include "pidsim_backend_trace.h"
+
+namespace PidSim {
+
+///
+/// @brief Streams every tick of the arm into a compressed trace
+///
+/// A row a tick: what the sensor read, where the arm really was, the set
+/// point, the PID controller's errors and motor power, and the settings
+/// the tick ran with.  Angles are in radians, and are kept to
+/// angleResolution, well under what the GUI can show.  Timestamps are in
+/// microseconds.
+///
+/// Read it back with TraceReader, finding columns by name.
+///
+class Telemetry
+{
+  public:
+
+  /// @brief Finest angle kept, in radians (about 0.006 degrees)
+  static constexpr double angleResolution = 1e-4;
+
+  ///
+  /// @brief The trace's columns, in the order record() writes them
+  ///
+  /// sensor_angle, actual_angle, setpoint, p_error, i_error, d_error,
+  /// motor_power, then the settings: p, i, d, target_angle,
+  /// rolling_friction, sensor_noise, sensor_delay, motor_delay
+  ///
+  [[nodiscard]] static std::vector<TraceWriter::Column> columns();
+
+  /// @brief How many columns
+  static constexpr std::size_t numColumns = 15;
+
+  ///
+  /// @brief A tick's row, as record() writes it
+  ///
+  /// @param[in]  inputs       - The settings the tick ran with
+  /// @param[in]  sensorAngle  - What the controller read
+  /// @param[in]  actualAngle  - Where the arm was after the tick
+  /// @param[in]  out          - What the loop did
+  /// @param[out] row          - numColumns values, in columns() order
+  ///
+  static void row( const Session::Inputs& inputs, double sensorAngle, double actualAngle,
+                   const ControlLoop::Output& out, double* row );
+
+  ///
+  /// @brief Start a trace, replacing the file if it's there
+  ///
+  /// @param[in] path - The file
+  ///
+  explicit Telemetry( const std::string& path );
+
+  // Remove operations people shouldn't be using.
+  Telemetry() = delete;
+  Telemetry( const Telemetry& ) = delete;
+  Telemetry& operator=( const Telemetry& ) = delete;
+
+  /// @brief Did the file open?
+  [[nodiscard]] bool isOpen() const { return mWriter.isOpen(); }
+
+  ///
+  /// @brief Record a tick
+  ///
+  /// @param[in] time         - Seconds since the trace started
+  /// @param[in] inputs       - The settings the tick ran with
+  /// @param[in] sensorAngle  - What the controller read
+  /// @param[in] actualAngle  - Where the arm was after the tick
+  /// @param[in] out          - What the loop did
+  ///
+  void record( double time, const Session::Inputs& inputs, double sensorAngle, double actualAngle,
+               const ControlLoop::Output& out );
+
+  ///
+  /// @brief Finish the trace
+  ///
+  /// @return - True if everything was written
+  ///
+  bool close() { return mWriter.close(); }
+
+  /// @brief Ticks recorded
+  [[nodiscard]] std::size_t getRows() const { return mWriter.getRows(); }
+
+  private:
+
+  TraceWriter   mWriter;
+};
+
+}
+
+#endif
+
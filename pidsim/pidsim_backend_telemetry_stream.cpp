@@ -0,0 +1,358 @@
+
+#include "pidsim_backend_telemetry_stream.h"
+#include <algorithm>
+#include <assert.h>
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace PidSim {
+
+namespace {
+  constexpr std::uint64_t streamMagic       = 0x4d4145525453444dull;  // "MDSTREAM"
+  constexpr std::uint64_t streamVersion     = 1;
+  constexpr std::size_t   batchHeaderWords  = 5;
+  constexpr std::size_t   wordSize          = sizeof( std::uint64_t );
+
+  // How often the thread looks for rows to batch when the sockets are quiet
+  constexpr int           pollMilliseconds  = 5;
+
+  std::uint64_t toWord( double value )
+  {
+    std::uint64_t word;
+    std::memcpy( &word, &value, sizeof( word ));
+    return word;
+  }
+
+  void appendWords( std::vector<unsigned char>& bytes, const std::uint64_t* words, std::size_t count )
+  {
+    const unsigned char* begin = reinterpret_cast<const unsigned char*>( words );
+    bytes.insert( bytes.end(), begin, begin + count * wordSize );
+  }
+
+  // Publish times ride in the ring as nanoseconds on the steady clock
+  std::uint64_t clockWord( std::chrono::steady_clock::time_point time )
+  {
+    return static_cast<std::uint64_t>( std::chrono::duration_cast<std::chrono::nanoseconds>(
+      time.time_since_epoch() ).count() );
+  }
+
+  std::chrono::steady_clock::time_point clockTime( std::uint64_t word )
+  {
+    return std::chrono::steady_clock::time_point( std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::nanoseconds( word )));
+  }
+}
+
+//
+// The header is the magic, version and column count, then the names
+//
+TelemetryStream::TelemetryStream( const Options& options ) :
+  mOptions{ options }
+{
+  assert( options.mRingRows > 0 && options.mBatchRows > 0 && options.mMaxDecimation > 0 );
+  std::vector<std::string> names = { "sequence", "source", "time" };
+  for ( const TraceWriter::Column& column : Telemetry::columns() ) {
+    names.push_back( column.mName );
+  }
+  assert( names.size() == rowWords );
+  const std::uint64_t start[] = { streamMagic, streamVersion, rowWords };
+  appendWords( mHeader, start, 3 );
+  for ( const std::string& name : names ) {
+    mHeader.insert( mHeader.end(), name.begin(), name.end() );
+    mHeader.resize( ( mHeader.size() / wordSize + 1 ) * wordSize, 0 );
+  }
+}
+
+TelemetryStream::~TelemetryStream()
+{
+  mStopping = true;
+  if ( mThread.joinable() ) {
+    mThread.join();
+  }
+  for ( const std::unique_ptr<Subscriber>& subscriber : mSubscribers ) {
+    close( subscriber->mSocket );
+  }
+  if ( mListener >= 0 ) {
+    close( mListener );
+  }
+}
+
+// See header for interface
+bool TelemetryStream::listen( unsigned short port, std::string& error )
+{
+  assert( mListener < 0 );
+  mListener = socket( AF_INET, SOCK_STREAM, 0 );
+  if ( mListener < 0 ) {
+    error = std::string( "couldn't make a socket: " ) + strerror( errno );
+    return false;
+  }
+  const int on = 1;
+  setsockopt( mListener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof( on ));
+  sockaddr_in name{};
+  name.sin_family       = AF_INET;
+  name.sin_addr.s_addr  = htonl( INADDR_LOOPBACK );
+  name.sin_port         = htons( port );
+  socklen_t length = sizeof( name );
+  if ( bind( mListener, reinterpret_cast<sockaddr*>( &name ), sizeof( name )) != 0
+    || ::listen( mListener, SOMAXCONN ) != 0
+    || getsockname( mListener, reinterpret_cast<sockaddr*>( &name ), &length ) != 0 ) {
+    error = "couldn't listen on port " + std::to_string( port ) + ": " + strerror( errno );
+    close( mListener );
+    mListener = -1;
+    return false;
+  }
+  mPort = ntohs( name.sin_port );
+  mThread = std::thread( [this]() { serve(); } );
+  return true;
+}
+
+//
+// 1. Make the row once
+// 2. Give each subscriber it, unless it's decimating it away or its ring
+//    is full.  A full ring drops the row and halves the subscriber's rate,
+//    and halves it again for each further ring's worth dropped.
+// 3. A subscriber that's taken a ring's worth of rows since its rate last
+//    changed, and has its ring under a quarter full, gets its rate doubled
+//    back
+//
+void TelemetryStream::publish( std::uint64_t source, double time, const Session::Inputs& inputs, double sensorAngle,
+                               double actualAngle, const ControlLoop::Output& out )
+{
+  // 1. Make the row once
+  double values[ Telemetry::numColumns ];
+  Telemetry::row( inputs, sensorAngle, actualAngle, out, values );
+  std::uint64_t row[ ringWords ];
+  row[ 1 ] = source;
+  row[ 2 ] = toWord( time );
+  for ( std::size_t column = 0; column < Telemetry::numColumns; ++column ) {
+    row[ 3 + column ] = toWord( values[ column ] );
+  }
+  row[ rowWords ] = clockWord( Clock::now() );
+
+  // 2. Give each subscriber it
+  std::lock_guard<std::mutex> lock( mMutex );
+  row[ 0 ] = mPublished.fetch_add( 1, std::memory_order_relaxed );
+  for ( const std::unique_ptr<Subscriber>& pointer : mSubscribers ) {
+    Subscriber& subscriber = *pointer;
+    unsigned decimation = subscriber.mDecimation.load( std::memory_order_relaxed );
+    if ( ++subscriber.mSkipped < decimation ) {
+      continue;
+    }
+    subscriber.mSkipped = 0;
+    const std::uint64_t written = subscriber.mWritten.load( std::memory_order_relaxed );
+    const std::uint64_t read = subscriber.mRead.load( std::memory_order_acquire );
+    if ( written - read == mOptions.mRingRows ) {
+      subscriber.mDropped.fetch_add( 1, std::memory_order_relaxed );
+      if ( read != subscriber.mDropRead ) {
+        subscriber.mDropRun = 0;
+        subscriber.mDropRead = read;
+      }
+      if ( subscriber.mDropRun++ % mOptions.mRingRows == 0 ) {
+        subscriber.mDecimation.store( std::min( decimation * 2, mOptions.mMaxDecimation ), std::memory_order_relaxed );
+        subscriber.mRateRead = read;
+      }
+      continue;
+    }
+    const std::size_t slot = static_cast<std::size_t>( written % mOptions.mRingRows );
+    std::copy( row, row + ringWords, subscriber.mRing.begin() + static_cast<std::ptrdiff_t>( slot * ringWords ));
+    subscriber.mWritten.store( written + 1, std::memory_order_release );
+
+    // 3. Double the rate back, once per ring's worth taken
+    if ( decimation > 1 && written + 1 - read < mOptions.mRingRows / 4 && read - subscriber.mRateRead >= mOptions.mRingRows ) {
+      subscriber.mDecimation.store( decimation / 2, std::memory_order_relaxed );
+      subscriber.mRateRead = read;
+    }
+  }
+}
+
+//
+// The rows are copied out before mRead moves past them, so publish()
+// can't write over them meanwhile
+//
+void TelemetryStream::batch( Subscriber& subscriber )
+{
+  const std::uint64_t read = subscriber.mRead.load( std::memory_order_relaxed );
+  const std::uint64_t written = subscriber.mWritten.load( std::memory_order_acquire );
+  const std::size_t rows = static_cast<std::size_t>( std::min<std::uint64_t>( written - read, mOptions.mBatchRows ));
+  const std::uint64_t header[ batchHeaderWords ] = {
+    batchMagic, rows, mPublished.load( std::memory_order_relaxed ) - 1,
+    subscriber.mDropped.load( std::memory_order_relaxed ), subscriber.mDecimation.load( std::memory_order_relaxed )
+  };
+  subscriber.mOutput.clear();
+  subscriber.mSent = 0;
+  appendWords( subscriber.mOutput, header, batchHeaderWords );
+  for ( std::size_t row = 0; row < rows; ++row ) {
+    const std::uint64_t* words = &subscriber.mRing[ (( read + row ) % mOptions.mRingRows ) * ringWords ];
+    if ( row == 0 ) {
+      subscriber.mOutputOldest.store( words[ rowWords ], std::memory_order_relaxed );
+    }
+    appendWords( subscriber.mOutput, words, rowWords );
+    subscriber.mOutputEnd = words[ 0 ] + 1;
+  }
+  subscriber.mOutputRows.store( rows, std::memory_order_relaxed );
+  subscriber.mRead.store( read + rows, std::memory_order_release );
+}
+
+//
+// Until the stream is destroyed,
+//
+// 1. Wait for new subscribers, or for sockets with room
+// 2. Take new subscribers, and forget ones that hung up
+// 3. Send each subscriber what it has room for.  Once a batch is out,
+//    start the next when there's a full batch, or the oldest row has
+//    waited long enough.
+//
+void TelemetryStream::serve()
+{
+  const auto flushInterval = std::chrono::duration<double>( mOptions.mFlushInterval );
+  while ( !mStopping ) {
+    // 1. Wait for new subscribers, or for sockets with room
+    std::vector<pollfd> polls = { { mListener, POLLIN, 0 } };
+    for ( const std::unique_ptr<Subscriber>& subscriber : mSubscribers ) {
+      const bool sending = subscriber->mSent < subscriber->mOutput.size();
+      polls.push_back( { subscriber->mSocket, static_cast<short>( POLLIN | ( sending ? POLLOUT : 0 )), 0 } );
+    }
+    poll( polls.data(), polls.size(), pollMilliseconds );
+
+    // 2. Take new subscribers, and forget ones that hung up.  Only the
+    //    list changes with publishers held up; the sockets are opened and
+    //    closed around that.
+    std::vector<bool> hungUp( mSubscribers.size(), false );
+    for ( std::size_t index = 0; index < mSubscribers.size(); ++index ) {
+      if ( polls[ index + 1 ].revents & ( POLLIN | POLLHUP | POLLERR )) {
+        unsigned char ignored[ 256 ];
+        const ssize_t read = recv( mSubscribers[ index ]->mSocket, ignored, sizeof( ignored ), MSG_DONTWAIT );
+        hungUp[ index ] = read == 0 || ( read < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR );
+      }
+    }
+    std::unique_ptr<Subscriber> joining;
+    if ( polls[ 0 ].revents & POLLIN ) {
+      const int socket = accept( mListener, nullptr, nullptr );
+      if ( socket >= 0 ) {
+        const int on = 1;
+        setsockopt( socket, IPPROTO_TCP, TCP_NODELAY, &on, sizeof( on ));
+        joining = std::make_unique<Subscriber>();
+        joining->mSocket = socket;
+        joining->mRing.resize( mOptions.mRingRows * ringWords );
+        joining->mOutput = mHeader;
+      }
+    }
+    std::vector<std::unique_ptr<Subscriber>> leaving;
+    if ( joining || std::find( hungUp.begin(), hungUp.end(), true ) != hungUp.end() ) {
+      std::lock_guard<std::mutex> lock( mMutex );
+      std::size_t index = 0;
+      mSubscribers.erase( std::remove_if( mSubscribers.begin(), mSubscribers.end(), [&]( std::unique_ptr<Subscriber>& subscriber ) {
+        if ( hungUp[ index++ ] ) {
+          leaving.push_back( std::move( subscriber ));
+          return true;
+        }
+        return false;
+      }), mSubscribers.end() );
+      if ( joining ) {
+        joining->mNextSequence.store( mPublished.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+        mSubscribers.push_back( std::move( joining ));
+      }
+    }
+    for ( const std::unique_ptr<Subscriber>& subscriber : leaving ) {
+      close( subscriber->mSocket );
+    }
+
+    // 3. Send each subscriber what it has room for
+    for ( const std::unique_ptr<Subscriber>& pointer : mSubscribers ) {
+      Subscriber& subscriber = *pointer;
+      while ( subscriber.mSent < subscriber.mOutput.size() ) {
+        const ssize_t sent = send( subscriber.mSocket, subscriber.mOutput.data() + subscriber.mSent,
+                                   subscriber.mOutput.size() - subscriber.mSent, MSG_DONTWAIT | MSG_NOSIGNAL );
+        if ( sent <= 0 ) {
+          break;
+        }
+        subscriber.mSent += static_cast<std::size_t>( sent );
+      }
+      if ( subscriber.mSent < subscriber.mOutput.size() ) {
+        continue;
+      }
+      const std::size_t outputRows = subscriber.mOutputRows.load( std::memory_order_relaxed );
+      if ( outputRows > 0 ) {
+        subscriber.mDelivered.fetch_add( outputRows, std::memory_order_relaxed );
+        subscriber.mNextSequence.store( subscriber.mOutputEnd, std::memory_order_relaxed );
+        subscriber.mOutputRows.store( 0, std::memory_order_release );
+      }
+      const std::uint64_t read = subscriber.mRead.load( std::memory_order_relaxed );
+      const std::uint64_t waiting = subscriber.mWritten.load( std::memory_order_acquire ) - read;
+      const std::size_t head = static_cast<std::size_t>( read % mOptions.mRingRows );
+      const bool due = waiting > 0 && ( waiting >= mOptions.mBatchRows
+        || Clock::now() - clockTime( subscriber.mRing[ head * ringWords + rowWords ] ) >= flushInterval );
+      if ( due ) {
+        batch( subscriber );
+      }
+    }
+  }
+}
+
+// See header for interface
+bool TelemetryStream::drain( double seconds )
+{
+  const Clock::time_point deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+    std::chrono::duration<double>( seconds ));
+  for ( ;; ) {
+    {
+      std::lock_guard<std::mutex> lock( mMutex );
+      if ( std::all_of( mSubscribers.begin(), mSubscribers.end(), []( const std::unique_ptr<Subscriber>& subscriber ) {
+        return subscriber->mRead.load( std::memory_order_acquire ) == subscriber->mWritten.load( std::memory_order_relaxed )
+            && subscriber->mOutputRows.load( std::memory_order_acquire ) == 0;
+      })) {
+        return true;
+      }
+    }
+    if ( Clock::now() >= deadline ) {
+      return false;
+    }
+    std::this_thread::sleep_for( std::chrono::milliseconds( pollMilliseconds ));
+  }
+}
+
+// See header for interface
+std::uint64_t TelemetryStream::getPublished() const
+{
+  return mPublished.load( std::memory_order_relaxed );
+}
+
+//
+// The oldest row not delivered is the first in the batch being sent, or
+// else the first in the ring.  Holding mMutex keeps publish() from
+// writing over that.
+//
+std::vector<TelemetryStream::Stats> TelemetryStream::getStats() const
+{
+  std::lock_guard<std::mutex> lock( mMutex );
+  const Clock::time_point now = Clock::now();
+  std::vector<Stats> stats;
+  for ( const std::unique_ptr<Subscriber>& pointer : mSubscribers ) {
+    const Subscriber& subscriber = *pointer;
+    const std::uint64_t read = subscriber.mRead.load( std::memory_order_acquire );
+    Clock::time_point oldest = now;
+    if ( subscriber.mOutputRows.load( std::memory_order_acquire ) > 0 ) {
+      oldest = clockTime( subscriber.mOutputOldest.load( std::memory_order_relaxed ));
+    }
+    else if ( subscriber.mWritten.load( std::memory_order_relaxed ) > read ) {
+      oldest = clockTime( subscriber.mRing[ static_cast<std::size_t>( read % mOptions.mRingRows ) * ringWords + rowWords ] );
+    }
+    stats.push_back( { subscriber.mDelivered.load( std::memory_order_relaxed ),
+                       subscriber.mDropped.load( std::memory_order_relaxed ),
+                       subscriber.mDecimation.load( std::memory_order_relaxed ),
+                       mPublished.load( std::memory_order_relaxed ) - subscriber.mNextSequence.load( std::memory_order_relaxed ),
+                       std::chrono::duration<double>( now - oldest ).count() } );
+  }
+  return stats;
+}
+
+}
@@ -0,0 +1,190 @@
+#ifndef __PIDSIM_BACKEND_TELEMETRY_STREAM_H__
+#define __PIDSIM_BACKEND_TELEMETRY_STREAM_H__
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "pidsim_backend_control_loop.h"
+#include "pidsim_backend_session.h"
+#include "pidsim_backend_telemetry.h"
+
+namespace PidSim {
+
+///
+/// @brief Streams ticks to any number of subscribers on a localhost TCP port
+///
+/// The rows are Telemetry's, so plotters and dashboards see what a trace
+/// would have.  publish() copies the row into each subscriber's ring and
+/// returns; a thread of the stream's own does the batching and sending.
+/// Each ring has one writer (publishers take turns, so sequence numbers
+/// stay in order) and one reader (the thread), which only share the
+/// ring's ends, so a publisher never waits on the thread's copying or on
+/// a socket.  The thread only holds up publishers to add or remove a
+/// subscriber.
+///
+/// A subscriber that can't keep up fills its ring.  Rows that don't fit
+/// are dropped, and from then on it only gets every 2nd (then 4th, ...)
+/// row.  Once it's caught up, its rate is doubled back, at most once per
+/// ring's worth of rows it takes.  Other subscribers don't notice.
+///
+/// The stream, in the host's byte order:
+///
+/// - A header: magic, version, column count, then each column's name,
+///   nul terminated and padded to 8 bytes
+/// - Batches of [ batchMagic, rows, latest sequence, rows dropped so far,
+///   decimation ], then per row [ sequence, source, time (s), columns ]
+///
+/// Sequence numbers count every row published, so gaps are what was
+/// dropped or decimated, and the latest sequence less the batch's last
+/// row is how far behind the subscriber is.  getStats() has the same
+/// from the stream's side.
+///
+class TelemetryStream
+{
+  public:
+
+  /// @brief Starts a batch
+  static constexpr std::uint64_t batchMagic = 0x48435441424d5453ull;  // "STMBATCH"
+
+  ///
+  /// @brief Sizes and timing
+  ///
+  struct Options
+  {
+    std::size_t   mRingRows       = 8192;   // Rows a subscriber can fall behind
+    std::size_t   mBatchRows      = 64;     // Rows per batch, at most
+    double        mFlushInterval  = 0.02;   // Seconds a part batch waits for more rows
+    unsigned      mMaxDecimation  = 64;     // A slow subscriber gets at least every this many rows
+  };
+
+  ///
+  /// @brief How one subscriber is keeping up
+  ///
+  struct Stats
+  {
+    std::uint64_t   mDelivered;     // Rows handed to the socket
+    std::uint64_t   mDropped;       // Rows that didn't fit in its ring
+    unsigned        mDecimation;    // Getting every this many rows
+    std::uint64_t   mLagRows;       // Rows published since the last one delivered
+    double          mLagSeconds;    // How long the oldest row not yet delivered has waited
+  };
+
+  ///
+  /// @brief Constructor.  Nothing listens yet.
+  ///
+  /// @param[in] options  - Sizes and timing
+  ///
+  explicit TelemetryStream( const Options& options );
+
+  /// @brief Stops the thread, and hangs up on the subscribers
+  ~TelemetryStream();
+
+  // Remove operations people shouldn't be using.
+  TelemetryStream() = delete;
+  TelemetryStream( const TelemetryStream& ) = delete;
+  TelemetryStream& operator=( const TelemetryStream& ) = delete;
+
+  ///
+  /// @brief Start taking subscribers on a localhost port
+  ///
+  /// @param[in]  port  - The port, or 0 to pick a free one
+  /// @param[out] error - What went wrong, if anything
+  /// @return           - True if listening
+  ///
+  bool listen( unsigned short port, std::string& error );
+
+  /// @brief The port subscribers should connect to
+  [[nodiscard]] unsigned short getPort() const { return mPort; }
+
+  ///
+  /// @brief Send a tick to every subscriber.  Safe from any thread.
+  ///
+  /// @param[in] source       - Which run the tick is from, i.e., a scenario
+  /// @param[in] time         - Seconds into the run
+  /// @param[in] inputs       - The settings the tick ran with
+  /// @param[in] sensorAngle  - What the controller read
+  /// @param[in] actualAngle  - Where the arm was after the tick
+  /// @param[in] out          - What the loop did
+  ///
+  void publish( std::uint64_t source, double time, const Session::Inputs& inputs, double sensorAngle,
+                double actualAngle, const ControlLoop::Output& out );
+
+  ///
+  /// @brief Wait for the subscribers to get what's been published
+  ///
+  /// @param[in] seconds  - How long to wait, at most
+  /// @return             - True if every subscriber is caught up
+  ///
+  bool drain( double seconds );
+
+  /// @brief Rows published
+  [[nodiscard]] std::uint64_t getPublished() const;
+
+  /// @brief Each subscriber's stats, oldest subscriber first
+  [[nodiscard]] std::vector<Stats> getStats() const;
+
+  private:
+
+  using Clock = std::chrono::steady_clock;
+
+  // Words in a row: sequence, source, time, then Telemetry's columns
+  static constexpr std::size_t rowWords   = 3 + Telemetry::numColumns;
+  // The ring keeps when each row was published too, for the lag
+  static constexpr std::size_t ringWords  = rowWords + 1;
+
+  struct Subscriber
+  {
+    int                         mSocket;
+    std::vector<std::uint64_t>  mRing;                  // mRingRows rows of ringWords
+
+    // The ring's ends, as rows ever put in and taken out.  Only publish()
+    // moves mWritten, and only the thread moves mRead.
+    std::atomic<std::uint64_t>  mWritten{ 0 };
+    std::atomic<std::uint64_t>  mRead{ 0 };
+
+    // publish()'s, under mMutex
+    unsigned                    mSkipped      = 0;      // Rows skipped since the last one kept
+    std::uint64_t               mDropRun      = 0;      // Rows dropped since the thread last read
+    std::uint64_t               mDropRead     = 0;      // mRead when they started dropping
+    std::uint64_t               mRateRead     = 0;      // mRead when the rate last changed
+    std::atomic<unsigned>       mDecimation{ 1 };       // Keeping every this many rows
+    std::atomic<std::uint64_t>  mDropped{ 0 };
+
+    // The thread's
+    std::atomic<std::uint64_t>  mDelivered{ 0 };
+    std::atomic<std::uint64_t>  mNextSequence{ 0 };     // After the last row delivered
+    std::vector<unsigned char>  mOutput;                // The batch being sent
+    std::size_t                 mSent         = 0;      // Bytes of it sent
+    std::atomic<std::size_t>    mOutputRows{ 0 };       // Rows in it
+    std::uint64_t               mOutputEnd    = 0;      // Sequence after its last row
+    std::atomic<std::uint64_t>  mOutputOldest{ 0 };     // When its first row was published
+  };
+
+  // The thread: take subscribers, batch their rows and send them
+  void serve();
+  // Move up to a batch of rows from the ring into mOutput
+  void batch( Subscriber& subscriber );
+
+  Options                     mOptions;
+  int                         mListener   = -1;
+  unsigned short              mPort       = 0;
+  std::vector<unsigned char>  mHeader;                  // Sent to each subscriber first
+  std::thread                 mThread;
+  std::atomic<bool>           mStopping{ false };
+
+  // Publishers take turns on mMutex.  The thread takes it to change
+  // mSubscribers, which it alone does.
+  mutable std::mutex                        mMutex;
+  std::vector<std::unique_ptr<Subscriber>>  mSubscribers;
+  std::atomic<std::uint64_t>                mPublished{ 0 };
+};
+
+}
+
+#endif
@@ -0,0 +1,637 @@
+
+#include "pidsim_backend_trace.h"
+#include <algorithm>
+#include <assert.h>
+#include <cstring>
+#include <fcntl.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace PidSim {
+
+namespace {
+  // The file is a header, the blocks, the footer, and then a trailer
+  // that says where the footer is
+  constexpr std::uint64_t fileMagic     = 0x314352544d495350ull;  // "PSIMTRC1"
+  constexpr std::uint64_t formatVersion = 1;
+  constexpr std::size_t   wordSize      = sizeof( std::uint64_t );
+  constexpr std::size_t   trailerWords  = 2;
+
+  ///
+  /// Packs bits most significant first, 64 at a time
+  ///
+  class BitWriter
+  {
+    public:
+
+    explicit BitWriter( std::vector<unsigned char>& out ) : mOut{ out } {}
+
+    // Write the low count bits of value, count up to 64
+    void write( std::uint64_t value, unsigned count )
+    {
+      if ( count == 0 ) {
+        return;
+      }
+      if ( count < 64 ) {
+        value &= ( std::uint64_t{ 1 } << count ) - 1;
+      }
+      const unsigned room = 64 - mFill;
+      if ( count < room ) {
+        mAccumulator = ( mAccumulator << count ) | value;
+        mFill += count;
+        return;
+      }
+      // Top up the accumulator, flush it, and keep what's left over
+      const unsigned left = count - room;
+      mAccumulator = room == 64 ? value >> left : ( mAccumulator << room ) | ( value >> left );
+      flushWord();
+      mAccumulator = left == 0 ? 0 : value & (( std::uint64_t{ 1 } << left ) - 1 );
+      mFill = left;
+    }
+
+    // Pad out to a whole byte
+    void finish()
+    {
+      const std::uint64_t word = mFill == 0 ? 0 : mAccumulator << ( 64 - mFill );
+      for ( unsigned byte = 0; byte < ( mFill + 7 ) / 8; ++byte ) {
+        mOut.push_back( static_cast<unsigned char>( word >> ( 56 - 8 * byte )));
+      }
+      mAccumulator = 0;
+      mFill = 0;
+    }
+
+    private:
+
+    void flushWord()
+    {
+      for ( unsigned byte = 0; byte < 8; ++byte ) {
+        mOut.push_back( static_cast<unsigned char>( mAccumulator >> ( 56 - 8 * byte )));
+      }
+    }
+
+    std::vector<unsigned char>&   mOut;
+    std::uint64_t                 mAccumulator  = 0;
+    unsigned                      mFill         = 0;    // Bits in the accumulator
+  };
+
+  ///
+  /// Reads what BitWriter wrote.  Reads past the end get zeros, so a bad
+  /// file decodes to junk rather than reading out of bounds.
+  ///
+  class BitReader
+  {
+    public:
+
+    BitReader( const unsigned char* bytes, std::size_t size ) : mBytes{ bytes }, mSize{ size } {}
+
+    // Read count bits, count up to 64
+    std::uint64_t read( unsigned count )
+    {
+      if ( count == 0 ) {
+        return 0;
+      }
+      if ( count > 56 ) {
+        const std::uint64_t high = read( count - 32 );
+        return ( high << 32 ) | read( 32 );
+      }
+      // At least 57 bits are valid in the window
+      const std::uint64_t value = window() >> ( 64 - count );
+      mPosition += count;
+      return value;
+    }
+
+    private:
+
+    std::uint64_t window() const
+    {
+      const std::size_t first = mPosition / 8;
+      std::uint64_t word = 0;
+      for ( std::size_t byte = 0; byte < 8; ++byte ) {
+        word = ( word << 8 ) | ( first + byte < mSize ? mBytes[ first + byte ] : 0u );
+      }
+      return word << ( mPosition % 8 );
+    }
+
+    const unsigned char*    mBytes;
+    std::size_t             mSize;
+    std::size_t             mPosition = 0;   // In bits
+  };
+
+  std::uint64_t toWord( double value )
+  {
+    std::uint64_t word;
+    std::memcpy( &word, &value, sizeof( word ));
+    return word;
+  }
+
+  double toDouble( std::uint64_t word )
+  {
+    double value;
+    std::memcpy( &value, &word, sizeof( value ));
+    return value;
+  }
+
+  unsigned leadingZeros( std::uint64_t word )  { return static_cast<unsigned>( __builtin_clzll( word )); }
+  unsigned trailingZeros( std::uint64_t word ) { return static_cast<unsigned>( __builtin_ctzll( word )); }
+
+  //
+  // Delta of delta timestamps.  The first is stored whole, and the first
+  // delta is taken as a change from 0.  Each change is '0' for none, or a
+  // prefix for how many bits it needs, and then those bits:
+  //
+  //   '10' 7 bits, '110' 9 bits, '1110' 12 bits, '1111' 64 bits
+  //
+  struct TimeBucket
+  {
+    std::uint64_t   mPrefix;
+    unsigned        mPrefixBits;
+    unsigned        mBits;
+  };
+  constexpr TimeBucket timeBuckets[] = {
+    { 0b10,   2, 7 },
+    { 0b110,  3, 9 },
+    { 0b1110, 4, 12 },
+    { 0b1111, 4, 64 },
+  };
+
+  void encodeTimes( const std::vector<std::int64_t>& times, std::vector<unsigned char>& out )
+  {
+    BitWriter writer( out );
+    std::int64_t last = 0, lastDelta = 0;
+    for ( std::size_t row = 0; row < times.size(); ++row ) {
+      if ( row == 0 ) {
+        writer.write( static_cast<std::uint64_t>( times[ 0 ] ), 64 );
+        last = times[ 0 ];
+        continue;
+      }
+      // Wrap around rather than overflow, the decoder wraps back
+      const std::int64_t delta = static_cast<std::int64_t>( static_cast<std::uint64_t>( times[ row ] ) - static_cast<std::uint64_t>( last ));
+      const std::int64_t change = static_cast<std::int64_t>( static_cast<std::uint64_t>( delta ) - static_cast<std::uint64_t>( lastDelta ));
+      if ( change == 0 ) {
+        writer.write( 0, 1 );
+      }
+      else {
+        for ( const TimeBucket& bucket : timeBuckets ) {
+          const std::int64_t limit = bucket.mBits == 64 ? 0 : std::int64_t{ 1 } << ( bucket.mBits - 1 );
+          if ( bucket.mBits == 64 || ( change >= -limit && change < limit )) {
+            writer.write( bucket.mPrefix, bucket.mPrefixBits );
+            writer.write( static_cast<std::uint64_t>( change ), bucket.mBits );
+            break;
+          }
+        }
+      }
+      last = times[ row ];
+      lastDelta = delta;
+    }
+    writer.finish();
+  }
+
+  void decodeTimes( const unsigned char* bytes, std::size_t size, std::size_t rows, std::vector<std::int64_t>& out )
+  {
+    BitReader reader( bytes, size );
+    std::uint64_t last = 0, lastDelta = 0;
+    for ( std::size_t row = 0; row < rows; ++row ) {
+      if ( row == 0 ) {
+        last = reader.read( 64 );
+        out.push_back( static_cast<std::int64_t>( last ));
+        continue;
+      }
+      std::uint64_t change = 0;
+      if ( reader.read( 1 ) == 1 ) {
+        // Count the 1s in the prefix to find the bucket
+        std::size_t bucket = 0;
+        while ( bucket + 1 < std::size( timeBuckets ) && reader.read( 1 ) == 1 ) {
+          ++bucket;
+        }
+        const unsigned bits = timeBuckets[ bucket ].mBits;
+        change = reader.read( bits );
+        if ( bits < 64 && ( change >> ( bits - 1 )) != 0 ) {
+          change |= ~std::uint64_t{ 0 } << bits;    // Sign extend
+        }
+      }
+      lastDelta += change;
+      last += lastDelta;
+      out.push_back( static_cast<std::int64_t>( last ));
+    }
+  }
+
+  //
+  // What a row is XORed with.  Gorilla uses the row before, which is
+  // right for values that hold and then jump.  Values that move smoothly,
+  // like a sampled arm angle, are better guessed by carrying on the last
+  // step, which leaves only the change in speed to store.  Doubling and
+  // subtracting rounds the same everywhere, so the reader guesses the same.
+  //
+  enum class Predictor
+  {
+    Last,
+    Linear
+  };
+
+  std::uint64_t predict( Predictor predictor, double last, double beforeLast )
+  {
+    if ( predictor == Predictor::Linear ) {
+      const double guess = 2.0 * last - beforeLast;
+      if ( std::isfinite( guess )) {
+        return toWord( guess );
+      }
+    }
+    return toWord( last );
+  }
+
+  //
+  // XOR compressed values.  The first is stored whole.  After that, each
+  // is XORed with the predicted value, and written as
+  //
+  //   '0'                     - As predicted
+  //   '10' bits               - The XOR fits in the last window of
+  //                             meaningful bits, so reuse it
+  //   '11' 5 bits 6 bits bits - A new window: leading zeros, the number
+  //                             of meaningful bits less 1, and the bits
+  //
+  void encodeValues( const std::vector<double>& values, Predictor predictor, std::vector<unsigned char>& out )
+  {
+    BitWriter writer( out );
+    writer.write( predictor == Predictor::Linear ? 1 : 0, 1 );
+    double last = 0.0, beforeLast = 0.0;
+    unsigned windowLeading = 65, windowTrailing = 0;   // No window yet
+    for ( std::size_t row = 0; row < values.size(); ++row ) {
+      const std::uint64_t word = toWord( values[ row ] );
+      if ( row == 0 ) {
+        writer.write( word, 64 );
+        last = beforeLast = values[ 0 ];
+        continue;
+      }
+      const std::uint64_t xorred = word ^ predict( predictor, last, beforeLast );
+      beforeLast = last;
+      last = values[ row ];
+      if ( xorred == 0 ) {
+        writer.write( 0, 1 );
+        continue;
+      }
+      const unsigned leading  = std::min( leadingZeros( xorred ), 31u );
+      const unsigned trailing = trailingZeros( xorred );
+      if ( windowLeading <= 64 && leading >= windowLeading && trailing >= windowTrailing ) {
+        writer.write( 0b10, 2 );
+        writer.write( xorred >> windowTrailing, 64 - windowLeading - windowTrailing );
+      }
+      else {
+        const unsigned meaningful = 64 - leading - trailing;
+        writer.write( 0b11, 2 );
+        writer.write( leading, 5 );
+        writer.write( meaningful - 1, 6 );
+        writer.write( xorred >> trailing, meaningful );
+        windowLeading  = leading;
+        windowTrailing = trailing;
+      }
+    }
+    writer.finish();
+  }
+
+  // Try both predictors, and keep whichever is smaller
+  void encodeValues( const std::vector<double>& values, std::vector<unsigned char>& out )
+  {
+    std::vector<unsigned char> linear;
+    encodeValues( values, Predictor::Linear, linear );
+    const std::size_t start = out.size();
+    encodeValues( values, Predictor::Last, out );
+    if ( linear.size() < out.size() - start ) {
+      out.resize( start );
+      out.insert( out.end(), linear.begin(), linear.end() );
+    }
+  }
+
+  void decodeValues( const unsigned char* bytes, std::size_t size, std::size_t rows, std::vector<double>& out )
+  {
+    BitReader reader( bytes, size );
+    const Predictor predictor = reader.read( 1 ) == 1 ? Predictor::Linear : Predictor::Last;
+    double last = 0.0, beforeLast = 0.0;
+    unsigned windowLeading = 0, windowTrailing = 0;
+    for ( std::size_t row = 0; row < rows; ++row ) {
+      std::uint64_t word = 0;
+      if ( row == 0 ) {
+        word = reader.read( 64 );
+        beforeLast = toDouble( word );
+      }
+      else {
+        word = predict( predictor, last, beforeLast );
+        if ( reader.read( 1 ) == 1 ) {
+          if ( reader.read( 1 ) == 1 ) {
+            windowLeading = static_cast<unsigned>( reader.read( 5 ));
+            const unsigned meaningful = static_cast<unsigned>( reader.read( 6 )) + 1;
+            windowTrailing = 64 - std::min( 64u, windowLeading + meaningful );
+          }
+          word ^= reader.read( 64 - windowLeading - windowTrailing ) << windowTrailing;
+        }
+        beforeLast = last;
+      }
+      last = toDouble( word );
+      out.push_back( last );
+    }
+  }
+
+  void appendWord( std::vector<unsigned char>& out, std::uint64_t word )
+  {
+    const std::size_t at = out.size();
+    out.resize( at + wordSize );
+    std::memcpy( out.data() + at, &word, wordSize );
+  }
+
+  std::uint64_t wordAt( const unsigned char* bytes, std::size_t offset )
+  {
+    std::uint64_t word;
+    std::memcpy( &word, bytes + offset, wordSize );
+    return word;
+  }
+}
+
+//
+// The header is the magic number, the version, the block size, the
+// column count, and each column's name as a length and its bytes,
+// padded to a whole word
+//
+TraceWriter::TraceWriter( const std::string& path, const std::vector<Column>& columns, std::size_t blockRows ) :
+  mFile         { path, std::ios::binary | std::ios::trunc },
+  mColumnCount  { columns.size() },
+  mBlockRows    { blockRows },
+  mValues       ( columns.size() )
+{
+  assert( blockRows > 0 );
+  std::vector<unsigned char> header;
+  appendWord( header, fileMagic );
+  appendWord( header, formatVersion );
+  appendWord( header, blockRows );
+  appendWord( header, columns.size() );
+  for ( const Column& column : columns ) {
+    appendWord( header, column.mName.size() );
+    header.insert( header.end(), column.mName.begin(), column.mName.end() );
+    header.resize(( header.size() + wordSize - 1 ) / wordSize * wordSize );
+
+    // A power of two quantum rounds exactly, and zeroes the bits below it
+    mQuanta.push_back( column.mResolution > 0.0 ? exp2( floor( log2( column.mResolution ))) : 0.0 );
+  }
+  mFile.write( reinterpret_cast<const char*>( header.data() ), static_cast<std::streamsize>( header.size() ));
+  mOffset = header.size();
+  mTimes.reserve( blockRows );
+  for ( std::vector<double>& values : mValues ) {
+    values.reserve( blockRows );
+  }
+}
+
+TraceWriter::~TraceWriter()
+{
+  close();
+}
+
+// See header for interface
+void TraceWriter::append( std::int64_t time, const double* values )
+{
+  mTimes.push_back( time );
+  for ( std::size_t column = 0; column < mColumnCount; ++column ) {
+    const double quantum = mQuanta[ column ];
+    mValues[ column ].push_back( quantum == 0.0 ? values[ column ] : std::nearbyint( values[ column ] / quantum ) * quantum );
+  }
+  ++mRows;
+  if ( mTimes.size() == mBlockRows ) {
+    writeBlock();
+  }
+}
+
+//
+// 1. Compress each column into its own chunk, less any zero tail
+// 2. Note where the chunks went in the index
+// 3. Start the next block
+//
+void TraceWriter::writeBlock()
+{
+  if ( mTimes.empty() ) {
+    return;
+  }
+
+  // 1. Compress each column into its own chunk
+  BlockIndex index{ mTimes.size(), mTimes.front(), mTimes.back(), {} };
+  std::vector<unsigned char> bytes;
+  for ( std::size_t chunk = 0; chunk <= mColumnCount; ++chunk ) {
+    const std::size_t start = bytes.size();
+    if ( chunk == 0 ) {
+      encodeTimes( mTimes, bytes );
+    }
+    else {
+      encodeValues( mValues[ chunk - 1 ], bytes );
+    }
+    // The reader reads zeros past the end of a chunk, and a zero bit is
+    // "no change", so a column that settled down can drop its tail
+    while ( bytes.size() > start && bytes.back() == 0 ) {
+      bytes.pop_back();
+    }
+
+    // 2. Note where the chunk went
+    index.mChunks.push_back( mOffset + start );
+    index.mChunks.push_back( bytes.size() - start );
+  }
+  mFile.write( reinterpret_cast<const char*>( bytes.data() ), static_cast<std::streamsize>( bytes.size() ));
+  mGood = mGood && mFile.good();
+  mOffset += bytes.size();
+  mIndex.push_back( std::move( index ));
+
+  // 3. Start the next block
+  mTimes.clear();
+  for ( std::vector<double>& values : mValues ) {
+    values.clear();
+  }
+}
+
+//
+// 1. Write the last block
+// 2. Write the footer: the block count, then each block's rows, times
+//    and chunks
+// 3. Write the trailer: where the footer is, and the magic number again
+//
+bool TraceWriter::close()
+{
+  if ( !mFile.is_open() ) {
+    return false;
+  }
+
+  // 1. Write the last block
+  writeBlock();
+
+  // 2. Write the footer
+  const std::uint64_t footer = mOffset;
+  std::vector<unsigned char> bytes;
+  appendWord( bytes, mIndex.size() );
+  for ( const BlockIndex& index : mIndex ) {
+    appendWord( bytes, index.mRows );
+    appendWord( bytes, static_cast<std::uint64_t>( index.mFirstTime ));
+    appendWord( bytes, static_cast<std::uint64_t>( index.mLastTime ));
+    for ( std::uint64_t word : index.mChunks ) {
+      appendWord( bytes, word );
+    }
+  }
+
+  // 3. Write the trailer
+  appendWord( bytes, footer );
+  appendWord( bytes, fileMagic );
+  mFile.write( reinterpret_cast<const char*>( bytes.data() ), static_cast<std::streamsize>( bytes.size() ));
+  mGood = mGood && mFile.flush().good();
+  mFile.close();
+  return mGood;
+}
+
+TraceReader::TraceReader( const std::string& path )
+{
+  const int file = open( path.c_str(), O_RDONLY | O_CLOEXEC );
+  if ( file < 0 ) {
+    return;
+  }
+  struct stat status;
+  if ( fstat( file, &status ) == 0 && status.st_size > 0 ) {
+    void* map = mmap( nullptr, static_cast<std::size_t>( status.st_size ), PROT_READ, MAP_SHARED, file, 0 );
+    if ( map != MAP_FAILED ) {
+      mMap  = static_cast<const unsigned char*>( map );
+      mSize = static_cast<std::size_t>( status.st_size );
+    }
+  }
+  close( file );
+  if ( mMap && !parse() ) {
+    munmap( const_cast<unsigned char*>( mMap ), mSize );
+    mMap = nullptr;
+  }
+}
+
+TraceReader::~TraceReader()
+{
+  if ( mMap ) {
+    munmap( const_cast<unsigned char*>( mMap ), mSize );
+  }
+}
+
+//
+// 1. Check the header, and read the column names
+// 2. Find the footer from the trailer
+// 3. Read the index, checking every chunk is inside the blocks
+//
+bool TraceReader::parse()
+{
+  // 1. Check the header, and read the column names
+  if ( mSize < 4 * wordSize + trailerWords * wordSize
+    || wordAt( mMap, 0 ) != fileMagic || wordAt( mMap, wordSize ) != formatVersion ) {
+    return false;
+  }
+  const std::uint64_t columns = wordAt( mMap, 3 * wordSize );
+  std::size_t offset = 4 * wordSize;
+  for ( std::uint64_t column = 0; column < columns; ++column ) {
+    if ( mSize - offset < wordSize ) {
+      return false;
+    }
+    const std::uint64_t length = wordAt( mMap, offset );
+    offset += wordSize;
+    if ( length > mSize - offset ) {
+      return false;
+    }
+    mColumns.emplace_back( reinterpret_cast<const char*>( mMap + offset ), length );
+    offset += ( length + wordSize - 1 ) / wordSize * wordSize;
+  }
+  const std::size_t blocksStart = offset;
+
+  // 2. Find the footer from the trailer
+  const std::size_t trailer = mSize - trailerWords * wordSize;
+  const std::uint64_t footer = wordAt( mMap, trailer );
+  if ( wordAt( mMap, trailer + wordSize ) != fileMagic || footer < blocksStart || footer > trailer - wordSize ) {
+    return false;
+  }
+
+  // 3. Read the index
+  const std::uint64_t blocks = wordAt( mMap, footer );
+  const std::size_t blockWords = 3 + 2 * ( columns + 1 );
+  if ( blocks > ( trailer - footer - wordSize ) / wordSize / blockWords ) {
+    return false;
+  }
+  offset = footer + wordSize;
+  for ( std::uint64_t block = 0; block < blocks; ++block ) {
+    Block entry;
+    entry.mRows       = wordAt( mMap, offset );
+    entry.mFirstRow   = mRows;
+    entry.mFirstTime  = static_cast<std::int64_t>( wordAt( mMap, offset + wordSize ));
+    entry.mLastTime   = static_cast<std::int64_t>( wordAt( mMap, offset + 2 * wordSize ));
+    offset += 3 * wordSize;
+    for ( std::size_t word = 0; word < 2 * ( columns + 1 ); ++word, offset += wordSize ) {
+      entry.mChunks.push_back( wordAt( mMap, offset ));
+    }
+    for ( std::size_t chunk = 0; chunk <= columns; ++chunk ) {
+      const std::uint64_t start = entry.mChunks[ 2 * chunk ], size = entry.mChunks[ 2 * chunk + 1 ];
+      if ( start < blocksStart || start > footer || size > footer - start ) {
+        return false;
+      }
+    }
+    mRows += entry.mRows;
+    mBlocks.push_back( std::move( entry ));
+  }
+  return true;
+}
+
+// See header for interface
+std::size_t TraceReader::findColumn( const std::string& name ) const
+{
+  return static_cast<std::size_t>( std::find( mColumns.begin(), mColumns.end(), name ) - mColumns.begin() );
+}
+
+// See header for interface
+std::size_t TraceReader::findBlock( std::int64_t time ) const
+{
+  return static_cast<std::size_t>( std::partition_point( mBlocks.begin(), mBlocks.end(),
+    [ time ]( const Block& block ) { return block.mLastTime < time; } ) - mBlocks.begin() );
+}
+
+// See header for interface
+void TraceReader::readBlockTimes( std::size_t block, std::vector<std::int64_t>& out ) const
+{
+  const Block& entry = mBlocks[ block ];
+  decodeTimes( mMap + entry.mChunks[ 0 ], entry.mChunks[ 1 ], entry.mRows, out );
+}
+
+// See header for interface
+void TraceReader::readBlock( std::size_t block, std::size_t column, std::vector<double>& out ) const
+{
+  assert( column < mColumns.size() );
+  const Block& entry = mBlocks[ block ];
+  decodeValues( mMap + entry.mChunks[ 2 * column + 2 ], entry.mChunks[ 2 * column + 3 ], entry.mRows, out );
+}
+
+// See header for interface
+std::vector<std::int64_t> TraceReader::readTimes() const
+{
+  std::vector<std::int64_t> times;
+  times.reserve( mRows );
+  for ( std::size_t block = 0; block < mBlocks.size(); ++block ) {
+    readBlockTimes( block, times );
+  }
+  return times;
+}
+
+//
+// Decode the blocks the range touches, and trim the first and last
+//
+std::vector<double> TraceReader::readColumn( std::size_t column, std::size_t first, std::size_t count ) const
+{
+  std::vector<double> values;
+  if ( first >= mRows ) {
+    return values;
+  }
+  const std::size_t end = first + std::min( count, mRows - first );
+  std::size_t block = static_cast<std::size_t>( std::partition_point( mBlocks.begin(), mBlocks.end(),
+    [ first ]( const Block& entry ) { return entry.mFirstRow + entry.mRows <= first; } ) - mBlocks.begin() );
+  const std::size_t skip = first - mBlocks[ block ].mFirstRow;
+  values.reserve( end - first + skip );
+  for ( ; block < mBlocks.size() && mBlocks[ block ].mFirstRow < end; ++block ) {
+    readBlock( block, column, values );
+  }
+  values.erase( values.begin(), values.begin() + static_cast<std::ptrdiff_t>( skip ));
+  values.resize( end - first );
+  return values;
+}
+
+}
+
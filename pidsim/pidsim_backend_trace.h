@@ -0,0 +1,234 @@
+#ifndef __PIDSIM_BACKEND_TRACE_H__
+#define __PIDSIM_BACKEND_TRACE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace PidSim {
+
+///
+/// @brief Writes a compressed, columnar trace of timestamped rows
+///
+/// Rows go into fixed size blocks.  In a block each column is compressed
+/// on its own, as in Facebook's Gorilla:
+///
+/// - Timestamps are stored as the change in the step between them
+///   (delta of delta), so a steady tick rate is one bit a row.
+/// - Values are XORed with a prediction.  A value that was predicted is
+///   one bit; one that wasn't stores only the bits between the XOR's
+///   leading and trailing zeros, often reusing the last row's window.
+///   Gorilla predicts the value before.  Each chunk may instead predict
+///   the last step carrying on, which suits smoothly moving values like
+///   the arm's angle, and keeps whichever is smaller.
+///
+/// A chunk's trailing zero bytes aren't written, since the reader treats
+/// the end of a chunk as zeros.  A column that stops changing part way
+/// through a block costs nothing for the rest of it.
+///
+/// A footer indexes every block's time range and where each column's
+/// chunk is, so readers can go straight to the blocks and columns they
+/// want.  Each chunk starts fresh, so it decodes on its own.
+///
+/// Simulated doubles rarely repeat exactly, so a column can be given a
+/// resolution.  Values are then rounded to a power of two no coarser than
+/// it, which clears their low mantissa bits, and a settled arm compresses
+/// to next to nothing.
+///
+/// The file is only complete once close() writes the footer (the
+/// destructor calls it).
+///
+class TraceWriter
+{
+  public:
+
+  /// @brief Rows per block, unless told otherwise
+  static constexpr std::size_t defaultBlockRows = 4096;
+
+  ///
+  /// @brief A column of values
+  ///
+  struct Column
+  {
+    std::string   mName;
+    double        mResolution = 0.0;    // Round values to at least this fine.  0 keeps them exact.
+  };
+
+  ///
+  /// @brief Start a trace, replacing the file if it's there
+  ///
+  /// @param[in] path       - The file
+  /// @param[in] columns    - The values in every row
+  /// @param[in] blockRows  - Rows per block
+  ///
+  TraceWriter( const std::string& path, const std::vector<Column>& columns, std::size_t blockRows = defaultBlockRows );
+
+  ~TraceWriter();
+
+  // Remove operations people shouldn't be using.
+  TraceWriter() = delete;
+  TraceWriter( const TraceWriter& ) = delete;
+  TraceWriter& operator=( const TraceWriter& ) = delete;
+
+  /// @brief Did the file open?
+  [[nodiscard]] bool isOpen() const { return mFile.is_open(); }
+
+  ///
+  /// @brief Add a row
+  ///
+  /// @param[in] time   - Its timestamp, i.e., in microseconds.  Not going
+  ///                     backwards keeps the index useful.
+  /// @param[in] values - One per column
+  ///
+  void append( std::int64_t time, const double* values );
+
+  ///
+  /// @brief Write the last block and the footer, and close the file
+  ///
+  /// @return - True if everything was written
+  ///
+  bool close();
+
+  /// @brief Rows appended
+  [[nodiscard]] std::size_t getRows() const { return mRows; }
+
+  private:
+
+  struct BlockIndex
+  {
+    std::uint64_t               mRows;
+    std::int64_t                mFirstTime;
+    std::int64_t                mLastTime;
+    std::vector<std::uint64_t>  mChunks;    // Offset & size of each chunk, times first
+  };
+
+  // Compress the rows so far into a block
+  void writeBlock();
+
+  std::ofstream                       mFile;
+  std::size_t                         mColumnCount;
+  std::size_t                         mBlockRows;
+  std::vector<double>                 mQuanta;          // Per column rounding, 0 for none
+  std::vector<std::int64_t>           mTimes;           // This block's rows
+  std::vector<std::vector<double>>    mValues;
+  std::vector<BlockIndex>             mIndex;
+  std::uint64_t                       mOffset   = 0;    // Bytes written
+  std::size_t                         mRows     = 0;
+  bool                                mGood     = true;
+};
+
+///
+/// @brief Reads a trace TraceWriter wrote
+///
+/// The file is memory mapped and only the footer is read up front.  Each
+/// read decodes just the chunks it needs.
+///
+class TraceReader
+{
+  public:
+
+  ///
+  /// @brief Open a trace
+  ///
+  /// @param[in] path - The file
+  ///
+  explicit TraceReader( const std::string& path );
+
+  ~TraceReader();
+
+  // Remove operations people shouldn't be using.
+  TraceReader() = delete;
+  TraceReader( const TraceReader& ) = delete;
+  TraceReader& operator=( const TraceReader& ) = delete;
+
+  /// @brief Did the file open, and is it a complete trace?
+  [[nodiscard]] bool isOpen() const { return mMap != nullptr; }
+
+  /// @brief The columns' names
+  [[nodiscard]] const std::vector<std::string>& getColumns() const { return mColumns; }
+
+  ///
+  /// @brief A column's number
+  ///
+  /// @param[in] name - Its name
+  /// @return         - Its number, or getColumns().size() if there isn't one
+  ///
+  [[nodiscard]] std::size_t findColumn( const std::string& name ) const;
+
+  [[nodiscard]] std::size_t getRows() const { return mRows; }
+  [[nodiscard]] std::size_t getBlocks() const { return mBlocks.size(); }
+
+  /// @brief A block's rows
+  [[nodiscard]] std::size_t getBlockRows( std::size_t block ) const { return mBlocks[ block ].mRows; }
+
+  /// @brief A block's first row
+  [[nodiscard]] std::size_t getBlockStart( std::size_t block ) const { return mBlocks[ block ].mFirstRow; }
+
+  /// @brief A block's first & last timestamps
+  [[nodiscard]] std::int64_t getBlockFirstTime( std::size_t block ) const { return mBlocks[ block ].mFirstTime; }
+  [[nodiscard]] std::int64_t getBlockLastTime( std::size_t block ) const { return mBlocks[ block ].mLastTime; }
+
+  ///
+  /// @brief The first block that could have a row at or after a time
+  ///
+  /// @param[in] time - The time
+  /// @return         - The block, or getBlocks() if none
+  ///
+  [[nodiscard]] std::size_t findBlock( std::int64_t time ) const;
+
+  ///
+  /// @brief Decode one block's timestamps
+  ///
+  /// @param[in] block  - The block
+  /// @param[out] out   - getBlockRows( block ) times, appended
+  ///
+  void readBlockTimes( std::size_t block, std::vector<std::int64_t>& out ) const;
+
+  ///
+  /// @brief Decode one block of a column
+  ///
+  /// @param[in] block  - The block
+  /// @param[in] column - The column
+  /// @param[out] out   - getBlockRows( block ) values, appended
+  ///
+  void readBlock( std::size_t block, std::size_t column, std::vector<double>& out ) const;
+
+  /// @brief Every timestamp
+  [[nodiscard]] std::vector<std::int64_t> readTimes() const;
+
+  ///
+  /// @brief A range of a column, decoding only the blocks it covers
+  ///
+  /// @param[in] column - The column
+  /// @param[in] first  - The first row
+  /// @param[in] count  - Rows, cut short at the end of the trace
+  /// @return           - The values
+  ///
+  [[nodiscard]] std::vector<double> readColumn( std::size_t column, std::size_t first = 0, std::size_t count = SIZE_MAX ) const;
+
+  private:
+
+  struct Block
+  {
+    std::size_t                 mRows;
+    std::size_t                 mFirstRow;
+    std::int64_t                mFirstTime;
+    std::int64_t                mLastTime;
+    std::vector<std::uint64_t>  mChunks;    // Offset & size of each chunk, times first
+  };
+
+  // Parse the header & footer.  False if it isn't a complete trace.
+  bool parse();
+
+  const unsigned char*        mMap      = nullptr;
+  std::size_t                 mSize     = 0;
+  std::vector<std::string>    mColumns;
+  std::vector<Block>          mBlocks;
+  std::size_t                 mRows     = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,303 @@
+
+#include "pidsim_backend_trace_summary.h"
+#include <algorithm>
+#include <assert.h>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <limits>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace PidSim {
+
+namespace {
+  constexpr std::uint64_t fileMagic     = 0x314d55534d495350ull;  // "PSIMSUM1"
+  constexpr std::uint64_t formatVersion = 1;
+  constexpr std::size_t   headerWords   = 8;
+  constexpr std::size_t   headerBytes   = headerWords * sizeof( std::uint64_t );
+
+  constexpr float noMin = std::numeric_limits<float>::infinity();
+  constexpr float noMax = -std::numeric_limits<float>::infinity();
+
+  // The nearest float no bigger than value
+  float floatBelow( double value )
+  {
+    const float rounded = static_cast<float>( value );
+    return rounded > value ? nextafterf( rounded, noMax ) : rounded;
+  }
+
+  // The nearest float no smaller than value
+  float floatAbove( double value )
+  {
+    const float rounded = static_cast<float>( value );
+    return rounded < value ? nextafterf( rounded, noMin ) : rounded;
+  }
+
+  // Widen a range to cover a bucket.  NaNs are skipped.
+  void cover( TraceSummary::Range& range, const float* bucket )
+  {
+    range.mMin = bucket[ 0 ] < range.mMin ? bucket[ 0 ] : range.mMin;
+    range.mMax = bucket[ 1 ] > range.mMax ? bucket[ 1 ] : range.mMax;
+  }
+
+  TraceSummary::Range emptyRange()
+  {
+    return { std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity() };
+  }
+}
+
+TraceSummary::TraceSummary( const std::string& path ) :
+  mReader{ path },
+  mPath{ path + summarySuffix }
+{
+  if ( !mReader.isOpen() ) {
+    return;
+  }
+  struct stat status;
+  if ( stat( path.c_str(), &status ) != 0 ) {
+    return;
+  }
+  mTraceSize = static_cast<std::uint64_t>( status.st_size );
+  mTraceTime = static_cast<std::uint64_t>( status.st_mtim.tv_sec ) * 1000000000u
+             + static_cast<std::uint64_t>( status.st_mtim.tv_nsec );
+  mOpen = true;
+
+  planLevels();
+  if ( load() ) {
+    return;
+  }
+
+  // Not saved, so start building, with every bucket empty
+  mBuilt = true;
+  mBuiltData.resize( mFloats );
+  for ( std::size_t index = 0; index < mFloats; index += 2 ) {
+    mBuiltData[ index ]     = noMin;
+    mBuiltData[ index + 1 ] = noMax;
+  }
+}
+
+TraceSummary::~TraceSummary()
+{
+  if ( mMap ) {
+    munmap( const_cast<unsigned char*>( mMap ), mMapSize );
+  }
+}
+
+//
+// Level 0 has a bucket every baseRows rows, and each level after has
+// fanout times fewer, down to a single bucket for the whole trace
+//
+void TraceSummary::planLevels()
+{
+  std::size_t bucketRows = baseRows;
+  std::size_t buckets = ( mReader.getRows() + baseRows - 1 ) / baseRows;
+  while ( buckets > 0 ) {
+    mLevels.push_back( { bucketRows, buckets, mFloats } );
+    mFloats += 2 * buckets * mReader.getColumns().size();
+    if ( buckets == 1 ) {
+      break;
+    }
+    buckets = ( buckets + fanout - 1 ) / fanout;
+    bucketRows *= fanout;
+  }
+}
+
+//
+// The file is a header, saying which trace it's for, then the levels'
+// floats
+//
+bool TraceSummary::load()
+{
+  const int file = open( mPath.c_str(), O_RDONLY | O_CLOEXEC );
+  if ( file < 0 ) {
+    return false;
+  }
+  struct stat status;
+  const std::size_t expected = headerBytes + mFloats * sizeof( float );
+  if ( fstat( file, &status ) == 0 && static_cast<std::size_t>( status.st_size ) == expected ) {
+    void* map = mmap( nullptr, expected, PROT_READ, MAP_SHARED, file, 0 );
+    if ( map != MAP_FAILED ) {
+      mMap     = static_cast<const unsigned char*>( map );
+      mMapSize = expected;
+    }
+  }
+  close( file );
+  if ( !mMap ) {
+    return false;
+  }
+
+  std::uint64_t header[ headerWords ];
+  std::memcpy( header, mMap, headerBytes );
+  const std::uint64_t wanted[ headerWords ] = { fileMagic, formatVersion, mTraceSize, mTraceTime,
+    mReader.getRows(), mReader.getColumns().size(), baseRows, fanout };
+  if ( std::memcmp( header, wanted, headerBytes ) != 0 ) {
+    munmap( const_cast<unsigned char*>( mMap ), mMapSize );
+    mMap = nullptr;
+    return false;
+  }
+  mData  = reinterpret_cast<const float*>( mMap + headerBytes );
+  mReady = true;
+  return true;
+}
+
+//
+// 1. Fold the next blocks into level 0.  Only one block is ever decoded.
+// 2. Once they're all in, fill the levels above and save
+//
+bool TraceSummary::build( std::size_t maxBlocks )
+{
+  if ( mReady || !mOpen ) {
+    return mReady;
+  }
+
+  // 1. Fold the next blocks into level 0
+  const std::size_t columns = mReader.getColumns().size();
+  std::vector<double> values;
+  for ( std::size_t read = 0; read < maxBlocks && mBuiltBlocks < mReader.getBlocks(); ++read, ++mBuiltBlocks ) {
+    const Level& level = mLevels[ 0 ];
+    for ( std::size_t column = 0; column < columns; ++column ) {
+      float* buckets = &mBuiltData[ level.mOffset + 2 * column * level.mBuckets ];
+      values.clear();
+      mReader.readBlock( mBuiltBlocks, column, values );
+      std::size_t row = mReader.getBlockStart( mBuiltBlocks );
+      for ( double value : values ) {
+        float* bucket = &buckets[ 2 * ( row++ / baseRows ) ];
+        const float low = floatBelow( value ), high = floatAbove( value );
+        bucket[ 0 ] = low  < bucket[ 0 ] ? low  : bucket[ 0 ];
+        bucket[ 1 ] = high > bucket[ 1 ] ? high : bucket[ 1 ];
+      }
+    }
+  }
+
+  // 2. Fill the levels above and save, once they're all in
+  if ( mBuiltBlocks == mReader.getBlocks() ) {
+    finishBuild();
+  }
+  return mReady;
+}
+
+// See header for interface
+double TraceSummary::getProgress() const
+{
+  if ( mReady || mReader.getBlocks() == 0 ) {
+    return mReady ? 1.0 : 0.0;
+  }
+  return static_cast<double>( mBuiltBlocks ) / static_cast<double>( mReader.getBlocks() );
+}
+
+//
+// 1. Fill each level above level 0 from the one below
+// 2. Save it.  If that doesn't work, keep it in memory.
+//
+void TraceSummary::finishBuild()
+{
+  const std::size_t columns = mReader.getColumns().size();
+
+  // 1. Fill each level above from the one below
+  for ( std::size_t levelIndex = 1; levelIndex < mLevels.size(); ++levelIndex ) {
+    const Level& below = mLevels[ levelIndex - 1 ];
+    const Level& level = mLevels[ levelIndex ];
+    for ( std::size_t column = 0; column < columns; ++column ) {
+      const float* from = &mBuiltData[ below.mOffset + 2 * column * below.mBuckets ];
+      float* to = &mBuiltData[ level.mOffset + 2 * column * level.mBuckets ];
+      for ( std::size_t index = 0; index < level.mBuckets; ++index ) {
+        float low = noMin, high = noMax;
+        const std::size_t last = std::min( ( index + 1 ) * fanout, below.mBuckets );
+        for ( std::size_t child = index * fanout; child < last; ++child ) {
+          low  = std::min( low,  from[ 2 * child ] );
+          high = std::max( high, from[ 2 * child + 1 ] );
+        }
+        to[ 2 * index ]     = low;
+        to[ 2 * index + 1 ] = high;
+      }
+    }
+  }
+
+  // 2. Save it, and map the saved copy
+  const std::uint64_t header[ headerWords ] = { fileMagic, formatVersion, mTraceSize, mTraceTime,
+    mReader.getRows(), columns, baseRows, fanout };
+  bool saved = false;
+  {
+    std::ofstream out( mPath, std::ios::binary | std::ios::trunc );
+    out.write( reinterpret_cast<const char*>( header ), headerBytes );
+    out.write( reinterpret_cast<const char*>( mBuiltData.data() ), static_cast<std::streamsize>( mBuiltData.size() * sizeof( float )));
+    saved = out.good();
+  }
+  if ( saved && load() ) {
+    std::vector<float>().swap( mBuiltData );
+    return;
+  }
+  mData  = mBuiltData.data();
+  mReady = true;
+}
+
+// See header for interface
+TraceSummary::Range TraceSummary::getRange( std::size_t column ) const
+{
+  assert( mReady );
+  Range range = emptyRange();
+  if ( !mLevels.empty() ) {
+    cover( range, bucket( mLevels.back(), column, 0 ));
+  }
+  return range;
+}
+
+//
+// 1. Zoomed in past level 0, decode the rows
+// 2. Otherwise use the coarsest level with a bucket or more per pixel
+//
+std::vector<TraceSummary::Range> TraceSummary::getEnvelope( std::size_t column, double firstRow, double rows, std::size_t pixels ) const
+{
+  assert( mReady );
+  std::vector<Range> envelope( pixels, emptyRange() );
+  if ( pixels == 0 || !( rows > 0.0 ) || mLevels.empty() ) {
+    return envelope;
+  }
+  const double rowsPerPixel = rows / static_cast<double>( pixels );
+  const double traceRows = static_cast<double>( mReader.getRows() );
+
+  // 1. Zoomed in past level 0, decode the rows
+  if ( rowsPerPixel < static_cast<double>( baseRows )) {
+    const double first = std::max( floor( firstRow ), 0.0 );
+    const double end   = std::min( ceil( firstRow + rows ), traceRows );
+    if ( first >= end ) {
+      return envelope;
+    }
+    const std::vector<double> values = mReader.readColumn( column, static_cast<std::size_t>( first ),
+                                                           static_cast<std::size_t>( end - first ));
+    for ( std::size_t index = 0; index < values.size(); ++index ) {
+      const double pixel = floor(( first + static_cast<double>( index ) - firstRow ) / rowsPerPixel );
+      if ( pixel < 0.0 || pixel >= static_cast<double>( pixels )) {
+        continue;
+      }
+      Range& range = envelope[ static_cast<std::size_t>( pixel ) ];
+      range.mMin = values[ index ] < range.mMin ? values[ index ] : range.mMin;
+      range.mMax = values[ index ] > range.mMax ? values[ index ] : range.mMax;
+    }
+    return envelope;
+  }
+
+  // 2. Use the coarsest level with a bucket or more per pixel
+  std::size_t levelIndex = 0;
+  while ( levelIndex + 1 < mLevels.size() && static_cast<double>( mLevels[ levelIndex + 1 ].mBucketRows ) <= rowsPerPixel ) {
+    ++levelIndex;
+  }
+  const Level& level = mLevels[ levelIndex ];
+  const double bucketRows = static_cast<double>( level.mBucketRows );
+  const double buckets = static_cast<double>( level.mBuckets );
+  for ( std::size_t pixel = 0; pixel < pixels; ++pixel ) {
+    const double start = firstRow + static_cast<double>( pixel ) * rowsPerPixel;
+    const double first = std::max( floor( start / bucketRows ), 0.0 );
+    const double end   = std::min( ceil(( start + rowsPerPixel ) / bucketRows ), buckets );
+    for ( double index = first; index < end; index += 1.0 ) {
+      cover( envelope[ pixel ], bucket( level, column, static_cast<std::size_t>( index )));
+    }
+  }
+  return envelope;
+}
+
+}
+
@@ -0,0 +1,159 @@
+#ifndef __PIDSIM_BACKEND_TRACE_SUMMARY_H__
+#define __PIDSIM_BACKEND_TRACE_SUMMARY_H__
+
+#include <cstddef>
+#include <limits>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "pidsim_backend_trace.h"
+
+namespace PidSim {
+
+///
+/// @brief A min/max pyramid over a trace, for drawing it at any zoom
+///
+/// Drawing an hour of 1 kHz telemetry a few hundred pixels wide can't
+/// decode millions of rows a frame.  Level 0 of the pyramid holds each
+/// column's min and max over every baseRows rows, and each level above
+/// holds the min and max of fanout buckets of the level below.  Drawing
+/// a span uses the coarsest level that still has a bucket per pixel, so
+/// it costs about the same whatever the zoom.  Zoomed in past level 0,
+/// the rows themselves are decoded, which is only a few blocks.
+///
+/// The pyramid is built the first time a trace is opened and saved beside
+/// it as path + summarySuffix.  After that it's memory mapped.  Building
+/// reads every block of the trace, so it's done a few blocks at a time
+/// through build(), and the caller decides how much time it gets.  It's rebuilt if the trace's size or modified time has
+/// changed.  Bounds are floats, rounded outward, so the pyramid is a
+/// fraction of the trace's size.
+///
+class TraceSummary
+{
+  public:
+
+  /// @brief Rows per level 0 bucket
+  static constexpr std::size_t baseRows = 256;
+  /// @brief Buckets per bucket of the level above
+  static constexpr std::size_t fanout   = 4;
+  /// @brief Added to the trace's path for the saved pyramid
+  static constexpr const char* summarySuffix = ".summary";
+
+  ///
+  /// @brief The values over a span.  Empty spans have mMin > mMax.
+  ///
+  struct Range
+  {
+    double mMin;
+    double mMax;
+  };
+
+  ///
+  /// @brief Open a trace, and its pyramid if it's saved and up to date
+  ///
+  /// If it isn't, build() has to be called until the summary isReady().
+  ///
+  /// @param[in] path - The trace
+  ///
+  explicit TraceSummary( const std::string& path );
+
+  ~TraceSummary();
+
+  // Remove operations people shouldn't be using.
+  TraceSummary() = delete;
+  TraceSummary( const TraceSummary& ) = delete;
+  TraceSummary& operator=( const TraceSummary& ) = delete;
+
+  /// @brief Did the trace open?
+  [[nodiscard]] bool isOpen() const { return mOpen; }
+
+  ///
+  /// @brief Build more of the pyramid, and save it once it's all built
+  ///
+  /// @param[in] maxBlocks  - The most trace blocks to read.  By default,
+  ///                         all that are left.
+  /// @return               - True once the summary isReady()
+  ///
+  bool build( std::size_t maxBlocks = std::numeric_limits<std::size_t>::max() );
+
+  /// @brief Is the pyramid there to draw from?
+  [[nodiscard]] bool isReady() const { return mReady; }
+
+  /// @brief How much of the pyramid is built, from 0 to 1
+  [[nodiscard]] double getProgress() const;
+
+  /// @brief Was the pyramid built, rather than loaded?
+  [[nodiscard]] bool wasBuilt() const { return mBuilt; }
+
+  /// @brief The trace
+  [[nodiscard]] const TraceReader& getReader() const { return mReader; }
+
+  /// @brief Number of levels
+  [[nodiscard]] std::size_t getLevels() const { return mLevels.size(); }
+
+  ///
+  /// @brief A column's values over the whole trace.  Only once isReady().
+  ///
+  /// @param[in] column - The column
+  /// @return           - Its range
+  ///
+  [[nodiscard]] Range getRange( std::size_t column ) const;
+
+  ///
+  /// @brief A column's values over each pixel of a span.  Only once
+  ///        isReady().
+  ///
+  /// Each pixel covers rowsPerPixel = rows / pixels rows.  Its range
+  /// covers at least those rows, and at most the buckets they touch.
+  ///
+  /// @param[in] column   - The column
+  /// @param[in] firstRow - Where the span starts.  Can be fractional.
+  /// @param[in] rows     - How many rows the span covers
+  /// @param[in] pixels   - How many pixels it's drawn over
+  /// @return             - A range per pixel
+  ///
+  [[nodiscard]] std::vector<Range> getEnvelope( std::size_t column, double firstRow, double rows, std::size_t pixels ) const;
+
+  private:
+
+  struct Level
+  {
+    std::size_t   mBucketRows;    // Rows per bucket
+    std::size_t   mBuckets;       // Per column
+    std::size_t   mOffset;        // Into mData, in floats
+  };
+
+  // Plan the levels for the trace's rows
+  void planLevels();
+  // Load the pyramid, if it's there and up to date
+  bool load();
+  // Fill the levels above level 0, and try to save the pyramid
+  void finishBuild();
+
+  // A bucket's min & max, as stored
+  const float* bucket( const Level& level, std::size_t column, std::size_t index ) const
+  {
+    return mData + level.mOffset + 2 * ( column * level.mBuckets + index );
+  }
+
+  TraceReader           mReader;
+  std::string           mPath;                // Of the saved pyramid
+  std::uint64_t         mTraceSize  = 0;      // What the pyramid says it's for
+  std::uint64_t         mTraceTime  = 0;
+  bool                  mOpen       = false;
+  std::vector<Level>    mLevels;
+  std::size_t           mFloats   = 0;        // Size of the pyramid
+  const float*          mData     = nullptr;  // mMap's, or mBuiltData's
+  const unsigned char*  mMap      = nullptr;
+  std::size_t           mMapSize  = 0;
+  std::vector<float>    mBuiltData;           // Being built, or if it couldn't be saved
+  std::size_t           mBuiltBlocks = 0;     // Trace blocks read into level 0 so far
+  bool                  mBuilt    = false;
+  bool                  mReady    = false;
+};
+
+}
+
+#endif
+
@@ -6,8 +6,12 @@
 #include "nanogui/textbox.h"
 #include "nanogui/widget.h"
 #include "nanogui/window.h"
+#include "pidsim_frontend_gain_map.h"
+#include "pidsim_frontend_trace_view.h"
+#include "pidsim_backend_trace_summary.h"
 #include "pidsim_model.h"
 #include "pidsim_utils.h"
+#include <cmath>
 #include <sstream>
 #include <iomanip>
 
@@ -120,6 +124,7 @@ R"(#version 300 es
 #endif
 uniform vec3 lightpos;
 uniform vec3 viewpos;
+uniform float ghost;
 in vec3 FragNormal;
 in vec3 FragPos;
 out vec4 color;
@@ -160,9 +165,11 @@ void main() {
                    white     * spec    * specularScale;
 
   //
-  // Output in RGBA.  The A (Alpha) is 1.0 for non-transparent.
+  // Output in RGBA.  The A (Alpha) is 1.0 for non-transparent.  Ghosts
+  // (predicted arm positions) are tinted yellow and see through.
   // 
-  color           = vec4( colorRGB, 1.0 );
+  vec3 ghostRGB   = vec3( 1.0, 0.9, 0.4 );
+  color           = mix( vec4( colorRGB, 1.0 ), vec4( ghostRGB, 0.25 ), ghost );
 }
 )";
 
@@ -234,6 +241,10 @@ void main() {
     objcolor  = vec3( 0.5, 0.5, 1.0 );  // Light Blue
     alpha = 1.0;
   }
+  else if ( colorIndex > 5.99 && colorIndex < 6.01 ) {
+    objcolor  = vec3( 0.8, 0.8, 0.8 );  // Grey, for predictions
+    alpha = 1.0;
+  }
   else {
     objcolor  = vec3( 0.0, 0.0, 0.0 );  // Black
     alpha = 0.0;
@@ -351,6 +362,33 @@ FrontEnd::FrontEnd() :
     makeSlider( window, "Kd", 0, 
       [&](float slider) { return sliderToPid( mPidD, slider ); }, "" );
 
+    Widget *controllerPanel = new Widget(window);
+    controllerPanel->setLayout(new BoxLayout(Orientation::Horizontal,
+        Alignment::Middle, 0, 20));
+    auto stateEstimator = new Button( controllerPanel, "Kalman Filter" );
+    stateEstimator->setFlags( Button::ToggleButton );
+    stateEstimator->setChangeCallback( [&] (bool state) { mStateEstimator = state; });
+    auto gainSchedule = new Button( controllerPanel, "Gain Schedule" );
+    gainSchedule->setFlags( Button::ToggleButton );
+    gainSchedule->setChangeCallback( [&] (bool state) { mGainScheduled = state; });
+    auto setpointProfile = new Button( controllerPanel, "Target: Step" );
+    setpointProfile->setCallback( [&, setpointProfile] (void) {
+      switch ( mSetpointProfile ) {
+        case MotionProfile::Type::Step:
+          mSetpointProfile = MotionProfile::Type::Trapezoidal;
+          setpointProfile->setCaption( "Target: Trapezoid" );
+          break;
+        case MotionProfile::Type::Trapezoidal:
+          mSetpointProfile = MotionProfile::Type::SCurve;
+          setpointProfile->setCaption( "Target: S-Curve" );
+          break;
+        case MotionProfile::Type::SCurve:
+          mSetpointProfile = MotionProfile::Type::Step;
+          setpointProfile->setCaption( "Target: Step" );
+          break;
+      }
+    });
+
     new Label(window, "Simulation Settings", "sans-bold");
     makeSlider( window, "Rolling Friction", .2, 
       [&](float slider ) { return sliderTo10( mRollingFriction, slider );}, 
@@ -412,6 +450,125 @@ FrontEnd::FrontEnd() :
     auto dAxis = new Label(keyLayout, "Error = 0 Axis", "sans-bold" );
     dAxis ->setColor( Color( 0, 255, 0, 255 ));
 
+    Widget *metricsLayout= new Widget(this);
+    metricsLayout->setLayout(new BoxLayout(Orientation::Horizontal,
+        Alignment::Middle, 0, 20));
+    metricsLayout->setPosition(Vector2i( mSize.x()/2, mSize.y()-40));
+    mStepMetrics = new Label(metricsLayout, "", "sans-bold" );
+    mStepMetrics->setFixedWidth( mSize.x()/2-30 );
+
+    // The stability map floats over the corner of the arm view
+    Window *stabilityWindow = new Window(this, "Stability");
+    stabilityWindow->setPosition(Vector2i( mSize.x()-185, mSize.y()-265 ));
+    stabilityWindow->setLayout(new BoxLayout(Orientation::Vertical,
+        Alignment::Middle, 5, 5));
+    mStabilityMap = new GainMapView( stabilityWindow );
+    mStabilityMap->setFixedSize( Vector2i( 160, 160 ));
+    auto stabilityPlane = new Button( stabilityWindow, "Kp (x) vs Kd (y)" );
+    stabilityPlane->setCallback( [&, stabilityPlane] (void) {
+      const bool kd = mStabilityPlane == StabilityMap::Plane::KpKd;
+      mStabilityPlane = kd ? StabilityMap::Plane::KpKi : StabilityMap::Plane::KpKd;
+      stabilityPlane->setCaption( kd ? "Kp (x) vs Ki (y)" : "Kp (x) vs Kd (y)" );
+    });
+
+    // The cost map sits next to it, over the same gains
+    Window *costWindow = new Window(this, "Cost");
+    costWindow->setPosition(Vector2i( mSize.x()-365, mSize.y()-265 ));
+    costWindow->setLayout(new BoxLayout(Orientation::Vertical,
+        Alignment::Middle, 5, 5));
+    mCostMap = new GainMapView( costWindow );
+    mCostMap->setFixedSize( Vector2i( 160, 160 ));
+    Widget *costPanel = new Widget(costWindow);
+    costPanel->setLayout(new BoxLayout(Orientation::Horizontal,
+        Alignment::Middle, 0, 10));
+    auto costMetric = new Button( costPanel, "ITAE" );
+    costMetric->setCallback( [&, costMetric] (void) {
+      const bool itae = mCostMetric == CostMap::Metric::ITAE;
+      mCostMetric = itae ? CostMap::Metric::SettlingTime : CostMap::Metric::ITAE;
+      costMetric->setCaption( itae ? "Settling" : "ITAE" );
+    });
+    mCostResolution = new Label( costPanel, "", "sans" );
+    mCostResolution->setFixedWidth( 70 );
+
+    // Relay auto-tuner, under the graph
+    Window *autotuneWindow = new Window(this, "Auto-tune");
+    autotuneWindow->setPosition(Vector2i( mSize.x()/2+15, mSize.y()/3+15 ));
+    autotuneWindow->setLayout(new BoxLayout(Orientation::Vertical,
+        Alignment::Minimum, 5, 5));
+    auto autotune = new Button( autotuneWindow, "Run Relay Experiment" );
+    autotune->setCallback( [&] (void) {
+      mAutotune = true;
+      mAutotuneUltimate->setCaption( "Tuning..." );
+      mAutotuneZN->setCaption( "" );
+      mAutotuneTL->setCaption( "" );
+    });
+    mAutotuneUltimate = new Label( autotuneWindow, "", "sans" );
+    mAutotuneZN       = new Label( autotuneWindow, "", "sans" );
+    mAutotuneTL       = new Label( autotuneWindow, "", "sans" );
+    auto optimize = new Button( autotuneWindow, "Optimize Gains (CMA-ES)" );
+    optimize->setCallback( [&] (void) {
+      mOptimize = true;
+      mOptimizerGains->setCaption( "Optimizing..." );
+      mOptimizerSpeed->setCaption( "" );
+    });
+    mOptimizerGains   = new Label( autotuneWindow, "", "sans" );
+    mOptimizerSpeed   = new Label( autotuneWindow, "", "sans" );
+    auto robustness = new Button( autotuneWindow, "Check Robustness" );
+    robustness->setCallback( [&] (void) {
+      mRobustness = true;
+      mRobustnessRate->setCaption( "Checking..." );
+      mRobustnessDraws->setCaption( "" );
+    });
+    mRobustnessRate   = new Label( autotuneWindow, "", "sans" );
+    mRobustnessDraws  = new Label( autotuneWindow, "", "sans" );
+
+    // What the identifier makes of the arm so far
+    new Label( autotuneWindow, "Identified Plant", "sans-bold" );
+    mPlantModel       = new Label( autotuneWindow, "", "sans" );
+    mPlantDelays      = new Label( autotuneWindow, "", "sans" );
+    for ( Label* label : { mAutotuneUltimate, mAutotuneZN, mAutotuneTL, mOptimizerGains, mOptimizerSpeed,
+                           mRobustnessRate, mRobustnessDraws, mPlantModel, mPlantDelays } ) {
+      label->setFixedWidth( 200 );
+    }
+
+    // Record telemetry to disk, and look back over it at any zoom
+    Window *traceWindow = new Window(this, "Trace");
+    traceWindow->setPosition(Vector2i( 15, mSize.y()-300 ));
+    traceWindow->setLayout(new BoxLayout(Orientation::Vertical,
+        Alignment::Minimum, 5, 5));
+    Widget *tracePanel = new Widget(traceWindow);
+    tracePanel->setLayout(new BoxLayout(Orientation::Horizontal,
+        Alignment::Middle, 0, 10));
+    mTracePath = new TextBox( tracePanel, "pidsim.trace" );
+    mTracePath->setEditable( true );
+    mTracePath->setFixedWidth( 200 );
+    auto traceRecord = new Button( tracePanel, "Record" );
+    traceRecord->setFlags( Button::ToggleButton );
+    traceRecord->setChangeCallback( [&, traceRecord] (bool state) {
+      mTraceRecording = state;
+      traceRecord->setCaption( state ? "Stop" : "Record" );
+    });
+    auto traceOpen = new Button( tracePanel, "Open" );
+    traceOpen->setCallback( [&] (void) {
+      mOpenTrace = true;
+      mTraceStatus->setCaption( "Opening..." );
+    });
+    // Save every input so far, to replay the session headless
+    Widget *sessionPanel = new Widget(traceWindow);
+    sessionPanel->setLayout(new BoxLayout(Orientation::Horizontal,
+        Alignment::Middle, 0, 10));
+    mSessionPath = new TextBox( sessionPanel, "pidsim.session" );
+    mSessionPath->setEditable( true );
+    mSessionPath->setFixedWidth( 200 );
+    auto sessionSave = new Button( sessionPanel, "Save session" );
+    sessionSave->setCallback( [&] (void) {
+      mSaveSession = true;
+    });
+    mTraceStatus = new Label( traceWindow, "", "sans" );
+    mTraceStatus->setFixedWidth( 400 );
+    mTraceView = new TraceView( traceWindow );
+    mTraceView->setFixedSize( Vector2i( 400, 150 ));
+
     performLayout();
 
     /* All NanoGUI widgets are initialized at this point. Now
@@ -450,6 +607,7 @@ FrontEnd::FrontEnd() :
     assert( mAxis.size() == axisSamples );
 
     resetErrorRecord();
+    clearPrediction();
   }
 
 FrontEnd::~FrontEnd() 
@@ -470,6 +628,10 @@ bool FrontEnd::keyboardEvent(int key, int scancode, int action, int modifiers)
   }
 
   void FrontEnd::draw(NVGcontext *ctx) {
+    const double markerY = mStabilityPlane == StabilityMap::Plane::KpKd ? mPidD : mPidI;
+    mStabilityMap->setMarker( mPidP / StabilityMap::maxGain, markerY / StabilityMap::maxGain );
+    mCostMap->setMarker( mPidP / CostMap::maxGain, markerY / CostMap::maxGain );
+
     /* Draw the user interface */
     Screen::draw(ctx);
   }
@@ -529,6 +691,7 @@ bool FrontEnd::keyboardEvent(int key, int scancode, int action, int modifiers)
     mShader.setUniform("projection", projection);
     mShader.setUniform("camera", camera);
     mShader.setUniform("model", baseModel );
+    mShader.setUniform("ghost", 0.0f );
     static int count = 0;
     mShader.drawIndexed(GL_TRIANGLES, base_TRIANGLE_START, base_TRIANGLE_END);
 
@@ -539,6 +702,21 @@ bool FrontEnd::keyboardEvent(int key, int scancode, int action, int modifiers)
     mShader.drawIndexed(GL_TRIANGLES, arm_TRIANGLE_START, arm_TRIANGLE_END - arm_TRIANGLE_START );
     ++count;
 
+    // Predicted arm positions go over the top, without hiding each other
+    if ( !mGhostAngles.empty() ) {
+      glEnable( GL_BLEND );
+      glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+      glDepthMask( GL_FALSE );
+      mShader.setUniform("ghost", 1.0f );
+      for ( double ghostAngle : mGhostAngles ) {
+        armLocal.topLeftCorner<3,3>() = Matrix3f(Eigen::AngleAxisf(-ghostAngle + M_PI/2,  Vector3f::UnitY()));
+        mShader.setUniform("model", Matrix4f( baseModel * armLocal ));
+        mShader.drawIndexed(GL_TRIANGLES, arm_TRIANGLE_START, arm_TRIANGLE_END - arm_TRIANGLE_START );
+      }
+      mShader.setUniform("ghost", 0.0f );
+      glDepthMask( GL_TRUE );
+    }
+
     double graphViewPortHeight = mSize.y()/3;
     glViewport( 
       mSize.x()/2, mSize.y()-graphViewPortHeight,
@@ -548,6 +726,7 @@ bool FrontEnd::keyboardEvent(int key, int scancode, int action, int modifiers)
     assert( mAxis.size() == axisSamples );
     std::pair<int,int> position(0,0);
     position = populateGraphIndices( mAxis,   position, ShaderGreen  );
+    position = populateGraphIndices( mGhost,  position, ShaderGhost  );
     position = populateGraphIndices( mPError, position, ShaderRed    );
     position = populateGraphIndices( mIError, position, ShaderPurple );
     position = populateGraphIndices( mDError, position, ShaderOrange );
@@ -616,12 +795,259 @@ bool FrontEnd::keyboardEvent(int key, int scancode, int action, int modifiers)
     return mSlowTimeState;
   }
 
+  bool FrontEnd::isStateEstimator() const
+  {
+    return mStateEstimator;
+  }
+
+  MotionProfile::Type FrontEnd::getSetpointProfile() const
+  {
+    return mSetpointProfile;
+  }
+
+  bool FrontEnd::isGainScheduled() const
+  {
+    return mGainScheduled;
+  }
+
+  bool FrontEnd::isAutotune()
+  {
+    bool result = mAutotune;
+    mAutotune = false;
+    return result;
+  }
+
+  void FrontEnd::setAutotuneResult( const RelayAutotuner::Result& result ) {
+    if ( !result.mSuccess ) {
+      mAutotuneUltimate->setCaption( "No steady oscillation" );
+      return;
+    }
+    const auto format = []( const std::string& name, const RelayAutotuner::Gains& gains ) {
+      std::stringstream stream;
+      stream << std::fixed << std::setprecision(2);
+      stream << name << "  P " << gains.mPidP << "  I " << gains.mPidI << "  D " << gains.mPidD;
+      return stream.str();
+    };
+    std::stringstream stream;
+    stream << std::fixed << std::setprecision(2);
+    stream << "Ku " << result.mUltimateGain << "  Tu " << result.mUltimatePeriod << " s";
+    mAutotuneUltimate->setCaption( stream.str() );
+    mAutotuneZN->setCaption( format( "Z-N", result.mZieglerNichols ));
+    mAutotuneTL->setCaption( format( "T-L", result.mTyreusLuyben ));
+  }
+
+  bool FrontEnd::isOptimize()
+  {
+    bool result = mOptimize;
+    mOptimize = false;
+    return result;
+  }
+
+  void FrontEnd::setOptimizerReport( const GainOptimizer::Report& report, bool done ) {
+    std::stringstream gains;
+    gains << std::fixed << std::setprecision(2);
+    gains << ( done ? "Best" : "So far" ) << "  P " << report.mBest[ 0 ]
+          << "  I " << report.mBest[ 1 ] << "  D " << report.mBest[ 2 ];
+    mOptimizerGains->setCaption( gains.str() );
+
+    std::stringstream speed;
+    speed << std::fixed << std::setprecision(0);
+    speed << report.mEvaluations << " runs, " << report.getEvaluationsPerSecond() << "/s";
+    mOptimizerSpeed->setCaption( speed.str() );
+  }
+
+  bool FrontEnd::isRobustness()
+  {
+    bool result = mRobustness;
+    mRobustness = false;
+    return result;
+  }
+
+  void FrontEnd::setRobustnessReport( const RobustnessAnalysis::Report& report ) {
+    std::stringstream rate;
+    rate << std::fixed << std::setprecision(0);
+    rate << "Meets specs " << report.mPassRate * 100.0 << "% ["
+         << report.mLower * 100.0 << "%, " << report.mUpper * 100.0 << "%]";
+    mRobustnessRate->setCaption( rate.str() );
+
+    std::stringstream draws;
+    draws << report.mDraws << " arms, " << report.mSettleFailures << " slow, "
+          << report.mOvershootFailures << " overshot";
+    mRobustnessDraws->setCaption( draws.str() );
+  }
+
+  void FrontEnd::setPlantEstimate( const PlantIdentifier::Estimate& estimate ) {
+    std::stringstream model;
+    model << std::fixed << std::setprecision(2);
+    model << "g " << estimate.mGravity << "  J " << estimate.mInertia
+          << "  Friction " << estimate.mFriction * 50.0;
+    mPlantModel->setCaption( model.str() );
+
+    std::stringstream delays;
+    delays << std::fixed << std::setprecision(0);
+    delays << "Sensor " << estimate.mSensorDelay << " ms  Motor " << estimate.mMotorDelay
+           << " ms  Fit " << std::setprecision(2) << estimate.mResidual;
+    mPlantDelays->setCaption( delays.str() );
+  }
+
+  bool FrontEnd::isTraceRecording() const
+  {
+    return mTraceRecording;
+  }
+
+  std::string FrontEnd::getTracePath() const
+  {
+    return mTracePath->value();
+  }
+
+  bool FrontEnd::isOpenTrace()
+  {
+    bool result = mOpenTrace;
+    mOpenTrace = false;
+    return result;
+  }
+
+  std::string FrontEnd::getSessionPath() const
+  {
+    return mSessionPath->value();
+  }
+
+  bool FrontEnd::isSaveSession()
+  {
+    bool result = mSaveSession;
+    mSaveSession = false;
+    return result;
+  }
+
+  //
+  // Show the sensor, the setpoint and the motor, where the trace has them
+  //
+  void FrontEnd::setTrace( std::shared_ptr<const TraceSummary> summary ) {
+    std::vector<std::size_t> columns;
+    for ( const char* name : { "sensor_angle", "setpoint", "motor_power" } ) {
+      const std::size_t column = summary->getReader().findColumn( name );
+      if ( column < summary->getReader().getColumns().size() ) {
+        columns.push_back( column );
+      }
+    }
+    std::stringstream stream;
+    stream << summary->getReader().getRows() << " rows, "
+           << ( summary->wasBuilt() ? "summary built" : "summary loaded" )
+           << ".  Drag to pan, scroll to zoom.";
+    mTraceStatus->setCaption( stream.str() );
+    mTraceView->setTrace( std::move( summary ), std::move( columns ));
+  }
+
+  void FrontEnd::setTraceStatus( const std::string& status ) {
+    mTraceStatus->setCaption( status );
+  }
+
   void FrontEnd::setArmAngle( double angle ) {
     int intAngle = Utils::radToDeg(angle);
     mAngleCurrent->setValue( std::to_string( intAngle ));
     mArmAngle = angle;
   }
 
+  void FrontEnd::setStepMetrics( const StepMetrics::Result& metrics ) {
+    std::stringstream stream;
+    stream << std::fixed << std::setprecision(2);
+    stream << "Rise ";
+    if ( std::isfinite( metrics.mRiseTime )) {
+      stream << metrics.mRiseTime << " s";
+    }
+    else {
+      stream << "--";
+    }
+    stream << "   Overshoot " << std::setprecision(0) << metrics.mOvershoot * 100 << "%";
+    stream << "   Settle " << std::setprecision(2) << metrics.mSettlingTime << " s";
+    stream << ( metrics.mSettled ? "" : "+" );
+    stream << "   SS Error " << std::setprecision(1) << Utils::radToDeg( metrics.mSteadyStateError ) << " deg";
+    stream << "   IAE " << std::setprecision(2) << metrics.mIAE;
+    stream << "   Effort " << metrics.mControlEffort;
+    mStepMetrics->setCaption( stream.str() );
+  }
+
+  //
+  // Unstable cells are red, brighter the faster they blow up.  Stable cells
+  // go from yellow (lightly damped, rings a lot) to green (well damped).
+  // Cells that haven't been computed yet are grey.
+  //
+  void FrontEnd::setStabilityMap( const StabilityMap& map ) {
+    constexpr int size = static_cast<int>( StabilityMap::resolution );
+    std::vector<std::uint8_t> rgba( size * size * 4 );
+    for ( int y = 0; y < size; ++y ) {
+      for ( int x = 0; x < size; ++x ) {
+        std::uint8_t* pixel = &rgba[ ( y * size + x ) * 4 ];
+        const std::size_t index = static_cast<std::size_t>( y * size + x );
+        const StabilityMap::Cell& cell = map.getCell( x, y );
+        double red = 0.4, green = 0.4, blue = 0.4;
+        if ( index >= map.getComputed() ) {
+          // Not computed yet
+        }
+        else if ( cell.mSpectralRadius >= 1.0 ) {
+          const double growth = std::min( 1.0, ( cell.mSpectralRadius - 1.0 ) * 20.0 );
+          red = 0.5 + 0.5 * growth; green = 0.0; blue = 0.0;
+        }
+        else {
+          const double damping = std::max( 0.0, std::min( cell.mDampingRatio / 0.7, 1.0 ));
+          red = 0.9 - 0.75 * damping; green = 0.8; blue = 0.15;
+        }
+        pixel[ 0 ] = static_cast<std::uint8_t>( red   * 255 );
+        pixel[ 1 ] = static_cast<std::uint8_t>( green * 255 );
+        pixel[ 2 ] = static_cast<std::uint8_t>( blue  * 255 );
+        pixel[ 3 ] = 255;
+      }
+    }
+    mStabilityMap->setImage( size, size, std::move( rgba ));
+  }
+
+  StabilityMap::Plane FrontEnd::getStabilityPlane() const
+  {
+    return mStabilityPlane;
+  }
+
+  //
+  // Costs are coloured on a log scale, from yellow (the best cell so far)
+  // through teal to dark blue (the worst).  Cells that haven't been
+  // simulated yet are grey.
+  //
+  void FrontEnd::setCostMap( const CostMap& map ) {
+    constexpr int size = static_cast<int>( CostMap::maxResolution );
+    const double logMin = log( std::max( map.getMinCost(), 1e-3 ));
+    const double logMax = log( std::max( map.getMaxCost(), 1e-3 ));
+    const double scale  = logMax > logMin ? 1.0 / ( logMax - logMin ) : 0.0;
+    std::vector<std::uint8_t> rgba( size * size * 4 );
+    for ( int y = 0; y < size; ++y ) {
+      for ( int x = 0; x < size; ++x ) {
+        std::uint8_t* pixel = &rgba[ ( y * size + x ) * 4 ];
+        const double cost = map.getCost( x, y );
+        double red = 0.4, green = 0.4, blue = 0.4;
+        if ( cost >= 0.0 ) {
+          const double t = ( log( std::max( cost, 1e-3 )) - logMin ) * scale;
+          const double good = std::max( 0.0, 1.0 - 2.0 * t );
+          const double bad  = std::max( 0.0, 2.0 * t - 1.0 );
+          const double mid  = 1.0 - good - bad;
+          red   = 0.98 * good + 0.15 * mid + 0.12 * bad;
+          green = 0.90 * good + 0.65 * mid + 0.12 * bad;
+          blue  = 0.25 * good + 0.55 * mid + 0.35 * bad;
+        }
+        pixel[ 0 ] = static_cast<std::uint8_t>( red   * 255 );
+        pixel[ 1 ] = static_cast<std::uint8_t>( green * 255 );
+        pixel[ 2 ] = static_cast<std::uint8_t>( blue  * 255 );
+        pixel[ 3 ] = 255;
+      }
+    }
+    mCostMap->setImage( size, size, std::move( rgba ));
+
+    const std::string resolution = std::to_string( map.getResolution() );
+    mCostResolution->setCaption( resolution + "x" + resolution );
+  }
+
+  CostMap::Metric FrontEnd::getCostMetric() const
+  {
+    return mCostMetric;
+  }
+
   double FrontEnd::getStartAngle() {
     return mStartAngle;
   }
@@ -630,6 +1056,34 @@ bool FrontEnd::keyboardEvent(int key, int scancode, int action, int modifiers)
     return mTargetAngle;
   }
 
+  //
+  // The graph shows the last 5 seconds, so the ghost P error (the angle
+  // the arm is predicted to be at minus the set point) fills the same
+  // width with the next 5.  The 3D view gets a ghost arm every second.
+  //
+  void FrontEnd::setPrediction( const ControlLoop::Prediction& prediction ) {
+    const std::size_t ticksPerSample = prediction.mAngles.size() / samplesToRecord;
+    if ( ticksPerSample == 0 ) {
+      clearPrediction();
+      return;
+    }
+    for ( std::size_t i = 0; i < samplesToRecord; ++i ) {
+      const std::size_t tick = ( i + 1 ) * ticksPerSample - 1;
+      mGhost.at( i ) = Utils::radToDeg( prediction.mAngles[ tick ] - prediction.mSetpoints[ tick ] );
+    }
+
+    const std::size_t ticksPerGhost = samplesPerSecond * ticksPerSample;
+    mGhostAngles.clear();
+    for ( std::size_t tick = ticksPerGhost; tick <= prediction.mAngles.size(); tick += ticksPerGhost ) {
+      mGhostAngles.push_back( prediction.mAngles[ tick - 1 ] );
+    }
+  }
+
+  void FrontEnd::clearPrediction() {
+    mGhost.assign( samplesToRecord, std::nullopt );
+    mGhostAngles.clear();
+  }
+
   void FrontEnd::resetErrorRecord()
   {
     mPError.clear();
@@ -9,16 +9,32 @@
 #include <nanogui/screen.h>     // for nanogui::Screen
 #include <nanogui/glutil.h>     // for GLShader
 #pragma clang diagnostic pop
+#include "pidsim_backend_autotune.h"
+#include "pidsim_backend_gain_optimizer.h"
+#include "pidsim_backend_plant_identifier.h"
+#include "pidsim_backend_robustness.h"
+#include "pidsim_backend_control_loop.h"
+#include "pidsim_backend_cost_map.h"
+#include "pidsim_backend_motion_profile.h"
+#include "pidsim_backend_stability_map.h"
+#include "pidsim_backend_step_metrics.h"
+#include <memory>               // for std::shared_ptr
 #include <optional>             // for std::optional
+#include <string>               // for std::string
 #include <vector>               // for std::vector
 
 namespace PidSim {
 
+class GainMapView;
+class TraceSummary;
+class TraceView;
+
 constexpr double ShaderRed    = 1.0;
 constexpr double ShaderGreen  = 2.0;
 constexpr double ShaderPurple = 3.0;
 constexpr double ShaderOrange = 4.0;
 constexpr double ShaderBlue   = 5.0;
+constexpr double ShaderGhost  = 6.0;
 
 class FrontEnd: public nanogui::Screen {
 public:
@@ -46,8 +62,56 @@ public:
 
   bool isSlowTime();
 
+  bool isStateEstimator() const;
+
+  MotionProfile::Type getSetpointProfile() const;
+
+  bool isGainScheduled() const;
+
+  bool isAutotune();
+
+  void setAutotuneResult( const RelayAutotuner::Result& result );
+
+  bool isOptimize();
+
+  void setOptimizerReport( const GainOptimizer::Report& report, bool done );
+
+  bool isRobustness();
+
+  void setRobustnessReport( const RobustnessAnalysis::Report& report );
+
+  void setPlantEstimate( const PlantIdentifier::Estimate& estimate );
+
+  bool isTraceRecording() const;
+
+  std::string getTracePath() const;
+
+  bool isOpenTrace();
+
+  void setTrace( std::shared_ptr<const TraceSummary> summary );
+
+  void setTraceStatus( const std::string& status );
+
+  std::string getSessionPath() const;
+
+  bool isSaveSession();
+
   void setArmAngle( double angle );
 
+  void setStepMetrics( const StepMetrics::Result& metrics );
+
+  void setStabilityMap( const StabilityMap& map );
+
+  StabilityMap::Plane getStabilityPlane() const;
+
+  void setCostMap( const CostMap& map );
+
+  CostMap::Metric getCostMetric() const;
+
+  void setPrediction( const ControlLoop::Prediction& prediction );
+
+  void clearPrediction();
+
   double getStartAngle(); 
 
   double getTargetAngle();
@@ -81,15 +145,17 @@ private:
 
   // For each sample, record top, middle, bottom for graph
   static constexpr int numGraphPositions = 
-      3 * (4*samplesToRecord + axisSamples );
+      3 * (5*samplesToRecord + axisSamples );
   static constexpr int numGraphIndices   =
-      4 * (4*(samplesToRecord-1)+(axisSamples-1)); 
+      4 * (5*(samplesToRecord-1)+(axisSamples-1)); 
 
   std::vector<std::optional<double>> mPError;
   std::vector<std::optional<double>> mIError;
   std::vector<std::optional<double>> mDError;
   std::vector<std::optional<double>> mMotor;
   std::vector<std::optional<double>> mAxis;
+  std::vector<std::optional<double>> mGhost;        // Predicted P error
+  std::vector<double>                mGhostAngles;  // Predicted arm angles, 1 second apart
 
   double              mArmAngle           = 0.0;
   double              mStartAngle         = -90.0;
@@ -110,9 +176,37 @@ private:
   bool                mNudgeUp            = false;
   bool                mWackDown           = false;
   bool                mWackUp             = false;
+  bool                mStateEstimator     = false;
+  MotionProfile::Type mSetpointProfile    = MotionProfile::Type::Step;
+  bool                mGainScheduled      = false;
+  bool                mAutotune           = false;
+  bool                mOptimize           = false;
+  bool                mRobustness         = false;
+  bool                mTraceRecording     = false;
+  bool                mOpenTrace          = false;
+  bool                mSaveSession        = false;
+  StabilityMap::Plane mStabilityPlane     = StabilityMap::Plane::KpKd;
+  CostMap::Metric     mCostMetric         = CostMap::Metric::ITAE;
 
   nanogui::Button*    mSlowTimeButton     = nullptr;
   nanogui::TextBox*   mAngleCurrent       = nullptr;
+  nanogui::Label*     mStepMetrics        = nullptr;
+  GainMapView*        mStabilityMap       = nullptr;
+  GainMapView*        mCostMap            = nullptr;
+  nanogui::Label*     mCostResolution     = nullptr;
+  nanogui::Label*     mAutotuneUltimate   = nullptr;
+  nanogui::Label*     mAutotuneZN         = nullptr;
+  nanogui::Label*     mAutotuneTL         = nullptr;
+  nanogui::Label*     mOptimizerGains     = nullptr;
+  nanogui::Label*     mOptimizerSpeed     = nullptr;
+  nanogui::Label*     mRobustnessRate     = nullptr;
+  nanogui::Label*     mRobustnessDraws    = nullptr;
+  nanogui::Label*     mPlantModel         = nullptr;
+  nanogui::Label*     mPlantDelays        = nullptr;
+  nanogui::TextBox*   mTracePath          = nullptr;
+  nanogui::Label*     mTraceStatus        = nullptr;
+  nanogui::TextBox*   mSessionPath        = nullptr;
+  TraceView*          mTraceView          = nullptr;
 
   nanogui::GLShader   mShader;
   nanogui::GLShader   mGrapher;
@@ -0,0 +1,82 @@
+#include "pidsim_frontend_gain_map.h"
+#include <nanogui/opengl.h>
+#include <assert.h>
+
+namespace PidSim {
+
+GainMapView::GainMapView( nanogui::Widget* parent ) :
+  nanogui::Widget( parent )
+{
+}
+
+GainMapView::~GainMapView()
+{
+  if ( mImage != 0 ) {
+    nvgDeleteImage( mContext, mImage );
+  }
+}
+
+void GainMapView::setImage( int width, int height, std::vector<std::uint8_t> rgba )
+{
+  assert( rgba.size() == static_cast<std::size_t>( width * height * 4 ));
+  if ( width != mImageWidth || height != mImageHeight ) {
+    if ( mImage != 0 ) {
+      nvgDeleteImage( mContext, mImage );
+      mImage = 0;
+    }
+    mImageWidth = width;
+    mImageHeight = height;
+  }
+  mPixels = std::move( rgba );
+  mDirty = true;
+}
+
+void GainMapView::setMarker( float x, float y )
+{
+  mMarkerX = x;
+  mMarkerY = y;
+}
+
+//
+// 1. Upload the image if it changed.  nanovg needs a context to do that,
+//    so it waits until we're drawn.
+// 2. Draw the image, flipped so row 0 is at the bottom
+// 3. Draw the marker
+//
+void GainMapView::draw( NVGcontext* ctx )
+{
+  nanogui::Widget::draw( ctx );
+
+  // 1. Upload the image if it changed
+  mContext = ctx;
+  if ( mDirty && !mPixels.empty() ) {
+    if ( mImage == 0 ) {
+      mImage = nvgCreateImageRGBA( ctx, mImageWidth, mImageHeight, NVG_IMAGE_FLIPY, mPixels.data() );
+    }
+    else {
+      nvgUpdateImage( ctx, mImage, mPixels.data() );
+    }
+    mDirty = false;
+  }
+
+  // 2. Draw the image
+  if ( mImage != 0 ) {
+    const NVGpaint paint = nvgImagePattern( ctx, mPos.x(), mPos.y(), mSize.x(), mSize.y(), 0.0f, mImage, 1.0f );
+    nvgBeginPath( ctx );
+    nvgRect( ctx, mPos.x(), mPos.y(), mSize.x(), mSize.y() );
+    nvgFillPaint( ctx, paint );
+    nvgFill( ctx );
+  }
+
+  // 3. Draw the marker
+  const float markerX = mPos.x() + mMarkerX * mSize.x();
+  const float markerY = mPos.y() + ( 1.0f - mMarkerY ) * mSize.y();
+  nvgBeginPath( ctx );
+  nvgCircle( ctx, markerX, markerY, 4.0f );
+  nvgStrokeColor( ctx, nvgRGBA( 255, 255, 255, 255 ));
+  nvgStrokeWidth( ctx, 2.0f );
+  nvgStroke( ctx );
+}
+
+} // end PidSim Namespace
+
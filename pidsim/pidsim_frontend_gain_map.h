@@ -0,0 +1,67 @@
+#ifndef __PIDSIM_FRONTEND_GAIN_MAP_H__
+#define __PIDSIM_FRONTEND_GAIN_MAP_H__
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wint-in-bool-context"
+#pragma clang diagnostic ignored "-Wdeprecated-copy"
+#pragma clang diagnostic ignored "-Wunused-parameter"
+
+#include <nanogui/widget.h>     // for nanogui::Widget
+#pragma clang diagnostic pop
+#include <cstdint>              // for std::uint8_t
+#include <vector>               // for std::vector
+
+namespace PidSim {
+
+///
+/// @brief Shows a map over a plane of gains, with a marker at the current gains
+///
+/// The map is a small RGBA image that nanovg scales up to the widget's
+/// size.  Row 0 of the image is the bottom of the widget, so higher gains
+/// are further up.
+///
+class GainMapView: public nanogui::Widget {
+public:
+
+  /// @brief Constructor
+  ///
+  /// @param[in] parent - The widget that owns the map
+  ///
+  GainMapView( nanogui::Widget* parent );
+  ~GainMapView();
+
+  ///
+  /// @brief Replace the image
+  ///
+  /// @param[in] width  - Image width, in pixels
+  /// @param[in] height - Image height, in pixels
+  /// @param[in] rgba   - width * height RGBA pixels, row major
+  ///
+  void setImage( int width, int height, std::vector<std::uint8_t> rgba );
+
+  ///
+  /// @brief Move the marker
+  ///
+  /// @param[in] x  - Where the marker goes, from 0 (left) to 1 (right)
+  /// @param[in] y  - Where the marker goes, from 0 (bottom) to 1 (top)
+  ///
+  void setMarker( float x, float y );
+
+  virtual void draw( NVGcontext* ctx ) override;
+
+private:
+
+  NVGcontext*                 mContext    = nullptr;  // Owns mImage
+  int                         mImage      = 0;        // nanovg image handle, 0 for none
+  int                         mImageWidth = 0;
+  int                         mImageHeight= 0;
+  bool                        mDirty      = false;    // mPixels changed since the last upload
+  std::vector<std::uint8_t>   mPixels;
+  float                       mMarkerX    = 0.0f;
+  float                       mMarkerY    = 0.0f;
+};
+
+} // end PidSim Namespace
+
+#endif
+
@@ -0,0 +1,151 @@
+#include "pidsim_frontend_trace_view.h"
+#include "pidsim_backend_trace_summary.h"
+#include <nanogui/opengl.h>
+#include <algorithm>
+#include <iomanip>
+#include <math.h>
+#include <sstream>
+
+namespace PidSim {
+
+namespace {
+  // Fewest rows the view zooms in to
+  constexpr double minRows = 8.0;
+
+  // How much each scroll step zooms
+  constexpr double zoomPerStep = 0.85;
+
+  // Colors for the columns, in order, as per the error graph
+  const NVGcolor columnColors[] = {
+    nvgRGBA( 255,   0,   0, 255 ),
+    nvgRGBA( 255,   0, 255, 255 ),
+    nvgRGBA( 255, 255,   0, 255 ),
+    nvgRGBA( 128, 128, 255, 255 ),
+    nvgRGBA(   0, 255,   0, 255 ),
+  };
+}
+
+TraceView::TraceView( nanogui::Widget* parent ) :
+  nanogui::Widget( parent )
+{
+}
+
+TraceView::~TraceView()
+{
+}
+
+void TraceView::setTrace( std::shared_ptr<const TraceSummary> summary, std::vector<std::size_t> columns )
+{
+  mSummary  = std::move( summary );
+  mColumns  = std::move( columns );
+  mFirstRow = 0.0;
+  mRows     = mSummary ? static_cast<double>( mSummary->getReader().getRows() ) : 0.0;
+  mSecondsPerRow = 0.0;
+  if ( mSummary && mRows > 1.0 ) {
+    const TraceReader& reader = mSummary->getReader();
+    const double span = static_cast<double>( reader.getBlockLastTime( reader.getBlocks() - 1 ) - reader.getBlockFirstTime( 0 ));
+    mSecondsPerRow = span * 1e-6 / ( mRows - 1.0 );
+  }
+}
+
+void TraceView::clampView()
+{
+  const double traceRows = mSummary ? static_cast<double>( mSummary->getReader().getRows() ) : 0.0;
+  mRows     = std::min( std::max( mRows, minRows ), std::max( traceRows, minRows ));
+  mFirstRow = std::min( std::max( mFirstRow, 0.0 ), std::max( traceRows - mRows, 0.0 ));
+}
+
+bool TraceView::mouseDragEvent( const nanogui::Vector2i& /* p */, const nanogui::Vector2i& rel, int /* button */, int /* modifiers */ )
+{
+  if ( mSize.x() > 0 ) {
+    mFirstRow -= rel.x() * mRows / mSize.x();
+    clampView();
+  }
+  return true;
+}
+
+//
+// Zoom around the row under the mouse, so it stays put
+//
+bool TraceView::scrollEvent( const nanogui::Vector2i& p, const nanogui::Vector2f& rel )
+{
+  if ( mSize.x() > 0 ) {
+    const double fraction = std::min( std::max( static_cast<double>( p.x() - mPos.x() ) / mSize.x(), 0.0 ), 1.0 );
+    const double anchor = mFirstRow + fraction * mRows;
+    mRows *= pow( zoomPerStep, rel.y() );
+    clampView();
+    mFirstRow = anchor - fraction * mRows;
+    clampView();
+  }
+  return true;
+}
+
+//
+// 1. Draw the background
+// 2. Draw each column's band, a min/max range per pixel
+// 3. Label the time span
+//
+void TraceView::draw( NVGcontext* ctx )
+{
+  nanogui::Widget::draw( ctx );
+
+  // 1. Draw the background
+  nvgBeginPath( ctx );
+  nvgRect( ctx, mPos.x(), mPos.y(), mSize.x(), mSize.y() );
+  nvgFillColor( ctx, nvgRGBA( 0, 0, 0, 160 ));
+  nvgFill( ctx );
+  if ( !mSummary || mSize.x() <= 0 ) {
+    return;
+  }
+
+  // 2. Draw each column's band
+  const std::size_t pixels = static_cast<std::size_t>( mSize.x() );
+  const float top = mPos.y() + 2.0f, height = mSize.y() - 4.0f;
+  for ( std::size_t index = 0; index < mColumns.size(); ++index ) {
+    const std::size_t column = mColumns[ index ];
+    const TraceSummary::Range range = mSummary->getRange( column );
+    if ( !( range.mMin <= range.mMax )) {
+      continue;
+    }
+    const double spread = range.mMax > range.mMin ? range.mMax - range.mMin : 1.0;
+    const auto toY = [ & ]( double value ) {
+      return top + static_cast<float>(( range.mMax - value ) / spread ) * height;
+    };
+
+    // A zig-zag down each pixel's range and across to the next, so ranges
+    // and lines between single rows are one path
+    const std::vector<TraceSummary::Range> envelope = mSummary->getEnvelope( column, mFirstRow, mRows, pixels );
+    nvgBeginPath( ctx );
+    bool started = false;
+    for ( std::size_t pixel = 0; pixel < pixels; ++pixel ) {
+      if ( envelope[ pixel ].mMin > envelope[ pixel ].mMax ) {
+        continue;
+      }
+      const float x = mPos.x() + pixel + 0.5f;
+      if ( started ) {
+        nvgLineTo( ctx, x, toY( envelope[ pixel ].mMax ));
+      }
+      else {
+        nvgMoveTo( ctx, x, toY( envelope[ pixel ].mMax ));
+        started = true;
+      }
+      nvgLineTo( ctx, x, toY( envelope[ pixel ].mMin ));
+    }
+    nvgStrokeColor( ctx, columnColors[ index % std::size( columnColors ) ] );
+    nvgStrokeWidth( ctx, 1.0f );
+    nvgStroke( ctx );
+  }
+
+  // 3. Label the time span
+  std::stringstream stream;
+  stream << std::fixed << std::setprecision( mRows * mSecondsPerRow < 10.0 ? 3 : 1 );
+  stream << mFirstRow * mSecondsPerRow << " - " << ( mFirstRow + mRows ) * mSecondsPerRow << " s";
+  nvgFontSize( ctx, 14.0f );
+  nvgFontFace( ctx, "sans" );
+  nvgTextAlign( ctx, NVG_ALIGN_LEFT | NVG_ALIGN_TOP );
+  nvgFillColor( ctx, nvgRGBA( 255, 255, 255, 200 ));
+  nvgText( ctx, mPos.x() + 4.0f, mPos.y() + 4.0f, stream.str().c_str(), nullptr );
+}
+
+} // end PidSim Namespace
+
@@ -0,0 +1,64 @@
+#ifndef __PIDSIM_FRONTEND_TRACE_VIEW_H__
+#define __PIDSIM_FRONTEND_TRACE_VIEW_H__
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wint-in-bool-context"
+#pragma clang diagnostic ignored "-Wdeprecated-copy"
+#pragma clang diagnostic ignored "-Wunused-parameter"
+
+#include <nanogui/widget.h>     // for nanogui::Widget
+#pragma clang diagnostic pop
+#include <cstddef>              // for std::size_t
+#include <memory>               // for std::shared_ptr
+#include <vector>               // for std::vector
+
+namespace PidSim {
+
+class TraceSummary;
+
+///
+/// @brief Shows columns of a recorded trace, with pan & zoom
+///
+/// Each frame asks the trace's summary pyramid for one min/max range per
+/// pixel and draws them as a band, so it costs the same whether it's
+/// showing the whole trace or a handful of ticks.  Drag to pan, scroll to
+/// zoom around the mouse.  Each column is scaled to its own range.
+///
+class TraceView: public nanogui::Widget {
+public:
+
+  /// @brief Constructor
+  ///
+  /// @param[in] parent - The widget that owns the view
+  ///
+  TraceView( nanogui::Widget* parent );
+  ~TraceView();
+
+  ///
+  /// @brief Show a trace, zoomed all the way out
+  ///
+  /// @param[in] summary  - The trace, or nullptr for none
+  /// @param[in] columns  - The columns to draw
+  ///
+  void setTrace( std::shared_ptr<const TraceSummary> summary, std::vector<std::size_t> columns );
+
+  virtual void draw( NVGcontext* ctx ) override;
+  virtual bool mouseDragEvent( const nanogui::Vector2i& p, const nanogui::Vector2i& rel, int button, int modifiers ) override;
+  virtual bool scrollEvent( const nanogui::Vector2i& p, const nanogui::Vector2f& rel ) override;
+
+private:
+
+  // Keep the view inside the trace, and at least a few ticks wide
+  void clampView();
+
+  std::shared_ptr<const TraceSummary> mSummary;
+  std::vector<std::size_t>    mColumns;
+  double                      mFirstRow   = 0.0;    // Left edge of the view
+  double                      mRows       = 0.0;    // Rows across the view
+  double                      mSecondsPerRow = 0.0; // From the trace's timestamps
+};
+
+} // end PidSim Namespace
+
+#endif
+
@@ -2,7 +2,12 @@
 #define __PIDSIM_UTILS__
 
 #include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <queue>
+#include <thread>
 #include <vector>
 #include <assert.h>
 
@@ -35,6 +40,147 @@ inline double radToDeg( double radians )
   return radians / M_PI * 180.0;
 }
 
+///
+/// @brief Scramble a 64 bit value (the SplitMix64 finalizer)
+///
+/// Used as a counter based random number generator, i.e.,
+/// splitMix64( seed + counter ), so any random value can be recreated
+/// from its counter without replaying the ones before it.
+///
+/// @param[in] value  - The value to scramble
+/// @return           - A well mixed 64 bit value
+///
+inline std::uint64_t splitMix64( std::uint64_t value )
+{
+  value += 0x9e3779b97f4a7c15ull;
+  value = ( value ^ ( value >> 30 )) * 0xbf58476d1ce4e5b9ull;
+  value = ( value ^ ( value >> 27 )) * 0x94d049bb133111ebull;
+  return value ^ ( value >> 31 );
+}
+
+///
+/// @brief Map a random 64 bit value to a double between -1 and 1
+///
+/// @param[in] random - A random value, i.e., from splitMix64
+/// @return           - A value in [-1, 1)
+///
+inline double toSignedUnit( std::uint64_t random )
+{
+  // The top 53 bits fill a double's mantissa exactly
+  return static_cast<double>( random >> 11 ) * ( 2.0 / 9007199254740992.0 ) - 1.0;
+}
+
+///
+/// @brief Map a random 64 bit value to a double between 0 and 1
+///
+/// @param[in] random - A random value, i.e., from splitMix64
+/// @return           - A value in (0, 1], so it's safe to take the log of
+///
+inline double toUnit( std::uint64_t random )
+{
+  return static_cast<double>(( random >> 11 ) + 1 ) * ( 1.0 / 9007199254740992.0 );
+}
+
+///
+/// @brief Map two random 64 bit values to a standard normal deviate
+///
+/// Box-Muller, keeping only the cosine half, so a counter based generator
+/// can recreate any deviate from its two counters.
+///
+/// @param[in] random0  - A random value, i.e., from splitMix64
+/// @param[in] random1  - Another, independent, random value
+/// @return             - A normally distributed value, mean 0 & variance 1
+///
+inline double toGaussian( std::uint64_t random0, std::uint64_t random1 )
+{
+  return sqrt( -2.0 * log( toUnit( random0 ))) * cos( 2.0 * M_PI * toUnit( random1 ));
+}
+
+///
+/// @brief The standard normal quantile, i.e., 1.96 for .975
+///
+/// Acklam's rational approximation (good to about 1e-9), then one Halley
+/// step on erfc to bring it to near double precision.  Cheap enough to
+/// turn every uniform sample into a normal one.
+///
+/// @param[in] probability  - A probability between 0 and 1
+/// @return                 - x such that P( Z < x ) = probability
+///
+inline double normalQuantile( double probability )
+{
+  if ( probability <= 0.0 ) { return -INFINITY; }
+  if ( probability >= 1.0 ) { return INFINITY; }
+
+  static constexpr double a[] = { -3.969683028665376e+01,  2.209460984245205e+02, -2.759285104469687e+02,
+                                   1.383577518672690e+02, -3.066479806614716e+01,  2.506628277459239e+00 };
+  static constexpr double b[] = { -5.447609879822406e+01,  1.615858368580409e+02, -1.556989798598866e+02,
+                                   6.680131188771972e+01, -1.328068155288572e+01 };
+  static constexpr double c[] = { -7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00,
+                                  -2.549732539343734e+00,  4.374664141464968e+00,  2.938163982698783e+00 };
+  static constexpr double d[] = {  7.784695709041462e-03,  3.224671290700398e-01,  2.445134137142996e+00,
+                                   3.754408661907416e+00 };
+  const double tail = 0.02425;
+  double x;
+  if ( probability < tail || probability > 1.0 - tail ) {
+    const double q = sqrt( -2.0 * log( std::min( probability, 1.0 - probability )));
+    x = ((((( c[ 0 ] * q + c[ 1 ] ) * q + c[ 2 ] ) * q + c[ 3 ] ) * q + c[ 4 ] ) * q + c[ 5 ] ) /
+        (((( d[ 0 ] * q + d[ 1 ] ) * q + d[ 2 ] ) * q + d[ 3 ] ) * q + 1.0 );
+    x = probability < tail ? x : -x;
+  }
+  else {
+    const double q = probability - 0.5;
+    const double r = q * q;
+    x = ((((( a[ 0 ] * r + a[ 1 ] ) * r + a[ 2 ] ) * r + a[ 3 ] ) * r + a[ 4 ] ) * r + a[ 5 ] ) * q /
+        ((((( b[ 0 ] * r + b[ 1 ] ) * r + b[ 2 ] ) * r + b[ 3 ] ) * r + b[ 4 ] ) * r + 1.0 );
+  }
+
+  const double error = 0.5 * erfc( -x / M_SQRT2 ) - probability;
+  const double u = error * sqrt( 2.0 * M_PI ) * exp( x * x / 2.0 );
+  return x - u / ( 1.0 + x * u / 2.0 );
+}
+
+///
+/// @brief Call function( i ) for every i in [0, count), spread over the cores
+///
+/// @param[in] count    - The number of calls
+/// @param[in] function - The function.  Calls may run at the same time,
+///                       in any order.
+/// @param[in] threads  - Use at most this many threads.  0 is one per core.
+///
+/// Indices are handed out one at a time, so uneven work balances out.
+/// Web assembly builds without pthreads just run the loop.
+///
+template< typename Function >
+void parallelFor( std::size_t count, Function&& function, std::size_t threads = 0 )
+{
+#if defined( __EMSCRIPTEN__ ) && !defined( __EMSCRIPTEN_PTHREADS__ )
+  (void) threads;
+  for ( std::size_t i = 0; i < count; ++i ) {
+    function( i );
+  }
+#else
+  if ( threads == 0 ) {
+    threads = std::max( 1u, std::thread::hardware_concurrency() );
+  }
+  threads = std::min( threads, count );
+  std::atomic<std::size_t> next{ 0 };
+  auto worker = [&]() {
+    for ( std::size_t i = next++; i < count; i = next++ ) {
+      function( i );
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for ( std::size_t thread = 1; thread < threads; ++thread ) {
+    pool.emplace_back( worker );
+  }
+  worker();
+  for ( std::thread& thread : pool ) {
+    thread.join();
+  }
+#endif
+}
+
 /// @brief a simple Moving Average class
 ///
 /// @param[in] T  = the type for the moving average (i.e., double, int)
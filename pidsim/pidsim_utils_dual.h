@@ -0,0 +1,137 @@
+#ifndef __PIDSIM_UTILS_DUAL__
+#define __PIDSIM_UTILS_DUAL__
+
+#include <math.h>
+#include <array>
+#include <cstddef>
+
+namespace PidSim {
+namespace Utils {
+
+///
+/// @brief A dual number for forward mode automatic differentiation
+///
+/// Carries a value and its derivatives with respect to N inputs.  Run a
+/// calculation with Duals instead of doubles, seed each input with
+/// variable(), and the result's gradient is exact - no finite differences,
+/// one pass no matter how many inputs.
+///
+/// Comparisons only look at the value, so branches (motor limits, hard
+/// stops) take the same path the double version would.
+///
+/// @param[in] N  = the number of inputs to differentiate with respect to
+///
+template< std::size_t N >
+struct Dual
+{
+  using Gradient = std::array<double, N>;
+
+  double    mValue;
+  Gradient  mGradient;
+
+  /// @brief A constant.  Implicit, so doubles mix freely with Duals.
+  Dual( double value = 0.0 ) : mValue{ value }, mGradient{} {}
+
+  /// @brief A value with a gradient
+  Dual( double value, const Gradient& gradient ) : mValue{ value }, mGradient{ gradient } {}
+
+  ///
+  /// @brief An input to differentiate with respect to
+  ///
+  /// @param[in] value  - The input's value
+  /// @param[in] index  - Which input it is, from 0 to N-1
+  ///
+  static Dual variable( double value, std::size_t index )
+  {
+    Dual dual{ value };
+    dual.mGradient[ index ] = 1.0;
+    return dual;
+  }
+
+  Dual& operator+=( const Dual& other )
+  {
+    mValue += other.mValue;
+    for ( std::size_t i = 0; i < N; ++i ) { mGradient[ i ] += other.mGradient[ i ]; }
+    return *this;
+  }
+
+  Dual& operator-=( const Dual& other )
+  {
+    mValue -= other.mValue;
+    for ( std::size_t i = 0; i < N; ++i ) { mGradient[ i ] -= other.mGradient[ i ]; }
+    return *this;
+  }
+
+  // (uv)' = u'v + uv'
+  Dual& operator*=( const Dual& other )
+  {
+    for ( std::size_t i = 0; i < N; ++i ) {
+      mGradient[ i ] = mGradient[ i ] * other.mValue + mValue * other.mGradient[ i ];
+    }
+    mValue *= other.mValue;
+    return *this;
+  }
+
+  // (u/v)' = ( u' - (u/v) v' ) / v
+  Dual& operator/=( const Dual& other )
+  {
+    mValue /= other.mValue;
+    for ( std::size_t i = 0; i < N; ++i ) {
+      mGradient[ i ] = ( mGradient[ i ] - mValue * other.mGradient[ i ] ) / other.mValue;
+    }
+    return *this;
+  }
+
+  //
+  // Hidden friends, so a double on either side converts and ADL finds
+  // cos/sin/abs for Duals.
+  //
+  friend Dual operator+( Dual a, const Dual& b ) { return a += b; }
+  friend Dual operator-( Dual a, const Dual& b ) { return a -= b; }
+  friend Dual operator*( Dual a, const Dual& b ) { return a *= b; }
+  friend Dual operator/( Dual a, const Dual& b ) { return a /= b; }
+  friend Dual operator-( Dual a )
+  {
+    a.mValue = -a.mValue;
+    for ( double& d : a.mGradient ) { d = -d; }
+    return a;
+  }
+
+  friend bool operator< ( const Dual& a, const Dual& b ) { return a.mValue <  b.mValue; }
+  friend bool operator> ( const Dual& a, const Dual& b ) { return a.mValue >  b.mValue; }
+  friend bool operator<=( const Dual& a, const Dual& b ) { return a.mValue <= b.mValue; }
+  friend bool operator>=( const Dual& a, const Dual& b ) { return a.mValue >= b.mValue; }
+  friend bool operator==( const Dual& a, const Dual& b ) { return a.mValue == b.mValue; }
+  friend bool operator!=( const Dual& a, const Dual& b ) { return a.mValue != b.mValue; }
+
+  friend Dual cos( const Dual& a ) { return chain( a, ::cos( a.mValue ), -::sin( a.mValue )); }
+  friend Dual sin( const Dual& a ) { return chain( a, ::sin( a.mValue ),  ::cos( a.mValue )); }
+  friend Dual abs( const Dual& a ) { return a.mValue < 0.0 ? -a : a; }
+
+  private:
+
+  // f( a ), given f( a.value ) and f'( a.value )
+  static Dual chain( const Dual& a, double value, double derivative )
+  {
+    Dual result{ value };
+    for ( std::size_t i = 0; i < N; ++i ) { result.mGradient[ i ] = derivative * a.mGradient[ i ]; }
+    return result;
+  }
+};
+
+///
+/// @brief The plain value of a scalar, dropping any derivatives
+///
+/// For code templated on the scalar type that needs a double, i.e., for
+/// a table lookup.
+///
+inline double valueOf( double value ) { return value; }
+
+template< std::size_t N >
+inline double valueOf( const Dual<N>& value ) { return value.mValue; }
+
+}
+}
+
+#endif
+
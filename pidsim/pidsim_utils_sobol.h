@@ -0,0 +1,263 @@
+#ifndef __PIDSIM_UTILS_SOBOL__
+#define __PIDSIM_UTILS_SOBOL__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <assert.h>
+#include "pidsim_utils.h"
+
+namespace PidSim {
+namespace Utils {
+
+///
+/// @brief A Sobol low discrepancy sequence, optionally scrambled
+///
+/// Random points clump and leave gaps; a grid needs steps ^ dimensions
+/// points before it's any use.  Sobol points fill the unit cube evenly at
+/// every count: any 2^m points starting at a multiple of 2^m put exactly
+/// one point in each of 2^m equal slices of every axis, and the first few
+/// axes are balanced in pairs too.  Averages over them converge close to
+/// 1 / N instead of 1 / sqrt( N ).
+///
+/// Point i is worked out from i alone (Gray code order), so a shard can
+/// generate any range of indices without knowing about the others, and
+/// generate() walks a range for one XOR per coordinate.
+///
+/// Scrambling (hash based Owen scrambling, Burley 2020) randomly permutes
+/// each axis in a nested way that keeps the balance above.  Each point is
+/// then uniformly distributed on its own, so estimates are unbiased and
+/// different seeds give independent replicates to put error bars on.
+///
+class Sobol
+{
+  public:
+
+  /// @brief The most axes supported (Joe & Kuo's direction numbers)
+  static constexpr std::size_t maxDimensions = 16;
+
+  /// @brief Points before the sequence runs out
+  static constexpr std::uint64_t maxPoints = std::uint64_t{ 1 } << 32;
+
+  ///
+  /// @brief An unscrambled sequence.  Point 0 is the origin.
+  ///
+  /// @param[in] dimensions - Axes per point, up to maxDimensions
+  ///
+  explicit Sobol( std::size_t dimensions ) :
+    mDimensions{ dimensions }
+  {
+    assert( dimensions > 0 && dimensions <= maxDimensions );
+    initDirections();
+  }
+
+  ///
+  /// @brief A scrambled sequence
+  ///
+  /// @param[in] dimensions - Axes per point, up to maxDimensions
+  /// @param[in] seed       - Picks the scramble.  Each seed is an
+  ///                         independent randomization of the sequence.
+  ///
+  Sobol( std::size_t dimensions, std::uint64_t seed ) :
+    Sobol( dimensions )
+  {
+    mScrambled = true;
+    for ( std::size_t dimension = 0; dimension < mDimensions; ++dimension ) {
+      mScrambles[ dimension ] = static_cast<std::uint32_t>( splitMix64( seed + dimension ) >> 32 );
+    }
+  }
+
+  // Remove constructors I probably never want (i.e., if used they're a bug)
+  Sobol() = delete;
+
+  /// @brief Axes per point
+  [[nodiscard]] std::size_t dimensions() const { return mDimensions; }
+
+  ///
+  /// @brief One coordinate of one point
+  ///
+  /// @param[in] index      - The point, below maxPoints
+  /// @param[in] dimension  - The axis
+  /// @return               - A value in [0, 1)
+  ///
+  [[nodiscard]] double coordinate( std::uint64_t index, std::size_t dimension ) const
+  {
+    assert( index < maxPoints && dimension < mDimensions );
+    const std::uint32_t gray = static_cast<std::uint32_t>( index ^ ( index >> 1 ));
+    std::uint32_t bits = 0;
+    for ( unsigned bit = 0; bit < 32; ++bit ) {
+      bits ^= ( gray >> bit & 1u ) ? mDirections[ dimension ][ bit ] : 0u;
+    }
+    return toDouble( bits, dimension );
+  }
+
+  ///
+  /// @brief One point
+  ///
+  /// @param[in] index  - The point, below maxPoints
+  /// @return           - dimensions() values in [0, 1)
+  ///
+  [[nodiscard]] std::vector<double> point( std::uint64_t index ) const
+  {
+    std::vector<double> result;
+    generate( index, 1, result );
+    return result;
+  }
+
+  ///
+  /// @brief A range of points
+  ///
+  /// 1. Work out the first point from its index
+  /// 2. Step to each next point.  Gray codes i and i + 1 differ in the
+  ///    bit that's the lowest set bit of i + 1, so that's one XOR.
+  ///
+  /// @param[in] first  - The first point's index
+  /// @param[in] count  - How many points.  first + count <= maxPoints.
+  /// @param[out] out   - count * dimensions() values, point major
+  ///
+  void generate( std::uint64_t first, std::size_t count, std::vector<double>& out ) const
+  {
+    assert( first + count <= maxPoints );
+    out.resize( count * mDimensions );
+    if ( count == 0 ) {
+      return;
+    }
+
+    // 1. Work out the first point from its index
+    const std::uint32_t gray = static_cast<std::uint32_t>( first ^ ( first >> 1 ));
+    std::array<std::uint32_t, maxDimensions> bits{};
+    for ( std::size_t dimension = 0; dimension < mDimensions; ++dimension ) {
+      for ( unsigned bit = 0; bit < 32; ++bit ) {
+        bits[ dimension ] ^= ( gray >> bit & 1u ) ? mDirections[ dimension ][ bit ] : 0u;
+      }
+    }
+
+    // 2. Step to each next point
+    for ( std::size_t i = 0; ; ++i ) {
+      for ( std::size_t dimension = 0; dimension < mDimensions; ++dimension ) {
+        out[ i * mDimensions + dimension ] = toDouble( bits[ dimension ], dimension );
+      }
+      if ( i + 1 == count ) {
+        break;
+      }
+      const unsigned changed = lowestSetBit( first + i + 1 );
+      for ( std::size_t dimension = 0; dimension < mDimensions; ++dimension ) {
+        bits[ dimension ] ^= mDirections[ dimension ][ changed ];
+      }
+    }
+  }
+
+  private:
+
+  using Directions = std::array<std::uint32_t, 32>;
+
+  ///
+  /// @brief Fill in the direction numbers
+  ///
+  /// Axis 0 is the van der Corput sequence.  Each other axis has a
+  /// primitive polynomial over GF(2) of degree s, packed into a (the
+  /// coefficients between the leading and trailing 1s), and s starting
+  /// odd integers m.  The rest come from the recurrence
+  ///
+  ///   v[k] = v[k-s] ^ ( v[k-s] >> s ) ^ sum of a_j v[k-j], j = 1 .. s-1
+  ///
+  void initDirections()
+  {
+    struct Polynomial
+    {
+      unsigned                  mDegree;
+      std::uint32_t             mCoefficients;
+      std::array<unsigned, 6>   mInitial;
+    };
+    // From new-joe-kuo-6.21201
+    static constexpr std::array<Polynomial, maxDimensions - 1> polynomials{{
+      { 1,  0, { 1 }},
+      { 2,  1, { 1, 3 }},
+      { 3,  1, { 1, 3, 1 }},
+      { 3,  2, { 1, 1, 1 }},
+      { 4,  1, { 1, 1, 3, 3 }},
+      { 4,  4, { 1, 3, 5, 13 }},
+      { 5,  2, { 1, 1, 5, 5, 17 }},
+      { 5,  4, { 1, 1, 5, 5, 5 }},
+      { 5,  7, { 1, 1, 7, 11, 19 }},
+      { 5, 11, { 1, 1, 5, 1, 1 }},
+      { 5, 13, { 1, 1, 1, 3, 11 }},
+      { 5, 14, { 1, 3, 5, 5, 31 }},
+      { 6,  1, { 1, 3, 3, 9, 7, 49 }},
+      { 6, 13, { 1, 1, 1, 15, 21, 21 }},
+      { 6, 16, { 1, 3, 1, 13, 27, 49 }},
+    }};
+
+    for ( unsigned bit = 0; bit < 32; ++bit ) {
+      mDirections[ 0 ][ bit ] = 1u << ( 31 - bit );
+    }
+    for ( std::size_t dimension = 1; dimension < mDimensions; ++dimension ) {
+      const Polynomial& polynomial = polynomials[ dimension - 1 ];
+      const unsigned s = polynomial.mDegree;
+      Directions& v = mDirections[ dimension ];
+      for ( unsigned bit = 0; bit < s; ++bit ) {
+        v[ bit ] = polynomial.mInitial[ bit ] << ( 31 - bit );
+      }
+      for ( unsigned bit = s; bit < 32; ++bit ) {
+        v[ bit ] = v[ bit - s ] ^ ( v[ bit - s ] >> s );
+        for ( unsigned j = 1; j < s; ++j ) {
+          v[ bit ] ^= ( polynomial.mCoefficients >> ( s - 1 - j ) & 1u ) ? v[ bit - j ] : 0u;
+        }
+      }
+    }
+  }
+
+  ///
+  /// @brief Scramble if asked to, and map to [0, 1)
+  ///
+  /// Reversing the bits turns "each bit only depends on the bits above
+  /// it" (nested, i.e. Owen, scrambling) into "each bit only depends on
+  /// the bits below it", which is what adds and multiplies do.  The
+  /// multiplies by even constants and the odd multiply are each
+  /// invertible, so it's a permutation of each slice's sub-slices.
+  ///
+  [[nodiscard]] double toDouble( std::uint32_t bits, std::size_t dimension ) const
+  {
+    if ( mScrambled ) {
+      const std::uint32_t seed = mScrambles[ dimension ];
+      bits  = reverseBits( bits );
+      bits ^= bits * 0x3d20adeau;
+      bits += seed;
+      bits *= ( seed >> 16 ) | 1u;
+      bits ^= bits * 0x05526c56u;
+      bits ^= bits * 0x53a22864u;
+      bits  = reverseBits( bits );
+    }
+    return static_cast<double>( bits ) * ( 1.0 / 4294967296.0 );
+  }
+
+  static std::uint32_t reverseBits( std::uint32_t bits )
+  {
+    bits = (( bits >> 1 ) & 0x55555555u ) | (( bits & 0x55555555u ) << 1 );
+    bits = (( bits >> 2 ) & 0x33333333u ) | (( bits & 0x33333333u ) << 2 );
+    bits = (( bits >> 4 ) & 0x0f0f0f0fu ) | (( bits & 0x0f0f0f0fu ) << 4 );
+    bits = (( bits >> 8 ) & 0x00ff00ffu ) | (( bits & 0x00ff00ffu ) << 8 );
+    return ( bits >> 16 ) | ( bits << 16 );
+  }
+
+  static unsigned lowestSetBit( std::uint64_t value )
+  {
+    unsigned bit = 0;
+    while (( value & 1u ) == 0 ) {
+      value >>= 1;
+      ++bit;
+    }
+    return bit;
+  }
+
+  std::size_t                                   mDimensions;
+  bool                                          mScrambled  = false;
+  std::array<Directions, maxDimensions>         mDirections{};
+  std::array<std::uint32_t, maxDimensions>      mScrambles{};
+};
+
+}
+}
+
+#endif
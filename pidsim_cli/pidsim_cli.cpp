@@ -0,0 +1,548 @@
+
+//
+// pidsim_cli - run scenario files through the arm simulation, no GUI
+//
+// Every scenario in every file runs at full speed, in parallel.  Metrics
+// for each target the arm was given go to stdout (or --metrics) as CSV,
+// in the order the scenarios were given, and each scenario's telemetry
+// can go to a trace.  The ticks per second is reported on stderr.
+//
+// Session logs the GUI saved replay the same way, with --replay.
+//
+// It can also coordinate a parameter sweep over worker processes, on this
+// machine or others, and be one of those workers.
+//
+#include "../pidsim/pidsim_backend_batch_run.h"
+#include "../pidsim/pidsim_backend_distributed_sweep.h"
+#include "../pidsim/pidsim_backend_scenario.h"
+#include "../pidsim/pidsim_backend_session_log.h"
+#include "../pidsim/pidsim_backend_telemetry.h"
+#include "../pidsim/pidsim_backend_telemetry_stream.h"
+#include "../pidsim/pidsim_utils.h"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+using PidSim::BatchSim;
+using PidSim::Scenario;
+
+namespace {
+
+const char* usage =
+  "usage: pidsim_cli [options] scenario_file...\n"
+  "       pidsim_cli [options] --replay LOG...\n"
+  "       pidsim_cli --sweep RUNS --listen ADDRESS [sweep options]\n"
+  "       pidsim_cli --worker ADDRESS [--cache FILE]\n"
+  "\n"
+  "  -j, --jobs N         Run at most N scenarios at once (default: one per core)\n"
+  "  -m, --metrics FILE   Write the metrics CSV to FILE instead of stdout\n"
+  "  -t, --traces DIR     Write each scenario's telemetry to DIR/<scenario>.trace\n"
+  "  -r, --replay LOG     Replay a session log the GUI saved, as if it were a scenario\n"
+  "                       named after the file\n"
+  "  -s, --stream PORT    Stream every tick on localhost:PORT, once someone subscribes\n"
+  "  -q, --quiet          Don't report ticks (or runs) per second\n"
+  "  -h, --help           Show this\n"
+  "\n"
+  "Sweeps, where settings are the Python module's PARAMETERS:\n"
+  "  --sweep RUNS         Run RUNS points of a sweep on workers, and write their metrics\n"
+  "  --listen ADDRESS     Where workers connect: unix:<path> or <host>:<port>\n"
+  "  --axis NAME=MIN:MAX  Sweep a setting\n"
+  "  --set NAME=VALUE     Fix a setting\n"
+  "  --ticks N            Ticks to simulate each run (default 250)\n"
+  "  --seed N             Seed for the sweep (default 1)\n"
+  "  --chunk N            Runs to hand a worker at a time (default 4096)\n"
+  "  --local N            Start N workers on this machine too\n"
+  "  --worker ADDRESS     Run chunks for the coordinator at ADDRESS until it's done\n"
+  "  --cache FILE         Keep a worker's results in a result cache file\n";
+
+struct Options
+{
+  std::vector<std::string>    mFiles;
+  std::vector<std::string>    mReplays;
+  std::string                 mMetrics;
+  std::string                 mTraces;
+  std::size_t                 mJobs       = 0;
+  bool                        mQuiet      = false;
+  int                         mStream     = -1;
+
+  // Sweeps
+  std::uint64_t               mSweepRuns  = 0;
+  std::string                 mListen;
+  std::string                 mWorker;
+  std::string                 mCache;
+  std::size_t                 mLocal      = 0;
+  std::vector<std::string>    mAxisNames;
+  PidSim::ParameterSweep::Settings   mSweep;
+  PidSim::SweepCoordinator::Options  mCoordinator;
+};
+
+// A whole number, at least minimum
+bool parseCount( const char* text, unsigned long long minimum, unsigned long long& value )
+{
+  char* end = nullptr;
+  value = strtoull( text, &end, 10 );
+  return *text != '\0' && *text != '-' && *end == '\0' && value >= minimum;
+}
+
+bool parseNumber( const std::string& text, double& value )
+{
+  char* end = nullptr;
+  value = strtod( text.c_str(), &end );
+  return !text.empty() && *end == '\0';
+}
+
+// The BatchRun parameter column for a name, or numParameters
+std::size_t parameterColumn( const std::string& name )
+{
+  std::size_t column = 0;
+  while ( column < PidSim::BatchRun::numParameters && name != PidSim::BatchRun::parameterNames[ column ] ) {
+    ++column;
+  }
+  return column;
+}
+
+//
+// NAME=MIN:MAX for an axis, NAME=VALUE for a fixed setting.  Values out of
+// BatchRun's bounds set the error.
+//
+bool parseSetting( const std::string& text, bool axis, Options& options, std::string& error )
+{
+  const std::size_t equals = text.find( '=' );
+  const std::size_t column = parameterColumn( text.substr( 0, equals ));
+  if ( equals == std::string::npos || column == PidSim::BatchRun::numParameters ) {
+    return false;
+  }
+  const std::string value = text.substr( equals + 1 );
+  double BatchSim::ArmSettings::* setting = PidSim::BatchRun::parameterSettings[ column ];
+  if ( !axis ) {
+    return parseNumber( value, options.mSweep.mArm.*setting )
+        && PidSim::BatchRun::checkParameter( column, options.mSweep.mArm.*setting, error );
+  }
+  const std::size_t colon = value.find( ':' );
+  PidSim::ParameterSweep::Axis range{ setting, 0.0, 0.0 };
+  if ( colon == std::string::npos || !parseNumber( value.substr( 0, colon ), range.mMin )
+    || !parseNumber( value.substr( colon + 1 ), range.mMax )
+    || options.mSweep.mAxes.size() == PidSim::Utils::Sobol::maxDimensions ) {
+    return false;
+  }
+  if ( !PidSim::BatchRun::checkParameter( column, range.mMin, error )
+    || !PidSim::BatchRun::checkParameter( column, range.mMax, error )) {
+    return false;
+  }
+  options.mSweep.mAxes.push_back( range );
+  options.mAxisNames.push_back( text.substr( 0, equals ));
+  return true;
+}
+
+//
+// Returns 0 to run, or the exit code
+//
+int parseOptions( int argc, char** argv, Options& options )
+{
+  for ( int arg = 1; arg < argc; ++arg ) {
+    const std::string word = argv[ arg ];
+    const bool hasValue = arg + 1 < argc;
+    if ( word == "-h" || word == "--help" ) {
+      std::cout << usage;
+      return -1;
+    }
+    else if ( word == "-q" || word == "--quiet" ) {
+      options.mQuiet = true;
+    }
+    else if (( word == "-j" || word == "--jobs" ) && hasValue ) {
+      char* end = nullptr;
+      const long jobs = strtol( argv[ ++arg ], &end, 10 );
+      if ( *end != '\0' || jobs < 1 ) {
+        std::cerr << "pidsim_cli: bad job count " << argv[ arg ] << "\n";
+        return 2;
+      }
+      options.mJobs = static_cast<std::size_t>( jobs );
+    }
+    else if (( word == "-m" || word == "--metrics" ) && hasValue ) {
+      options.mMetrics = argv[ ++arg ];
+    }
+    else if (( word == "-t" || word == "--traces" ) && hasValue ) {
+      options.mTraces = argv[ ++arg ];
+    }
+    else if (( word == "-r" || word == "--replay" ) && hasValue ) {
+      options.mReplays.push_back( argv[ ++arg ] );
+    }
+    else if (( word == "-s" || word == "--stream" ) && hasValue ) {
+      unsigned long long port = 0;
+      if ( !parseCount( argv[ ++arg ], 1, port ) || port > 65535 ) {
+        std::cerr << "pidsim_cli: bad port " << argv[ arg ] << "\n";
+        return 2;
+      }
+      options.mStream = static_cast<int>( port );
+    }
+    else if ( word == "--listen" && hasValue ) {
+      options.mListen = argv[ ++arg ];
+    }
+    else if ( word == "--worker" && hasValue ) {
+      options.mWorker = argv[ ++arg ];
+    }
+    else if ( word == "--cache" && hasValue ) {
+      options.mCache = argv[ ++arg ];
+    }
+    else if (( word == "--axis" || word == "--set" ) && hasValue ) {
+      std::string error;
+      if ( !parseSetting( argv[ ++arg ], word == "--axis", options, error )) {
+        std::cerr << "pidsim_cli: bad " << word << " " << argv[ arg ]
+                  << ( error.empty() ? "" : ": " + error ) << "\n";
+        return 2;
+      }
+    }
+    else if (( word == "--sweep" || word == "--ticks" || word == "--seed" || word == "--chunk"
+            || word == "--local" ) && hasValue ) {
+      unsigned long long count = 0;
+      if ( !parseCount( argv[ ++arg ], word == "--seed" || word == "--local" ? 0 : 1, count )) {
+        std::cerr << "pidsim_cli: bad " << word << " " << argv[ arg ] << "\n";
+        return 2;
+      }
+      if ( word == "--sweep" ) {
+        options.mSweepRuns = count;
+      }
+      else if ( word == "--ticks" ) {
+        options.mSweep.mTicks = static_cast<unsigned>( count );
+      }
+      else if ( word == "--seed" ) {
+        options.mSweep.mSeed = count;
+      }
+      else if ( word == "--chunk" ) {
+        options.mCoordinator.mChunkSize = count;
+      }
+      else {
+        options.mLocal = count;
+      }
+    }
+    else if ( !word.empty() && word[ 0 ] == '-' ) {
+      std::cerr << "pidsim_cli: bad option " << word << "\n" << usage;
+      return 2;
+    }
+    else {
+      options.mFiles.push_back( word );
+    }
+  }
+  if ( options.mSweepRuns > 0 && options.mListen.empty() ) {
+    std::cerr << "pidsim_cli: a sweep needs --listen\n";
+    return 2;
+  }
+  if ( options.mFiles.empty() && options.mReplays.empty() && options.mSweepRuns == 0 && options.mWorker.empty() ) {
+    std::cerr << usage;
+    return 2;
+  }
+  return 0;
+}
+
+//
+// A scenario's run, and whether its trace was written
+//
+struct Run
+{
+  Scenario::Result  mResult;
+  bool              mTraced = true;
+};
+
+void writeMetrics( std::ostream& out, const std::vector<std::string>& names, const std::vector<Run>& runs )
+{
+  out << "scenario,step,start_time,target,rise_time,overshoot,settling_time,steady_state_error,"
+         "iae,ise,itae,control_effort,settled\n";
+  out << std::setprecision( 10 );
+  for ( std::size_t index = 0; index < names.size(); ++index ) {
+    const std::vector<Scenario::Step>& steps = runs[ index ].mResult.mSteps;
+    for ( std::size_t step = 0; step < steps.size(); ++step ) {
+      const PidSim::StepMetrics::Result& metrics = steps[ step ].mMetrics;
+      out << names[ index ] << ',' << step << ',' << steps[ step ].mStartTime << ','
+          << steps[ step ].mTarget << ',' << metrics.mRiseTime << ',' << metrics.mOvershoot << ','
+          << metrics.mSettlingTime << ',' << metrics.mSteadyStateError << ',' << metrics.mIAE << ','
+          << metrics.mISE << ',' << metrics.mITAE << ',' << metrics.mControlEffort << ','
+          << ( metrics.mSettled ? 1 : 0 ) << '\n';
+    }
+  }
+}
+
+//
+// A saved session, ticked through a fresh session as Scenario::run ticks
+// a scenario: a new target ends a step
+//
+Scenario::Result replay( const PidSim::SessionLog& log, PidSim::Telemetry* telemetry, const Scenario::Publisher& publish )
+{
+  Scenario::Result result{ {}, log.getTicks() };
+  PidSim::Session session = log.makeSession();
+  PidSim::SessionLog::Reader reader( log );
+  double stepStart = 0.0;
+  double target = log.getInitialInputs().mTargetAngle;
+  PidSim::Session::Inputs inputs;
+  for ( std::uint64_t tick = 0; reader.next( inputs ); ++tick ) {
+    const double time = static_cast<double>( tick ) * PidSim::Session::timeSlice;
+    if ( inputs.mTargetAngle != target ) {
+      result.mSteps.push_back( { stepStart, target, session.getStepMetrics().getResult() } );
+      stepStart = time;
+      target = inputs.mTargetAngle;
+    }
+    const PidSim::Session::Tick out = session.tick( inputs );
+    if ( telemetry && out.mOut ) {
+      telemetry->record( time, inputs, out.mSensorAngle,
+                         session.getControlLoop().getPhysicsSim().getActualAngle(), *out.mOut );
+    }
+    if ( publish && out.mOut ) {
+      publish( time, inputs, out.mSensorAngle,
+               session.getControlLoop().getPhysicsSim().getActualAngle(), *out.mOut );
+    }
+  }
+  result.mSteps.push_back( { stepStart, target, session.getStepMetrics().getResult() } );
+  return result;
+}
+
+// A session log's scenario name: its file name, less the directory and extension
+std::string replayName( const std::string& path )
+{
+  const std::size_t slash = path.find_last_of( '/' );
+  std::string name = slash == std::string::npos ? path : path.substr( slash + 1 );
+  const std::size_t dot = name.find_last_of( '.' );
+  return dot == 0 || dot == std::string::npos ? name : name.substr( 0, dot );
+}
+
+//
+// --worker: run chunks until the coordinator is done
+//
+int runWorker( const Options& options )
+{
+  std::unique_ptr<PidSim::ResultCache> cache;
+  if ( !options.mCache.empty() ) {
+    cache = std::make_unique<PidSim::ResultCache>( options.mCache );
+    if ( !cache->isOpen() ) {
+      std::cerr << "pidsim_cli: couldn't open " << options.mCache << ", so nothing will be cached\n";
+    }
+  }
+  std::string error;
+  if ( !PidSim::SweepWorker::serve( options.mWorker, error, cache.get() )) {
+    std::cerr << "pidsim_cli: " << error << "\n";
+    return 1;
+  }
+  return 0;
+}
+
+//
+// --sweep
+//
+// 1. Listen, and start any local workers
+// 2. Write each run's swept settings and metrics as the results come in
+// 3. Let the workers go, and report the speed
+//
+int runSweep( const Options& options )
+{
+  // 1. Listen, and start any local workers
+  auto coordinator = std::make_unique<PidSim::SweepCoordinator>( options.mSweep, options.mCoordinator );
+  std::string error;
+  if ( !coordinator->listen( options.mListen, error )) {
+    std::cerr << "pidsim_cli: " << error << "\n";
+    return 1;
+  }
+  std::vector<pid_t> workers;
+  for ( std::size_t worker = 0; worker < options.mLocal; ++worker ) {
+    const pid_t pid = fork();
+    if ( pid == 0 ) {
+      _exit( PidSim::SweepWorker::serve( coordinator->getAddress(), error ) ? 0 : 1 );
+    }
+    workers.push_back( pid );
+  }
+  if ( !options.mQuiet ) {
+    std::cerr << "pidsim_cli: workers can connect to " << coordinator->getAddress() << "\n";
+  }
+
+  // 2. Write each run's swept settings and metrics
+  std::ofstream file;
+  if ( !options.mMetrics.empty() ) {
+    file.open( options.mMetrics );
+  }
+  std::ostream& out = options.mMetrics.empty() ? std::cout : file;
+  out << "run";
+  for ( const std::string& name : options.mAxisNames ) {
+    out << ',' << name;
+  }
+  for ( const char* metric : PidSim::BatchRun::metricNames ) {
+    out << ',' << metric;
+  }
+  out << '\n' << std::setprecision( 10 );
+  const PidSim::ParameterSweep sweep( options.mSweep );
+  const auto start = std::chrono::steady_clock::now();
+  const bool ran = coordinator->run( 0, options.mSweepRuns, [&]( std::uint64_t first,
+                                    const std::vector<PidSim::StepMetrics::Result>& results ) {
+    const std::vector<BatchSim::ArmSettings> arms = sweep.arms( first, results.size() );
+    for ( std::size_t run = 0; run < results.size(); ++run ) {
+      const PidSim::StepMetrics::Result& metrics = results[ run ];
+      out << first + run;
+      for ( const PidSim::ParameterSweep::Axis& axis : options.mSweep.mAxes ) {
+        out << ',' << arms[ run ].*axis.mSetting;
+      }
+      out << ',' << metrics.mRiseTime << ',' << metrics.mOvershoot << ',' << metrics.mSettlingTime << ','
+          << metrics.mSteadyStateError << ',' << metrics.mIAE << ',' << metrics.mISE << ',' << metrics.mITAE << ','
+          << metrics.mControlEffort << ',' << ( metrics.mSettled ? 1 : 0 ) << '\n';
+    }
+  }, error );
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  const bool written = static_cast<bool>( out.flush() );
+
+  // 3. Let the workers go, and report the speed
+  const PidSim::SweepCoordinator::Report report = coordinator->getReport();
+  coordinator.reset();
+  for ( pid_t worker : workers ) {
+    waitpid( worker, nullptr, 0 );
+  }
+  if ( !ran ) {
+    std::cerr << "pidsim_cli: " << error << "\n";
+    return 1;
+  }
+  if ( !written ) {
+    std::cerr << "pidsim_cli: couldn't write the metrics\n";
+    return 1;
+  }
+  if ( !options.mQuiet ) {
+    std::cerr << std::fixed << std::setprecision( 2 ) << options.mSweepRuns << " runs on " << report.mWorkers
+              << " workers in " << elapsed.count() << " s, " << options.mSweepRuns / elapsed.count()
+              << " runs/s.  " << report.mRetried << " chunks retried, " << report.mStolen << " stolen\n";
+  }
+  return 0;
+}
+
+}
+
+//
+// 1. Read every scenario and session log.  Any bad file stops everything,
+//    before the runs start.
+// 2. Run them, tracing and streaming each if asked
+// 3. Write the metrics, in order, and the speed
+//
+int main( int argc, char** argv )
+{
+  Options options;
+  if ( const int exitCode = parseOptions( argc, argv, options )) {
+    return exitCode < 0 ? 0 : exitCode;
+  }
+  if ( !options.mWorker.empty() ) {
+    return runWorker( options );
+  }
+  if ( options.mSweepRuns > 0 ) {
+    return runSweep( options );
+  }
+
+  // 1. Read every scenario and session log
+  std::vector<Scenario> scenarios;
+  for ( const std::string& file : options.mFiles ) {
+    std::string error;
+    if ( !Scenario::load( file, scenarios, error )) {
+      std::cerr << "pidsim_cli: " << error << "\n";
+      return 1;
+    }
+  }
+  std::vector<PidSim::SessionLog> logs;
+  for ( const std::string& file : options.mReplays ) {
+    logs.emplace_back( PidSim::Session::Inputs(), 0 );
+    if ( !logs.back().load( file )) {
+      std::cerr << "pidsim_cli: couldn't read the session log " << file << "\n";
+      return 1;
+    }
+  }
+  std::vector<std::string> names;
+  for ( const Scenario& scenario : scenarios ) {
+    names.push_back( scenario.getName() );
+  }
+  for ( const std::string& file : options.mReplays ) {
+    names.push_back( replayName( file ));
+  }
+  if ( !options.mTraces.empty() ) {
+    std::set<std::string> unique;
+    for ( const std::string& name : names ) {
+      if ( !unique.insert( name ).second ) {
+        std::cerr << "pidsim_cli: two scenarios are named " << name << ", so their traces would collide\n";
+        return 1;
+      }
+    }
+  }
+
+  // 2. Run them
+  std::unique_ptr<PidSim::TelemetryStream> stream;
+  if ( options.mStream >= 0 ) {
+    stream = std::make_unique<PidSim::TelemetryStream>( PidSim::TelemetryStream::Options() );
+    std::string error;
+    if ( !stream->listen( static_cast<unsigned short>( options.mStream ), error )) {
+      std::cerr << "pidsim_cli: " << error << "\n";
+      return 1;
+    }
+    std::cerr << "pidsim_cli: waiting for a subscriber on localhost:" << stream->getPort() << "\n";
+    while ( stream->getStats().empty() ) {
+      std::this_thread::sleep_for( std::chrono::milliseconds( 10 ));
+    }
+  }
+  std::vector<Run> runs( names.size() );
+  const auto start = std::chrono::steady_clock::now();
+  PidSim::Utils::parallelFor( names.size(), [&]( std::size_t index ) {
+    std::unique_ptr<PidSim::Telemetry> telemetry;
+    if ( !options.mTraces.empty() ) {
+      telemetry = std::make_unique<PidSim::Telemetry>( options.mTraces + "/" + names[ index ] + ".trace" );
+    }
+    Scenario::Publisher publish;
+    if ( stream ) {
+      publish = [&stream, index]( double time, const PidSim::Session::Inputs& inputs, double sensorAngle,
+                                  double actualAngle, const PidSim::ControlLoop::Output& out ) {
+        stream->publish( index, time, inputs, sensorAngle, actualAngle, out );
+      };
+    }
+    PidSim::Telemetry* trace = telemetry && telemetry->isOpen() ? telemetry.get() : nullptr;
+    runs[ index ].mResult = index < scenarios.size() ? scenarios[ index ].run( trace, publish )
+                                                     : replay( logs[ index - scenarios.size() ], trace, publish );
+    if ( telemetry ) {
+      runs[ index ].mTraced = telemetry->isOpen() && telemetry->close();
+    }
+  }, options.mJobs );
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  if ( stream ) {
+    stream->drain( 5.0 );
+  }
+
+  // 3. Write the metrics, and the speed
+  bool ok = true;
+  if ( options.mMetrics.empty() ) {
+    writeMetrics( std::cout, names, runs );
+    ok = static_cast<bool>( std::cout.flush() );
+  }
+  else {
+    std::ofstream out( options.mMetrics );
+    writeMetrics( out, names, runs );
+    ok = static_cast<bool>( out.flush() );
+  }
+  if ( !ok ) {
+    std::cerr << "pidsim_cli: couldn't write the metrics\n";
+  }
+  std::uint64_t ticks = 0;
+  for ( std::size_t index = 0; index < runs.size(); ++index ) {
+    ticks += runs[ index ].mResult.mTicks;
+    if ( !runs[ index ].mTraced ) {
+      std::cerr << "pidsim_cli: couldn't write the trace for " << names[ index ] << "\n";
+      ok = false;
+    }
+  }
+  if ( !options.mQuiet ) {
+    std::cerr << std::fixed << std::setprecision( 2 ) << names.size() << " scenarios, " << ticks
+              << " ticks in " << elapsed.count() << " s, " << ticks / elapsed.count() / 1e6 << " M ticks/s\n";
+    const std::vector<PidSim::TelemetryStream::Stats> stats = stream ? stream->getStats()
+                                                                     : std::vector<PidSim::TelemetryStream::Stats>();
+    for ( std::size_t subscriber = 0; subscriber < stats.size(); ++subscriber ) {
+      std::cerr << "subscriber " << subscriber << ": " << stats[ subscriber ].mDelivered << " ticks delivered, "
+                << stats[ subscriber ].mDropped << " dropped, 1 in " << stats[ subscriber ].mDecimation << " kept, "
+                << stats[ subscriber ].mLagRows << " behind\n";
+    }
+  }
+  return ok ? 0 : 1;
+}
+
@@ -0,0 +1,352 @@
+
+//
+// The "pidsim" Python module: BatchRun through the CPython buffer protocol
+//
+//   import numpy as np, pidsim
+//   run = pidsim.simulate( parameters, ticks, seed=0, profile="step", trajectories=True )
+//   angles = np.asarray( run.angles )      # ticks x arms, no copy
+//
+// parameters is anything with a C contiguous, 2D buffer of doubles, one
+// row per arm in pidsim.PARAMETERS order, i.e., a float64 numpy array.
+// The run's angles, setpoints, motor_powers (ticks x arms) and metrics
+// (arms x len( pidsim.METRICS )) are read only buffers over the run's
+// own arrays.  They keep the run alive for as long as they're used.
+//
+// The simulation runs without the GIL, so Python threads can run several
+// batches at once, one per core.  Trajectories are held to
+// maxTrajectorySamples ticks x arms, and anything the run throws comes
+// back as a MemoryError or RuntimeError.
+//
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include "../pidsim/pidsim_backend_batch_run.h"
+#include <climits>
+#include <cstring>
+#include <exception>
+#include <new>
+#include <string>
+#include <vector>
+
+using PidSim::BatchRun;
+
+namespace {
+
+//
+// A finished run
+//
+struct RunObject
+{
+  PyObject_HEAD
+  BatchRun*   mRun;
+};
+
+//
+// A read only 2D view of one of a run's arrays
+//
+struct ArrayObject
+{
+  PyObject_HEAD
+  PyObject*     mOwner;         // The RunObject, kept alive while we are
+  const double* mData;
+  Py_ssize_t    mShape[ 2 ];
+  Py_ssize_t    mStrides[ 2 ];
+};
+
+// Made by PyInit_pidsim
+PyTypeObject* ArrayType = nullptr;
+PyTypeObject* RunType   = nullptr;
+
+// The buffer format for doubles
+char doubleFormat[] = "d";
+
+// Most ticks x arms a run keeps trajectories for.  Each of the three is
+// 8 bytes a sample, so this is 3 GB.
+constexpr unsigned long long maxTrajectorySamples = 1ull << 27;
+
+void arrayDealloc( ArrayObject* self )
+{
+  PyTypeObject* type = Py_TYPE( self );
+  Py_XDECREF( self->mOwner );
+  type->tp_free( reinterpret_cast<PyObject*>( self ));
+  Py_DECREF( type );
+}
+
+int arrayGetBuffer( ArrayObject* self, Py_buffer* view, int flags )
+{
+  if ( flags & PyBUF_WRITABLE ) {
+    PyErr_SetString( PyExc_BufferError, "pidsim results are read only" );
+    return -1;
+  }
+  view->obj         = reinterpret_cast<PyObject*>( self );
+  view->buf         = const_cast<double*>( self->mData );
+  view->len         = self->mShape[ 0 ] * self->mShape[ 1 ] * static_cast<Py_ssize_t>( sizeof( double ));
+  view->readonly    = 1;
+  view->itemsize    = sizeof( double );
+  view->format      = ( flags & PyBUF_FORMAT ) ? doubleFormat : nullptr;
+  view->ndim        = 2;
+  view->shape       = ( flags & PyBUF_ND ) ? self->mShape : nullptr;
+  view->strides     = ( flags & PyBUF_STRIDES ) == PyBUF_STRIDES ? self->mStrides : nullptr;
+  view->suboffsets  = nullptr;
+  view->internal    = nullptr;
+  Py_INCREF( self );
+  return 0;
+}
+
+PyObject* arrayShape( ArrayObject* self, void* )
+{
+  return Py_BuildValue( "(nn)", self->mShape[ 0 ], self->mShape[ 1 ] );
+}
+
+PyGetSetDef arrayGetSet[] = {
+  { "shape", reinterpret_cast<getter>( arrayShape ), nullptr, "(rows, columns)", nullptr },
+  { nullptr, nullptr, nullptr, nullptr, nullptr }
+};
+
+// A view of one of the run's arrays
+PyObject* newArray( RunObject* owner, const std::vector<double>& data, Py_ssize_t rows, Py_ssize_t columns )
+{
+  ArrayObject* array = PyObject_New( ArrayObject, ArrayType );
+  if ( !array ) {
+    return nullptr;
+  }
+  Py_INCREF( owner );
+  array->mOwner       = reinterpret_cast<PyObject*>( owner );
+  array->mData        = data.data();
+  array->mShape[ 0 ]  = rows;
+  array->mShape[ 1 ]  = columns;
+  array->mStrides[ 0 ] = columns * static_cast<Py_ssize_t>( sizeof( double ));
+  array->mStrides[ 1 ] = sizeof( double );
+  return reinterpret_cast<PyObject*>( array );
+}
+
+void runDealloc( RunObject* self )
+{
+  PyTypeObject* type = Py_TYPE( self );
+  delete self->mRun;
+  type->tp_free( reinterpret_cast<PyObject*>( self ));
+  Py_DECREF( type );
+}
+
+// Trajectories are empty unless they were asked for
+PyObject* runTrajectory( RunObject* self, const std::vector<double>& data )
+{
+  const Py_ssize_t arms = static_cast<Py_ssize_t>( self->mRun->size() );
+  return newArray( self, data, data.empty() ? 0 : static_cast<Py_ssize_t>( self->mRun->getTicks() ), arms );
+}
+
+PyObject* runAngles( RunObject* self, void* )       { return runTrajectory( self, self->mRun->getAngles() ); }
+PyObject* runSetpoints( RunObject* self, void* )    { return runTrajectory( self, self->mRun->getSetpoints() ); }
+PyObject* runMotorPowers( RunObject* self, void* )  { return runTrajectory( self, self->mRun->getMotorPowers() ); }
+
+PyObject* runMetrics( RunObject* self, void* )
+{
+  return newArray( self, self->mRun->getMetrics(), static_cast<Py_ssize_t>( self->mRun->size() ),
+                   static_cast<Py_ssize_t>( BatchRun::numMetrics ));
+}
+
+PyObject* runTicks( RunObject* self, void* )  { return PyLong_FromUnsignedLong( self->mRun->getTicks() ); }
+PyObject* runArms( RunObject* self, void* )   { return PyLong_FromSize_t( self->mRun->size() ); }
+
+PyGetSetDef runGetSet[] = {
+  { "angles",       reinterpret_cast<getter>( runAngles ),      nullptr, "Arm angles in radians, ticks x arms", nullptr },
+  { "setpoints",    reinterpret_cast<getter>( runSetpoints ),   nullptr, "Set points in radians, ticks x arms", nullptr },
+  { "motor_powers", reinterpret_cast<getter>( runMotorPowers ), nullptr, "Motor powers, ticks x arms", nullptr },
+  { "metrics",      reinterpret_cast<getter>( runMetrics ),     nullptr, "Step metrics, arms x len( METRICS )", nullptr },
+  { "ticks",        reinterpret_cast<getter>( runTicks ),       nullptr, "Ticks run", nullptr },
+  { "arms",         reinterpret_cast<getter>( runArms ),        nullptr, "Number of arms", nullptr },
+  { nullptr, nullptr, nullptr, nullptr, nullptr }
+};
+
+//
+// An O& converter for ticks: an int from 0 to UINT_MAX.  "I" would wrap
+// -1 and 2**32 around instead of refusing them.
+//
+int parseTicks( PyObject* object, void* out )
+{
+  if ( !PyLong_Check( object )) {
+    PyErr_SetString( PyExc_TypeError, "ticks should be an int" );
+    return 0;
+  }
+  const unsigned long long ticks = PyLong_AsUnsignedLongLong( object );
+  if ( PyErr_Occurred() || ticks > UINT_MAX ) {
+    PyErr_Clear();
+    PyErr_Format( PyExc_ValueError, "ticks should be from 0 to %u", UINT_MAX );
+    return 0;
+  }
+  *static_cast<unsigned*>( out ) = static_cast<unsigned>( ticks );
+  return 1;
+}
+
+// Turn whatever a run threw into a Python exception
+void setError( std::exception_ptr error )
+{
+  try {
+    std::rethrow_exception( error );
+  }
+  catch ( const std::bad_alloc& ) {
+    PyErr_NoMemory();
+  }
+  catch ( const std::exception& exception ) {
+    PyErr_SetString( PyExc_RuntimeError, exception.what() );
+  }
+  catch ( ... ) {
+    PyErr_SetString( PyExc_RuntimeError, "the simulation failed" );
+  }
+}
+
+//
+// 1. Check the arguments and the parameters' buffer
+// 2. Set up the arms, then let go of the parameters
+// 3. Run without the GIL
+//
+PyObject* simulate( PyObject*, PyObject* args, PyObject* kwargs )
+{
+  // 1. Check the arguments and the parameters' buffer
+  static const char* keywords[] = { "parameters", "ticks", "seed", "profile", "trajectories", nullptr };
+  PyObject* parameters = nullptr;
+  unsigned ticks = 0;
+  unsigned long long seed = 0;
+  const char* profileName = "step";
+  int trajectories = 1;
+  if ( !PyArg_ParseTupleAndKeywords( args, kwargs, "OO&|Ksp", const_cast<char**>( keywords ),
+                                     &parameters, parseTicks, &ticks, &seed, &profileName, &trajectories )) {
+    return nullptr;
+  }
+  PidSim::MotionProfile::Type profile;
+  if ( std::strcmp( profileName, "step" ) == 0 ) {
+    profile = PidSim::MotionProfile::Type::Step;
+  }
+  else if ( std::strcmp( profileName, "trapezoidal" ) == 0 ) {
+    profile = PidSim::MotionProfile::Type::Trapezoidal;
+  }
+  else if ( std::strcmp( profileName, "scurve" ) == 0 ) {
+    profile = PidSim::MotionProfile::Type::SCurve;
+  }
+  else {
+    PyErr_SetString( PyExc_ValueError, "profile should be step, trapezoidal or scurve" );
+    return nullptr;
+  }
+
+  Py_buffer view;
+  if ( PyObject_GetBuffer( parameters, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT ) != 0 ) {
+    return nullptr;
+  }
+  const std::string format = view.format ? view.format : "B";
+  if (( format != "d" && format != "=d" && format != "<d" && format != "@d" ) || view.ndim != 2
+      || view.shape[ 1 ] != static_cast<Py_ssize_t>( BatchRun::numParameters )) {
+    PyBuffer_Release( &view );
+    PyErr_Format( PyExc_ValueError, "parameters should be an arms x %zu array of float64",
+                  BatchRun::numParameters );
+    return nullptr;
+  }
+  const double* rows = static_cast<const double*>( view.buf );
+  const std::size_t arms = static_cast<std::size_t>( view.shape[ 0 ] );
+  if ( trajectories && arms > 0 && ticks > maxTrajectorySamples / arms ) {
+    PyBuffer_Release( &view );
+    PyErr_Format( PyExc_ValueError, "trajectories for %u ticks x %zu arms is over %llu samples; "
+                  "run fewer, or with trajectories=False", ticks, arms, maxTrajectorySamples );
+    return nullptr;
+  }
+  for ( std::size_t arm = 0; arm < arms; ++arm ) {
+    std::string error;
+    if ( !BatchRun::checkParameters( rows + arm * BatchRun::numParameters, error )) {
+      PyBuffer_Release( &view );
+      PyErr_Format( PyExc_ValueError, "arm %zu: %s", arm, error.c_str() );
+      return nullptr;
+    }
+  }
+
+  // 2. Set up the arms, then let go of the parameters
+  RunObject* run = PyObject_New( RunObject, RunType );
+  if ( !run ) {
+    PyBuffer_Release( &view );
+    return nullptr;
+  }
+  run->mRun = nullptr;
+  std::exception_ptr error;
+  try {
+    run->mRun = new BatchRun( rows, arms, profile, seed );
+  }
+  catch ( ... ) {
+    error = std::current_exception();
+  }
+  PyBuffer_Release( &view );
+
+  // 3. Run without the GIL.  Nothing else can see the run yet.
+  if ( !error ) {
+    Py_BEGIN_ALLOW_THREADS
+    try {
+      run->mRun->run( ticks, trajectories != 0 );
+    }
+    catch ( ... ) {
+      error = std::current_exception();
+    }
+    Py_END_ALLOW_THREADS
+  }
+  if ( error ) {
+    setError( error );
+    Py_DECREF( run );
+    return nullptr;
+  }
+  return reinterpret_cast<PyObject*>( run );
+}
+
+PyMethodDef methods[] = {
+  { "simulate", reinterpret_cast<PyCFunction>( reinterpret_cast<void(*)()>( simulate )), METH_VARARGS | METH_KEYWORDS,
+    "simulate(parameters, ticks, seed=0, profile='step', trajectories=True)\n\n"
+    "Run a batch of arms, one per row of parameters, for ticks ticks of 1/50 s." },
+  { nullptr, nullptr, 0, nullptr }
+};
+
+PyModuleDef module = {
+  PyModuleDef_HEAD_INIT, "pidsim", "Batches of PID controlled robot arms, with zero copy results",
+  -1, methods, nullptr, nullptr, nullptr, nullptr
+};
+
+// A tuple of column names
+PyObject* names( const char* const* names, std::size_t count )
+{
+  PyObject* tuple = PyTuple_New( static_cast<Py_ssize_t>( count ));
+  for ( std::size_t index = 0; tuple && index < count; ++index ) {
+    PyTuple_SET_ITEM( tuple, static_cast<Py_ssize_t>( index ), PyUnicode_FromString( names[ index ] ));
+  }
+  return tuple;
+}
+
+}
+
+PyMODINIT_FUNC PyInit_pidsim()
+{
+  PyType_Slot arraySlots[] = {
+    { Py_tp_doc,        const_cast<char*>( "A read only view of a run's results, for numpy.asarray or memoryview" ) },
+    { Py_tp_dealloc,    reinterpret_cast<void*>( arrayDealloc ) },
+    { Py_tp_getset,     arrayGetSet },
+    { Py_bf_getbuffer,  reinterpret_cast<void*>( arrayGetBuffer ) },
+    { 0, nullptr }
+  };
+  PyType_Slot runSlots[] = {
+    { Py_tp_doc,        const_cast<char*>( "A finished batch of arms, from pidsim.simulate" ) },
+    { Py_tp_dealloc,    reinterpret_cast<void*>( runDealloc ) },
+    { Py_tp_getset,     runGetSet },
+    { 0, nullptr }
+  };
+  PyType_Spec arraySpec = { "pidsim.Array", sizeof( ArrayObject ), 0, Py_TPFLAGS_DEFAULT, arraySlots };
+  PyType_Spec runSpec   = { "pidsim.Run",   sizeof( RunObject ),   0, Py_TPFLAGS_DEFAULT, runSlots };
+  ArrayType = reinterpret_cast<PyTypeObject*>( PyType_FromSpec( &arraySpec ));
+  RunType   = reinterpret_cast<PyTypeObject*>( PyType_FromSpec( &runSpec ));
+  if ( !ArrayType || !RunType ) {
+    return nullptr;
+  }
+  PyObject* pidsim = PyModule_Create( &module );
+  if ( !pidsim ) {
+    return nullptr;
+  }
+  if ( PyModule_AddObject( pidsim, "PARAMETERS", names( BatchRun::parameterNames, BatchRun::numParameters )) < 0
+    || PyModule_AddObject( pidsim, "METRICS", names( BatchRun::metricNames, BatchRun::numMetrics )) < 0
+    || PyModule_AddObject( pidsim, "MAX_DELAY", PyFloat_FromDouble( BatchRun::maxDelay )) < 0 ) {
+    Py_DECREF( pidsim );
+    return nullptr;
+  }
+  return pidsim;
+}
+
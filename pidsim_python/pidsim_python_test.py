@@ -0,0 +1,71 @@
+#
+# Checks the pidsim module's results are the zero copy, read only views
+# the module promises, and that bad arguments are refused.  Needs the
+# built module on PYTHONPATH; ctest sets that up.
+#
+import array
+import gc
+import unittest
+
+import pidsim
+
+
+# A batch of arms, as the 2D float64 buffer simulate wants, without numpy
+def parameters(arms, **settings):
+    row = [float(settings.get(name, 0.0)) for name in pidsim.PARAMETERS]
+    return memoryview(array.array("d", row * arms)).cast("B").cast("d", [arms, len(row)])
+
+
+class SimulateTest(unittest.TestCase):
+
+    def test_shapes(self):
+        run = pidsim.simulate(parameters(3, p=5.0, d=1.0), 100)
+        self.assertEqual((run.ticks, run.arms), (100, 3))
+        for array in (run.angles, run.setpoints, run.motor_powers):
+            view = memoryview(array)
+            self.assertEqual(view.shape, (100, 3))
+            self.assertEqual(view.format, "d")
+            self.assertEqual(view.shape, array.shape)
+        self.assertEqual(memoryview(run.metrics).shape, (3, len(pidsim.METRICS)))
+
+        # No trajectories, no rows
+        run = pidsim.simulate(parameters(3), 100, trajectories=False)
+        self.assertEqual(memoryview(run.angles).shape, (0, 3))
+
+    def test_read_only(self):
+        run = pidsim.simulate(parameters(2, p=5.0), 10)
+        view = memoryview(run.angles)
+        self.assertTrue(view.readonly)
+        with self.assertRaises(TypeError):
+            view[0, 0] = 1.0
+
+    def test_views_keep_the_run(self):
+        run = pidsim.simulate(parameters(2, p=5.0), 50)
+        view = memoryview(run.angles)
+        before = view.tolist()
+        del run
+        gc.collect()
+        pidsim.simulate(parameters(2, p=7.0), 50)
+        self.assertEqual(view.tolist(), before)
+        view.release()
+
+    def test_bad_ticks(self):
+        for ticks in (-1, 2 ** 32, 2 ** 70):
+            with self.assertRaises(ValueError):
+                pidsim.simulate(parameters(1), ticks)
+        with self.assertRaises(TypeError):
+            pidsim.simulate(parameters(1), 1.5)
+
+    def test_too_many_samples(self):
+        with self.assertRaises(ValueError):
+            pidsim.simulate(parameters(4), 2 ** 31)
+
+    def test_bad_parameters(self):
+        with self.assertRaises(ValueError):
+            pidsim.simulate(parameters(1, sensor_delay=-1.0), 10)
+        with self.assertRaises(ValueError):
+            pidsim.simulate(memoryview(array.array("d", [0.0] * 3)), 10)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+#include "../pidsim/pidsim_backend_autotune.h"
+#include "../pidsim/pidsim_backend_stability_map.h"
+
+using PidSim::ControlLoop;
+using PidSim::RelayAutotuner;
+using PidSim::StabilityMap;
+
+static ControlLoop testLoop( double sensorDelay, double noise )
+{
+  ControlLoop loop( PidSim::Utils::degToRad( -90 ), PidSim::defaultProfileLimits );
+  loop.setRollingFriction( 0.004 );
+  loop.getPhysicsSim().setSensorDelay( sensorDelay );
+  loop.getPhysicsSim().setMotorDelay( 20.0 );
+  loop.getPhysicsSim().setSensorNoise( noise );
+  return loop;
+}
+
+static StabilityMap::Settings linearSettings( double sensorDelay, double target )
+{
+  StabilityMap::Settings settings;
+  settings.mRollingFriction = 0.004;
+  settings.mSensorDelay     = sensorDelay;
+  settings.mMotorDelay      = 20.0;
+  settings.mTargetAngle     = target;
+  return settings;
+}
+
+static bool isStable( const StabilityMap::Settings& base, const RelayAutotuner::Gains& gains )
+{
+  StabilityMap::Settings settings = base;
+  settings.mPlane     = StabilityMap::Plane::KpKd;
+  settings.mFixedGain = gains.mPidI;
+  return StabilityMap::analyze( settings, gains.mPidP, gains.mPidD ).mSpectralRadius < 1.0;
+}
+
+//
+// The relay's ultimate gain is close to where the linearized loop, with
+// only P control, goes unstable.  The describing function is only an
+// approximation, so "close" is within 25%.
+//
+TEST( AUTOTUNE, finds_the_ultimate_gain )
+{
+  RelayAutotuner tuner( testLoop( 40.0, 0.0 ), 0.0, 0.0 );
+  ASSERT_TRUE( tuner.run( 100000 ));
+  const RelayAutotuner::Result& result = tuner.getResult();
+  ASSERT_TRUE( result.mSuccess );
+
+  const StabilityMap::Settings settings = linearSettings( 40.0, 0.0 );
+  double stable = 0.01, unstable = 20.0;
+  for ( int i = 0; i < 40; ++i ) {
+    const double kp = ( stable + unstable ) / 2.0;
+    ( StabilityMap::analyze( settings, kp, 0.0 ).mSpectralRadius < 1.0 ? stable : unstable ) = kp;
+  }
+  ASSERT_NEAR( stable, result.mUltimateGain, 0.25 * stable );
+  ASSERT_GT( result.mUltimatePeriod, 1.0 );
+  ASSERT_LT( result.mUltimatePeriod, 10.0 );
+}
+
+//
+// Both tuning rules give gains that hold the arm steady, with and without
+// noise and delay.
+//
+TEST( AUTOTUNE, proposed_gains_are_stable )
+{
+  for ( double delay : { 0.0, 40.0, 100.0 } ) {
+    for ( double target : { 0.0, -0.5 } ) {
+      RelayAutotuner tuner( testLoop( delay, 0.0 ), target, 0.0 );
+      ASSERT_TRUE( tuner.run( 100000 ));
+      const RelayAutotuner::Result& result = tuner.getResult();
+      ASSERT_TRUE( result.mSuccess ) << delay << " " << target;
+      ASSERT_TRUE( isStable( linearSettings( delay, target ), result.mZieglerNichols )) << delay << " " << target;
+      ASSERT_TRUE( isStable( linearSettings( delay, target ), result.mTyreusLuyben )) << delay << " " << target;
+      ASSERT_GT( result.mZieglerNichols.mPidP, result.mTyreusLuyben.mPidP );
+    }
+  }
+
+  RelayAutotuner noisy( testLoop( 40.0, 1.0 ), -0.5, 1.0 );
+  ASSERT_TRUE( noisy.run( 100000 ));
+  ASSERT_TRUE( noisy.getResult().mSuccess );
+}
+
+//
+// An arm that can't hold a steady oscillation reports failure, rather
+// than making gains up.
+//
+TEST( AUTOTUNE, reports_failure )
+{
+  RelayAutotuner tuner( testLoop( 100.0, 0.0 ), 0.5, 0.0 );
+  ASSERT_TRUE( tuner.run( 100000 ));
+  ASSERT_FALSE( tuner.getResult().mSuccess );
+  ASSERT_LE( tuner.getResult().mSimulatedTime, RelayAutotuner::maxTime + 0.1 );
+}
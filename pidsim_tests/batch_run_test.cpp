@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+#include <math.h>
+#include "../pidsim/pidsim_backend_batch_run.h"
+#include "../pidsim/pidsim_utils.h"
+
+using PidSim::BatchRun;
+using PidSim::BatchSim;
+
+namespace {
+
+// A row of parameters per arm, as a binding would pass them
+std::vector<double> testParameters( std::size_t arms )
+{
+  std::vector<double> parameters;
+  for ( std::size_t arm = 0; arm < arms; ++arm ) {
+    const double row[ BatchRun::numParameters ] = {
+      1.0 + arm * 0.25, 0.1 * ( arm % 5 ), 0.2 * ( arm % 4 ),
+      PidSim::Utils::degToRad( -90 ), PidSim::Utils::degToRad( arm % 12 * 10.0 - 30.0 ),
+      0.01 * ( arm % 3 ), 0.5 * ( arm % 2 ), 20.0 * ( arm % 5 ), 40.0 * ( arm % 3 )
+    };
+    parameters.insert( parameters.end(), row, row + BatchRun::numParameters );
+  }
+  return parameters;
+}
+
+}
+
+//
+// The flat arrays are BatchSim's results, laid out as documented
+//
+TEST( BATCH_RUN, matches_batch_sim )
+{
+  constexpr std::size_t arms = 13;
+  constexpr unsigned ticks = 300;
+  const std::vector<double> parameters = testParameters( arms );
+  BatchRun run( parameters.data(), arms, PidSim::MotionProfile::Type::Trapezoidal, 5 );
+  run.run( ticks, true );
+  ASSERT_EQ( ticks, run.getTicks() );
+  ASSERT_EQ( ticks * arms, run.getAngles().size() );
+  ASSERT_EQ( arms * BatchRun::numMetrics, run.getMetrics().size() );
+
+  std::vector<BatchSim::ArmSettings> settings( arms );
+  for ( std::size_t arm = 0; arm < arms; ++arm ) {
+    const double* row = &parameters[ arm * BatchRun::numParameters ];
+    settings[ arm ] = { row[ 0 ], row[ 1 ], row[ 2 ], row[ 3 ], row[ 4 ], row[ 5 ], row[ 6 ], row[ 7 ], row[ 8 ],
+                        PidSim::MotionProfile::Type::Trapezoidal };
+  }
+  BatchSim sim( settings, 5 );
+  for ( unsigned tick = 0; tick < ticks; ++tick ) {
+    sim.run( 1 );
+    for ( std::size_t arm = 0; arm < arms; ++arm ) {
+      ASSERT_EQ( sim.getActualAngles()[ arm ], run.getAngles()[ tick * arms + arm ] );
+      ASSERT_EQ( sim.getSetpoints()[ arm ],    run.getSetpoints()[ tick * arms + arm ] );
+      ASSERT_EQ( sim.getMotorPowers()[ arm ],  run.getMotorPowers()[ tick * arms + arm ] );
+    }
+  }
+  for ( std::size_t arm = 0; arm < arms; ++arm ) {
+    const PidSim::StepMetrics::Result metrics = sim.getMetrics( arm );
+    const double* row = &run.getMetrics()[ arm * BatchRun::numMetrics ];
+    ASSERT_EQ( metrics.mRiseTime,       row[ 0 ] );
+    ASSERT_EQ( metrics.mIAE,            row[ 4 ] );
+    ASSERT_EQ( metrics.mControlEffort,  row[ 7 ] );
+    ASSERT_EQ( metrics.mSettled ? 1.0 : 0.0, row[ 8 ] );
+  }
+
+  // Without trajectories, only the metrics are kept, and they're the same
+  BatchRun metricsOnly( parameters.data(), arms, PidSim::MotionProfile::Type::Trapezoidal, 5 );
+  metricsOnly.run( ticks, false );
+  ASSERT_TRUE( metricsOnly.getAngles().empty() );
+  ASSERT_EQ( run.getMetrics(), metricsOnly.getMetrics() );
+}
+
+TEST( BATCH_RUN, bad_parameters_are_caught )
+{
+  std::vector<double> row = testParameters( 1 );
+  std::string error;
+  ASSERT_TRUE( BatchRun::checkParameters( row.data(), error ));
+
+  row[ 1 ] = NAN;
+  ASSERT_FALSE( BatchRun::checkParameters( row.data(), error ));
+  ASSERT_EQ( "i isn't finite", error );
+
+  row = testParameters( 1 );
+  row[ 8 ] = BatchRun::maxDelay;
+  ASSERT_FALSE( BatchRun::checkParameters( row.data(), error ));
+  ASSERT_EQ( "motor_delay has to be at least 0 and under 320 ms", error );
+  row[ 8 ] = BatchRun::maxDelay - 0.001;
+  ASSERT_TRUE( BatchRun::checkParameters( row.data(), error ));
+
+  ASSERT_FALSE( BatchRun::checkParameter( 5, 1.0, error ));
+  ASSERT_EQ( "rolling_friction has to be at least 0 and under 1", error );
+  ASSERT_FALSE( BatchRun::checkParameter( 6, -0.5, error ));
+  ASSERT_EQ( "sensor_noise can't be negative", error );
+  ASSERT_FALSE( BatchRun::checkParameter( 7, -100.0, error ));
+  ASSERT_EQ( "sensor_delay has to be at least 0 and under 320 ms", error );
+  ASSERT_TRUE( BatchRun::checkParameter( 0, -3.0, error ));
+}
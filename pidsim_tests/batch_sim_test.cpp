@@ -0,0 +1,122 @@
+#include <gtest/gtest.h>
+#include "../pidsim/pidsim_backend_batch_sim.h"
+#include "../pidsim/pidsim_backend_motion_profile.h"
+#include "../pidsim/pidsim_backend_physics_sim.h"
+#include "../pidsim/pidsim_backend_pid_controller.h"
+
+using PidSim::BatchSim;
+using PidSim::MotionProfile;
+
+//
+// Run one arm the way BackEnd does, with PhysicsSim & PidController.
+// Returns the angle after every tick.
+//
+static std::vector<double> runScalar( const BatchSim::ArmSettings& settings, unsigned ticks )
+{
+  using namespace PidSim;
+  PhysicsSim          sim( settings.mStartAngle );
+  PidController       pid;
+  SetpointGenerator   setpoint( settings.mStartAngle, settings.mProfileLimits );
+  sim.setSensorNoise( settings.mSensorNoise );
+  sim.setSensorDelay( settings.mSensorDelay );
+  sim.setMotorDelay( settings.mMotorDelay );
+  setpoint.updateTarget( settings.mTargetAngle, settings.mProfileType );
+
+  std::vector<double> angles;
+  for ( unsigned tick = 0; tick < ticks; ++tick ) {
+    pid.updatePidSettings( settings.mPidP, settings.mPidI, settings.mPidD,
+                           setpoint.update( BatchSim::timeSlice ));
+    const auto out = pid.updatePidController( BatchSim::timeSlice, sim.getSensorAngle() );
+    sim.startSimulationIteration();
+    sim.applyGravity();
+    sim.applyMotor( out.mMotorPower, BatchSim::timeSlice );
+    sim.updateAngleVel( BatchSim::timeSlice );
+    sim.applyFriction( settings.mRollingFriction );
+    sim.updateAngle( BatchSim::timeSlice );
+    sim.imposePositionHardLimits();
+    sim.endSimulationIteration();
+    angles.push_back( sim.getActualAngle() );
+  }
+  return angles;
+}
+
+static std::vector<BatchSim::ArmSettings> testArms()
+{
+  std::vector<BatchSim::ArmSettings> arms;
+  for ( int i = 0; i < 12; ++i ) {
+    BatchSim::ArmSettings arm;
+    arm.mPidP             = 1.0 + i * 0.5;
+    arm.mPidI             = 0.1 * i;
+    arm.mPidD             = 0.2 * ( i % 4 );
+    arm.mStartAngle       = PidSim::Utils::degToRad( -90 );
+    arm.mTargetAngle      = PidSim::Utils::degToRad( i * 10 - 30 );
+    arm.mRollingFriction  = 0.01 * ( i % 3 );
+    arm.mSensorDelay      = 20.0 * ( i % 5 );
+    arm.mMotorDelay       = 40.0 * ( i % 3 );
+    arm.mProfileType      = static_cast<MotionProfile::Type>( i % 3 );
+    arms.push_back( arm );
+  }
+  return arms;
+}
+
+//
+// With no noise each arm in the batch matches the scalar simulation exactly.
+//
+TEST( BATCH_SIM, matches_scalar_simulation )
+{
+  const auto arms = testArms();
+  constexpr unsigned ticks = 300;
+
+  BatchSim batch( arms );
+  std::vector<std::vector<double>> batchAngles( arms.size() );
+  for ( unsigned tick = 0; tick < ticks; ++tick ) {
+    batch.run( 1 );
+    for ( std::size_t arm = 0; arm < arms.size(); ++arm ) {
+      batchAngles[ arm ].push_back( batch.getActualAngles()[ arm ] );
+    }
+  }
+
+  for ( std::size_t arm = 0; arm < arms.size(); ++arm ) {
+    const auto scalarAngles = runScalar( arms[ arm ], ticks );
+    for ( unsigned tick = 0; tick < ticks; ++tick ) {
+      ASSERT_EQ( scalarAngles[ tick ], batchAngles[ arm ][ tick ] ) << "arm " << arm << " tick " << tick;
+    }
+  }
+}
+
+//
+// Noise is reproducible from the seed.
+//
+TEST( BATCH_SIM, noise_is_seeded )
+{
+  auto arms = testArms();
+  for ( auto& arm : arms ) { arm.mSensorNoise = 1.0; }
+
+  BatchSim a( arms, 7 ), b( arms, 7 ), c( arms, 8 );
+  a.run( 100 );
+  b.run( 100 );
+  c.run( 100 );
+  ASSERT_EQ( a.getActualAngles(), b.getActualAngles() );
+  ASSERT_NE( a.getActualAngles(), c.getActualAngles() );
+}
+
+//
+// Arms on the same noise stream see the same noise, wherever they are in
+// the batch.
+//
+TEST( BATCH_SIM, shared_noise_stream )
+{
+  auto arms = testArms();
+  for ( auto& arm : arms ) {
+    arm = arms[ 0 ];
+    arm.mSensorNoise = 1.0;
+    arm.mNoiseStream = 3;
+  }
+
+  BatchSim shared( arms, 7 ), alone( { arms[ 0 ] }, 7 );
+  shared.run( 100 );
+  alone.run( 100 );
+  for ( double angle : shared.getActualAngles() ) {
+    ASSERT_EQ( alone.getActualAngles()[ 0 ], angle );
+  }
+}
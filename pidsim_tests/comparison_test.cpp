@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include <math.h>
+#include "../pidsim/pidsim_backend_comparison.h"
+
+using PidSim::GainComparison;
+
+//
+// Two similar gain sets on a noisy arm - the case where telling them
+// apart takes precision.
+//
+static GainComparison::Settings testSettings( GainComparison::Mode mode )
+{
+  GainComparison::Settings settings;
+  settings.mArm.mStartAngle       = PidSim::Utils::degToRad( -90 );
+  settings.mArm.mRollingFriction  = 0.004;
+  settings.mArm.mSensorNoise      = 2.0;
+  settings.mArm.mSensorDelay      = 40.0;
+  settings.mArm.mMotorDelay       = 20.0;
+  settings.mGainsA                = { 3.46, 2.29, 0.86 };
+  settings.mGainsB                = { 3.6, 2.2, 0.9 };
+  settings.mMode                  = mode;
+  settings.mSimulations           = 2048;
+  return settings;
+}
+
+//
+// Sharing the noise cuts the variance of the difference by over 10x for
+// the same number of simulations, i.e., 10x fewer simulations for the
+// same interval.
+//
+TEST( COMPARISON, common_noise_reduces_variance )
+{
+  const auto independent  = GainComparison::compare( testSettings( GainComparison::Mode::Independent ));
+  const auto common       = GainComparison::compare( testSettings( GainComparison::Mode::Common ));
+  const auto antithetic   = GainComparison::compare( testSettings( GainComparison::Mode::Antithetic ));
+
+  for ( const auto& report : { independent, common, antithetic } ) {
+    ASSERT_EQ( 2048u, report.mSimulations );
+    ASSERT_LT( report.mLower, report.mMeanDifference );
+    ASSERT_GT( report.mUpper, report.mMeanDifference );
+    ASSERT_NEAR( report.mMeanB - report.mMeanA, report.mMeanDifference, 1e-12 );
+  }
+  ASSERT_EQ( 1024u, independent.mSamples );
+  ASSERT_EQ( 512u, antithetic.mSamples );
+
+  const double independentVariance = independent.mStandardError * independent.mStandardError;
+  ASSERT_GT( independentVariance, 10.0 * common.mStandardError * common.mStandardError );
+  ASSERT_GT( independentVariance, 10.0 * antithetic.mStandardError * antithetic.mStandardError );
+  ASSERT_LT( antithetic.mStandardError, common.mStandardError );
+
+  // They all estimate the same thing.  B is a bit worse.
+  const double combined = sqrt( independentVariance + antithetic.mStandardError * antithetic.mStandardError );
+  ASSERT_NEAR( independent.mMeanDifference, antithetic.mMeanDifference, 4.0 * combined );
+  ASSERT_GT( antithetic.mLower, 0.0 );
+}
+
+//
+// Same settings, same answer.  A gain set compared with itself on
+// common noise is exactly even.
+//
+TEST( COMPARISON, deterministic )
+{
+  const auto a = GainComparison::compare( testSettings( GainComparison::Mode::Antithetic ));
+  const auto b = GainComparison::compare( testSettings( GainComparison::Mode::Antithetic ));
+  ASSERT_EQ( a.mMeanDifference, b.mMeanDifference );
+  ASSERT_EQ( a.mStandardError, b.mStandardError );
+
+  auto settings = testSettings( GainComparison::Mode::Common );
+  settings.mGainsB = settings.mGainsA;
+  const auto same = GainComparison::compare( settings );
+  ASSERT_EQ( 0.0, same.mMeanDifference );
+  ASSERT_EQ( 0.0, same.mStandardError );
+}
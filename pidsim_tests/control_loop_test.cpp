@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+#include "../pidsim/pidsim_backend_control_loop.h"
+
+using PidSim::ControlLoop;
+
+static constexpr double timeSlice = 1.0 / 50.0;
+
+static ControlLoop testLoop()
+{
+  ControlLoop loop( PidSim::Utils::degToRad( -90 ), PidSim::defaultProfileLimits );
+  loop.setRollingFriction( 0.004 );
+  loop.getPhysicsSim().setSensorDelay( 40.0 );
+  loop.getPhysicsSim().setMotorDelay( 20.0 );
+  loop.getSetpointGenerator().updateTarget( 0.0, PidSim::MotionProfile::Type::Step );
+  return loop;
+}
+
+//
+// With no noise a prediction is exactly what the live loop goes on to do,
+// delays, integral and all.
+//
+TEST( CONTROL_LOOP, prediction_matches_the_live_loop )
+{
+  ControlLoop loop = testLoop();
+  for ( int tick = 0; tick < 60; ++tick ) {
+    loop.tick( timeSlice, 3.0, 0.5, 1.0 );
+  }
+
+  const ControlLoop::Prediction prediction = loop.predict( timeSlice, 250, 6.0, 1.0, 1.5 );
+  ASSERT_EQ( 250u, prediction.mAngles.size() );
+  for ( std::size_t tick = 0; tick < prediction.mAngles.size(); ++tick ) {
+    const ControlLoop::Output out = loop.tick( timeSlice, 6.0, 1.0, 1.5 );
+    ASSERT_EQ( prediction.mAngles[ tick ], loop.getPhysicsSim().getActualAngle() );
+    ASSERT_EQ( prediction.mSetpoints[ tick ], out.mSetpoint );
+  }
+}
+
+//
+// Predicting doesn't touch the live loop, and with noise on it doesn't
+// move the live loop's noise along either.
+//
+TEST( CONTROL_LOOP, prediction_leaves_the_live_loop_alone )
+{
+  ControlLoop a = testLoop(), b = testLoop();
+  a.getPhysicsSim().setSensorNoise( 2.0 );
+  b.getPhysicsSim().setSensorNoise( 2.0 );
+
+  for ( int tick = 0; tick < 100; ++tick ) {
+    a.tick( timeSlice, 4.0, 0.0, 1.0 );
+  }
+  for ( int tick = 0; tick < 100; ++tick ) {
+    b.tick( timeSlice, 4.0, 0.0, 1.0 );
+    if ( tick % 10 == 0 ) {
+      (void) b.predict( timeSlice, 250, 8.0, 2.0, 0.5 );
+    }
+  }
+  ASSERT_EQ( a.getPhysicsSim().getActualAngle(), b.getPhysicsSim().getActualAngle() );
+}
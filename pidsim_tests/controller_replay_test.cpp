@@ -0,0 +1,207 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <unistd.h>
+#include "../pidsim/pidsim_backend_controller_replay.h"
+#include "../pidsim/pidsim_backend_control_loop.h"
+#include "../pidsim/pidsim_backend_telemetry.h"
+#include "../pidsim/pidsim_backend_trace.h"
+#include "../pidsim/pidsim_utils.h"
+
+using PidSim::ControlLoop;
+using PidSim::ControllerReplay;
+using PidSim::GainSchedule;
+using PidSim::Session;
+using PidSim::Telemetry;
+using PidSim::TraceReader;
+
+namespace {
+
+constexpr double liveP = 2.0;
+constexpr double liveI = 0.5;
+constexpr double liveD = 0.4;
+
+//
+// Record a noisy, delayed arm run by a PID controller, moving the target
+// every few seconds
+//
+ControllerReplay::Recording recordArm( unsigned ticks, Telemetry* telemetry = nullptr )
+{
+  ControlLoop loop( PidSim::Utils::degToRad( -60.0 ), PidSim::defaultProfileLimits );
+  PidSim::PhysicsSim& physicsSim = loop.getPhysicsSim();
+  physicsSim.setNoiseSeed( 17 );
+  physicsSim.setSensorNoise( 1.0 );
+  physicsSim.setSensorDelay( 40.0 );
+  physicsSim.setMotorDelay( 20.0 );
+  Session::Inputs inputs;
+  inputs.mP = liveP;
+  inputs.mI = liveI;
+  inputs.mD = liveD;
+  inputs.mSensorNoise = 1.0;
+  inputs.mSensorDelay = 40.0;
+  inputs.mMotorDelay  = 20.0;
+
+  ControllerReplay::Recording recording;
+  for ( unsigned tick = 0; tick < ticks; ++tick ) {
+    inputs.mTargetAngle = ( tick / 200 ) % 2 ? 80.0 : -20.0;
+    loop.getSetpointGenerator().updateTarget( PidSim::Utils::degToRad( inputs.mTargetAngle ), PidSim::MotionProfile::Type::Step );
+    const double sensorAngle = physicsSim.getSensorAngle();
+    const ControlLoop::Output out = loop.tick( Session::timeSlice, liveP, liveI, liveD );
+    recording.mSensorAngles.push_back( sensorAngle );
+    recording.mSetpoints.push_back( out.mSetpoint );
+    recording.mMotorPowers.push_back( out.mPid.mMotorPower );
+    if ( telemetry ) {
+      telemetry->record( tick * Session::timeSlice, inputs, sensorAngle, physicsSim.getActualAngle(), out );
+    }
+  }
+  return recording;
+}
+
+std::vector<ControllerReplay::Gains> someVariants()
+{
+  std::vector<ControllerReplay::Gains> variants;
+  for ( double p : { 0.5, 2.0, 8.0 } ) {
+    for ( double i : { 0.0, 0.5 } ) {
+      for ( double d : { 0.0, 0.4, 1.5 } ) {
+        variants.push_back( { p, i, d } );
+      }
+    }
+  }
+  return variants;
+}
+
+}
+
+//
+// Replaying what the live controller read gives back what it commanded,
+// bit for bit
+//
+TEST( CONTROLLER_REPLAY, replay_matches_the_live_controller )
+{
+  const ControllerReplay::Recording recording = recordArm( 1000 );
+  const std::vector<PidSim::PidController::Output> outputs = ControllerReplay::replay( recording, liveP, liveI, liveD );
+  ASSERT_EQ( 1000u, outputs.size() );
+  for ( std::size_t tick = 0; tick < outputs.size(); ++tick ) {
+    ASSERT_EQ( recording.mMotorPowers[ tick ], outputs[ tick ].mMotorPower );
+  }
+
+  ControllerReplay batch( { { 1.0, 0.0, 0.0 }, { liveP, liveI, liveD } } );
+  batch.run( recording );
+  ASSERT_GT( batch.getResult( 0 ).mRmsDifference, 0.01 );
+  ASSERT_EQ( 0.0, batch.getResult( 1 ).mRmsDifference );
+  ASSERT_EQ( 0.0, batch.getResult( 1 ).mMaxDifference );
+}
+
+//
+// Every variant in the batch matches running it on its own, with and
+// without a gain schedule
+//
+TEST( CONTROLLER_REPLAY, batch_matches_one_at_a_time )
+{
+  const ControllerReplay::Recording recording = recordArm( 800 );
+  const std::vector<ControllerReplay::Gains> variants = someVariants();
+  const GainSchedule schedule( {{ 0.0, { 1.5, 1.0, 1.5 }}, { PidSim::Utils::degToRad( 90 ), { 0.5, 1.0, 0.5 }}} );
+
+  for ( const GainSchedule* scheduled : { static_cast<const GainSchedule*>( nullptr ), &schedule } ) {
+    ControllerReplay batch( variants );
+    if ( scheduled ) {
+      batch.setGainSchedule( *scheduled );
+    }
+    std::vector<double> powers;
+    batch.run( recording, &powers );
+    ASSERT_EQ( recording.mSensorAngles.size() * variants.size(), powers.size() );
+
+    for ( std::size_t variant = 0; variant < variants.size(); ++variant ) {
+      const ControllerReplay::Gains& gains = variants[ variant ];
+      const std::vector<PidSim::PidController::Output> outputs =
+        ControllerReplay::replay( recording, gains.mPidP, gains.mPidI, gains.mPidD, scheduled );
+      double sumSquared = 0.0, maxDifference = 0.0;
+      std::size_t saturated = 0;
+      for ( std::size_t tick = 0; tick < outputs.size(); ++tick ) {
+        const double power = outputs[ tick ].mMotorPower;
+        ASSERT_EQ( power, powers[ tick * variants.size() + variant ] );
+        sumSquared += power * power;
+        maxDifference = std::max( maxDifference, std::abs( power - recording.mMotorPowers[ tick ] ));
+        saturated += std::abs( power ) == 0.8 ? 1 : 0;
+      }
+      const ControllerReplay::Result result = batch.getResult( variant );
+      ASSERT_NEAR( sqrt( sumSquared / outputs.size() ), result.mRmsPower, 1e-12 );
+      ASSERT_EQ( maxDifference, result.mMaxDifference );
+      ASSERT_EQ( maxDifference, std::abs( outputs[ result.mMaxDifferenceTick ].mMotorPower
+                                          - recording.mMotorPowers[ result.mMaxDifferenceTick ] ));
+      ASSERT_EQ( saturated, result.mSaturatedTicks );
+    }
+  }
+}
+
+//
+// With duals, the replay gives the motor power's slope with respect to
+// the gains
+//
+TEST( CONTROLLER_REPLAY, duals_give_gain_sensitivity )
+{
+  using Dual = PidSim::Utils::Dual<3>;
+  const ControllerReplay::Recording recording = recordArm( 300 );
+  const std::vector<PidSim::BasicPidController<Dual>::Output> outputs = ControllerReplay::replay(
+    recording, Dual::variable( 0.3, 0 ), Dual::variable( 0.1, 1 ), Dual::variable( 0.05, 2 ));
+
+  constexpr double step = 1e-6;
+  const std::array<std::vector<PidSim::PidController::Output>, 3> nudged = {
+    ControllerReplay::replay( recording, 0.3 + step, 0.1, 0.05 ),
+    ControllerReplay::replay( recording, 0.3, 0.1 + step, 0.05 ),
+    ControllerReplay::replay( recording, 0.3, 0.1, 0.05 + step ),
+  };
+  const std::vector<PidSim::PidController::Output> base = ControllerReplay::replay( recording, 0.3, 0.1, 0.05 );
+  unsigned checked = 0;
+  for ( std::size_t tick = 1; tick < outputs.size(); ++tick ) {
+    ASSERT_EQ( base[ tick ].mMotorPower, outputs[ tick ].mMotorPower.mValue );
+    if ( std::abs( base[ tick ].mMotorPower ) > 0.79 ) {
+      continue;     // Clamped
+    }
+    for ( std::size_t gain = 0; gain < 3; ++gain ) {
+      const double slope = ( nudged[ gain ][ tick ].mMotorPower - base[ tick ].mMotorPower ) / step;
+      ASSERT_NEAR( slope, outputs[ tick ].mMotorPower.mGradient[ gain ], 1e-5 * ( 1.0 + std::abs( slope )));
+    }
+    ++checked;
+  }
+  ASSERT_GT( checked, 100u );
+}
+
+//
+// A telemetry trace replays too.  The trace rounds the angles, and the D
+// term magnifies that, so the live gains come close rather than exact.
+//
+TEST( CONTROLLER_REPLAY, replays_a_telemetry_trace )
+{
+  const std::string path = testing::TempDir() + "pidsim_controller_replay_" + std::to_string( getpid() ) + ".trace";
+  ControllerReplay::Recording live;
+  {
+    Telemetry telemetry( path );
+    ASSERT_TRUE( telemetry.isOpen() );
+    live = recordArm( 2000, &telemetry );
+  }
+  TraceReader trace( path );
+  ASSERT_TRUE( trace.isOpen() );
+  ControllerReplay::Recording recording;
+  ASSERT_TRUE( ControllerReplay::loadRecording( trace, recording ));
+  ASSERT_NEAR( Session::timeSlice, recording.mTimeSlice, 1e-12 );
+  ASSERT_EQ( 2000u, recording.mSensorAngles.size() );
+  ASSERT_EQ( 2000u, recording.mMotorPowers.size() );
+
+  ControllerReplay batch( { { liveP, liveI, liveD }, { liveP, liveI, 0.0 }, { liveP * 2, liveI, liveD } } );
+  batch.run( recording );
+  ASSERT_LT( batch.getResult( 0 ).mRmsDifference, 0.01 );
+  ASSERT_GT( batch.getResult( 1 ).mRmsDifference, 10 * batch.getResult( 0 ).mRmsDifference );
+  ASSERT_GT( batch.getResult( 2 ).mRmsDifference, 10 * batch.getResult( 0 ).mRmsDifference );
+  std::remove( path.c_str() );
+
+  // A trace without the columns doesn't load
+  {
+    PidSim::TraceWriter writer( path, { { "something_else" } } );
+    const double value = 1.0;
+    writer.append( 0, &value );
+  }
+  TraceReader other( path );
+  ASSERT_TRUE( other.isOpen() );
+  ASSERT_FALSE( ControllerReplay::loadRecording( other, recording ));
+  std::remove( path.c_str() );
+}
@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include <math.h>
+#include "../pidsim/pidsim_backend_batch_sim.h"
+#include "../pidsim/pidsim_backend_cost_map.h"
+
+using PidSim::BatchSim;
+using PidSim::CostMap;
+
+static CostMap::Settings testSettings()
+{
+  CostMap::Settings settings;
+  settings.mFixedGain             = 1.0;
+  settings.mTicks                 = 150;
+  settings.mArm.mStartAngle       = PidSim::Utils::degToRad( -90 );
+  settings.mArm.mTargetAngle      = PidSim::Utils::degToRad( 0 );
+  settings.mArm.mRollingFriction  = 0.004;
+  settings.mArm.mSensorDelay      = 40.0;
+  return settings;
+}
+
+static void finish( CostMap& map, std::size_t chunk )
+{
+  while ( !map.isComplete() ) {
+    map.refine( chunk );
+  }
+}
+
+//
+// The map gets to full resolution, and skips most of the cells on the way.
+//
+TEST( COST_MAP, refines_to_full_resolution )
+{
+  CostMap map( testSettings() );
+  ASSERT_EQ( CostMap::startResolution, map.getResolution() );
+  ASSERT_LT( map.getCost( 0, 0 ), 0.0 );
+
+  std::size_t resolution = map.getResolution();
+  while ( !map.isComplete() ) {
+    map.refine( 500 );
+    ASSERT_GE( map.getResolution(), resolution );
+    resolution = map.getResolution();
+  }
+
+  ASSERT_EQ( CostMap::maxResolution, map.getResolution() );
+  ASSERT_GT( map.getSimulated(), CostMap::startResolution * CostMap::startResolution );
+  ASSERT_LT( map.getSimulated(), CostMap::maxResolution * CostMap::maxResolution / 2 );
+  for ( std::size_t y = 0; y < CostMap::maxResolution; ++y ) {
+    for ( std::size_t x = 0; x < CostMap::maxResolution; ++x ) {
+      ASSERT_GE( map.getCost( x, y ), 0.0 );
+    }
+  }
+  ASSERT_FALSE( map.refine( 500 ));
+}
+
+//
+// How the work is chunked doesn't change the answer, even with sensor noise.
+//
+TEST( COST_MAP, chunking_does_not_matter )
+{
+  CostMap::Settings settings = testSettings();
+  settings.mArm.mSensorNoise = 1.0;
+  CostMap small( settings ), big( settings );
+  finish( small, 37 );
+  finish( big, 5000 );
+  ASSERT_EQ( small.getSimulated(), big.getSimulated() );
+  for ( std::size_t y = 0; y < CostMap::maxResolution; ++y ) {
+    for ( std::size_t x = 0; x < CostMap::maxResolution; ++x ) {
+      ASSERT_EQ( small.getCost( x, y ), big.getCost( x, y ));
+    }
+  }
+}
+
+//
+// Cells that were never simulated at full resolution are still close to
+// what a simulation would give.
+//
+TEST( COST_MAP, matches_brute_force )
+{
+  const CostMap::Settings settings = testSettings();
+  CostMap map( settings );
+  finish( map, 5000 );
+
+  std::vector<BatchSim::ArmSettings> arms;
+  std::vector<std::pair<std::size_t, std::size_t>> cells;
+  for ( std::size_t i = 0; i < 500; ++i ) {
+    const std::size_t x = ( i * 97 ) % CostMap::maxResolution;
+    const std::size_t y = ( i * 61 + 13 ) % CostMap::maxResolution;
+    BatchSim::ArmSettings arm = settings.mArm;
+    arm.mPidP = ( x + 0.5 ) * CostMap::maxGain / CostMap::maxResolution;
+    arm.mPidI = settings.mFixedGain;
+    arm.mPidD = ( y + 0.5 ) * CostMap::maxGain / CostMap::maxResolution;
+    arms.push_back( arm );
+    cells.push_back( { x, y } );
+  }
+  BatchSim sim( arms );
+  sim.run( settings.mTicks );
+
+  const double range = log( map.getMaxCost() ) - log( map.getMinCost() );
+  int close = 0;
+  for ( std::size_t i = 0; i < arms.size(); ++i ) {
+    const double truth = sim.getMetrics( i ).mITAE;
+    const double mapped = map.getCost( cells[ i ].first, cells[ i ].second );
+    close += std::abs( log( truth ) - log( mapped )) < range / 16.0;
+  }
+  ASSERT_GT( close, 475 );
+}
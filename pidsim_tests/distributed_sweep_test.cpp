@@ -0,0 +1,292 @@
+#include <gtest/gtest.h>
+#include <csignal>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../pidsim/pidsim_backend_distributed_sweep.h"
+
+using PidSim::BatchSim;
+using PidSim::ParameterSweep;
+using PidSim::StepMetrics;
+using PidSim::SweepCoordinator;
+using PidSim::SweepWorker;
+
+namespace {
+
+ParameterSweep::Settings testSettings()
+{
+  ParameterSweep::Settings settings;
+  settings.mArm.mStartAngle   = PidSim::Utils::degToRad( -90 );
+  settings.mArm.mSensorNoise  = 1.0;
+  settings.mArm.mProfileType  = PidSim::MotionProfile::Type::Trapezoidal;
+  settings.mTicks = 200;
+  settings.mSeed  = 7;
+  settings.mAxes = {
+    { &BatchSim::ArmSettings::mPidP,        1.0, 6.0 },
+    { &BatchSim::ArmSettings::mPidD,        0.0, 2.0 },
+    { &BatchSim::ArmSettings::mSensorDelay, 0.0, 100.0 },
+  };
+  return settings;
+}
+
+std::string unixAddress( const char* name )
+{
+  return "unix:/tmp/pidsim_" + std::string( name ) + "_" + std::to_string( getpid() ) + ".sock";
+}
+
+// A worker in its own process, as it would be on another machine.  It
+// can wait a while before it connects.
+pid_t spawnWorker( const std::string& address, std::size_t maxChunks = 0, unsigned delayMs = 0 )
+{
+  const pid_t pid = fork();
+  if ( pid == 0 ) {
+    usleep( delayMs * 1000 );
+    std::string error;
+    _exit( SweepWorker::serve( address, error, nullptr, maxChunks ) ? 0 : 1 );
+  }
+  return pid;
+}
+
+//
+// A worker that's connected and said hello, then stopped dead, i.e., a
+// machine that's swapping.  It's let in once the coordinator runs, and
+// takes chunks it never finishes.
+//
+pid_t spawnStalledWorker( const std::string& address )
+{
+  const pid_t pid = spawnWorker( address );
+  usleep( 200000 );
+  kill( pid, SIGSTOP );
+  return pid;
+}
+
+int exitStatus( pid_t pid )
+{
+  int status = 0;
+  waitpid( pid, &status, 0 );
+  return WIFEXITED( status ) ? WEXITSTATUS( status ) : -1;
+}
+
+void expectSame( const std::vector<StepMetrics::Result>& expected, const std::vector<StepMetrics::Result>& actual )
+{
+  ASSERT_EQ( expected.size(), actual.size() );
+  for ( std::size_t i = 0; i < expected.size(); ++i ) {
+    ASSERT_EQ( expected[ i ].mRiseTime,       actual[ i ].mRiseTime );
+    ASSERT_EQ( expected[ i ].mOvershoot,      actual[ i ].mOvershoot );
+    ASSERT_EQ( expected[ i ].mIAE,            actual[ i ].mIAE );
+    ASSERT_EQ( expected[ i ].mITAE,           actual[ i ].mITAE );
+    ASSERT_EQ( expected[ i ].mControlEffort,  actual[ i ].mControlEffort );
+    ASSERT_EQ( expected[ i ].mSettled,        actual[ i ].mSettled );
+  }
+}
+
+}
+
+//
+// Chunks spread over local workers come back in order, exactly as one
+// process would have run them, and the workers stay for the next run
+//
+TEST( DISTRIBUTED_SWEEP, matches_one_machine )
+{
+  const ParameterSweep sweep( testSettings() );
+  SweepCoordinator::Options options;
+  options.mChunkSize = 100;
+  std::vector<pid_t> workers;
+  std::size_t served = 0;
+  {
+    SweepCoordinator coordinator( testSettings(), options );
+    std::string error;
+    ASSERT_TRUE( coordinator.listen( unixAddress( "sweep" ), error )) << error;
+    for ( int worker = 0; worker < 3; ++worker ) {
+      workers.push_back( spawnWorker( coordinator.getAddress() ));
+    }
+
+    std::vector<std::uint64_t> firsts;
+    std::vector<StepMetrics::Result> results;
+    ASSERT_TRUE( coordinator.run( 37, 1050, [&]( std::uint64_t first, const std::vector<StepMetrics::Result>& chunk ) {
+      firsts.push_back( first );
+      results.insert( results.end(), chunk.begin(), chunk.end() );
+    }, error )) << error;
+    expectSame( sweep.run( 37, 1050 ), results );
+    ASSERT_EQ( 11u, coordinator.getReport().mChunks );
+    ASSERT_EQ( 11u, firsts.size() );
+    for ( std::size_t chunk = 0; chunk < firsts.size(); ++chunk ) {
+      ASSERT_EQ( 37 + chunk * 100, firsts[ chunk ] );
+    }
+    ASSERT_GE( coordinator.getReport().mWorkers, 1u );
+    ASSERT_EQ( 0u, coordinator.getReport().mRetried );
+
+    ASSERT_TRUE( coordinator.run( 5000, 250, results, error )) << error;
+    expectSame( sweep.run( 5000, 250 ), results );
+    served = coordinator.getReport().mWorkers;
+  }
+
+  // Hanging up is the workers' cue to go.  One that was still waiting to
+  // be let in when the coordinator went away doesn't count as served.
+  std::size_t leftCleanly = 0;
+  for ( pid_t worker : workers ) {
+    leftCleanly += exitStatus( worker ) == 0;
+  }
+  ASSERT_GE( leftCleanly, served );
+}
+
+//
+// Chunks held by a worker that leaves, or is killed, are run again
+//
+TEST( DISTRIBUTED_SWEEP, lost_chunks_are_retried )
+{
+  const ParameterSweep sweep( testSettings() );
+  SweepCoordinator::Options options;
+  options.mChunkSize = 50;
+  SweepCoordinator coordinator( testSettings(), options );
+  std::string error;
+  ASSERT_TRUE( coordinator.listen( "127.0.0.1:0", error )) << error;
+  ASSERT_NE( "127.0.0.1:0", coordinator.getAddress() );
+
+  // One leaves after a chunk, with its second still held, and one is
+  // killed as soon as results start coming in
+  const pid_t leaver  = spawnWorker( coordinator.getAddress(), 1 );
+  const pid_t victim  = spawnWorker( coordinator.getAddress() );
+  const pid_t steady  = spawnWorker( coordinator.getAddress() );
+  std::vector<StepMetrics::Result> results;
+  bool killed = false;
+  ASSERT_TRUE( coordinator.run( 0, 1000, [&]( std::uint64_t, const std::vector<StepMetrics::Result>& chunk ) {
+    if ( !killed ) {
+      kill( victim, SIGKILL );
+      killed = true;
+    }
+    results.insert( results.end(), chunk.begin(), chunk.end() );
+  }, error )) << error;
+  expectSame( sweep.run( 0, 1000 ), results );
+  ASSERT_GE( coordinator.getReport().mRetried, 1u );
+
+  ASSERT_EQ( 0, exitStatus( leaver ));
+  ASSERT_EQ( -1, exitStatus( victim ));
+  kill( steady, SIGKILL );
+  exitStatus( steady );
+}
+
+//
+// Once the queue is empty, an idle worker takes a copy of a stalled
+// worker's chunk, and the results still come in order
+//
+TEST( DISTRIBUTED_SWEEP, stalled_chunks_are_stolen )
+{
+  const ParameterSweep sweep( testSettings() );
+  SweepCoordinator::Options options;
+  options.mChunkSize = 50;
+  SweepCoordinator coordinator( testSettings(), options );
+  std::string error;
+  ASSERT_TRUE( coordinator.listen( unixAddress( "steal" ), error )) << error;
+
+  // The stalled worker is let in first, so it's holding chunks 0 and 1
+  const pid_t stalled = spawnStalledWorker( coordinator.getAddress() );
+  const pid_t steady  = spawnWorker( coordinator.getAddress() );
+  std::vector<std::uint64_t> firsts;
+  std::vector<StepMetrics::Result> results;
+  ASSERT_TRUE( coordinator.run( 0, 500, [&]( std::uint64_t first, const std::vector<StepMetrics::Result>& chunk ) {
+    firsts.push_back( first );
+    results.insert( results.end(), chunk.begin(), chunk.end() );
+  }, error )) << error;
+  expectSame( sweep.run( 0, 500 ), results );
+  ASSERT_EQ( 10u, firsts.size() );
+  for ( std::size_t chunk = 0; chunk < firsts.size(); ++chunk ) {
+    ASSERT_EQ( chunk * 50, firsts[ chunk ] );
+  }
+  ASSERT_EQ( 2u, coordinator.getReport().mStolen );
+  ASSERT_EQ( 0u, coordinator.getReport().mDiscarded );
+  ASSERT_EQ( 0u, coordinator.getReport().mRetried );
+
+  kill( stalled, SIGKILL );
+  kill( steady, SIGKILL );
+  exitStatus( stalled );
+  exitStatus( steady );
+}
+
+//
+// A worker that goes quiet for longer than the chunk timeout loses its
+// chunks, which are run by whoever comes along next
+//
+TEST( DISTRIBUTED_SWEEP, timed_out_chunks_are_retried )
+{
+  const ParameterSweep sweep( testSettings() );
+  SweepCoordinator::Options options;
+  options.mChunkSize    = 50;
+  options.mChunkTimeout = 0.2;
+  SweepCoordinator coordinator( testSettings(), options );
+  std::string error;
+  ASSERT_TRUE( coordinator.listen( unixAddress( "timeout" ), error )) << error;
+
+  // Nobody else turns up until the stalled worker has long timed out
+  const pid_t stalled = spawnStalledWorker( coordinator.getAddress() );
+  const pid_t late    = spawnWorker( coordinator.getAddress(), 0, 1000 );
+  std::vector<StepMetrics::Result> results;
+  ASSERT_TRUE( coordinator.run( 0, 500, results, error )) << error;
+  expectSame( sweep.run( 0, 500 ), results );
+  ASSERT_EQ( 2u, coordinator.getReport().mRetried );
+  ASSERT_EQ( 0u, coordinator.getReport().mStolen );
+
+  kill( stalled, SIGKILL );
+  kill( late, SIGKILL );
+  exitStatus( stalled );
+  exitStatus( late );
+}
+
+//
+// A chunk that keeps losing workers fails the sweep, though chunks given
+// back by a worker that's leaving don't count.  So does having no workers
+// at all, or only connections that never say hello, and a worker with
+// nowhere to go says so.
+//
+TEST( DISTRIBUTED_SWEEP, failures_are_reported )
+{
+  std::string error;
+  {
+    SweepCoordinator::Options options;
+    options.mChunkSize    = 10;
+    options.mMaxAttempts  = 1;
+    SweepCoordinator coordinator( testSettings(), options );
+    ASSERT_TRUE( coordinator.listen( unixAddress( "leaving" ), error )) << error;
+    const pid_t leaver = spawnWorker( coordinator.getAddress(), 1 );
+    const pid_t steady = spawnWorker( coordinator.getAddress(), 0, 100 );
+    std::vector<StepMetrics::Result> results;
+    ASSERT_TRUE( coordinator.run( 0, 100, results, error )) << error;
+    ASSERT_EQ( 0, exitStatus( leaver ));
+    kill( steady, SIGKILL );
+    exitStatus( steady );
+  }
+  {
+    SweepCoordinator::Options options;
+    options.mChunkSize    = 10;
+    options.mMaxAttempts  = 1;
+    options.mChunkTimeout = 0.2;
+    SweepCoordinator coordinator( testSettings(), options );
+    ASSERT_TRUE( coordinator.listen( unixAddress( "lossy" ), error )) << error;
+    const pid_t stalled = spawnStalledWorker( coordinator.getAddress() );
+    ASSERT_FALSE( coordinator.run( 0, 100, []( std::uint64_t, const std::vector<StepMetrics::Result>& ) {}, error ));
+    ASSERT_EQ( "runs 0 to 9 were lost 1 times", error );
+    kill( stalled, SIGKILL );
+    exitStatus( stalled );
+  }
+  {
+    SweepCoordinator::Options options;
+    options.mIdleTimeout = 0.2;
+    SweepCoordinator coordinator( testSettings(), options );
+    const std::string address = unixAddress( "idle" );
+    ASSERT_TRUE( coordinator.listen( address, error )) << error;
+    const int silent = socket( AF_UNIX, SOCK_STREAM, 0 );
+    sockaddr_un local = {};
+    local.sun_family = AF_UNIX;
+    strncpy( local.sun_path, address.c_str() + 5, sizeof( local.sun_path ) - 1 );
+    ASSERT_EQ( 0, connect( silent, reinterpret_cast<const sockaddr*>( &local ), sizeof( local )));
+    std::vector<StepMetrics::Result> results;
+    ASSERT_FALSE( coordinator.run( 0, 100, results, error ));
+    ASSERT_EQ( "gave up waiting for workers", error );
+    close( silent );
+  }
+  ASSERT_FALSE( SweepWorker::serve( "unix:/nonexistent/pidsim.sock", error ));
+  ASSERT_EQ( 0u, error.find( "couldn't connect to unix:/nonexistent/pidsim.sock" ));
+  ASSERT_FALSE( SweepWorker::serve( "no port here", error ));
+}
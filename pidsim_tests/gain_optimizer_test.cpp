@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+#include <math.h>
+#include "../pidsim/pidsim_backend_batch_sim.h"
+#include "../pidsim/pidsim_backend_gain_optimizer.h"
+
+using PidSim::BatchSim;
+using PidSim::GainOptimizer;
+
+static GainOptimizer::Settings testSettings()
+{
+  GainOptimizer::Settings settings;
+  settings.mArm.mPidP             = 1.0;
+  settings.mArm.mPidI             = 0.0;
+  settings.mArm.mPidD             = 0.0;
+  settings.mArm.mStartAngle       = PidSim::Utils::degToRad( -90 );
+  settings.mArm.mTargetAngle      = PidSim::Utils::degToRad( 0 );
+  settings.mArm.mRollingFriction  = 0.004;
+  settings.mArm.mSensorNoise      = 0.5;
+  settings.mArm.mSensorDelay      = 40.0;
+  settings.mArm.mMotorDelay       = 20.0;
+  return settings;
+}
+
+// The cost of each set of gains, simulated the way the optimizer does it
+static std::vector<double> simulate( const GainOptimizer::Settings& settings,
+                                     const std::vector<GainOptimizer::Gains>& gains )
+{
+  std::vector<double> costs;
+  for ( const GainOptimizer::Gains& gain : gains ) {
+    BatchSim::ArmSettings arm = settings.mArm;
+    arm.mPidP = gain[ 0 ];
+    arm.mPidI = gain[ 1 ];
+    arm.mPidD = gain[ 2 ];
+    BatchSim sim( { arm }, settings.mSeed );
+    sim.run( settings.mTicks );
+    costs.push_back( GainOptimizer::cost( settings, sim.getMetrics( 0 )));
+  }
+  return costs;
+}
+
+//
+// The search beats the starting gains by a lot, and every point of a
+// coarse grid over the sliders.
+//
+TEST( GAIN_OPTIMIZER, beats_a_grid_search )
+{
+  const GainOptimizer::Settings settings = testSettings();
+  GainOptimizer optimizer( settings );
+  const GainOptimizer::Report& report = optimizer.run();
+  ASSERT_TRUE( optimizer.isDone() );
+
+  const double startCost = simulate( settings, { { 1.0, 0.0, 0.0 } } )[ 0 ];
+  ASSERT_LT( report.mBestCost, startCost / 4.0 );
+  ASSERT_NEAR( report.mBestCost, simulate( settings, { report.mBest } )[ 0 ], 1e-9 );
+
+  std::vector<GainOptimizer::Gains> grid;
+  for ( double p = 0.5; p <= GainOptimizer::maxGain; p += 1.0 ) {
+    for ( double i = 0.5; i <= GainOptimizer::maxGain; i += 1.0 ) {
+      for ( double d = 0.5; d <= GainOptimizer::maxGain; d += 1.0 ) {
+        grid.push_back( { p, i, d } );
+      }
+    }
+  }
+  const std::vector<double> costs = simulate( settings, grid );
+  ASSERT_LE( report.mBestCost, *std::min_element( costs.begin(), costs.end() ));
+  for ( double gain : report.mBest ) {
+    ASSERT_GE( gain, 0.0 );
+    ASSERT_LE( gain, GainOptimizer::maxGain );
+  }
+}
+
+//
+// Same seed, same answer.  A different seed still gets close.
+//
+TEST( GAIN_OPTIMIZER, deterministic )
+{
+  GainOptimizer::Settings settings = testSettings();
+  GainOptimizer a( settings ), b( settings );
+  const GainOptimizer::Report& reportA = a.run();
+  const GainOptimizer::Report& reportB = b.run();
+  ASSERT_EQ( reportA.mBest, reportB.mBest );
+  ASSERT_EQ( reportA.mBestCost, reportB.mBestCost );
+  ASSERT_EQ( reportA.mEvaluations, reportB.mEvaluations );
+  ASSERT_EQ( reportA.mStoppedEarly, reportB.mStoppedEarly );
+
+  settings.mSeed = 7;
+  GainOptimizer c( settings );
+  ASSERT_NEAR( reportA.mBestCost, c.run().mBestCost, 0.1 * reportA.mBestCost );
+}
+
+//
+// Stopped candidates can't have been selected, so stopping them doesn't
+// change the answer.
+//
+TEST( GAIN_OPTIMIZER, early_stopping )
+{
+  GainOptimizer::Settings settings = testSettings();
+  GainOptimizer early( settings );
+  settings.mEarlyStopFactor = INFINITY;
+  GainOptimizer full( settings );
+  const GainOptimizer::Report& earlyReport = early.run();
+  const GainOptimizer::Report& fullReport  = full.run();
+
+  ASSERT_GT( earlyReport.mStoppedEarly, 0u );
+  ASSERT_EQ( 0u, fullReport.mStoppedEarly );
+  ASSERT_EQ( fullReport.mEvaluations * settings.mTicks, fullReport.mArmTicks );
+  ASSERT_LE( earlyReport.mArmTicks, earlyReport.mEvaluations * settings.mTicks );
+  ASSERT_EQ( fullReport.mBest, earlyReport.mBest );
+}
+
+//
+// Even when most candidates are stopped, the best cost is a whole run's,
+// and the search still gets somewhere.
+//
+TEST( GAIN_OPTIMIZER, stopped_candidates_rank_last )
+{
+  GainOptimizer::Settings settings = testSettings();
+  settings.mEarlyStopFactor = 0.5;
+  GainOptimizer optimizer( settings );
+  const GainOptimizer::Report& report = optimizer.run();
+
+  ASSERT_GT( report.mStoppedEarly, report.mEvaluations / 4 );
+  ASSERT_NEAR( report.mBestCost, simulate( settings, { report.mBest } )[ 0 ], 1e-9 );
+  ASSERT_LT( report.mBestCost, simulate( settings, { { 1.0, 0.0, 0.0 } } )[ 0 ] / 4.0 );
+}
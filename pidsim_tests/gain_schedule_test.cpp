@@ -0,0 +1,56 @@
+#include <gtest/gtest.h>
+#include "../pidsim/pidsim_backend_batch_sim.h"
+#include "../pidsim/pidsim_backend_gain_schedule.h"
+
+using PidSim::GainSchedule;
+using PidSim::BatchSim;
+
+//
+// Breakpoints that line up with the grid are reproduced exactly, and
+// everything in between is linearly interpolated.
+//
+TEST( GAIN_SCHEDULE, interpolates_between_breakpoints )
+{
+  // 256 grid points over 0-255 radians puts a grid point on each radian
+  const GainSchedule schedule( {
+      { 100.0, { 1.0, 2.0, 3.0 }},
+      {  10.0, { 3.0, 2.0, 1.0 }},
+      {  50.0, { 1.0, 4.0, 1.0 }}
+    }, 0.0, 255.0 );
+
+  ASSERT_DOUBLE_EQ( 3.0, schedule.lookup( 10.0 ).mPidP );
+  ASSERT_DOUBLE_EQ( 2.0, schedule.lookup( 30.0 ).mPidP );
+  ASSERT_DOUBLE_EQ( 3.0, schedule.lookup( 30.0 ).mPidI );
+  ASSERT_DOUBLE_EQ( 1.0, schedule.lookup( 30.0 ).mPidD );
+  ASSERT_DOUBLE_EQ( 3.0, schedule.lookup( 75.0 ).mPidI );
+  ASSERT_DOUBLE_EQ( 3.02, schedule.lookup( 74.5 ).mPidI );
+
+  // Held constant past the ends, and past the table
+  ASSERT_DOUBLE_EQ( 3.0, schedule.lookup( 0.0 ).mPidP );
+  ASSERT_DOUBLE_EQ( 3.0, schedule.lookup( -1000.0 ).mPidP );
+  ASSERT_DOUBLE_EQ( 3.0, schedule.lookup( 200.0 ).mPidD );
+  ASSERT_DOUBLE_EQ( 3.0, schedule.lookup( 1000.0 ).mPidD );
+}
+
+//
+// A flat schedule doesn't change anything, and the batch uses the schedule.
+//
+TEST( GAIN_SCHEDULE, batch_uses_schedule )
+{
+  std::vector<BatchSim::ArmSettings> arms( 8 );
+  for ( std::size_t i = 0; i < arms.size(); ++i ) {
+    arms[ i ].mPidP = 2.0 + i;
+    arms[ i ].mPidD = 0.5;
+    arms[ i ].mStartAngle = -1.0;
+  }
+
+  BatchSim plain( arms ), flat( arms ), scheduled( arms );
+  flat.setGainSchedule( GainSchedule( {{ 0.0, { 1.0, 1.0, 1.0 }}, { 1.0, { 1.0, 1.0, 1.0 }}} ));
+  scheduled.setGainSchedule( GainSchedule( {{ 0.0, { 0.5, 1.0, 2.0 }}, { 1.0, { 0.5, 1.0, 2.0 }}} ));
+  plain.run( 100 );
+  flat.run( 100 );
+  scheduled.run( 100 );
+
+  ASSERT_EQ( plain.getActualAngles(), flat.getActualAngles() );
+  ASSERT_NE( plain.getActualAngles(), scheduled.getActualAngles() );
+}
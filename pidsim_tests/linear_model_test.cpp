@@ -0,0 +1,175 @@
+#include <gtest/gtest.h>
+#include "../pidsim/pidsim_backend_linear_model.h"
+#include "../pidsim/pidsim_backend_physics_sim.h"
+#include "../pidsim/pidsim_backend_pid_controller.h"
+
+using PidSim::BatchSim;
+using PidSim::LinearModel;
+
+//
+// Run one arm the way BackEnd does, with PhysicsSim & PidController.
+// Returns the angle after every tick.
+//
+static std::vector<double> runScalar( const BatchSim::ArmSettings& settings, unsigned ticks )
+{
+  using namespace PidSim;
+  PhysicsSim          sim( settings.mStartAngle );
+  PidController       pid;
+  sim.setSensorDelay( settings.mSensorDelay );
+  sim.setMotorDelay( settings.mMotorDelay );
+
+  std::vector<double> angles;
+  for ( unsigned tick = 0; tick < ticks; ++tick ) {
+    pid.updatePidSettings( settings.mPidP, settings.mPidI, settings.mPidD, settings.mTargetAngle );
+    const auto out = pid.updatePidController( BatchSim::timeSlice, sim.getSensorAngle() );
+    sim.startSimulationIteration();
+    sim.applyGravity();
+    sim.applyMotor( out.mMotorPower, BatchSim::timeSlice );
+    sim.updateAngleVel( BatchSim::timeSlice );
+    sim.applyFriction( settings.mRollingFriction );
+    sim.updateAngle( BatchSim::timeSlice );
+    sim.imposePositionHardLimits();
+    sim.endSimulationIteration();
+    angles.push_back( sim.getActualAngle() );
+  }
+  return angles;
+}
+
+//
+// A small step near level.  The sensor reads 0 on the first tick, so start
+// at 0 to keep the first tick's D term from maxing out the motor.
+//
+static BatchSim::ArmSettings smallStep()
+{
+  BatchSim::ArmSettings settings;
+  settings.mPidP            = 20.0;
+  settings.mPidI            = 2.0;
+  settings.mPidD            = 2.5;
+  settings.mStartAngle      = 0.0;
+  settings.mTargetAngle     = 0.02;
+  settings.mRollingFriction = 0.004;
+  settings.mSensorDelay     = 20.0;
+  settings.mMotorDelay      = 20.0;
+  return settings;
+}
+
+//
+// Small steps follow the nonlinear simulation closely, every tick.
+//
+TEST( LINEAR_MODEL, matches_physics_sim_for_small_steps )
+{
+  constexpr unsigned ticks = 500;
+  const auto settings = smallStep();
+  const auto linear = LinearModel::runStepResponse( settings, ticks );
+  const auto scalar = runScalar( settings, ticks );
+
+  ASSERT_TRUE( linear.mLinear );
+  ASSERT_EQ( scalar.size(), linear.mAngles.size() );
+  for ( unsigned tick = 0; tick < ticks; ++tick ) {
+    ASSERT_NEAR( scalar[ tick ], linear.mAngles[ tick ], 1e-4 ) << "tick " << tick;
+  }
+}
+
+//
+// Whenever the model says it's linear, it's within the tolerance
+//
+TEST( LINEAR_MODEL, linear_responses_are_within_tolerance )
+{
+  constexpr unsigned ticks = 500;
+  BatchSim::ArmSettings settings = smallStep();
+  unsigned linearCount = 0;
+  for ( double p : { 5.0, 10.0, 20.0, 30.0 } ) {
+    for ( double step : { 0.005, 0.02, 0.05, 0.1 } ) {
+      for ( double tolerance : { 1e-4, LinearModel::defaultTolerance } ) {
+        settings.mPidP        = p;
+        settings.mTargetAngle = step;
+        const auto linear = LinearModel::runStepResponse( settings, ticks, 1, tolerance );
+        if ( !linear.mLinear ) {
+          continue;
+        }
+        ++linearCount;
+        const auto scalar = runScalar( settings, ticks );
+        for ( unsigned tick = 0; tick < ticks; ++tick ) {
+          ASSERT_NEAR( scalar[ tick ], linear.mAngles[ tick ], tolerance ) << "P " << p << " step " << step;
+        }
+      }
+    }
+  }
+  ASSERT_GT( linearCount, 2u );
+}
+
+//
+// With a stride, every stride'th angle comes back, linear or not
+//
+TEST( LINEAR_MODEL, strides_sample_every_stride_ticks )
+{
+  constexpr unsigned ticks  = 500;
+  constexpr unsigned stride = 7;
+  for ( double target : { 0.02, PidSim::Utils::degToRad( 60 ) } ) {
+    BatchSim::ArmSettings settings = smallStep();
+    settings.mTargetAngle = target;
+    const auto every = LinearModel::runStepResponse( settings, ticks );
+    const auto sampled = LinearModel::runStepResponse( settings, ticks, stride );
+    ASSERT_EQ( every.mLinear, sampled.mLinear );
+    ASSERT_EQ( ticks / stride, sampled.mAngles.size() );
+    for ( unsigned i = 0; i < sampled.mAngles.size(); ++i ) {
+      ASSERT_NEAR( every.mAngles[ ( i + 1 ) * stride - 1 ], sampled.mAngles[ i ], 1e-9 ) << i;
+    }
+  }
+}
+
+//
+// Starting below level, the sensor's jump from 0 on the second tick kicks
+// the D term and maxes the motor out between the first two samples, so a
+// strided run falls back just like a single tick one.
+//
+TEST( LINEAR_MODEL, strides_catch_clamping_between_samples )
+{
+  constexpr unsigned ticks      = 500;
+  constexpr unsigned stride     = 25;
+  constexpr double   tolerance  = 0.1;
+  BatchSim::ArmSettings settings = smallStep();
+  settings.mPidP        = 10.0;
+  settings.mPidI        = 0.0;
+  settings.mStartAngle  = -0.05;
+  settings.mSensorDelay = 0.0;
+  settings.mMotorDelay  = 0.0;
+  ASSERT_FALSE( LinearModel::runStepResponse( settings, ticks, 1, tolerance ).mLinear );
+
+  const auto sampled = LinearModel::runStepResponse( settings, ticks, stride, tolerance );
+  ASSERT_FALSE( sampled.mLinear );
+  const auto scalar = runScalar( settings, ticks );
+  for ( unsigned i = 0; i < sampled.mAngles.size(); ++i ) {
+    ASSERT_NEAR( scalar[ ( i + 1 ) * stride - 1 ], sampled.mAngles[ i ], 1e-9 ) << i;
+  }
+}
+
+//
+// Jumping k ticks is the same as k single ticks.
+//
+TEST( LINEAR_MODEL, jumps_match_single_ticks )
+{
+  const LinearModel model( smallStep() );
+  for ( unsigned ticks : { 0u, 1u, 7u, 64u, 499u, 5000u } ) {
+    LinearModel::Vector stepped = model.getFirstTickState();
+    for ( unsigned tick = 0; tick < ticks; ++tick ) {
+      stepped = model.tick( stepped );
+    }
+    const LinearModel::Vector jumped = model.advance( model.getFirstTickState(), ticks );
+    ASSERT_NEAR( 0.0, ( stepped - jumped ).lpNorm<Eigen::Infinity>(), 1e-9 ) << ticks << " ticks";
+  }
+}
+
+//
+// Big steps max out the motor, so we fall back to the real simulation.
+//
+TEST( LINEAR_MODEL, falls_back_when_nonlinear )
+{
+  constexpr unsigned ticks = 300;
+  BatchSim::ArmSettings settings = smallStep();
+  settings.mTargetAngle = PidSim::Utils::degToRad( 60 );
+
+  const auto response = LinearModel::runStepResponse( settings, ticks );
+  ASSERT_FALSE( response.mLinear );
+  ASSERT_EQ( runScalar( settings, ticks ), response.mAngles );
+}
@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "../pidsim/pidsim_backend_motion_profile.h"
+
+using PidSim::MotionProfile;
+
+//
+// Walk a profile in small steps, checking it's continuous, stays within
+// the limits and ends up at the target.
+//
+static void checkProfile( MotionProfile::Type type, double start, double target,
+                          double startVel = 0.0, double startAccel = 0.0 )
+{
+  const MotionProfile::Limits limits{ 2.0, 4.0, 16.0 };
+  const MotionProfile profile{ type, start, target, limits, startVel, startAccel };
+  const bool sCurve = type == MotionProfile::Type::SCurve;
+
+  const double dt = 1e-4;
+  double lastPos    = profile.getPosition( 0.0 );
+  double lastVel    = profile.getVel( 0.0 );
+  double lastAccel  = profile.getAccel( 0.0 );
+  ASSERT_DOUBLE_EQ( start, lastPos );
+  ASSERT_DOUBLE_EQ( startVel, lastVel );
+  if ( sCurve ) {
+    ASSERT_DOUBLE_EQ( startAccel, lastAccel );
+  }
+
+  for ( double t = dt; t < profile.getDuration() + 0.1; t += dt ) {
+    const double pos    = profile.getPosition( t );
+    const double vel    = profile.getVel( t );
+    const double accel  = profile.getAccel( t );
+    ASSERT_LE( std::abs( vel ), limits.mMaxVel + 1e-9 );
+    ASSERT_NEAR( vel, ( pos - lastPos ) / dt, limits.mMaxAccel * dt );
+    ASSERT_LE( std::abs( vel - lastVel ) / dt, limits.mMaxAccel + 1e-6 );
+    if ( sCurve ) {
+      ASSERT_LE( std::abs( accel ), limits.mMaxAccel + 1e-9 );
+      ASSERT_LE( std::abs( accel - lastAccel ) / dt, limits.mMaxJerk + 1e-6 );
+    }
+    lastPos   = pos;
+    lastVel   = vel;
+    lastAccel = accel;
+  }
+  ASSERT_DOUBLE_EQ( target, profile.getPosition( profile.getDuration() ));
+  ASSERT_NEAR( target, lastPos, 1e-12 );
+  ASSERT_EQ( 0.0, lastVel );
+}
+
+TEST( MOTION_PROFILE, trapezoid_respects_limits )
+{
+  // Long enough to cruise, and short enough that we never reach max velocity
+  checkProfile( MotionProfile::Type::Trapezoidal, -1.0, 3.0 );
+  checkProfile( MotionProfile::Type::Trapezoidal, 0.5, 0.0 );
+}
+
+TEST( MOTION_PROFILE, s_curve_respects_limits )
+{
+  // Cruising, max acceleration but no cruise, and never reaching max acceleration
+  checkProfile( MotionProfile::Type::SCurve, -1.0, 3.0 );
+  checkProfile( MotionProfile::Type::SCurve, 1.0, 0.0 );
+  checkProfile( MotionProfile::Type::SCurve, 0.0, 0.05 );
+}
+
+TEST( MOTION_PROFILE, profiles_on_the_move_respect_limits )
+{
+  for ( const MotionProfile::Type type : { MotionProfile::Type::Trapezoidal, MotionProfile::Type::SCurve } ) {
+    // Carrying on, carrying on but slowing down, overshooting and coming
+    // back, and turning around
+    checkProfile( type, 0.0, 3.0, 1.0, 2.0 );
+    checkProfile( type, 0.0, 0.6, 2.0, 0.0 );
+    checkProfile( type, 0.0, 0.1, 1.2, 4.0 );
+    checkProfile( type, 0.5, -1.0, 1.5, -3.0 );
+    // Slowing down to a target a hair further on
+    checkProfile( type, 0.0, 0.5 + 1e-9, 2.0, 0.0 );
+  }
+}
+
+TEST( MOTION_PROFILE, trapezoid_timing_is_exact )
+{
+  // 0.5s to reach 2 rad/s, 1.5s cruising, 0.5s stopping.
+  const MotionProfile profile{ MotionProfile::Type::Trapezoidal, 0.0, 4.0, { 2.0, 4.0, 16.0 }};
+  ASSERT_DOUBLE_EQ( 2.5, profile.getDuration() );
+  ASSERT_DOUBLE_EQ( 0.5, profile.getPosition( 0.5 ));
+  ASSERT_DOUBLE_EQ( 2.0, profile.getVel( 1.0 ));
+  ASSERT_DOUBLE_EQ( 2.0, profile.getPosition( 1.25 ));
+}
+
+TEST( MOTION_PROFILE, step_jumps_to_target )
+{
+  const MotionProfile profile{ MotionProfile::Type::Step, 1.0, 2.0, PidSim::defaultProfileLimits };
+  ASSERT_DOUBLE_EQ( 0.0, profile.getDuration() );
+  ASSERT_DOUBLE_EQ( 2.0, profile.getPosition( 0.0 ));
+}
+
+TEST( MOTION_PROFILE, setpoint_generator_restarts_from_current_setpoint )
+{
+  PidSim::SetpointGenerator generator( 0.0, { 2.0, 4.0, 16.0 } );
+  generator.updateTarget( 4.0, MotionProfile::Type::Trapezoidal );
+  for ( int i = 0; i < 25; ++i ) { generator.update( 0.02 ); }
+  const double midway = generator.getSetpoint();
+  ASSERT_NEAR( 0.5, midway, 1e-9 );
+
+  // Turning around starts a new profile, from where we were.  It has to
+  // stop first, so the set point carries on for a bit.
+  generator.updateTarget( 0.0, MotionProfile::Type::Trapezoidal );
+  ASSERT_DOUBLE_EQ( midway, generator.getSetpoint() );
+  ASSERT_GT( generator.update( 0.02 ), midway );
+  for ( int i = 0; i < 200; ++i ) { generator.update( 0.02 ); }
+  ASSERT_DOUBLE_EQ( 0.0, generator.getSetpoint() );
+}
+
+//
+// Changing the target part way through an S-Curve keeps the velocity and
+// acceleration continuous, so the jerk limit holds through the change
+//
+TEST( MOTION_PROFILE, setpoint_generator_retargets_smoothly )
+{
+  const MotionProfile::Limits limits{ 2.0, 4.0, 16.0 };
+  const double dt = 0.001;
+  PidSim::SetpointGenerator generator( 0.0, limits );
+  generator.updateTarget( 4.0, MotionProfile::Type::SCurve );
+  std::vector<double> setpoints{ generator.getSetpoint() };
+  for ( int i = 0; i < 4000; ++i ) {
+    if ( i == 300 ) { generator.updateTarget( -1.0, MotionProfile::Type::SCurve ); }
+    if ( i == 1200 ) { generator.updateTarget( 0.5, MotionProfile::Type::SCurve ); }
+    setpoints.push_back( generator.update( dt ));
+  }
+  ASSERT_DOUBLE_EQ( 0.5, setpoints.back() );
+  for ( std::size_t i = 3; i < setpoints.size(); ++i ) {
+    const double vel  = ( setpoints[ i ] - setpoints[ i-1 ] ) / dt;
+    const double prev = ( setpoints[ i-1 ] - setpoints[ i-2 ] ) / dt;
+    const double last = ( setpoints[ i-2 ] - setpoints[ i-3 ] ) / dt;
+    ASSERT_LE( std::abs( vel ), limits.mMaxVel + 1e-6 );
+    ASSERT_LE( std::abs( vel - prev ) / dt, limits.mMaxAccel + 0.1 );
+    ASSERT_LE( std::abs(( vel - prev ) - ( prev - last )) / dt / dt, limits.mMaxJerk + 1.0 );
+  }
+}
+
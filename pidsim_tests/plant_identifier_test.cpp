@@ -0,0 +1,140 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include "../pidsim/pidsim_backend_control_loop.h"
+#include "../pidsim/pidsim_backend_plant_identifier.h"
+
+using PidSim::BatchSim;
+using PidSim::ControlLoop;
+using PidSim::PlantIdentifier;
+
+namespace {
+
+struct Trace
+{
+  std::vector<double> mAngles;
+  std::vector<double> mCommands;
+};
+
+struct Plant
+{
+  double mFriction;
+  double mSensorDelay;
+  double mMotorDelay;
+  double mNoise;
+};
+
+//
+// Run the loop with a new random target every 1.5 s, recording what the
+// sensor read and what the controller sent.  The plant changes to each
+// stage in turn.  The first tick is left out, since the sensor has
+// nothing to read yet.
+//
+Trace record( const std::vector<Plant>& stages, unsigned ticksPerStage )
+{
+  ControlLoop loop( PidSim::Utils::degToRad( -45 ), PidSim::MotionProfile::Limits{ 10, 10, 100 } );
+  Trace trace;
+  for ( unsigned tick = 0; tick < stages.size() * ticksPerStage; ++tick ) {
+    if ( tick % ticksPerStage == 0 ) {
+      const Plant& plant = stages[ tick / ticksPerStage ];
+      loop.setRollingFriction( plant.mFriction );
+      loop.getPhysicsSim().setSensorDelay( plant.mSensorDelay );
+      loop.getPhysicsSim().setMotorDelay( plant.mMotorDelay );
+      loop.getPhysicsSim().setSensorNoise( plant.mNoise );
+    }
+    if ( tick % 75 == 0 ) {
+      const double unit = PidSim::Utils::toUnit( PidSim::Utils::splitMix64( tick ));
+      loop.getSetpointGenerator().updateTarget( PidSim::Utils::degToRad( -60 + 150 * unit ),
+        PidSim::MotionProfile::Type::Step );
+    }
+    const double angle = loop.getPhysicsSim().getSensorAngle();
+    const ControlLoop::Output out = loop.tick( BatchSim::timeSlice, 2, 0.5, 0.5 );
+    if ( tick > 0 ) {
+      trace.mAngles.push_back( angle );
+      trace.mCommands.push_back( out.mPid.mMotorPower );
+    }
+  }
+  return trace;
+}
+
+Trace record( const Plant& plant, unsigned ticks )
+{
+  return record( std::vector<Plant>{ plant }, ticks );
+}
+
+}
+
+//
+// Without noise the plant is in the model (but for the sensor lagging
+// gravity), so the fit lands on it, and rounds back to the same whole
+// tick delays
+//
+TEST( PLANT_IDENTIFIER, recovers_noise_free_plant )
+{
+  for ( const Plant& plant : std::vector<Plant>{
+      { 0.0,   0.0,  0.0,  0.0 },
+      { 0.01,  20.0, 0.0,  0.0 },
+      { 0.02,  0.0,  60.0, 0.0 },
+      { 0.005, 40.0, 40.0, 0.0 },
+      { 0.01,  100.0, 80.0, 0.0 } } ) {
+    const Trace trace = record( plant, 3000 );
+    PlantIdentifier identifier;
+    identifier.fit( trace.mAngles, trace.mCommands );
+    const PlantIdentifier::Estimate estimate = identifier.getEstimate();
+    ASSERT_NEAR( 9.8, estimate.mGravity, 0.05 );
+    ASSERT_NEAR( 1.0, estimate.mInertia, 0.01 );
+    ASSERT_NEAR( plant.mFriction, estimate.mFriction, 5e-4 );
+    ASSERT_LT( estimate.mResidual, 0.01 );
+
+    const BatchSim::ArmSettings arm = identifier.toArmSettings( BatchSim::ArmSettings{} );
+    ASSERT_EQ( std::floor( plant.mSensorDelay / 20 ), std::floor( arm.mSensorDelay / 20 ));
+    ASSERT_EQ( std::floor( plant.mMotorDelay / 20 ), std::floor( arm.mMotorDelay / 20 ));
+    ASSERT_EQ( std::max( 0.0, estimate.mFriction ), arm.mRollingFriction );
+  }
+}
+
+//
+// A little noise biases the fit, but not by much
+//
+TEST( PLANT_IDENTIFIER, small_noise_stays_close )
+{
+  const Trace trace = record( { 0.01, 20.0, 40.0, 0.02 }, 5000 );
+  PlantIdentifier identifier;
+  identifier.fit( trace.mAngles, trace.mCommands );
+  const PlantIdentifier::Estimate estimate = identifier.getEstimate();
+  ASSERT_NEAR( 9.8, estimate.mGravity, 1.0 );
+  ASSERT_NEAR( 1.0, estimate.mInertia, 0.1 );
+  ASSERT_NEAR( 0.01, estimate.mFriction, 0.005 );
+  ASSERT_NEAR( 50.0, estimate.mDelay, 10.0 );
+}
+
+//
+// fit() is update() in a loop
+//
+TEST( PLANT_IDENTIFIER, fit_matches_update )
+{
+  const Trace trace = record( { 0.01, 40.0, 20.0, 0.5 }, 1000 );
+  PlantIdentifier batch, online;
+  batch.fit( trace.mAngles, trace.mCommands );
+  for ( std::size_t tick = 0; tick < trace.mAngles.size(); ++tick ) {
+    online.update( trace.mAngles[ tick ], trace.mCommands[ tick ] );
+  }
+  ASSERT_EQ( batch.getRls().getParameters(), online.getRls().getParameters() );
+  ASSERT_EQ( batch.getEstimate().mSamples, online.getEstimate().mSamples );
+}
+
+//
+// With forgetting, the fit follows the plant when it changes
+//
+TEST( PLANT_IDENTIFIER, tracks_a_changing_plant )
+{
+  const Trace trace = record( { { 0.01, 20.0, 20.0, 0.0 }, { 0.03, 20.0, 20.0, 0.0 } }, 3000 );
+  const std::size_t half = trace.mAngles.size() / 2;
+  PlantIdentifier identifier( 0.995 );
+  for ( std::size_t tick = 0; tick < trace.mAngles.size(); ++tick ) {
+    identifier.update( trace.mAngles[ tick ], trace.mCommands[ tick ] );
+    if ( tick == half ) {
+      ASSERT_NEAR( 0.01, identifier.getEstimate().mFriction, 1e-3 );
+    }
+  }
+  ASSERT_NEAR( 0.03, identifier.getEstimate().mFriction, 1e-3 );
+}
@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+#include <math.h>
+#include "../pidsim/pidsim_backend_rare_failure.h"
+
+using PidSim::RareFailureAnalysis;
+
+//
+// The arm holds at 150 degrees, 60 degrees from the top stop, while it
+// gets pushed every half second.
+//
+static RareFailureAnalysis::Settings testSettings( double pushSigma )
+{
+  RareFailureAnalysis::Settings settings;
+  settings.mArm.mPidP             = 3.46;
+  settings.mArm.mPidI             = 2.29;
+  settings.mArm.mPidD             = 0.86;
+  settings.mArm.mStartAngle       = PidSim::Utils::degToRad( 150 );
+  settings.mArm.mTargetAngle      = PidSim::Utils::degToRad( 150 );
+  settings.mArm.mRollingFriction  = 0.004;
+  settings.mArm.mSensorNoise      = 2.0;
+  settings.mArm.mSensorDelay      = 40.0;
+  settings.mArm.mMotorDelay       = 20.0;
+  settings.mPushSigma             = pushSigma;
+  return settings;
+}
+
+TEST( RARE_FAILURE, score )
+{
+  const RareFailureAnalysis::Settings settings = testSettings( 3.0 );
+  const std::size_t size = RareFailureAnalysis::inputSize( settings );
+  ASSERT_EQ( 250u + 10u, size );
+
+  // No noise, no pushes.  The arm sags toward the stop under gravity until
+  // the controller catches it, but doesn't get there.
+  std::vector<double> calm( size, 0.0 );
+  // A big push up at the start
+  std::vector<double> slam( size, 0.0 );
+  slam[ 250 ] = 10.0;
+  const std::vector<double> scores = RareFailureAnalysis::score( settings, { calm, slam } );
+  ASSERT_GE( scores[ 0 ], -PidSim::Utils::degToRad( 60 ));
+  ASSERT_LT( scores[ 0 ], -PidSim::Utils::degToRad( 30 ));
+  ASSERT_EQ( 0.0, scores[ 1 ] );
+}
+
+//
+// Where plain Monte Carlo can check it, subset simulation agrees
+//
+TEST( RARE_FAILURE, matches_monte_carlo )
+{
+  const RareFailureAnalysis::Settings settings = testSettings( 2.0 );
+  const RareFailureAnalysis::Report truth = RareFailureAnalysis::monteCarlo( settings, 5000 );
+  ASSERT_GT( truth.mFailures, 50u );
+
+  for ( std::uint64_t seed = 1; seed <= 2; ++seed ) {
+    RareFailureAnalysis::Settings seeded = settings;
+    seeded.mSeed = seed;
+    const RareFailureAnalysis::Report report = RareFailureAnalysis::run( seeded );
+    ASSERT_LE( report.mSimulations, 2000u );
+    ASSERT_EQ( 1u, report.mLevels.size() );
+    ASSERT_GT( report.mProbability, truth.mProbability / 1.5 );
+    ASSERT_LT( report.mProbability, truth.mProbability * 1.5 );
+  }
+}
+
+//
+// Probabilities under 1e-6 take thousands of runs, not millions.  Gentler
+// pushes are less likely to crash the arm, and different seeds agree.
+//
+TEST( RARE_FAILURE, deep_tail )
+{
+  RareFailureAnalysis::Settings settings = testSettings( 1.0 );
+  settings.mRunsPerLevel = 500;
+  const RareFailureAnalysis::Report deep = RareFailureAnalysis::run( settings );
+
+  ASSERT_LT( deep.mProbability, 1e-6 );
+  ASSERT_GT( deep.mProbability, 0.0 );
+  ASSERT_LE( deep.mSimulations, 5000u );
+  ASSERT_GT( deep.mAcceptance, 0.1 );
+  for ( std::size_t level = 1; level < deep.mLevels.size(); ++level ) {
+    ASSERT_GT( deep.mLevels[ level ], deep.mLevels[ level - 1 ] );
+  }
+
+  settings.mSeed = 2;
+  const double other = RareFailureAnalysis::run( settings ).mProbability;
+  ASSERT_LT( fabs( log( other / deep.mProbability )), log( 2.0 ));
+
+  // A rough estimate is plenty for the comparison
+  RareFailureAnalysis::Settings moderate = testSettings( 1.5 );
+  moderate.mRunsPerLevel = 250;
+  ASSERT_GT( RareFailureAnalysis::run( moderate ).mProbability, 10.0 * deep.mProbability );
+}
+
+TEST( RARE_FAILURE, deterministic )
+{
+  const RareFailureAnalysis::Report a = RareFailureAnalysis::run( testSettings( 2.0 ));
+  const RareFailureAnalysis::Report b = RareFailureAnalysis::run( testSettings( 2.0 ));
+  ASSERT_EQ( a.mProbability, b.mProbability );
+  ASSERT_EQ( a.mLevels, b.mLevels );
+}
@@ -0,0 +1,233 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../pidsim/pidsim_backend_result_cache.h"
+#include "../pidsim/pidsim_backend_sweep.h"
+
+using PidSim::BatchSim;
+using PidSim::ResultCache;
+using PidSim::StepMetrics;
+
+// A fresh cache file for each test
+static std::string cachePath( const std::string& name )
+{
+  const std::string path = testing::TempDir() + "pidsim_" + name + "_" + std::to_string( getpid() ) + ".cache";
+  std::remove( path.c_str() );
+  return path;
+}
+
+static BatchSim::ArmSettings testArm()
+{
+  BatchSim::ArmSettings arm;
+  arm.mPidP         = 3.0;
+  arm.mPidI         = 1.0;
+  arm.mPidD         = 0.5;
+  arm.mStartAngle   = PidSim::Utils::degToRad( -90 );
+  arm.mNoiseStream  = 0;
+  return arm;
+}
+
+// Metrics that are easy to check, one set per value
+static StepMetrics::Result testMetrics( double value )
+{
+  return { value, value + 1, value + 2, value + 3, value + 4, value + 5, value + 6, value + 7, true };
+}
+
+TEST( RESULT_CACHE, key_covers_the_scenario )
+{
+  const BatchSim::ArmSettings arm = testArm();
+  const ResultCache::Key key = ResultCache::key( arm, 250, 1 );
+  ASSERT_TRUE( key == ResultCache::key( arm, 250, 1 ));
+  ASSERT_FALSE( key == ResultCache::key( arm, 251, 1 ));
+  ASSERT_FALSE( key == ResultCache::key( arm, 250, 2 ));
+
+  BatchSim::ArmSettings other = arm;
+  other.mPidD = std::nextafter( arm.mPidD, 1.0 );
+  ASSERT_FALSE( key == ResultCache::key( other, 250, 1 ));
+  other = arm;
+  other.mMotorDelay = 20.0;
+  ASSERT_FALSE( key == ResultCache::key( other, 250, 1 ));
+  other = arm;
+  other.mNoiseStream = 1;
+  ASSERT_FALSE( key == ResultCache::key( other, 250, 1 ));
+  other = arm;
+  other.mProfileType = PidSim::MotionProfile::Type::SCurve;
+  ASSERT_FALSE( key == ResultCache::key( other, 250, 1 ));
+  other = arm;
+  other.mTargetAngle = -0.0;
+  ASSERT_TRUE( key == ResultCache::key( other, 250, 1 ));
+}
+
+//
+// What goes in comes back out, here and after reopening the file
+//
+TEST( RESULT_CACHE, round_trip )
+{
+  const std::string path = cachePath( "round_trip" );
+  const ResultCache::Key a = ResultCache::key( testArm(), 250, 1 );
+  const ResultCache::Key b = ResultCache::key( testArm(), 250, 2 );
+  const std::vector<double> trajectory = { 0.5, -1.25, 3.0 };
+  {
+    ResultCache cache( path );
+    ASSERT_TRUE( cache.isOpen() );
+    StepMetrics::Result metrics;
+    ASSERT_FALSE( cache.find( a, metrics ));
+    ASSERT_TRUE( cache.insert( a, testMetrics( 10.0 ), trajectory ));
+    ASSERT_TRUE( cache.insert( b, testMetrics( 20.0 )));
+    ASSERT_FALSE( cache.insert( a, testMetrics( 30.0 )));
+    ASSERT_EQ( 2u, cache.size() );
+  }
+  ResultCache cache( path );
+  ASSERT_EQ( 2u, cache.size() );
+  StepMetrics::Result metrics;
+  std::vector<double> found;
+  ASSERT_TRUE( cache.find( a, metrics, &found ));
+  ASSERT_EQ( 10.0, metrics.mRiseTime );
+  ASSERT_EQ( 17.0, metrics.mControlEffort );
+  ASSERT_TRUE( metrics.mSettled );
+  ASSERT_EQ( trajectory, found );
+  ASSERT_TRUE( cache.find( b, metrics, &found ));
+  ASSERT_EQ( 26.0, metrics.mITAE );
+  ASSERT_TRUE( found.empty() );
+  std::remove( path.c_str() );
+}
+
+//
+// A record can be found right after it's inserted, through the same
+// cache, including once the file has grown past the first map.
+//
+TEST( RESULT_CACHE, find_after_insert )
+{
+  const std::string path = cachePath( "find_after_insert" );
+  ResultCache cache( path );
+  const std::vector<double> trajectory( 20000, 0.25 );
+  StepMetrics::Result metrics;
+  std::vector<double> found;
+  for ( std::uint64_t seed = 0; seed < 16; ++seed ) {
+    const ResultCache::Key key = ResultCache::key( testArm(), 250, seed );
+    ASSERT_TRUE( cache.insert( key, testMetrics( static_cast<double>( seed )), trajectory ));
+    ASSERT_TRUE( cache.find( key, metrics, &found ));
+    ASSERT_EQ( static_cast<double>( seed ), metrics.mRiseTime );
+    ASSERT_EQ( trajectory, found );
+  }
+  std::remove( path.c_str() );
+}
+
+//
+// A crash mid append leaves part of a record.  Readers ignore it, and
+// the next append cuts it off.  A file that isn't a cache isn't touched.
+//
+TEST( RESULT_CACHE, torn_tail_and_bad_files )
+{
+  const std::string path = cachePath( "torn" );
+  const ResultCache::Key a = ResultCache::key( testArm(), 250, 1 );
+  const ResultCache::Key b = ResultCache::key( testArm(), 250, 2 );
+  {
+    ResultCache cache( path );
+    ASSERT_TRUE( cache.insert( a, testMetrics( 1.0 )));
+  }
+  {
+    std::ofstream file( path, std::ios::binary | std::ios::app );
+    const char junk[ 100 ] = { 'S', 'P', 'D', 'R', 'O', 'C', 'E', 'R' };
+    file.write( junk, sizeof( junk ));
+  }
+  {
+    ResultCache cache( path );
+    ASSERT_EQ( 1u, cache.size() );
+    ASSERT_TRUE( cache.insert( b, testMetrics( 2.0 )));
+  }
+  ResultCache cache( path );
+  ASSERT_EQ( 2u, cache.size() );
+  StepMetrics::Result metrics;
+  ASSERT_TRUE( cache.find( b, metrics ));
+  ASSERT_EQ( 2.0, metrics.mRiseTime );
+  std::remove( path.c_str() );
+
+  const std::string notCache = cachePath( "not_a_cache" );
+  {
+    std::ofstream file( notCache );
+    file << "some other file, that's long enough to have a header\n";
+  }
+  ResultCache bad( notCache );
+  ASSERT_FALSE( bad.isOpen() );
+  ASSERT_FALSE( bad.insert( a, testMetrics( 1.0 )));
+  ASSERT_FALSE( bad.find( a, metrics ));
+  std::remove( notCache.c_str() );
+}
+
+//
+// Processes append to one file at once.  Half of each one's keys are
+// shared with the next, and every key ends up stored exactly once.
+//
+TEST( RESULT_CACHE, concurrent_writers )
+{
+  const std::string path = cachePath( "concurrent" );
+  constexpr int processes = 4;
+  constexpr int keysPerProcess = 400;
+  { ResultCache create( path ); }
+
+  std::vector<pid_t> children;
+  for ( int process = 0; process < processes; ++process ) {
+    const pid_t child = fork();
+    if ( child == 0 ) {
+      ResultCache cache( path );
+      const int first = process * keysPerProcess / 2;
+      for ( int i = first; i < first + keysPerProcess; ++i ) {
+        BatchSim::ArmSettings arm = testArm();
+        arm.mNoiseStream = static_cast<std::uint64_t>( i );
+        cache.insert( ResultCache::key( arm, 250, 1 ), testMetrics( i ));
+      }
+      _exit( 0 );
+    }
+    children.push_back( child );
+  }
+  for ( pid_t child : children ) {
+    int status = 0;
+    waitpid( child, &status, 0 );
+    ASSERT_EQ( 0, status );
+  }
+
+  ResultCache cache( path );
+  const int unique = ( processes + 1 ) * keysPerProcess / 2;
+  ASSERT_EQ( static_cast<std::size_t>( unique ), cache.size() );
+  for ( int i = 0; i < unique; ++i ) {
+    BatchSim::ArmSettings arm = testArm();
+    arm.mNoiseStream = static_cast<std::uint64_t>( i );
+    StepMetrics::Result metrics;
+    ASSERT_TRUE( cache.find( ResultCache::key( arm, 250, 1 ), metrics ));
+    ASSERT_EQ( static_cast<double>( i ), metrics.mRiseTime );
+  }
+  std::remove( path.c_str() );
+}
+
+//
+// A second sweep over the same runs is all lookups, with the same results
+//
+TEST( RESULT_CACHE, sweeps_reuse_results )
+{
+  const std::string path = cachePath( "sweep" );
+  PidSim::ParameterSweep::Settings settings;
+  settings.mArm = testArm();
+  settings.mAxes = {
+    { &BatchSim::ArmSettings::mPidP,            1.0, 6.0 },
+    { &BatchSim::ArmSettings::mPidI,            0.0, 3.0 },
+    { &BatchSim::ArmSettings::mPidD,            0.0, 2.0 },
+    { &BatchSim::ArmSettings::mRollingFriction, 0.0, 0.01 },
+  };
+  const PidSim::ParameterSweep sweep( settings );
+  const std::size_t count = 4096;
+  ResultCache cache( path );
+
+  const std::vector<StepMetrics::Result> simulated = sweep.run( 0, count, &cache );
+  ResultCache reopened( path );
+  const std::vector<StepMetrics::Result> cached = sweep.run( 0, count, &reopened );
+
+  for ( std::size_t i = 0; i < count; ++i ) {
+    ASSERT_EQ( simulated[ i ].mITAE, cached[ i ].mITAE );
+    ASSERT_EQ( simulated[ i ].mSettled, cached[ i ].mSettled );
+  }
+  ASSERT_EQ( count, reopened.size() );
+  std::remove( path.c_str() );
+}
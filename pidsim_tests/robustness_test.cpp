@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+#include "../pidsim/pidsim_backend_robustness.h"
+
+using PidSim::RobustnessAnalysis;
+using Distribution = RobustnessAnalysis::Distribution;
+
+//
+// Gains that meet the specs on about 90% of these arms.  Sensor delay
+// is what hurts most.
+//
+static RobustnessAnalysis::Settings testSettings()
+{
+  RobustnessAnalysis::Settings settings;
+  settings.mArm.mPidP         = 3.46;
+  settings.mArm.mPidI         = 2.29;
+  settings.mArm.mPidD         = 0.86;
+  settings.mArm.mStartAngle   = PidSim::Utils::degToRad( -90 );
+  settings.mArm.mTargetAngle  = 0.0;
+  settings.mRollingFriction   = { Distribution::Shape::Uniform, 0.001, 0.01 };
+  settings.mSensorDelay       = { Distribution::Shape::Uniform, 0.0, 100.0 };
+  settings.mMotorDelay        = { Distribution::Shape::Normal, 20.0, 10.0 };
+  settings.mSensorNoise       = { Distribution::Shape::Uniform, 0.0, 2.0 };
+  return settings;
+}
+
+// Every draw, no early stopping
+static RobustnessAnalysis::Settings exhaustive( RobustnessAnalysis::Settings settings )
+{
+  settings.mRequiredRate  = -1.0;
+  settings.mHalfWidth     = 0.0;
+  return settings;
+}
+
+TEST( ROBUSTNESS, wilson_interval )
+{
+  double lower, upper;
+  RobustnessAnalysis::wilsonInterval( 8, 10, 0.95, lower, upper );
+  ASSERT_NEAR( 0.4902, lower, 1e-4 );
+  ASSERT_NEAR( 0.9433, upper, 1e-4 );
+  RobustnessAnalysis::wilsonInterval( 0, 0, 0.95, lower, upper );
+  ASSERT_EQ( 0.0, lower );
+  ASSERT_EQ( 1.0, upper );
+  RobustnessAnalysis::wilsonInterval( 100, 100, 0.95, lower, upper );
+  ASSERT_GT( lower, 0.95 );
+  ASSERT_EQ( 1.0, upper );
+}
+
+//
+// Draws come from the seed and their index, not from the round they're
+// simulated in.
+//
+TEST( ROBUSTNESS, draws_are_reproducible )
+{
+  RobustnessAnalysis::Settings settings = exhaustive( testSettings() );
+  settings.mMaxDraws = 1000;
+  RobustnessAnalysis a( settings );
+  settings.mRoundSize = 77;
+  RobustnessAnalysis b( settings );
+  const RobustnessAnalysis::Report& reportA = a.run();
+  const RobustnessAnalysis::Report& reportB = b.run();
+  ASSERT_EQ( 1000u, reportA.mDraws );
+  ASSERT_EQ( reportA.mPasses, reportB.mPasses );
+  ASSERT_EQ( reportA.mSettleFailures, reportB.mSettleFailures );
+  ASSERT_EQ( reportA.mOvershootFailures, reportB.mOvershootFailures );
+
+  const auto arm = RobustnessAnalysis::drawArm( settings, 123 );
+  ASSERT_GE( arm.mRollingFriction, 0.001 );
+  ASSERT_LE( arm.mRollingFriction, 0.01 );
+  ASSERT_GE( arm.mSensorDelay, 0.0 );
+  ASSERT_LE( arm.mSensorDelay, 100.0 );
+  ASSERT_GE( arm.mMotorDelay, 0.0 );
+  ASSERT_EQ( settings.mArm.mPidP, arm.mPidP );
+}
+
+//
+// Sobol draws estimate the pass rate with less scatter than random
+// draws of the same count.  Replicates differ only in their seed.
+//
+TEST( ROBUSTNESS, quasi_random_draws )
+{
+  RobustnessAnalysis::Settings settings = exhaustive( testSettings() );
+  settings.mMaxDraws = 16384;
+  const double reference = RobustnessAnalysis( settings ).run().mPassRate;
+
+  settings.mMaxDraws = 512;
+  double quasiSquares = 0.0, randomSquares = 0.0;
+  for ( std::uint64_t seed = 1; seed <= 8; ++seed ) {
+    settings.mSeed = seed;
+    settings.mQuasiRandom = false;
+    randomSquares += pow( RobustnessAnalysis( settings ).run().mPassRate - reference, 2 );
+    settings.mQuasiRandom = true;
+    const auto arm = RobustnessAnalysis::drawArm( settings, 5 );
+    ASSERT_GE( arm.mSensorDelay, 0.0 );
+    ASSERT_LT( arm.mSensorDelay, 100.0 );
+    quasiSquares += pow( RobustnessAnalysis( settings ).run().mPassRate - reference, 2 );
+  }
+  ASSERT_LT( quasiSquares, randomSquares );
+}
+
+//
+// Stopping early uses a fraction of the draws, and the interval still
+// covers the rate a big fixed budget finds.
+//
+TEST( ROBUSTNESS, stops_early )
+{
+  RobustnessAnalysis::Settings settings = exhaustive( testSettings() );
+  RobustnessAnalysis truth( settings );
+  const double rate = truth.run().mPassRate;
+  ASSERT_EQ( settings.mMaxDraws, truth.getReport().mDraws );
+  ASSERT_GT( rate, 0.8 );
+  ASSERT_LT( rate, 0.95 );
+
+  for ( std::uint64_t seed = 1; seed <= 5; ++seed ) {
+    settings = testSettings();
+    settings.mSeed      = seed;
+    settings.mHalfWidth = 0.03;
+    RobustnessAnalysis early( settings );
+    const RobustnessAnalysis::Report& report = early.run();
+    ASSERT_LE( report.mDraws, settings.mMaxDraws / 4 );
+    ASSERT_LE( report.mLower, rate );
+    ASSERT_GE( report.mUpper, rate );
+  }
+}
+
+//
+// A clear pass or fail is decided in one round.
+//
+TEST( ROBUSTNESS, clear_verdicts )
+{
+  RobustnessAnalysis::Settings settings = testSettings();
+  settings.mSensorDelay = { Distribution::Shape::Uniform, 0.0, 40.0 };
+  RobustnessAnalysis good( settings );
+  ASSERT_EQ( RobustnessAnalysis::Verdict::Meets, good.run().mVerdict );
+  ASSERT_EQ( 1u, good.getReport().mRounds );
+
+  settings.mSensorDelay = { Distribution::Shape::Uniform, 100.0, 300.0 };
+  RobustnessAnalysis bad( settings );
+  ASSERT_EQ( RobustnessAnalysis::Verdict::Fails, bad.run().mVerdict );
+  ASSERT_EQ( 1u, bad.getReport().mRounds );
+  ASSERT_GT( bad.getReport().mSettleFailures + bad.getReport().mOvershootFailures, 0u );
+}
@@ -0,0 +1,169 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <sstream>
+#include <unistd.h>
+#include "../pidsim/pidsim_backend_scenario.h"
+#include "../pidsim/pidsim_backend_telemetry.h"
+
+using PidSim::Scenario;
+using PidSim::Session;
+
+namespace {
+
+// A family of runs on one arm: a setpoint schedule, and a bump
+const char* family = R"(
+# Shared by every scenario
+p 2.0
+i 0.5
+d 0.5
+start -45
+target 30
+sensor_noise 1.0
+seed 7
+duration 20
+at 5 target 120     # Then up
+at 12 target -20    # And back down
+
+scenario plain
+
+scenario bumped
+at 8 wack_down
+at 8.5 nudge_up
+
+scenario delayed
+sensor_delay 40
+motor_delay 60
+state_estimator on
+profile trapezoidal
+at 3 p 3.0
+)";
+
+std::vector<Scenario> parseOk( const std::string& text, const std::string& name = "unnamed" )
+{
+  std::istringstream in( text );
+  std::vector<Scenario> scenarios;
+  std::string error;
+  EXPECT_TRUE( Scenario::parse( in, name, scenarios, error )) << error;
+  return scenarios;
+}
+
+}
+
+TEST( SCENARIO, parses_defaults_and_scenarios )
+{
+  const std::vector<Scenario> scenarios = parseOk( family );
+  ASSERT_EQ( 3u, scenarios.size() );
+  ASSERT_EQ( "plain",   scenarios[ 0 ].getName() );
+  ASSERT_EQ( "bumped",  scenarios[ 1 ].getName() );
+  ASSERT_EQ( "delayed", scenarios[ 2 ].getName() );
+  for ( const Scenario& scenario : scenarios ) {
+    ASSERT_EQ( 2.0,   scenario.getInputs().mP );
+    ASSERT_EQ( -45.0, scenario.getInputs().mStartAngle );
+    ASSERT_EQ( 30.0,  scenario.getInputs().mTargetAngle );
+    ASSERT_EQ( 7u,    scenario.getSeed() );
+    ASSERT_EQ( 20.0,  scenario.getDuration() );
+  }
+  ASSERT_EQ( 0.0,  scenarios[ 0 ].getInputs().mSensorDelay );
+  ASSERT_EQ( 40.0, scenarios[ 2 ].getInputs().mSensorDelay );
+  ASSERT_TRUE( scenarios[ 2 ].getInputs().mStateEstimator );
+  ASSERT_EQ( PidSim::MotionProfile::Type::Trapezoidal, scenarios[ 2 ].getInputs().mProfile );
+
+  // No scenario lines is one scenario, with the GUI's defaults
+  const std::vector<Scenario> single = parseOk( "p 1\n", "single" );
+  ASSERT_EQ( 1u, single.size() );
+  ASSERT_EQ( "single", single[ 0 ].getName() );
+  ASSERT_EQ( -90.0, single[ 0 ].getInputs().mStartAngle );
+  ASSERT_EQ( 2.0, single[ 0 ].getInputs().mRollingFriction );
+}
+
+TEST( SCENARIO, errors_say_where )
+{
+  const std::pair<const char*, const char*> bad[] = {
+    { "p 1\nq 2\n",                    "line 2: unknown setting q" },
+    { "p one\n",                       "line 1: bad p one" },
+    { "\n\nat -1 target 5\n",          "line 3: expected at <seconds> <setting> [value]" },
+    { "at 1 wack_up 5\n",              "line 1: wack_up doesn't take a value" },
+    { "wack_up 1\n",                   "line 1: wack_up only makes sense with at <seconds>" },
+    { "state_estimator yes\n",         "line 1: state_estimator should be on or off" },
+    { "profile jerky\n",               "line 1: profile should be step, trapezoidal or scurve" },
+    { "duration 0\n",                  "line 1: bad duration 0" },
+    { "scenario\n",                    "line 1: expected scenario <name>" },
+    { "p 1 2\n",                       "line 1: expected <setting> <value>" },
+    { "p 1\nsensor_delay -100\n",       "line 2: sensor_delay has to be at least 0 and under 320 ms" },
+    { "at 1 motor_delay 500\n",         "line 1: motor_delay has to be at least 0 and under 320 ms" },
+    { "sensor_noise -1\n",              "line 1: sensor_noise can't be negative" },
+    { "rolling_friction 50\n",          "line 1: rolling_friction has to be at least 0 and under 50" },
+  };
+  for ( const auto& [ text, message ] : bad ) {
+    std::istringstream in( text );
+    std::vector<Scenario> scenarios = parseOk( "p 1\n" );
+    std::string error;
+    ASSERT_FALSE( Scenario::parse( in, "bad", scenarios, error )) << text;
+    ASSERT_EQ( message, error );
+    ASSERT_EQ( 1u, scenarios.size() );
+  }
+
+  std::vector<Scenario> scenarios;
+  std::string error;
+  ASSERT_FALSE( Scenario::load( "/nonexistent/arm.scenario", scenarios, error ));
+  ASSERT_EQ( "/nonexistent/arm.scenario: can't open", error );
+}
+
+//
+// A run is the session the GUI would have had, given the same inputs
+// at the same ticks
+//
+TEST( SCENARIO, run_matches_a_session )
+{
+  const Scenario scenario = parseOk( family )[ 1 ];
+  const Scenario::Result result = scenario.run();
+  ASSERT_EQ( 1000u, result.mTicks );
+
+  Session::Inputs inputs = scenario.getInputs();
+  Session session( inputs, scenario.getSeed() );
+  std::vector<PidSim::StepMetrics::Result> steps;
+  for ( unsigned tick = 0; tick < 1000; ++tick ) {
+    const double target = tick < 250 ? 30.0 : tick < 600 ? 120.0 : -20.0;
+    if ( target != inputs.mTargetAngle ) {
+      steps.push_back( session.getStepMetrics().getResult() );
+    }
+    inputs.mTargetAngle = target;
+    inputs.mWackDown    = tick == 400;
+    inputs.mNudgeUp     = tick == 425;
+    session.tick( inputs );
+  }
+  steps.push_back( session.getStepMetrics().getResult() );
+
+  ASSERT_EQ( 3u, result.mSteps.size() );
+  const double starts[] = { 0.0, 5.0, 12.0 }, targets[] = { 30.0, 120.0, -20.0 };
+  for ( std::size_t step = 0; step < 3; ++step ) {
+    ASSERT_NEAR( starts[ step ], result.mSteps[ step ].mStartTime, 1e-9 );
+    ASSERT_EQ( targets[ step ], result.mSteps[ step ].mTarget );
+    ASSERT_EQ( steps[ step ].mIAE, result.mSteps[ step ].mMetrics.mIAE );
+    ASSERT_EQ( steps[ step ].mSettlingTime, result.mSteps[ step ].mMetrics.mSettlingTime );
+  }
+
+  // The bump shows up in the second step, and only in the bumped run
+  const Scenario::Result plain = parseOk( family )[ 0 ].run();
+  ASSERT_EQ( plain.mSteps[ 0 ].mMetrics.mIAE, result.mSteps[ 0 ].mMetrics.mIAE );
+  ASSERT_GT( result.mSteps[ 1 ].mMetrics.mIAE, plain.mSteps[ 1 ].mMetrics.mIAE );
+}
+
+TEST( SCENARIO, traces_every_tick )
+{
+  const std::string path = testing::TempDir() + "pidsim_scenario_" + std::to_string( getpid() ) + ".trace";
+  const Scenario scenario = parseOk( family )[ 2 ];
+  {
+    PidSim::Telemetry telemetry( path );
+    ASSERT_TRUE( telemetry.isOpen() );
+    scenario.run( &telemetry );
+    ASSERT_TRUE( telemetry.close() );
+  }
+  PidSim::TraceReader reader( path );
+  ASSERT_TRUE( reader.isOpen() );
+  ASSERT_EQ( 1000u, reader.getRows() );
+  const std::vector<double> p = reader.readColumn( reader.findColumn( "p" ));
+  ASSERT_EQ( 2.0, p[ 149 ] );
+  ASSERT_EQ( 3.0, p[ 150 ] );
+  std::remove( path.c_str() );
+}
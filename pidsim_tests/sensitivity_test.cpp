@@ -0,0 +1,88 @@
+#include <gtest/gtest.h>
+#include <math.h>
+#include "../pidsim/pidsim_backend_sensitivity.h"
+#include "../pidsim/pidsim_utils_dual.h"
+
+using PidSim::BatchSim;
+using PidSim::Sensitivity;
+
+static BatchSim::ArmSettings testArm()
+{
+  BatchSim::ArmSettings arm;
+  arm.mPidP             = 3.0;
+  arm.mPidI             = 0.5;
+  arm.mPidD             = 1.0;
+  arm.mStartAngle       = PidSim::Utils::degToRad( -90 );
+  arm.mTargetAngle      = PidSim::Utils::degToRad( 0 );
+  arm.mRollingFriction  = 0.004;
+  arm.mSensorDelay      = 40.0;
+  arm.mMotorDelay       = 20.0;
+  return arm;
+}
+
+//
+// Dual numbers get the textbook derivatives.
+//
+TEST( SENSITIVITY, dual_numbers_work )
+{
+  using Dual = PidSim::Utils::Dual<2>;
+  const Dual x = Dual::variable( 0.5, 0 );
+  const Dual y = Dual::variable( -2.0, 1 );
+
+  // f = x * y + sin( x ) / y - 3
+  const Dual f = x * y + sin( x ) / y - 3.0;
+  ASSERT_DOUBLE_EQ( 0.5 * -2.0 + sin( 0.5 ) / -2.0 - 3.0, f.mValue );
+  ASSERT_DOUBLE_EQ( -2.0 + cos( 0.5 ) / -2.0, f.mGradient[ 0 ] );
+  ASSERT_DOUBLE_EQ( 0.5 - sin( 0.5 ) / 4.0, f.mGradient[ 1 ] );
+
+  const Dual g = abs( -x ) * cos( y );
+  ASSERT_DOUBLE_EQ( cos( -2.0 ), g.mGradient[ 0 ] );
+  ASSERT_DOUBLE_EQ( -0.5 * sin( -2.0 ), g.mGradient[ 1 ] );
+  ASSERT_TRUE( x < y + 3.0 );
+  ASSERT_EQ( 0.5, PidSim::Utils::valueOf( x ));
+}
+
+//
+// The dual run's value is the plain run, exactly.
+//
+TEST( SENSITIVITY, value_matches_plain_run )
+{
+  const BatchSim::ArmSettings arm = testArm();
+  const Sensitivity::Result result = Sensitivity::runStepResponse( arm, 250 );
+  ASSERT_EQ( Sensitivity::runCost( arm, 250 ), result.mCost );
+  ASSERT_EQ( 250u, result.mAngles.size() );
+  ASSERT_EQ( 250u, result.mAngleGradients.size() );
+}
+
+//
+// The gradient matches central finite differences, for a few sets of
+// gains, with and without the motor saturating.
+//
+TEST( SENSITIVITY, gradient_matches_finite_differences )
+{
+  const std::array<std::array<double, 3>, 4> gains{{
+    { 3.0, 0.5, 1.0 },
+    { 0.8, 0.1, 0.3 },
+    { 6.0, 2.0, 2.5 },
+    { 1.5, 0.0, 0.0 },
+  }};
+  for ( const auto& gain : gains ) {
+    BatchSim::ArmSettings arm = testArm();
+    arm.mPidP = gain[ 0 ];
+    arm.mPidI = gain[ 1 ];
+    arm.mPidD = gain[ 2 ];
+    const Sensitivity::Result result = Sensitivity::runStepResponse( arm, 250 );
+
+    for ( int i = 0; i < 3; ++i ) {
+      constexpr double step = 1e-6;
+      BatchSim::ArmSettings up = arm, down = arm;
+      double* upGain[]   = { &up.mPidP,   &up.mPidI,   &up.mPidD };
+      double* downGain[] = { &down.mPidP, &down.mPidI, &down.mPidD };
+      *upGain[ i ]   += step;
+      *downGain[ i ] -= step;
+      const double finite = ( Sensitivity::runCost( up, 250 ) - Sensitivity::runCost( down, 250 )) / ( 2 * step );
+      ASSERT_NEAR( finite, result.mGradient[ i ], 1e-4 * std::max( 1.0, std::abs( finite )))
+        << "gains " << gain[ 0 ] << " " << gain[ 1 ] << " " << gain[ 2 ] << " index " << i;
+    }
+  }
+}
@@ -0,0 +1,171 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include "../pidsim/pidsim_backend_session_log.h"
+
+using PidSim::Session;
+using PidSim::SessionLog;
+
+namespace {
+
+Session::Inputs startingInputs()
+{
+  Session::Inputs inputs;
+  inputs.mP           = 2.0;
+  inputs.mI           = 0.5;
+  inputs.mD           = 0.5;
+  inputs.mStartAngle  = -45.0;
+  inputs.mTargetAngle = 30.0;
+  inputs.mSensorNoise = 2.0;
+  return inputs;
+}
+
+//
+// A student playing with everything: sliders dragged, targets moved,
+// bumps, resets and slow time
+//
+Session::Inputs scriptedInputs( unsigned tick )
+{
+  Session::Inputs inputs = startingInputs();
+  inputs.mTargetAngle     = tick < 400 ? 30.0 : tick < 900 ? 120.0 : -20.0;
+  inputs.mP               = 2.0 + ( tick > 200 && tick < 300 ? ( tick - 200 ) * 0.01 : 0.0 );
+  inputs.mProfile         = tick < 600 ? PidSim::MotionProfile::Type::Step : PidSim::MotionProfile::Type::Trapezoidal;
+  inputs.mRollingFriction = tick < 500 ? 0.0 : 0.3;
+  inputs.mSensorDelay     = tick < 700 ? 0.0 : 40.0;
+  inputs.mMotorDelay      = tick < 800 ? 0.0 : 60.0;
+  inputs.mStateEstimator  = tick > 1000;
+  inputs.mGainScheduled   = tick > 1100;
+  inputs.mSlowTime        = tick > 1200 && tick < 1300;
+  inputs.mNudgeUp         = tick == 150;
+  inputs.mWackDown        = tick == 450;
+  inputs.mReset           = tick == 1400;
+  return inputs;
+}
+
+//
+// Run a session on the script, logging it
+//
+std::vector<double> runScript( SessionLog& log, std::uint64_t seed, unsigned ticks )
+{
+  Session session( startingInputs(), seed );
+  std::vector<double> angles;
+  for ( unsigned tick = 0; tick < ticks; ++tick ) {
+    const Session::Inputs inputs = scriptedInputs( tick );
+    log.record( inputs );
+    session.tick( inputs );
+    angles.push_back( session.getControlLoop().getPhysicsSim().getActualAngle() );
+  }
+  return angles;
+}
+
+}
+
+//
+// The replay is the recorded run, bit for bit, and another seed isn't
+//
+TEST( SESSION_LOG, replay_is_bit_for_bit )
+{
+  SessionLog log( startingInputs(), 1234 );
+  const std::vector<double> recorded = runScript( log, 1234, 2000 );
+  ASSERT_EQ( 2000u, log.getTicks() );
+  ASSERT_EQ( recorded, log.replay() );
+
+  SessionLog other( startingInputs(), 1235 );
+  ASSERT_NE( recorded, runScript( other, 1235, 2000 ));
+}
+
+//
+// A saved log loads back the same
+//
+TEST( SESSION_LOG, save_and_load )
+{
+  SessionLog log( startingInputs(), 99 );
+  const std::vector<double> recorded = runScript( log, 99, 1500 );
+  const std::string path = testing::TempDir() + "session_log_test.log";
+  ASSERT_TRUE( log.save( path ));
+
+  SessionLog loaded( Session::Inputs{}, 0 );
+  ASSERT_TRUE( loaded.load( path ));
+  ASSERT_EQ( 99u, loaded.getSeed() );
+  ASSERT_EQ( log.getTicks(), loaded.getTicks() );
+  ASSERT_EQ( log.getBytes(), loaded.getBytes() );
+  ASSERT_EQ( recorded, loaded.replay() );
+
+  // Recording carries on from where the saved log left off
+  loaded.record( scriptedInputs( 1500 ));
+  log.record( scriptedInputs( 1500 ));
+  ASSERT_EQ( log.getBytes(), loaded.getBytes() );
+  std::remove( path.c_str() );
+}
+
+//
+// Truncated or foreign files don't load, and leave the log alone
+//
+TEST( SESSION_LOG, bad_files_dont_load )
+{
+  SessionLog log( startingInputs(), 7 );
+  runScript( log, 7, 1000 );
+  const std::string path = testing::TempDir() + "session_log_test_bad.log";
+  ASSERT_TRUE( log.save( path ));
+  std::ifstream in( path, std::ios::binary );
+  const std::string bytes(( std::istreambuf_iterator<char>( in )), std::istreambuf_iterator<char>() );
+  in.close();
+
+  SessionLog loaded( startingInputs(), 3 );
+  for ( std::size_t length : { std::size_t{ 0 }, std::size_t{ 20 }, bytes.size() - 1 } ) {
+    std::ofstream( path, std::ios::binary | std::ios::trunc ).write( bytes.data(), static_cast<std::streamsize>( length ));
+    ASSERT_FALSE( loaded.load( path ));
+  }
+  std::string foreign = bytes;
+  foreign[ 0 ] ^= 1;
+  std::ofstream( path, std::ios::binary | std::ios::trunc ).write( foreign.data(), static_cast<std::streamsize>( foreign.size() ));
+  ASSERT_FALSE( loaded.load( path ));
+  ASSERT_EQ( 3u, loaded.getSeed() );
+  ASSERT_EQ( 0u, loaded.getTicks() );
+  std::remove( path.c_str() );
+}
+
+//
+// Sizes past the end of the file, and profiles that don't exist, don't load
+//
+TEST( SESSION_LOG, corrupt_headers_and_fields_dont_load )
+{
+  const std::string path = testing::TempDir() + "session_log_test_corrupt.log";
+  const auto write = [&]( std::uint64_t initialSize, std::uint64_t changesSize, std::vector<std::uint8_t> body ) {
+    const std::uint64_t header[ 6 ] = { 0x474f4c534d495350ull, 1, 0, 10, initialSize, changesSize };
+    std::ofstream file( path, std::ios::binary | std::ios::trunc );
+    file.write( reinterpret_cast<const char*>( header ), sizeof( header ));
+    file.write( reinterpret_cast<const char*>( body.data() ), static_cast<std::streamsize>( body.size() ));
+  };
+
+  // Stamp 0, the profile field (after the 9 doubles), then the profile
+  SessionLog loaded( startingInputs(), 3 );
+  write( 3, 0, { 0, 9, 2 } );
+  ASSERT_TRUE( loaded.load( path ));
+  ASSERT_EQ( PidSim::MotionProfile::Type::SCurve, loaded.getInitialInputs().mProfile );
+  write( 3, 0, { 0, 9, 3 } );
+  ASSERT_FALSE( loaded.load( path ));
+  write( 3, 1ull << 60, { 0, 9, 2 } );
+  ASSERT_FALSE( loaded.load( path ));
+  write( ~0ull, 3, { 0, 9, 2 } );
+  ASSERT_FALSE( loaded.load( path ));
+  write( 4, 0, { 0, 9, 2 } );
+  ASSERT_FALSE( loaded.load( path ));
+  ASSERT_EQ( 10u, loaded.getTicks() );
+  std::remove( path.c_str() );
+}
+
+//
+// Only changes cost anything
+//
+TEST( SESSION_LOG, still_sliders_are_free )
+{
+  SessionLog log( startingInputs(), 1 );
+  for ( unsigned tick = 0; tick < 100000; ++tick ) {
+    Session::Inputs inputs = startingInputs();
+    inputs.mTargetAngle = tick < 50000 ? 30.0 : 90.0;
+    log.record( inputs );
+  }
+  ASSERT_EQ( 100000u, log.getTicks() );
+  ASSERT_LT( log.getBytes(), 16u );
+}
@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+#include <set>
+#include "../pidsim/pidsim_utils_sobol.h"
+
+using PidSim::Utils::Sobol;
+
+//
+// The standard unscrambled sequence (Gray code order), first two axes
+//
+TEST( SOBOL, known_points )
+{
+  const Sobol sobol( 2 );
+  const double axis0[] = { 0.0, 0.5, 0.75, 0.25, 0.375, 0.875, 0.625, 0.125 };
+  const double axis1[] = { 0.0, 0.5, 0.25, 0.75, 0.375, 0.875, 0.125, 0.625 };
+  for ( std::size_t i = 0; i < 8; ++i ) {
+    ASSERT_EQ( axis0[ i ], sobol.coordinate( i, 0 ));
+    ASSERT_EQ( axis1[ i ], sobol.coordinate( i, 1 ));
+  }
+}
+
+//
+// generate() steps through a range, coordinate() and point() work from
+// the index.  They have to agree, wherever the range starts.
+//
+TEST( SOBOL, bulk_matches_index )
+{
+  for ( const Sobol& sobol : { Sobol( Sobol::maxDimensions ), Sobol( Sobol::maxDimensions, 7 ) } ) {
+    std::vector<double> points;
+    const std::uint64_t first = 123456789;
+    sobol.generate( first, 1000, points );
+    ASSERT_EQ( 1000 * Sobol::maxDimensions, points.size() );
+    for ( std::size_t i = 0; i < 1000; ++i ) {
+      const std::vector<double> point = sobol.point( first + i );
+      for ( std::size_t dimension = 0; dimension < Sobol::maxDimensions; ++dimension ) {
+        ASSERT_EQ( point[ dimension ], points[ i * Sobol::maxDimensions + dimension ] );
+        ASSERT_EQ( point[ dimension ], sobol.coordinate( first + i, dimension ));
+      }
+    }
+  }
+}
+
+//
+// Shards that each take a range, with no idea of the others, make up
+// the sequence one pass makes.
+//
+TEST( SOBOL, shards_are_disjoint_ranges )
+{
+  const Sobol sobol( 6, 42 );
+  std::vector<double> whole;
+  sobol.generate( 0, 1000, whole );
+  std::vector<double> joined;
+  const std::uint64_t bounds[] = { 0, 333, 334, 999, 1000 };
+  for ( std::size_t shard = 0; shard + 1 < 5; ++shard ) {
+    std::vector<double> part;
+    sobol.generate( bounds[ shard ], bounds[ shard + 1 ] - bounds[ shard ], part );
+    joined.insert( joined.end(), part.begin(), part.end() );
+  }
+  ASSERT_EQ( whole, joined );
+}
+
+//
+// Any 2^m aligned points put one point in each 1 / 2^m slice of every
+// axis, and in each cell of a 16 x 16 grid on the first two.  Scrambling
+// keeps that.
+//
+TEST( SOBOL, points_are_stratified )
+{
+  for ( const Sobol& sobol : { Sobol( Sobol::maxDimensions ), Sobol( Sobol::maxDimensions, 3 ) } ) {
+    const std::size_t count = 256;
+    std::vector<double> points;
+    sobol.generate( 5 * count, count, points );
+    for ( std::size_t dimension = 0; dimension < Sobol::maxDimensions; ++dimension ) {
+      std::set<std::size_t> slices;
+      for ( std::size_t i = 0; i < count; ++i ) {
+        slices.insert( static_cast<std::size_t>( points[ i * Sobol::maxDimensions + dimension ] * count ));
+      }
+      ASSERT_EQ( count, slices.size() );
+    }
+    std::set<std::size_t> cells;
+    for ( std::size_t i = 0; i < count; ++i ) {
+      const std::size_t x = static_cast<std::size_t>( points[ i * Sobol::maxDimensions ] * 16 );
+      const std::size_t y = static_cast<std::size_t>( points[ i * Sobol::maxDimensions + 1 ] * 16 );
+      cells.insert( x * 16 + y );
+    }
+    ASSERT_EQ( count, cells.size() );
+  }
+}
+
+//
+// Different seeds scramble differently, the same seed the same way
+//
+TEST( SOBOL, seeds_pick_the_scramble )
+{
+  ASSERT_EQ( Sobol( 4, 9 ).point( 77 ), Sobol( 4, 9 ).point( 77 ));
+  ASSERT_NE( Sobol( 4, 9 ).point( 77 ), Sobol( 4, 10 ).point( 77 ));
+  ASSERT_NE( Sobol( 4 ).point( 77 ), Sobol( 4, 9 ).point( 77 ));
+}
+
+//
+// Integrate a smooth function over the 6D unit cube, exactly 1, with
+// 4096 points.  Each scrambled replicate is unbiased, and its error is
+// much smaller than plain random sampling's.
+//
+TEST( SOBOL, beats_random_sampling )
+{
+  constexpr std::size_t dimensions = 6;
+  constexpr std::size_t count = 4096;
+  constexpr std::size_t replicates = 16;
+  const auto f = []( const double* x ) {
+    double product = 1.0;
+    for ( std::size_t i = 0; i < dimensions; ++i ) {
+      product *= 1.0 + ( x[ i ] - 0.5 ) * ( i + 1 ) / 3.0 + 0.5 * sin( 2.0 * M_PI * x[ i ] );
+    }
+    return product;
+  };
+
+  double sobolSquares = 0.0, randomSquares = 0.0;
+  for ( std::size_t replicate = 0; replicate < replicates; ++replicate ) {
+    std::vector<double> points;
+    Sobol( dimensions, replicate ).generate( 0, count, points );
+    double sobolSum = 0.0, randomSum = 0.0;
+    for ( std::size_t i = 0; i < count; ++i ) {
+      sobolSum += f( &points[ i * dimensions ] );
+      double x[ dimensions ];
+      for ( std::size_t d = 0; d < dimensions; ++d ) {
+        x[ d ] = PidSim::Utils::toUnit( PidSim::Utils::splitMix64( replicate * count * dimensions + i * dimensions + d ));
+      }
+      randomSum += f( x );
+    }
+    sobolSquares  += pow( sobolSum / count - 1.0, 2 ) / replicates;
+    randomSquares += pow( randomSum / count - 1.0, 2 ) / replicates;
+  }
+  const double sobolError = sqrt( sobolSquares ), randomError = sqrt( randomSquares );
+  ASSERT_LT( sobolError * 10.0, randomError );
+}
@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+#include "../pidsim/pidsim_backend_linear_model.h"
+#include "../pidsim/pidsim_backend_stability_map.h"
+
+using PidSim::BatchSim;
+using PidSim::LinearModel;
+using PidSim::StabilityMap;
+using PidSim::StabilityMapCache;
+
+static StabilityMap::Settings testSettings()
+{
+  StabilityMap::Settings settings;
+  settings.mPlane           = StabilityMap::Plane::KpKd;
+  settings.mFixedGain       = 1.0;
+  settings.mRollingFriction = 0.004;
+  settings.mSensorDelay     = 40.0;
+  settings.mMotorDelay      = 60.0;
+  settings.mTargetAngle     = PidSim::Utils::degToRad( 45 );
+  return settings;
+}
+
+//
+// Stable cells settle in the time domain and unstable cells blow up.
+//
+TEST( STABILITY_MAP, agrees_with_time_domain )
+{
+  const auto settings = testSettings();
+  StabilityMap map( settings );
+  ASSERT_EQ( 0u, map.compute() );
+
+  int stable = 0, unstable = 0;
+  for ( std::size_t y = 0; y < StabilityMap::resolution; y += 3 ) {
+    for ( std::size_t x = 0; x < StabilityMap::resolution; x += 3 ) {
+      const StabilityMap::Cell& cell = map.getCell( x, y );
+      if ( std::abs( cell.mSpectralRadius - 1.0 ) < 0.005 ) {
+        continue;
+      }
+
+      BatchSim::ArmSettings arm;
+      arm.mPidP             = StabilityMap::getGain( x );
+      arm.mPidI             = settings.mFixedGain;
+      arm.mPidD             = StabilityMap::getGain( y );
+      arm.mStartAngle       = settings.mTargetAngle;
+      arm.mTargetAngle      = settings.mTargetAngle + 0.01;
+      arm.mRollingFriction  = settings.mRollingFriction;
+      arm.mSensorDelay      = settings.mSensorDelay;
+      arm.mMotorDelay       = settings.mMotorDelay;
+      const LinearModel model( arm );
+      const double error = std::abs( model.getAngle( model.advance( model.getFirstTickState(), 50000 )) - arm.mTargetAngle );
+
+      if ( cell.mSpectralRadius < 1.0 ) {
+        ASSERT_LT( error, 1e-6 ) << "Kp " << arm.mPidP << " Kd " << arm.mPidD;
+        ++stable;
+      }
+      else {
+        // Blowing up for 50000 ticks can overflow all the way to NaN
+        ASSERT_FALSE( error < 1.0 ) << "Kp " << arm.mPidP << " Kd " << arm.mPidD;
+        ++unstable;
+      }
+    }
+  }
+  // Make sure the map has both regions in it
+  ASSERT_GT( stable, 0 );
+  ASSERT_GT( unstable, 0 );
+}
+
+//
+// With no gains, an arm pointed straight up falls over.
+//
+TEST( STABILITY_MAP, upright_arm_without_gains_is_unstable )
+{
+  StabilityMap::Settings settings = testSettings();
+  settings.mFixedGain = 0.0;
+  settings.mTargetAngle = M_PI / 2;
+  const StabilityMap::Cell cell = StabilityMap::analyze( settings, 0.0, 0.0 );
+  ASSERT_GT( cell.mSpectralRadius, 1.0 );
+}
+
+//
+// Computing a bit at a time gets the same answer as all at once.
+//
+TEST( STABILITY_MAP, computes_incrementally )
+{
+  StabilityMap whole( testSettings() ), pieces( testSettings() );
+  whole.compute();
+  std::size_t left = StabilityMap::resolution * StabilityMap::resolution;
+  while ( !pieces.isComplete() ) {
+    const std::size_t newLeft = pieces.compute( 100 );
+    ASSERT_EQ( std::min<std::size_t>( left, 100 ), left - newLeft );
+    left = newLeft;
+  }
+  for ( std::size_t y = 0; y < StabilityMap::resolution; ++y ) {
+    for ( std::size_t x = 0; x < StabilityMap::resolution; ++x ) {
+      ASSERT_EQ( whole.getCell( x, y ).mSpectralRadius, pieces.getCell( x, y ).mSpectralRadius );
+      ASSERT_EQ( whole.getCell( x, y ).mDampingRatio, pieces.getCell( x, y ).mDampingRatio );
+    }
+  }
+}
+
+//
+// Delays that round to the same number of ticks share a map.
+//
+TEST( STABILITY_MAP, cache_reuses_maps )
+{
+  StabilityMapCache cache;
+  StabilityMap::Settings settings = testSettings();
+  const auto first = cache.get( settings );
+  settings.mSensorDelay += 5.0;
+  ASSERT_EQ( first, cache.get( settings ));
+  settings.mSensorDelay += 20.0;
+  ASSERT_NE( first, cache.get( settings ));
+}
@@ -0,0 +1,163 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "../pidsim/pidsim_backend_physics_sim.h"
+#include "../pidsim/pidsim_backend_pid_controller.h"
+#include "../pidsim/pidsim_backend_state_estimator.h"
+
+//
+// Count heap allocations so we can check the filters don't make any.
+//
+static std::atomic<std::size_t> allocationCount{ 0 };
+
+void* operator new( std::size_t size )
+{
+  ++allocationCount;
+  void* mem = std::malloc( size ? size : 1 );
+  if ( !mem ) { throw std::bad_alloc(); }
+  return mem;
+}
+
+void operator delete( void* mem ) noexcept
+{
+  std::free( mem );
+}
+
+void operator delete( void* mem, std::size_t ) noexcept
+{
+  std::free( mem );
+}
+
+//
+// A constant velocity/ acceleration/ jerk... model of order N.  Each
+// state integrates the next one.
+//
+template< int N >
+PidSim::KalmanFilter<N> makeFilter( double timeSlice )
+{
+  using Filter = PidSim::KalmanFilter<N>;
+  typename Filter::Matrix a = Filter::Matrix::Identity();
+  for ( int i = 0; i+1 < N; ++i ) { a( i, i+1 ) = timeSlice; }
+  typename Filter::Vector b = Filter::Vector::Zero();
+  b( N-1 ) = timeSlice;
+  typename Filter::RowVector h = Filter::RowVector::Zero();
+  h( 0 ) = 1.0;
+  Filter filter{ a, b, h, Filter::Matrix::Identity() * 1e-6, 1e-4 };
+  filter.setDelay( 5 );
+  return filter;
+}
+
+template< typename T >
+class KALMAN_FILTER : public ::testing::Test {};
+
+template< int N > struct Dimension { static constexpr int value = N; };
+using Dimensions = ::testing::Types< Dimension<1>, Dimension<2>, Dimension<3>, Dimension<4> >;
+TYPED_TEST_SUITE( KALMAN_FILTER, Dimensions );
+
+//
+// Steady state updates shouldn't touch the heap
+//
+TYPED_TEST( KALMAN_FILTER, no_allocations )
+{
+  constexpr int N = TypeParam::value;
+  auto filter = makeFilter<N>( 0.02 );
+
+  constexpr int ticks = 200000;
+  double checksum = 0.0;
+  const std::size_t allocationsBefore = allocationCount;
+  for ( int tick = 0; tick < ticks; ++tick ) {
+    filter.update( 0.1, 0.001 * ( tick % 100 ));
+    checksum += filter.getState()( 0 );
+  }
+  ASSERT_EQ( allocationsBefore, allocationCount );
+  ASSERT_TRUE( std::isfinite( checksum ));
+}
+
+//
+// With no input & a constant measurement the estimate settles on it.
+//
+TYPED_TEST( KALMAN_FILTER, converges_to_constant_measurement )
+{
+  constexpr int N = TypeParam::value;
+  auto filter = makeFilter<N>( 0.02 );
+
+  for ( int tick = 0; tick < 5000; ++tick ) {
+    filter.update( 0.0, 2.0 );
+  }
+  ASSERT_NEAR( 2.0, filter.getState()( 0 ), 1e-3 );
+}
+
+//
+// Delays that don't fit the history rings are turned down, and the old
+// delay stays
+//
+TYPED_TEST( KALMAN_FILTER, rejects_delays_past_the_ring )
+{
+  constexpr int N = TypeParam::value;
+  auto filter = makeFilter<N>( 0.02 );
+  auto reference = makeFilter<N>( 0.02 );
+
+  ASSERT_TRUE( filter.setDelay( decltype( filter )::maxDelay ));
+  ASSERT_FALSE( filter.setDelay( decltype( filter )::maxDelay + 1 ));
+  ASSERT_TRUE( filter.setDelay( 5 ));
+  ASSERT_FALSE( filter.setDelay( 500 ));
+  for ( int tick = 0; tick < 100; ++tick ) {
+    filter.update( 0.1, 0.01 * tick );
+    reference.update( 0.1, 0.01 * tick );
+  }
+  ASSERT_EQ( reference.getState(), filter.getState() );
+}
+
+//
+// Run the physics simulation & PID controller the same way the back end
+// does.  Returns the largest difference between the estimated and actual
+// angle.
+//
+static double maxEstimateError( double sensorDelay, double motorDelay, double noise )
+{
+  using namespace PidSim;
+  const double timeSlice = 1.0/50.0;
+  const double friction  = 0.04;
+  const double start     = Utils::degToRad( -90 );
+
+  PhysicsSim      sim( start );
+  PidController   pid;
+  StateEstimator  estimator( start );
+  pid.updatePidSettings( 3.0, 0.5, 1.0, 0.0 );
+
+  double maxError = 0.0;
+  for ( int tick = 0; tick < 500; ++tick ) {
+    sim.setSensorNoise( noise );
+    sim.setSensorDelay( sensorDelay );
+    sim.setMotorDelay( motorDelay );
+    estimator.updateSettings( friction, noise, sensorDelay, motorDelay );
+
+    const double estimate = estimator.update( timeSlice, sim.getSensorAngle() );
+    maxError = std::max( maxError, std::abs( estimate - sim.getActualAngle() ));
+
+    const auto out = pid.updatePidController( timeSlice, estimate );
+    estimator.recordMotorPower( out.mMotorPower );
+
+    sim.startSimulationIteration();
+    sim.applyGravity();
+    sim.applyMotor( out.mMotorPower, timeSlice );
+    sim.updateAngleVel( timeSlice );
+    sim.applyFriction( friction );
+    sim.updateAngle( timeSlice );
+    sim.imposePositionHardLimits();
+    sim.endSimulationIteration();
+  }
+  return maxError;
+}
+
+//
+// With no noise the model matches PhysicsSim, so the estimator sees
+// through the sensor & motor delays.
+//
+TEST( STATE_ESTIMATOR, tracks_actual_angle_through_delays )
+{
+  ASSERT_NEAR( 0.0, maxEstimateError(   0.0,   0.0, 0.0 ), 1e-3 );
+  ASSERT_NEAR( 0.0, maxEstimateError( 200.0, 100.0, 0.0 ), 1e-3 );
+}
+
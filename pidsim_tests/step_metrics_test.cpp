@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "../pidsim/pidsim_backend_batch_sim.h"
+#include "../pidsim/pidsim_backend_step_metrics.h"
+
+using PidSim::BatchSim;
+using PidSim::StepMetrics;
+
+//
+// A first order response, 1 - e^(-t/tau), has textbook metrics.
+//
+TEST( STEP_METRICS, first_order_response )
+{
+  const double tau = 0.5;
+  const double dt = 0.0001;
+  StepMetrics metrics( 0.0, 1.0, 0.02 );
+  for ( double t = dt; t < 10.0; t += dt ) {
+    metrics.update( dt, 1.0 - exp( -t / tau ), 1.0, 0.5 );
+  }
+
+  const StepMetrics::Result result = metrics.getResult();
+  ASSERT_NEAR( tau * log( 9.0 ),  result.mRiseTime, 2 * dt );
+  ASSERT_NEAR( tau * log( 50.0 ), result.mSettlingTime, 2 * dt );
+  ASSERT_NEAR( tau, result.mIAE, 0.001 );
+  ASSERT_NEAR( tau / 2, result.mISE, 0.001 );
+  ASSERT_NEAR( tau * tau, result.mITAE, 0.001 );
+  ASSERT_NEAR( 0.25 * 10.0, result.mControlEffort, 0.001 );
+  ASSERT_EQ( 0.0, result.mOvershoot );
+  ASSERT_TRUE( result.mSettled );
+  ASSERT_GT( 0.0, result.mSteadyStateError );
+  ASSERT_LT( -0.02, result.mSteadyStateError );
+}
+
+//
+// The streaming metrics match the same metrics computed the slow way,
+// from the whole trajectory, for an underdamped response going down.
+//
+TEST( STEP_METRICS, matches_full_trajectory )
+{
+  const double dt = 1.0 / 50.0;
+  const double start = 1.0;
+  const double target = -0.5;
+  const double band = 0.01;
+
+  std::vector<double> angles;
+  StepMetrics metrics( start, target, band );
+  for ( int tick = 1; tick <= 500; ++tick ) {
+    const double t = tick * dt;
+    const double angle = target + ( start - target ) * exp( -t ) * cos( 4 * t );
+    angles.push_back( angle );
+    metrics.update( dt, angle, target, 0.0 );
+  }
+
+  double minAngle = start;
+  int rise10 = -1, rise90 = -1, lastOutside = -1;
+  for ( int i = 0; i < static_cast<int>( angles.size() ); ++i ) {
+    const double progress = ( angles[ i ] - start ) / ( target - start );
+    minAngle = std::min( minAngle, angles[ i ] );
+    if ( rise10 < 0 && progress >= 0.1 ) { rise10 = i; }
+    if ( rise90 < 0 && progress >= 0.9 ) { rise90 = i; }
+    if ( std::abs( angles[ i ] - target ) > band ) { lastOutside = i; }
+  }
+  double sum = 0.0;
+  for ( std::size_t i = lastOutside + 1; i < angles.size(); ++i ) {
+    sum += angles[ i ] - target;
+  }
+
+  const StepMetrics::Result result = metrics.getResult();
+  ASSERT_NEAR( ( rise90 - rise10 ) * dt, result.mRiseTime, 1e-9 );
+  ASSERT_NEAR(( target - minAngle ) / ( start - target ), result.mOvershoot, 1e-12 );
+  ASSERT_NEAR(( lastOutside + 1 ) * dt, result.mSettlingTime, 1e-9 );
+  ASSERT_NEAR( sum / ( angles.size() - lastOutside - 1 ), result.mSteadyStateError, 1e-12 );
+  ASSERT_GT( result.mOvershoot, 0.1 );
+}
+
+//
+// No step means nothing to rise to.  Never reaching the target means an
+// infinite rise time, and we're never settled.
+//
+TEST( STEP_METRICS, degenerate_steps )
+{
+  StepMetrics noStep( 1.0, 1.0 );
+  noStep.update( 0.02, 1.0, 1.0, 0.0 );
+  ASSERT_EQ( 0.0, noStep.getResult().mRiseTime );
+  ASSERT_EQ( 0.0, noStep.getResult().mOvershoot );
+  ASSERT_TRUE( noStep.getResult().mSettled );
+
+  StepMetrics stuck( 0.0, 1.0 );
+  for ( int i = 0; i < 100; ++i ) {
+    stuck.update( 0.02, 0.5, 1.0, 0.0 );
+  }
+  ASSERT_TRUE( std::isinf( stuck.getResult().mRiseTime ));
+  ASSERT_FALSE( stuck.getResult().mSettled );
+  ASSERT_NEAR( 2.0, stuck.getResult().mSettlingTime, 1e-9 );
+  ASSERT_EQ( -0.5, stuck.getResult().mSteadyStateError );
+}
+
+//
+// Batch arms get metrics without keeping a trajectory.  A tuned arm
+// settles, an arm with no gains falls and never gets there.
+//
+TEST( STEP_METRICS, batch_metrics )
+{
+  std::vector<BatchSim::ArmSettings> arms( 2 );
+  arms[ 0 ].mPidP = 8.0;
+  arms[ 0 ].mPidI = 4.0;
+  arms[ 0 ].mPidD = 1.0;
+  arms[ 0 ].mStartAngle = -M_PI / 2;
+  arms[ 0 ].mRollingFriction = 0.004;
+  arms[ 1 ] = arms[ 0 ];
+  arms[ 1 ].mPidP = arms[ 1 ].mPidI = arms[ 1 ].mPidD = 0.0;
+
+  BatchSim sim( arms );
+  sim.run( 50 * 20 );
+
+  const StepMetrics::Result tuned = sim.getMetrics( 0 );
+  ASSERT_TRUE( tuned.mSettled );
+  ASSERT_TRUE( std::isfinite( tuned.mRiseTime ));
+  ASSERT_LT( tuned.mSettlingTime, 20.0 );
+  ASSERT_GT( tuned.mControlEffort, 0.0 );
+
+  const StepMetrics::Result untuned = sim.getMetrics( 1 );
+  ASSERT_FALSE( untuned.mSettled );
+  ASSERT_TRUE( std::isinf( untuned.mRiseTime ));
+  ASSERT_EQ( 0.0, untuned.mControlEffort );
+  ASSERT_GT( untuned.mIAE, tuned.mIAE );
+}
+
@@ -0,0 +1,62 @@
+#include <gtest/gtest.h>
+#include "../pidsim/pidsim_backend_sweep.h"
+
+using PidSim::BatchSim;
+using PidSim::ParameterSweep;
+
+static ParameterSweep::Settings testSettings()
+{
+  ParameterSweep::Settings settings;
+  settings.mArm.mStartAngle   = PidSim::Utils::degToRad( -90 );
+  settings.mArm.mTargetAngle  = 0.0;
+  settings.mArm.mSensorNoise  = 1.0;
+  settings.mAxes = {
+    { &BatchSim::ArmSettings::mPidP,            1.0, 6.0 },
+    { &BatchSim::ArmSettings::mPidI,            0.0, 3.0 },
+    { &BatchSim::ArmSettings::mPidD,            0.0, 2.0 },
+    { &BatchSim::ArmSettings::mRollingFriction, 0.0, 0.01 },
+    { &BatchSim::ArmSettings::mSensorDelay,     0.0, 100.0 },
+    { &BatchSim::ArmSettings::mMotorDelay,      0.0, 100.0 },
+  };
+  return settings;
+}
+
+//
+// Each axis lands in its range, and what isn't swept is left alone
+//
+TEST( SWEEP, arms_cover_the_axes )
+{
+  const ParameterSweep sweep( testSettings() );
+  const std::vector<BatchSim::ArmSettings> arms = sweep.arms( 0, 64 );
+  double lowest = 1e9, highest = -1e9;
+  for ( std::size_t i = 0; i < arms.size(); ++i ) {
+    ASSERT_GE( arms[ i ].mPidP, 1.0 );
+    ASSERT_LT( arms[ i ].mPidP, 6.0 );
+    ASSERT_GE( arms[ i ].mSensorDelay, 0.0 );
+    ASSERT_LT( arms[ i ].mSensorDelay, 100.0 );
+    ASSERT_EQ( PidSim::Utils::degToRad( -90 ), arms[ i ].mStartAngle );
+    ASSERT_EQ( i, arms[ i ].mNoiseStream );
+    lowest  = std::min( lowest, arms[ i ].mPidD );
+    highest = std::max( highest, arms[ i ].mPidD );
+  }
+  // 64 stratified points reach within a slice of each end
+  ASSERT_LT( lowest, 2.0 / 64 );
+  ASSERT_GT( highest, 2.0 - 2.0 / 64 );
+}
+
+//
+// Shards simulated separately match one big run, index for index
+//
+TEST( SWEEP, shards_match_one_run )
+{
+  const ParameterSweep sweep( testSettings() );
+  const std::vector<PidSim::StepMetrics::Result> whole = sweep.run( 0, 300 );
+  const std::vector<PidSim::StepMetrics::Result> first = sweep.run( 0, 100 );
+  const std::vector<PidSim::StepMetrics::Result> second = sweep.run( 100, 200 );
+  for ( std::size_t i = 0; i < 300; ++i ) {
+    const PidSim::StepMetrics::Result& shard = i < 100 ? first[ i ] : second[ i - 100 ];
+    ASSERT_EQ( whole[ i ].mITAE, shard.mITAE );
+    ASSERT_EQ( whole[ i ].mSettlingTime, shard.mSettlingTime );
+  }
+  ASSERT_EQ( sweep.arm( 150 ).mPidP, sweep.arms( 150, 1 ).front().mPidP );
+}
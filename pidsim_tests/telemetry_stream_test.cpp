@@ -0,0 +1,255 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include "../pidsim/pidsim_backend_telemetry_stream.h"
+
+using PidSim::ControlLoop;
+using PidSim::PidController;
+using PidSim::Session;
+using PidSim::Telemetry;
+using PidSim::TelemetryStream;
+
+namespace {
+
+constexpr std::size_t rowWords = 3 + Telemetry::numColumns;
+
+int subscribe( unsigned short port )
+{
+  const int socket = ::socket( AF_INET, SOCK_STREAM, 0 );
+  sockaddr_in name{};
+  name.sin_family       = AF_INET;
+  name.sin_addr.s_addr  = htonl( INADDR_LOOPBACK );
+  name.sin_port         = htons( port );
+  connect( socket, reinterpret_cast<sockaddr*>( &name ), sizeof( name ));
+  return socket;
+}
+
+bool readAll( int socket, void* data, std::size_t size )
+{
+  char* bytes = static_cast<char*>( data );
+  while ( size > 0 ) {
+    const ssize_t got = recv( socket, bytes, size, 0 );
+    if ( got <= 0 ) {
+      return false;
+    }
+    bytes += got;
+    size  -= static_cast<std::size_t>( got );
+  }
+  return true;
+}
+
+// The header's column names
+std::vector<std::string> readHeader( int socket )
+{
+  std::uint64_t start[ 3 ];
+  readAll( socket, start, sizeof( start ));
+  std::vector<std::string> names;
+  for ( std::uint64_t column = 0; column < start[ 2 ]; ++column ) {
+    std::string name;
+    char word[ 8 ];
+    do {
+      readAll( socket, word, sizeof( word ));
+      name.append( word, strnlen( word, sizeof( word )));
+    } while ( word[ 7 ] != '\0' );
+    names.push_back( name );
+  }
+  return names;
+}
+
+// A batch's header and rows
+struct Batch
+{
+  std::uint64_t               mLatest;
+  std::uint64_t               mDropped;
+  std::uint64_t               mDecimation;
+  std::vector<std::uint64_t>  mRows;
+};
+
+bool readBatch( int socket, Batch& batch )
+{
+  std::uint64_t header[ 5 ];
+  if ( !readAll( socket, header, sizeof( header )) || header[ 0 ] != TelemetryStream::batchMagic ) {
+    return false;
+  }
+  batch.mLatest     = header[ 2 ];
+  batch.mDropped    = header[ 3 ];
+  batch.mDecimation = header[ 4 ];
+  batch.mRows.resize( header[ 1 ] * rowWords );
+  return readAll( socket, batch.mRows.data(), batch.mRows.size() * sizeof( std::uint64_t ));
+}
+
+double toDouble( std::uint64_t word )
+{
+  double value;
+  std::memcpy( &value, &word, sizeof( value ));
+  return value;
+}
+
+void publish( TelemetryStream& stream, std::uint64_t tick )
+{
+  Session::Inputs inputs;
+  inputs.mP = 2.5;
+  const ControlLoop::Output out{ 0.001 * tick, PidController::Output( 0.1, 0.2, 0.3, 0.5 ) };
+  stream.publish( 7, tick * Session::timeSlice, inputs, 0.002 * tick, 0.003 * tick, out );
+}
+
+void waitForSubscribers( const TelemetryStream& stream, std::size_t count )
+{
+  while ( stream.getStats().size() < count ) {
+    std::this_thread::sleep_for( std::chrono::milliseconds( 1 ));
+  }
+}
+
+// Publish in small bursts, letting the first subscriber catch up after each
+void publishPaced( TelemetryStream& stream, std::uint64_t& tick, std::uint64_t rows )
+{
+  for ( std::uint64_t row = 0; row < rows; ++row ) {
+    publish( stream, tick++ );
+    if ( tick % 256 == 0 ) {
+      while ( stream.getStats()[ 0 ].mLagRows > 0 ) {
+        std::this_thread::sleep_for( std::chrono::microseconds( 200 ));
+      }
+    }
+  }
+}
+
+}
+
+//
+// A subscriber that keeps up gets the header, then every row in order
+//
+TEST( TELEMETRY_STREAM, subscribers_get_every_row )
+{
+  TelemetryStream stream{ TelemetryStream::Options() };
+  std::string error;
+  ASSERT_TRUE( stream.listen( 0, error )) << error;
+  const int socket = subscribe( stream.getPort() );
+  const std::vector<std::string> names = readHeader( socket );
+  ASSERT_EQ( rowWords, names.size() );
+  ASSERT_EQ( "sequence", names[ 0 ] );
+  ASSERT_EQ( "time", names[ 2 ] );
+  ASSERT_EQ( "sensor_angle", names[ 3 ] );
+  ASSERT_EQ( "rolling_friction", names[ 14 ] );
+  waitForSubscribers( stream, 1 );
+
+  constexpr std::uint64_t rows = 1000;
+  for ( std::uint64_t tick = 0; tick < rows; ++tick ) {
+    publish( stream, tick );
+  }
+  ASSERT_TRUE( stream.drain( 5.0 ));
+  ASSERT_EQ( rows, stream.getPublished() );
+
+  std::uint64_t next = 0;
+  Batch batch;
+  while ( next < rows && readBatch( socket, batch )) {
+    ASSERT_EQ( 0u, batch.mDropped );
+    ASSERT_EQ( 1u, batch.mDecimation );
+    for ( std::size_t row = 0; row < batch.mRows.size(); row += rowWords ) {
+      const std::uint64_t* words = &batch.mRows[ row ];
+      ASSERT_EQ( next, words[ 0 ] );
+      ASSERT_EQ( 7u, words[ 1 ] );
+      ASSERT_EQ( next * Session::timeSlice, toDouble( words[ 2 ] ));
+      ASSERT_EQ( 0.002 * next, toDouble( words[ 3 ] ));
+      ASSERT_EQ( 0.5, toDouble( words[ 9 ] ));
+      ASSERT_EQ( 2.5, toDouble( words[ 10 ] ));
+      ++next;
+    }
+  }
+  ASSERT_EQ( rows, next );
+  const TelemetryStream::Stats stats = stream.getStats()[ 0 ];
+  ASSERT_EQ( rows, stats.mDelivered );
+  ASSERT_EQ( 0u, stats.mLagRows );
+  close( socket );
+}
+
+//
+// A subscriber that stops reading drops and decimates its own rows, and
+// lags, while the publisher and a subscriber that keeps up carry on.  Once
+// it reads again, it catches up and gets every row again.
+//
+TEST( TELEMETRY_STREAM, slow_subscribers_only_hurt_themselves )
+{
+  TelemetryStream::Options options;
+  options.mRingRows       = 1024;
+  options.mBatchRows      = 64;
+  options.mFlushInterval  = 0.001;
+  options.mMaxDecimation  = 16;
+  TelemetryStream stream( options );
+  std::string error;
+  ASSERT_TRUE( stream.listen( 0, error )) << error;
+
+  std::atomic<std::uint64_t> fastRows{ 0 }, fastGaps{ 0 };
+  const int fast = subscribe( stream.getPort() );
+  waitForSubscribers( stream, 1 );
+  const int slow = subscribe( stream.getPort() );
+  waitForSubscribers( stream, 2 );
+  std::thread fastReader( [&]() {
+    readHeader( fast );
+    Batch batch;
+    std::uint64_t next = 0;
+    while ( readBatch( fast, batch )) {
+      for ( std::size_t row = 0; row < batch.mRows.size(); row += rowWords ) {
+        fastGaps += batch.mRows[ row ] != next;
+        next = batch.mRows[ row ] + 1;
+        ++fastRows;
+      }
+    }
+  });
+
+  // Enough rows to fill the slow subscriber's socket & ring many times over
+  std::uint64_t tick = 0;
+  publishPaced( stream, tick, 200000 );
+  std::vector<TelemetryStream::Stats> stats = stream.getStats();
+  ASSERT_EQ( 0u, stats[ 0 ].mDropped );
+  ASSERT_EQ( 1u, stats[ 0 ].mDecimation );
+  ASSERT_GT( stats[ 1 ].mDropped, 0u );
+  ASSERT_EQ( 16u, stats[ 1 ].mDecimation );
+  ASSERT_GT( stats[ 1 ].mLagRows, options.mRingRows );
+  ASSERT_GT( stats[ 1 ].mLagSeconds, 0.0 );
+
+  // The slow subscriber reads again, and comes back to every row
+  std::thread slowReader( [&]() {
+    readHeader( slow );
+    Batch batch;
+    while ( readBatch( slow, batch )) {
+    }
+  });
+  // Its rate comes back a step at a time, each after a ring's worth of
+  // rows.  A round is never more than half a ring's worth at a rate of 2
+  // or under.
+  unsigned decimation = 16;
+  std::uint64_t lastStep = 0;
+  for ( int round = 0; round < 1000 && decimation > 1; ++round ) {
+    publishPaced( stream, tick, 1024 );
+    const TelemetryStream::Stats slowStats = stream.getStats()[ 1 ];
+    if ( slowStats.mDecimation == decimation ) {
+      continue;
+    }
+    ASSERT_EQ( decimation / 2, slowStats.mDecimation );
+    if ( decimation < 16 ) {
+      ASSERT_GE( slowStats.mDelivered - lastStep, options.mRingRows - options.mBatchRows );
+    }
+    decimation = slowStats.mDecimation;
+    lastStep = slowStats.mDelivered;
+  }
+  ASSERT_EQ( 1u, stream.getStats()[ 1 ].mDecimation );
+  ASSERT_TRUE( stream.drain( 5.0 ));
+  stats = stream.getStats();
+  ASSERT_EQ( 0u, stats[ 1 ].mLagRows );
+  ASSERT_EQ( stream.getPublished(), stats[ 0 ].mDelivered );
+
+  shutdown( fast, SHUT_RDWR );
+  shutdown( slow, SHUT_RDWR );
+  fastReader.join();
+  slowReader.join();
+  ASSERT_EQ( stream.getPublished(), fastRows.load() );
+  ASSERT_EQ( 0u, fastGaps.load() );
+  close( fast );
+  close( slow );
+}
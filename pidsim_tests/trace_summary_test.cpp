@@ -0,0 +1,200 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <math.h>
+#include <random>
+#include <unistd.h>
+#include "../pidsim/pidsim_backend_trace_summary.h"
+
+using PidSim::TraceReader;
+using PidSim::TraceSummary;
+using PidSim::TraceWriter;
+
+namespace {
+
+// A fresh trace file, and no summary, for each test
+std::string tracePath( const std::string& name )
+{
+  const std::string path = testing::TempDir() + "pidsim_" + name + "_" + std::to_string( getpid() ) + ".trace";
+  std::remove( path.c_str() );
+  std::remove(( path + TraceSummary::summarySuffix ).c_str() );
+  return path;
+}
+
+void removeTrace( const std::string& path )
+{
+  std::remove( path.c_str() );
+  std::remove(( path + TraceSummary::summarySuffix ).c_str() );
+}
+
+//
+// A random walk with the odd spike, and a slow sine
+//
+std::vector<std::vector<double>> writeTrace( const std::string& path, std::size_t rows, std::uint64_t seed )
+{
+  std::mt19937_64 random( seed );
+  std::normal_distribution<double> step( 0.0, 0.01 );
+  std::vector<std::vector<double>> columns( 2 );
+  TraceWriter writer( path, { { "walk" }, { "sine" } }, 1000 );
+  double walk = 0.0;
+  for ( std::size_t row = 0; row < rows; ++row ) {
+    walk += step( random );
+    const double values[] = { row % 7919 == 0 ? walk + 5.0 : walk, sin( row * 1e-4 ) };
+    columns[ 0 ].push_back( values[ 0 ] );
+    columns[ 1 ].push_back( values[ 1 ] );
+    writer.append( static_cast<std::int64_t>( row ) * 1000, values );
+  }
+  return columns;
+}
+
+// The true range of some rows
+TraceSummary::Range trueRange( const std::vector<double>& values, double first, double end )
+{
+  TraceSummary::Range range{ INFINITY, -INFINITY };
+  for ( double row = std::max( ceil( first ), 0.0 ); row < std::min( end, static_cast<double>( values.size() )); row += 1.0 ) {
+    range.mMin = std::min( range.mMin, values[ static_cast<std::size_t>( row ) ] );
+    range.mMax = std::max( range.mMax, values[ static_cast<std::size_t>( row ) ] );
+  }
+  return range;
+}
+
+}
+
+//
+// Every pixel's range covers its rows, and no more than the buckets those
+// rows are in, at every zoom
+//
+TEST( TRACE_SUMMARY, envelope_covers_each_pixel )
+{
+  const std::string path = tracePath( "envelope" );
+  const std::vector<std::vector<double>> columns = writeTrace( path, 300000, 1 );
+  TraceSummary summary( path );
+  ASSERT_TRUE( summary.isOpen() );
+  ASSERT_TRUE( summary.wasBuilt() );
+  ASSERT_TRUE( summary.build() );
+  ASSERT_EQ( 7u, summary.getLevels() );     // 1172, 293, 74, 19, 5, 2 and 1 buckets
+
+  struct View { double mFirst; double mRows; std::size_t mPixels; };
+  for ( const View& view : { View{ 0, 300000, 500 }, View{ -1000, 302000, 333 }, View{ 12345.5, 40000, 400 },
+                             View{ 777, 1000, 200 }, View{ 299990, 20, 100 }, View{ 5000, 3, 600 } } ) {
+    for ( std::size_t column = 0; column < 2; ++column ) {
+      const std::vector<TraceSummary::Range> envelope = summary.getEnvelope( column, view.mFirst, view.mRows, view.mPixels );
+      ASSERT_EQ( view.mPixels, envelope.size() );
+      const double rowsPerPixel = view.mRows / view.mPixels;
+      const double slack = rowsPerPixel < TraceSummary::baseRows ? 1.0 : rowsPerPixel * TraceSummary::fanout;
+      for ( std::size_t pixel = 0; pixel < view.mPixels; ++pixel ) {
+        const double start = view.mFirst + pixel * rowsPerPixel;
+        const TraceSummary::Range inside = trueRange( columns[ column ], start, start + rowsPerPixel );
+        const TraceSummary::Range near = trueRange( columns[ column ], start - slack, start + rowsPerPixel + slack );
+        const TraceSummary::Range& got = envelope[ pixel ];
+        if ( inside.mMin > inside.mMax ) {
+          continue;     // No rows in the pixel
+        }
+        ASSERT_LE( got.mMin, inside.mMin );
+        ASSERT_GE( got.mMax, inside.mMax );
+        ASSERT_GE( got.mMin, near.mMin - 1e-6 * std::abs( near.mMin ));
+        ASSERT_LE( got.mMax, near.mMax + 1e-6 * std::abs( near.mMax ));
+      }
+    }
+  }
+
+  // Zoomed in, the pixels are the rows themselves
+  const std::vector<TraceSummary::Range> rows = summary.getEnvelope( 0, 1000, 50, 50 );
+  for ( std::size_t row = 0; row < 50; ++row ) {
+    ASSERT_EQ( columns[ 0 ][ 1000 + row ], rows[ row ].mMin );
+    ASSERT_EQ( columns[ 0 ][ 1000 + row ], rows[ row ].mMax );
+  }
+
+  // Past the ends there's nothing
+  const std::vector<TraceSummary::Range> past = summary.getEnvelope( 1, 400000, 1000, 10 );
+  ASSERT_GT( past[ 0 ].mMin, past[ 0 ].mMax );
+
+  const TraceSummary::Range whole = summary.getRange( 0 );
+  const TraceSummary::Range truth = trueRange( columns[ 0 ], 0, 300000 );
+  ASSERT_LE( whole.mMin, truth.mMin );
+  ASSERT_GE( whole.mMax, truth.mMax );
+  ASSERT_NEAR( truth.mMin, whole.mMin, 1e-6 );
+  removeTrace( path );
+}
+
+//
+// The pyramid is saved beside the trace and reused, until the trace
+// changes
+//
+TEST( TRACE_SUMMARY, saved_and_reused )
+{
+  const std::string path = tracePath( "saved" );
+  writeTrace( path, 50000, 2 );
+  std::vector<TraceSummary::Range> built;
+  {
+    TraceSummary summary( path );
+    ASSERT_TRUE( summary.wasBuilt() );
+    ASSERT_TRUE( summary.build() );
+    built = summary.getEnvelope( 0, 0, 50000, 100 );
+  }
+  ASSERT_TRUE( TraceReader( path ).isOpen() );
+  {
+    TraceSummary summary( path );
+    ASSERT_TRUE( summary.isOpen() );
+    ASSERT_FALSE( summary.wasBuilt() );
+    ASSERT_TRUE( summary.isReady() );
+    const std::vector<TraceSummary::Range> loaded = summary.getEnvelope( 0, 0, 50000, 100 );
+    for ( std::size_t pixel = 0; pixel < built.size(); ++pixel ) {
+      ASSERT_EQ( built[ pixel ].mMin, loaded[ pixel ].mMin );
+      ASSERT_EQ( built[ pixel ].mMax, loaded[ pixel ].mMax );
+    }
+  }
+
+  // A new trace in the same place gets a new pyramid
+  const std::vector<std::vector<double>> columns = writeTrace( path, 50000, 3 );
+  {
+    TraceSummary summary( path );
+    ASSERT_TRUE( summary.wasBuilt() );
+    ASSERT_TRUE( summary.build() );
+    const TraceSummary::Range truth = trueRange( columns[ 0 ], 0, 50000 );
+    ASSERT_NEAR( truth.mMax, summary.getRange( 0 ).mMax, 1e-6 );
+  }
+
+  // And a missing trace doesn't open
+  removeTrace( path );
+  ASSERT_FALSE( TraceSummary( path ).isOpen() );
+}
+
+//
+// Built a few blocks at a time, the pyramid comes out the same as built
+// all at once
+//
+TEST( TRACE_SUMMARY, build_resumes_in_slices )
+{
+  const std::string path = tracePath( "slices" );
+  writeTrace( path, 50000, 4 );
+  std::vector<TraceSummary::Range> whole;
+  {
+    TraceSummary summary( path );
+    ASSERT_TRUE( summary.build() );
+    whole = summary.getEnvelope( 0, 0, 50000, 100 );
+  }
+  std::remove(( path + TraceSummary::summarySuffix ).c_str() );
+
+  TraceSummary summary( path );
+  ASSERT_FALSE( summary.isReady() );
+  ASSERT_EQ( 0.0, summary.getProgress() );
+  std::size_t slices = 0;
+  double progress = 0.0;
+  while ( !summary.build( 3 )) {
+    ++slices;
+    ASSERT_GT( summary.getProgress(), progress );
+    ASSERT_LT( summary.getProgress(), 1.0 );
+    progress = summary.getProgress();
+  }
+  ASSERT_EQ( 16u, slices );     // 50 blocks of 1000 rows, 3 at a time
+  ASSERT_EQ( 1.0, summary.getProgress() );
+  const std::vector<TraceSummary::Range> sliced = summary.getEnvelope( 0, 0, 50000, 100 );
+  for ( std::size_t pixel = 0; pixel < whole.size(); ++pixel ) {
+    ASSERT_EQ( whole[ pixel ].mMin, sliced[ pixel ].mMin );
+    ASSERT_EQ( whole[ pixel ].mMax, sliced[ pixel ].mMax );
+  }
+
+  // And it was saved, so the next open has nothing to build
+  ASSERT_TRUE( TraceSummary( path ).isReady() );
+  removeTrace( path );
+}
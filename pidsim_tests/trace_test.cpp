@@ -0,0 +1,280 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <math.h>
+#include <random>
+#include <unistd.h>
+#include "../pidsim/pidsim_backend_telemetry.h"
+#include "../pidsim/pidsim_backend_trace.h"
+#include "../pidsim/pidsim_utils.h"
+
+using PidSim::ControlLoop;
+using PidSim::Session;
+using PidSim::Telemetry;
+using PidSim::TraceReader;
+using PidSim::TraceWriter;
+
+namespace {
+
+// A fresh trace file for each test
+std::string tracePath( const std::string& name )
+{
+  const std::string path = testing::TempDir() + "pidsim_" + name + "_" + std::to_string( getpid() ) + ".trace";
+  std::remove( path.c_str() );
+  return path;
+}
+
+//
+// Rows that exercise every encoding: steady and jittery ticks, time
+// jumping both ways, values that hold, drift, jump and change sign, and
+// the odd special value
+//
+struct Rows
+{
+  std::vector<std::int64_t>           mTimes;
+  std::vector<std::vector<double>>    mColumns;
+};
+
+Rows awkwardRows( std::size_t rows )
+{
+  std::mt19937_64 random( 42 );
+  std::uniform_real_distribution<double> unit( -1.0, 1.0 );
+  Rows result{ {}, std::vector<std::vector<double>>( 4 ) };
+  std::int64_t time = -5000;
+  double walk = 0.0;
+  for ( std::size_t row = 0; row < rows; ++row ) {
+    time += row % 500 == 499 ? -123456789 : row % 300 < 150 ? 1000 : 1000 + static_cast<std::int64_t>( unit( random ) * 3000 );
+    walk += unit( random ) * 0.01;
+    result.mTimes.push_back( row == rows / 2 ? INT64_MAX : time );
+    result.mColumns[ 0 ].push_back( walk );
+    result.mColumns[ 1 ].push_back( row % 700 < 350 ? 2.5 : -1e300 * unit( random ));
+    result.mColumns[ 2 ].push_back( row % 97 == 0 ? INFINITY : row % 89 == 0 ? -0.0 : static_cast<double>( row / 10 ));
+    result.mColumns[ 3 ].push_back( unit( random ));
+  }
+  return result;
+}
+
+void writeRows( const std::string& path, const Rows& rows, const std::vector<TraceWriter::Column>& columns, std::size_t blockRows )
+{
+  TraceWriter writer( path, columns, blockRows );
+  ASSERT_TRUE( writer.isOpen() );
+  std::vector<double> row( columns.size() );
+  for ( std::size_t i = 0; i < rows.mTimes.size(); ++i ) {
+    for ( std::size_t column = 0; column < columns.size(); ++column ) {
+      row[ column ] = rows.mColumns[ column ][ i ];
+    }
+    writer.append( rows.mTimes[ i ], row.data() );
+  }
+  ASSERT_EQ( rows.mTimes.size(), writer.getRows() );
+  ASSERT_TRUE( writer.close() );
+}
+
+const std::vector<TraceWriter::Column> exactColumns = { { "walk" }, { "jumps" }, { "steps" }, { "noise" } };
+
+// Bitwise compare, so -0.0 and 0.0 differ
+bool sameBits( const std::vector<double>& a, const std::vector<double>& b )
+{
+  return a.size() == b.size() && std::memcmp( a.data(), b.data(), a.size() * sizeof( double )) == 0;
+}
+
+//
+// Run an arm at 1 kHz, moving the target every 10 seconds
+//
+void runArm( Telemetry& telemetry, double seconds, double sensorNoise )
+{
+  constexpr double tickTime = 0.001;
+  ControlLoop loop( 0.0, PidSim::defaultProfileLimits );
+  loop.getPhysicsSim().setSensorNoise( sensorNoise );
+  loop.getPhysicsSim().setNoiseSeed( 3 );
+  Session::Inputs inputs;
+  inputs.mP = 2.0;
+  inputs.mI = 0.5;
+  inputs.mD = 0.5;
+  inputs.mSensorNoise = sensorNoise;
+  inputs.mProfile = PidSim::MotionProfile::Type::Trapezoidal;
+  const long ticks = lround( seconds / tickTime );
+  for ( long tick = 0; tick < ticks; ++tick ) {
+    static constexpr double targets[] = { 60.0, -30.0, 120.0, 0.0, -90.0, 45.0 };
+    inputs.mTargetAngle = targets[ ( tick / 10000 ) % std::size( targets ) ];
+    loop.getSetpointGenerator().updateTarget( PidSim::Utils::degToRad( inputs.mTargetAngle ), inputs.mProfile );
+    const double sensorAngle = loop.getPhysicsSim().getSensorAngle();
+    const ControlLoop::Output out = loop.tick( tickTime, inputs.mP, inputs.mI, inputs.mD );
+    telemetry.record( tick * tickTime, inputs, sensorAngle, loop.getPhysicsSim().getActualAngle(), out );
+  }
+}
+
+long fileSize( const std::string& path )
+{
+  std::ifstream in( path, std::ios::binary | std::ios::ate );
+  return static_cast<long>( in.tellg() );
+}
+
+}
+
+//
+// With no resolution, every time and value comes back bit for bit
+//
+TEST( TRACE, round_trip_is_exact )
+{
+  const std::string path = tracePath( "round_trip" );
+  const Rows rows = awkwardRows( 5000 );
+  writeRows( path, rows, exactColumns, 256 );
+
+  TraceReader reader( path );
+  ASSERT_TRUE( reader.isOpen() );
+  ASSERT_EQ( 5000u, reader.getRows() );
+  ASSERT_EQ( 20u, reader.getBlocks() );
+  ASSERT_EQ( 4u, reader.getColumns().size() );
+  ASSERT_EQ( rows.mTimes, reader.readTimes() );
+  for ( std::size_t column = 0; column < exactColumns.size(); ++column ) {
+    ASSERT_EQ( exactColumns[ column ].mName, reader.getColumns()[ column ] );
+    ASSERT_TRUE( sameBits( rows.mColumns[ column ], reader.readColumn( column )));
+  }
+  std::remove( path.c_str() );
+}
+
+//
+// A resolution rounds values to a power of two no coarser than it
+//
+TEST( TRACE, resolution_rounds_values )
+{
+  const std::string path = tracePath( "resolution" );
+  const Rows rows = awkwardRows( 1000 );
+  writeRows( path, rows, { { "walk", 0.001 }, { "jumps" }, { "steps", 0.3 }, { "noise", 1e-6 } }, 300 );
+
+  TraceReader reader( path );
+  ASSERT_TRUE( reader.isOpen() );
+  const std::vector<double> walk = reader.readColumn( 0 );
+  const std::vector<double> noise = reader.readColumn( 3 );
+  for ( std::size_t row = 0; row < 1000; ++row ) {
+    ASSERT_LE( std::abs( walk[ row ] - rows.mColumns[ 0 ][ row ] ), 0.0005 );
+    ASSERT_EQ( walk[ row ], std::ldexp( std::nearbyint( std::ldexp( walk[ row ], 10 )), -10 ));
+    ASSERT_LE( std::abs( noise[ row ] - rows.mColumns[ 3 ][ row ] ), 0.5e-6 );
+  }
+  // Whole numbers, infinity and -0 survive a 1/4 quantum
+  ASSERT_TRUE( sameBits( rows.mColumns[ 2 ], reader.readColumn( 2 )));
+  ASSERT_TRUE( sameBits( rows.mColumns[ 1 ], reader.readColumn( 1 )));
+  std::remove( path.c_str() );
+}
+
+//
+// Ranges decode only the blocks they cover, and come back the same as
+// cutting up the whole column
+//
+TEST( TRACE, reads_ranges_and_blocks )
+{
+  const std::string path = tracePath( "ranges" );
+  Rows rows;
+  rows.mColumns.resize( 4 );
+  for ( std::int64_t row = 0; row < 1000; ++row ) {
+    rows.mTimes.push_back( row * 20000 );
+    for ( std::size_t column = 0; column < 4; ++column ) {
+      rows.mColumns[ column ].push_back( sin( row * 0.01 * ( column + 1 )));
+    }
+  }
+  writeRows( path, rows, exactColumns, 100 );
+
+  TraceReader reader( path );
+  ASSERT_TRUE( reader.isOpen() );
+  ASSERT_EQ( 2u, reader.findColumn( "steps" ));
+  ASSERT_EQ( 4u, reader.findColumn( "missing" ));
+  ASSERT_EQ( 10u, reader.getBlocks() );
+  for ( std::size_t first : { 0, 1, 99, 100, 250, 999 } ) {
+    for ( std::size_t count : { 0, 1, 100, 333, 5000 } ) {
+      const std::vector<double>& column = rows.mColumns[ 1 ];
+      const std::size_t end = std::min( first + count, column.size() );
+      ASSERT_EQ( std::vector<double>( column.begin() + first, column.begin() + end ), reader.readColumn( 1, first, count ));
+    }
+  }
+  ASSERT_TRUE( reader.readColumn( 0, 1000 ).empty() );
+
+  ASSERT_EQ( 300u, reader.getBlockStart( 3 ));
+  ASSERT_EQ( 100u, reader.getBlockRows( 3 ));
+  ASSERT_EQ( 300 * 20000, reader.getBlockFirstTime( 3 ));
+  ASSERT_EQ( 399 * 20000, reader.getBlockLastTime( 3 ));
+  ASSERT_EQ( 0u, reader.findBlock( -1 ));
+  ASSERT_EQ( 3u, reader.findBlock( 399 * 20000 ));
+  ASSERT_EQ( 4u, reader.findBlock( 399 * 20000 + 1 ));
+  ASSERT_EQ( 10u, reader.findBlock( 1000 * 20000 ));
+  std::vector<double> block;
+  reader.readBlock( 3, 3, block );
+  ASSERT_EQ( std::vector<double>( rows.mColumns[ 3 ].begin() + 300, rows.mColumns[ 3 ].begin() + 400 ), block );
+  std::remove( path.c_str() );
+}
+
+//
+// Missing, truncated, unfinished or foreign files don't open
+//
+TEST( TRACE, bad_files_dont_open )
+{
+  const std::string path = tracePath( "bad" );
+  ASSERT_FALSE( TraceReader( path ).isOpen() );
+  writeRows( path, awkwardRows( 1000 ), exactColumns, 128 );
+  std::ifstream in( path, std::ios::binary );
+  const std::string bytes(( std::istreambuf_iterator<char>( in )), std::istreambuf_iterator<char>() );
+  in.close();
+
+  for ( std::size_t length : { std::size_t{ 0 }, std::size_t{ 20 }, bytes.size() / 2, bytes.size() - 1 } ) {
+    std::ofstream( path, std::ios::binary | std::ios::trunc ).write( bytes.data(), static_cast<std::streamsize>( length ));
+    ASSERT_FALSE( TraceReader( path ).isOpen() );
+  }
+  std::string foreign = bytes;
+  foreign[ 0 ] ^= 1;
+  std::ofstream( path, std::ios::binary | std::ios::trunc ).write( foreign.data(), static_cast<std::streamsize>( foreign.size() ));
+  ASSERT_FALSE( TraceReader( path ).isOpen() );
+
+  // A footer pointing a chunk past the blocks
+  std::string corrupt = bytes;
+  std::uint64_t footer;
+  std::memcpy( &footer, corrupt.data() + corrupt.size() - 16, 8 );
+  const std::uint64_t badOffset = corrupt.size();
+  std::memcpy( &corrupt[ footer + 32 ], &badOffset, 8 );
+  std::ofstream( path, std::ios::binary | std::ios::trunc ).write( corrupt.data(), static_cast<std::streamsize>( corrupt.size() ));
+  ASSERT_FALSE( TraceReader( path ).isOpen() );
+
+  // A writer that hasn't closed yet
+  {
+    TraceWriter writer( path, exactColumns, 10 );
+    const double row[] = { 1.0, 2.0, 3.0, 4.0 };
+    for ( std::int64_t time = 0; time < 100; ++time ) {
+      writer.append( time, row );
+    }
+    ASSERT_FALSE( TraceReader( path ).isOpen() );
+  }
+  ASSERT_TRUE( TraceReader( path ).isOpen() );
+  std::remove( path.c_str() );
+}
+
+//
+// An hour of a 1 kHz arm, every column, fits in a few MB.  Sensor noise
+// can't be compressed away, so a noisy sensor costs about what its noise
+// is worth at angleResolution.
+//
+TEST( TRACE, hour_at_1khz_is_a_few_mb )
+{
+  const std::string path = tracePath( "hour" );
+  {
+    Telemetry telemetry( path );
+    ASSERT_TRUE( telemetry.isOpen() );
+    runArm( telemetry, 3600.0, 0.0 );
+    ASSERT_EQ( 3600000u, telemetry.getRows() );
+    ASSERT_TRUE( telemetry.close() );
+  }
+  const long size = fileSize( path );
+  ASSERT_LT( size, 6500000 );
+
+  // The readers get back what was recorded, to angleResolution
+  TraceReader reader( path );
+  ASSERT_TRUE( reader.isOpen() );
+  ASSERT_EQ( Telemetry::columns().size(), reader.getColumns().size() );
+  const std::vector<std::int64_t> times = reader.readTimes();
+  ASSERT_EQ( 0, times.front() );
+  ASSERT_EQ( 3599999000, times.back() );
+  const std::vector<double> target = reader.readColumn( reader.findColumn( "target_angle" ));
+  ASSERT_EQ( PidSim::Utils::degToRad( 60.0 ), target[ 9999 ] );
+  ASSERT_EQ( PidSim::Utils::degToRad( -30.0 ), target[ 10000 ] );
+  const std::vector<double> actual = reader.readColumn( reader.findColumn( "actual_angle" ), 19000, 1000 );
+  ASSERT_NEAR( PidSim::Utils::degToRad( -30.0 ), actual.back(), 0.02 );
+  std::remove( path.c_str() );
+}